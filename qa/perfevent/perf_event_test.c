@@ -683,6 +683,51 @@ void test_derived_events_scale(void)
     wrap_sysconf_override = 0;
 }
 
+void test_event_groups(void)
+{
+    wrap_sysconf_override = 1;
+    wrap_sysconf_retcode = 1;
+
+    printf( " ===== %s ==== \n", __FUNCTION__) ;
+
+    const char *eventlist = "config/test_event_groups.txt";
+
+    perfhandle_t *h = perf_event_create(eventlist);
+    perfdata_t *pdata = (perfdata_t *)h;
+
+    assert( h != NULL );
+
+    /* the mismatch group is not setup, and the grouped event is not repeated */
+    assert(pdata->ngroups == 1);
+    assert(pdata->groups[0].first == 0);
+    assert(pdata->groups[0].nevents == 3);
+    assert(pdata->nevents == 5);
+    assert(pdata->events[0].group == 0);
+    assert(pdata->events[2].group == 0);
+    assert(pdata->events[3].group == -1);
+
+    perf_counter *data = NULL;
+    int size = 0;
+    perf_derived_counter *pddata = NULL;
+    int derivedsize = 0;
+    perf_read_stats stats;
+
+    int count = perf_get(h, &data, &size, &pddata, &derivedsize);
+
+    assert(count == 5);
+    assert(size == 5);
+    assert(derivedsize == 1);
+
+    /* one read for the group and one each for the other events */
+    perf_get_stats(h, &stats);
+    printf("reads : %u\n", stats.reads);
+    assert(stats.reads == 3);
+
+    perf_event_destroy(h);
+    perf_counter_destroy(data, size, pddata, derivedsize);
+    wrap_sysconf_override = 0;
+}
+
 static int
 compar(const void *a, const void *b)
 {
@@ -1141,6 +1186,9 @@ int runtest(int n)
 	case 31:
 	    test_cpu_smt();
 	    break;
+	case 32:
+	    test_event_groups();
+	    break;
         default:
             ret = -1;
     }
@@ -0,0 +1,324 @@
+/*
+ * Benchmark for archive writing, optionally with compressed data volumes.
+ *
+ * Writes samples of a set of counter metrics with instances the way
+ * pmlogger does (__pmLogPutResult2, and a temporal index update about
+ * every 100Kbytes of data, with the same seek back to the start of the
+ * last record), then reports the write rate and the bytes written per
+ * sample.  With -z the data volume is compressed as it is written
+ * (see __pmLogSetCompress), then every record is read back to check
+ * it, e.g.
+ *
+ *	archwrite_bench -n 10000 /tmp/plain
+ *	archwrite_bench -n 10000 -z xz /tmp/packed
+ *
+ * With -l the archive is also read (pmFetchArchive) after each temporal
+ * index update, as a client following a live archive would.
+ *
+ * Copyright (c) 2026 Red Hat.
+ */
+
+#include <pcp/pmapi.h>
+#include "libpcp.h"
+#include <sys/stat.h>
+
+#define FLUSHSIZE	100000	/* as in pmlogger */
+
+static double
+elapsed(struct timeval *start)
+{
+    struct timeval	now;
+
+    pmtimevalNow(&now);
+    return pmtimevalSub(&now, start);
+}
+
+static void
+put_index(__pmArchCtl *acp, pmTimeval *stamp, off_t last_log_offset)
+{
+    __pmLogCtl	*lcp = acp->ac_log;
+    off_t	new_offset = __pmFtell(acp->ac_mfp);
+    off_t	new_meta_offset = __pmFtell(lcp->l_mdfp);
+
+    __pmFseek(acp->ac_mfp, last_log_offset, SEEK_SET);
+    __pmLogPutIndex(acp, stamp);
+    __pmFseek(acp->ac_mfp, new_offset, SEEK_SET);
+    __pmFseek(lcp->l_mdfp, new_meta_offset, SEEK_SET);
+}
+
+static int	live_ctx = -1;
+static int	live_count;
+
+/* read any records added since the last call */
+static void
+live_read(const char *archive)
+{
+    pmResult		*rp;
+
+    if (live_ctx < 0) {
+	if ((live_ctx = pmNewContext(PM_CONTEXT_ARCHIVE, archive)) < 0) {
+	    fprintf(stderr, "pmNewContext(%s): %s\n", archive, pmErrStr(live_ctx));
+	    exit(1);
+	}
+    }
+    else
+	pmUseContext(live_ctx);
+    while (pmFetchArchive(&rp) >= 0) {
+	live_count++;
+	pmFreeResult(rp);
+    }
+}
+
+static int
+check(const char *archive, int samples)
+{
+    pmResult		*rp;
+    int			ctx, sts, count = 0;
+
+    if ((ctx = pmNewContext(PM_CONTEXT_ARCHIVE, archive)) < 0) {
+	fprintf(stderr, "pmNewContext(%s): %s\n", archive, pmErrStr(ctx));
+	return ctx;
+    }
+    while ((sts = pmFetchArchive(&rp)) >= 0) {
+	count++;
+	pmFreeResult(rp);
+    }
+    pmDestroyContext(ctx);
+    if (count != samples) {
+	fprintf(stderr, "%s: read %d records, expected %d\n",
+		archive, count, samples);
+	return -1;
+    }
+    return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+    int			c;
+    int			sts;
+    int			errflag = 0;
+    int			samples = 1000;
+    int			live = 0;
+    int			nmetrics = 50;
+    int			ninst = 20;
+    char		*compress = NULL;
+    char		*archive;
+    char		*endnum;
+    char		fname[MAXPATHLEN];
+    char		name[32];
+    char		*namelist[1];
+    int			*instlist;
+    char		**instnames;
+    __pmLogCtl		logctl;
+    __pmArchCtl		archctl;
+    pmResult		*rp;
+    pmDesc		desc;
+    pmTimeval		stamp;
+    __pmPDU		*pb;
+    struct stat		sbuf;
+    struct timeval	start;
+    off_t		last_log_offset, flushsize = FLUSHSIZE;
+    long		usize;
+    double		t;
+    int			i, j;
+
+    pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "D:i:lm:n:z:?")) != EOF) {
+	switch (c) {
+
+	case 'D':	/* debug options */
+	    sts = pmSetDebug(optarg);
+	    if (sts < 0) {
+		fprintf(stderr, "%s: unrecognized debug options specification (%s)\n",
+		    pmGetProgname(), optarg);
+		errflag++;
+	    }
+	    break;
+
+	case 'i':	/* instances per metric */
+	    ninst = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || ninst < 1) {
+		fprintf(stderr, "%s: -i requires numeric argument\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case 'l':	/* read while writing */
+	    live = 1;
+	    break;
+
+	case 'm':	/* metrics per sample */
+	    nmetrics = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || nmetrics < 1) {
+		fprintf(stderr, "%s: -m requires numeric argument\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case 'n':	/* samples */
+	    samples = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || samples < 1) {
+		fprintf(stderr, "%s: -n requires numeric argument\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case 'z':	/* compressed data volume */
+	    compress = optarg;
+	    break;
+
+	case '?':
+	default:
+	    errflag++;
+	    break;
+	}
+    }
+
+    if (errflag || optind != argc - 1) {
+	fprintf(stderr,
+"Usage: %s [options] archive\n\
+\n\
+Options:\n\
+  -D debug	set debug options\n\
+  -i count	instances per metric [default 20]\n\
+  -l		read the archive while it is being written\n\
+  -m count	metrics in each sample [default 50]\n\
+  -n count	samples [default 1000]\n\
+  -z suffix	compress the data volume as it is written (xz)\n",
+		pmGetProgname());
+	exit(1);
+    }
+    archive = argv[optind];
+
+    if (compress != NULL && (sts = __pmLogSetCompress(compress)) < 0) {
+	fprintf(stderr, "__pmLogSetCompress(%s): %s\n", compress, pmErrStr(sts));
+	exit(1);
+    }
+
+    /* one pmResult, values updated in place for each sample */
+    rp = (pmResult *)malloc(sizeof(pmResult) + nmetrics * sizeof(pmValueSet *));
+    instlist = (int *)malloc(ninst * sizeof(int));
+    instnames = (char **)malloc(ninst * sizeof(char *));
+    if (rp == NULL || instlist == NULL || instnames == NULL) {
+	fprintf(stderr, "%s: out of memory\n", pmGetProgname());
+	exit(1);
+    }
+    rp->numpmid = nmetrics;
+    for (j = 0; j < ninst; j++) {
+	instlist[j] = j;
+	pmsprintf(name, sizeof(name), "inst%03d", j);
+	instnames[j] = strdup(name);
+    }
+    for (i = 0; i < nmetrics; i++) {
+	rp->vset[i] = (pmValueSet *)malloc(sizeof(pmValueSet) + ninst * sizeof(pmValue));
+	if (rp->vset[i] == NULL) {
+	    fprintf(stderr, "%s: out of memory\n", pmGetProgname());
+	    exit(1);
+	}
+	rp->vset[i]->pmid = pmID_build(245, 0, i);
+	rp->vset[i]->numval = ninst;
+	rp->vset[i]->valfmt = PM_VAL_INSITU;
+	for (j = 0; j < ninst; j++) {
+	    rp->vset[i]->vlist[j].inst = j;
+	    rp->vset[i]->vlist[j].value.lval = 0;
+	}
+    }
+
+    memset(&logctl, 0, sizeof(logctl));
+    memset(&archctl, 0, sizeof(archctl));
+    archctl.ac_log = &logctl;
+    if ((sts = __pmLogCreate("localhost", archive, PM_LOG_VERS02, &archctl)) < 0) {
+	fprintf(stderr, "__pmLogCreate(%s): %s\n", archive, pmErrStr(sts));
+	exit(1);
+    }
+
+    pmtimevalNow(&start);
+    stamp.tv_sec = 1000000000;
+    stamp.tv_usec = 0;
+    logctl.l_label.ill_start = stamp;
+    logctl.l_label.ill_vol = PM_LOG_VOL_TI;
+    __pmLogWriteLabel(logctl.l_tifp, &logctl.l_label);
+    logctl.l_label.ill_vol = PM_LOG_VOL_META;
+    __pmLogWriteLabel(logctl.l_mdfp, &logctl.l_label);
+    logctl.l_label.ill_vol = 0;
+    __pmLogWriteLabel(archctl.ac_mfp, &logctl.l_label);
+    logctl.l_state = PM_LOG_STATE_INIT;
+
+    desc.type = PM_TYPE_U32;
+    desc.indom = pmInDom_build(245, 0);
+    desc.sem = PM_SEM_COUNTER;
+    memset(&desc.units, 0, sizeof(desc.units));
+    desc.units.dimCount = 1;
+    for (i = 0; i < nmetrics; i++) {
+	desc.pmid = rp->vset[i]->pmid;
+	pmsprintf(name, sizeof(name), "bench.write.m%03d", i);
+	namelist[0] = name;
+	if ((sts = __pmLogPutDesc(&archctl, &desc, 1, namelist)) < 0) {
+	    fprintf(stderr, "__pmLogPutDesc: %s\n", pmErrStr(sts));
+	    exit(1);
+	}
+    }
+    if ((sts = __pmLogPutInDom(&archctl, desc.indom, &stamp, ninst, instlist, instnames)) < 0) {
+	fprintf(stderr, "__pmLogPutInDom: %s\n", pmErrStr(sts));
+	exit(1);
+    }
+
+    for (i = 0; i < samples; i++) {
+	rp->timestamp.tv_sec = stamp.tv_sec = 1000000000 + i;
+	rp->timestamp.tv_usec = stamp.tv_usec = 0;
+	/* counters, with a mix of rates, some idle */
+	for (j = 0; j < nmetrics * ninst; j++) {
+	    if (j % 3 != 0)
+		rp->vset[j / ninst]->vlist[j % ninst].value.lval += lrand48() % (1 << (j % 17));
+	}
+	if ((sts = __pmEncodeResult(__pmFileno(archctl.ac_mfp), rp, &pb)) < 0) {
+	    fprintf(stderr, "__pmEncodeResult: %s\n", pmErrStr(sts));
+	    exit(1);
+	}
+	last_log_offset = __pmFtell(archctl.ac_mfp);
+	if ((sts = __pmLogPutResult2(&archctl, pb)) < 0) {
+	    fprintf(stderr, "__pmLogPutResult2: %s\n", pmErrStr(sts));
+	    exit(1);
+	}
+	__pmUnpinPDUBuf(pb);
+	if (i == 0 || __pmFtell(archctl.ac_mfp) > flushsize) {
+	    put_index(&archctl, &stamp, last_log_offset);
+	    flushsize = __pmFtell(archctl.ac_mfp) + FLUSHSIZE;
+	    if (live)
+		live_read(archive);
+	}
+    }
+    usize = __pmFtell(archctl.ac_mfp);
+    __pmLogPutIndex(&archctl, &stamp);
+    __pmLogClose(&archctl);
+    t = elapsed(&start);
+
+    pmsprintf(fname, sizeof(fname), "%s.0%s%s", archive,
+		compress ? "." : "", compress ? compress : "");
+    if (stat(fname, &sbuf) < 0) {
+	fprintf(stderr, "%s: stat(%s): %s\n", pmGetProgname(), fname, strerror(errno));
+	exit(1);
+    }
+    printf("%d samples of %d values in %.3f sec (%.0f samples/sec, %.1f Mbyte/sec)\n",
+	    samples, nmetrics * ninst, t, samples / t, usize / t / (1024 * 1024));
+    printf("%s: %ld bytes (%.1f bytes/sample), data %ld bytes (%.1f bytes/sample)\n",
+	    fname, (long)sbuf.st_size, (double)sbuf.st_size / samples,
+	    usize, (double)usize / samples);
+
+    if (live) {
+	int	count = live_count;
+
+	live_read(archive);
+	pmDestroyContext(live_ctx);
+	printf("read %d records while writing, %d after\n", count, live_count - count);
+	if (live_count != samples) {
+	    fprintf(stderr, "%s: read %d records live, expected %d\n",
+		    archive, live_count, samples);
+	    exit(1);
+	}
+    }
+
+    exit(check(archive, samples) < 0);
+}
@@ -0,0 +1,134 @@
+/*
+ * Exercise libpcp_import metric and instance lookups, including the
+ * "match to first space" rule for instance names, and pmiPutRow.
+ *
+ * Copyright (c) 2026 Red Hat.
+ */
+
+#include <pcp/pmapi.h>
+#include <pcp/import.h>
+
+static void
+check(int sts, char *name)
+{
+    if (sts < 0) {
+	printf("%s: Error: %s\n", name, pmiErrStr(sts));
+    } else {
+	printf("%s: OK", name);
+	if (sts != 0)
+	    printf(" -> %d", sts);
+	putchar('\n');
+    }
+    /* keep stdout in step with libpcp_import diagnostics on stderr */
+    fflush(stdout);
+}
+
+int
+main(int argc, char **argv)
+{
+    int		sts;
+    int		i;
+    int		bad;
+    int		handles[5];
+    const char	*values[5];
+    char	name[64];
+    char	msg[128];
+    pmInDom	indom = pmInDom_build(245, 1);
+    pmInDom	bigdom = pmInDom_build(245, 2);
+    static char	*inames[] = { "abc", "abc def", "1 one", "2 two", "10 ten" };
+    static char	*lookups[] = {
+	"abc", "abc def", "abc xyz", "abc ", "ab", "2", "2 anything",
+	"10 ten", "1", "1 one", "10", "zzz"
+    };
+
+    if (argc != 2) {
+	printf("Usage: %s archive\n", argv[0]);
+	exit(1);
+    }
+
+    check(pmiStart(argv[1], 0), "pmiStart");
+    check(pmiSetHostname("import.row.com"), "pmiSetHostname");
+    check(pmiSetTimezone("UTC"), "pmiSetTimezone");
+
+    check(pmiAddMetric("row.single", pmID_build(245,0,1), PM_TYPE_U32,
+		PM_INDOM_NULL, PM_SEM_INSTANT, pmiUnits(0,0,0,0,0,0)),
+		"pmiAddMetric row.single");
+    check(pmiAddMetric("row.multi", pmID_build(245,0,2), PM_TYPE_64,
+		indom, PM_SEM_INSTANT, pmiUnits(0,0,0,0,0,0)),
+		"pmiAddMetric row.multi");
+    check(pmiAddMetric("row.big", pmID_build(245,0,3), PM_TYPE_DOUBLE,
+		bigdom, PM_SEM_INSTANT, pmiUnits(0,0,0,0,0,0)),
+		"pmiAddMetric row.big");
+    check(pmiAddMetric("row.single", pmID_build(245,0,4), PM_TYPE_U32,
+		PM_INDOM_NULL, PM_SEM_INSTANT, pmiUnits(0,0,0,0,0,0)),
+		"pmiAddMetric duplicate name");
+    check(pmiAddMetric("row.other", pmID_build(245,0,2), PM_TYPE_U32,
+		PM_INDOM_NULL, PM_SEM_INSTANT, pmiUnits(0,0,0,0,0,0)),
+		"pmiAddMetric duplicate pmid");
+
+    for (i = 0; i < sizeof(inames) / sizeof(inames[0]); i++) {
+	pmsprintf(msg, sizeof(msg), "pmiAddInstance \"%s\"", inames[i]);
+	check(pmiAddInstance(indom, inames[i], i), msg);
+    }
+    check(pmiAddInstance(indom, "abc other", 10), "pmiAddInstance \"abc other\"");
+    check(pmiAddInstance(indom, "2 deux", 10), "pmiAddInstance \"2 deux\"");
+    check(pmiAddInstance(indom, "3 three", 2), "pmiAddInstance \"3 three\" id 2");
+
+    for (i = 0; i < sizeof(lookups) / sizeof(lookups[0]); i++) {
+	pmsprintf(msg, sizeof(msg), "pmiGetHandle \"%s\"", lookups[i]);
+	sts = pmiGetHandle("row.multi", lookups[i]);
+	check(sts, msg);
+    }
+    check(pmiGetHandle("row.multi", NULL), "pmiGetHandle row.multi NULL");
+    check(pmiGetHandle("row.single", "abc"), "pmiGetHandle row.single abc");
+    check(pmiGetHandle("row.nosuch", NULL), "pmiGetHandle row.nosuch");
+
+    /* enough instances to make the hash tables grow */
+    for (i = 0; i < 2000; i++) {
+	pmsprintf(name, sizeof(name), "%d cpu%d", i, i);
+	if ((sts = pmiAddInstance(bigdom, name, i)) < 0) {
+	    check(sts, "pmiAddInstance bigdom");
+	    break;
+	}
+    }
+    bad = 0;
+    for (i = 0; i < 2000; i++) {
+	pmsprintf(name, sizeof(name), "%d whatever", i);
+	if ((sts = pmiGetHandle("row.big", name)) < 0) {
+	    check(sts, "pmiGetHandle row.big");
+	    bad++;
+	}
+    }
+    printf("row.big: %d handles, %d bad\n", i, bad);
+
+    handles[0] = pmiGetHandle("row.single", NULL);
+    handles[1] = pmiGetHandle("row.multi", "abc");
+    handles[2] = pmiGetHandle("row.multi", "2 two");
+    handles[3] = pmiGetHandle("row.multi", "10 ten");
+    handles[4] = pmiGetHandle("row.big", "1999 cpu1999");
+
+    values[0] = "42"; values[1] = "-1"; values[2] = "99"; values[3] = NULL; values[4] = "1.5";
+    check(pmiPutRow(1000000000, 0, 5, handles, values), "pmiPutRow");
+    values[3] = "7";
+    check(pmiPutRow(1000000001, 0, 5, handles, values), "pmiPutRow");
+    values[2] = "not-a-number";
+    check(pmiPutRow(1000000002, 0, 5, handles, values), "pmiPutRow bad value");
+    values[2] = "100";
+    handles[4] = 99999;
+    check(pmiPutRow(1000000002, 0, 5, handles, values), "pmiPutRow bad handle");
+    handles[4] = handles[0];
+    check(pmiPutRow(1000000002, 0, 5, handles, values), "pmiPutRow duplicate value");
+    check(pmiPutRow(1000000002, 0, 4, handles, values), "pmiPutRow");
+    check(pmiPutRow(1000000001, 0, 4, handles, values), "pmiPutRow old timestamp");
+    /* row after values already put individually */
+    check(pmiPutValue("row.multi", "10 ten", "10"), "pmiPutValue");
+    check(pmiPutRow(1000000003, 0, 1, handles, values), "pmiPutRow");
+    /* failed row after values already put individually */
+    check(pmiPutValue("row.multi", "1 one", "11"), "pmiPutValue");
+    values[2] = "not-a-number";
+    check(pmiPutRow(1000000004, 0, 4, handles, values), "pmiPutRow bad value");
+    check(pmiWrite(1000000004, 0), "pmiWrite");
+    check(pmiEnd(), "pmiEnd");
+
+    exit(0);
+}
@@ -0,0 +1,305 @@
+/*
+ * Benchmark for derived metric evaluation.
+ *
+ * Creates an archive with a few metrics over -i instances and -n samples
+ * (using libpcp_import), registers -m copies of a set of derived metrics
+ * using arithmetic, relational and boolean operators, unary operators,
+ * units scaling and the instance aggregation functions, then fetches
+ * all of the derived metrics for every sample in the archive -r times
+ * and reports the fetch rate, e.g.
+ *
+ *	derive_bench -i 1000 -m 10 -n 100 /tmp/derive
+ *
+ * With -c the values are reported instead, so the results can be
+ * compared with those from the expression tree walker, which is used
+ * when the derive debug option is set, e.g.
+ *
+ *	derive_bench -c /tmp/a >a.out
+ *	derive_bench -c -D derive /tmp/b 2>/dev/null >b.out
+ *
+ * Copyright (c) 2026 Red Hat.
+ */
+
+#include <pcp/pmapi.h>
+#include <pcp/import.h>
+
+static char *exprs[] = {
+    "bench.derive.a + bench.derive.b",
+    "bench.derive.b - 3 * bench.derive.a",
+    "bench.derive.c / bench.derive.b",
+    "bench.derive.a > bench.derive.c && bench.derive.d != 0",
+    "bench.derive.a * bench.derive.d",
+    "-bench.derive.c",
+    "!bench.derive.a",
+    "sum(bench.derive.a)",
+    "max(bench.derive.c)",
+    "avg(bench.derive.b)",
+    "count(bench.derive.c)",
+    "delta(bench.derive.b)",	/* not compiled */
+};
+#define NEXPR (sizeof(exprs) / sizeof(exprs[0]))
+
+static double
+elapsed(struct timeval *start)
+{
+    struct timeval	now;
+
+    pmtimevalNow(&now);
+    return pmtimevalSub(&now, start);
+}
+
+static void
+fail(const char *what, int sts)
+{
+    fprintf(stderr, "%s: %s: %s\n", pmGetProgname(), what, pmiErrStr(sts));
+    exit(1);
+}
+
+static void
+mkarchive(const char *archive, int ninst, int samples)
+{
+    pmInDom	indom = pmInDom_build(245, 0);
+    char	name[64];
+    char	value[32];
+    int		sts;
+    int		j;
+    int		n;
+
+    if ((sts = pmiStart(archive, 0)) < 0)
+	fail("pmiStart", sts);
+    if ((sts = pmiAddMetric("bench.derive.a", PM_ID_NULL, PM_TYPE_U32, indom,
+		PM_SEM_INSTANT, pmiUnits(1,0,0,PM_SPACE_KBYTE,0,0))) < 0 ||
+	(sts = pmiAddMetric("bench.derive.b", PM_ID_NULL, PM_TYPE_U64, indom,
+		PM_SEM_INSTANT, pmiUnits(1,0,0,PM_SPACE_BYTE,0,0))) < 0 ||
+	(sts = pmiAddMetric("bench.derive.c", PM_ID_NULL, PM_TYPE_DOUBLE, indom,
+		PM_SEM_INSTANT, pmiUnits(1,0,0,PM_SPACE_BYTE,0,0))) < 0 ||
+	(sts = pmiAddMetric("bench.derive.d", PM_ID_NULL, PM_TYPE_U32, PM_INDOM_NULL,
+		PM_SEM_INSTANT, pmiUnits(0,0,0,0,0,0))) < 0)
+	fail("pmiAddMetric", sts);
+    for (j = 0; j < ninst; j++) {
+	pmsprintf(name, sizeof(name), "inst%d", j);
+	if ((sts = pmiAddInstance(indom, name, j)) < 0)
+	    fail("pmiAddInstance", sts);
+    }
+    for (n = 0; n < samples; n++) {
+	for (j = 0; j < ninst; j++) {
+	    pmsprintf(name, sizeof(name), "inst%d", j);
+	    pmsprintf(value, sizeof(value), "%d", (n * 7 + j) % 1000);
+	    if ((sts = pmiPutValue("bench.derive.a", name, value)) < 0)
+		fail("pmiPutValue a", sts);
+	    pmsprintf(value, sizeof(value), "%d", n * j * 13 + 5);
+	    if ((sts = pmiPutValue("bench.derive.b", name, value)) < 0)
+		fail("pmiPutValue b", sts);
+	    /* some instances missing, so they have to be paired up */
+	    if (j % 7 == 3)
+		continue;
+	    pmsprintf(value, sizeof(value), "%.1f", (n + 1) * (j + 2) * 0.5);
+	    if ((sts = pmiPutValue("bench.derive.c", name, value)) < 0)
+		fail("pmiPutValue c", sts);
+	}
+	pmsprintf(value, sizeof(value), "%d", n % 5);
+	if ((sts = pmiPutValue("bench.derive.d", NULL, value)) < 0)
+	    fail("pmiPutValue d", sts);
+	if ((sts = pmiWrite(1000000000 + n, 0)) < 0)
+	    fail("pmiWrite", sts);
+    }
+    if ((sts = pmiEnd()) < 0)
+	fail("pmiEnd", sts);
+}
+
+static void
+report(pmResult *rp, pmDesc *desc, char **names)
+{
+    pmAtomValue	av;
+    pmValueSet	*vsp;
+    int		i;
+    int		j;
+    int		sts;
+
+    for (i = 0; i < rp->numpmid; i++) {
+	vsp = rp->vset[i];
+	printf("%s:", names[i]);
+	if (vsp->numval < 0)
+	    printf(" %s", pmErrStr(vsp->numval));
+	for (j = 0; j < vsp->numval; j++) {
+	    sts = pmExtractValue(vsp->valfmt, &vsp->vlist[j], desc[i].type,
+				&av, PM_TYPE_DOUBLE);
+	    if (sts < 0)
+		printf(" [%d] %s", vsp->vlist[j].inst, pmErrStr(sts));
+	    else
+		printf(" [%d] %.6g", vsp->vlist[j].inst, av.d);
+	}
+	putchar('\n');
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    int			c;
+    int			sts;
+    int			errflag = 0;
+    int			cflag = 0;
+    int			ninst = 100;
+    int			ncopy = 1;
+    int			samples = 10;
+    int			passes = 1;
+    int			nmetric;
+    int			nfetch = 0;
+    int			nvalues = 0;
+    char		*archive;
+    char		*endnum;
+    char		**names;
+    pmID		*pmids;
+    pmDesc		*desc;
+    pmResult		*rp;
+    pmLogLabel		label;
+    struct timeval	start;
+    double		t;
+    char		name[64];
+    int			i, k, p;
+
+    pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "cD:i:m:n:r:?")) != EOF) {
+	switch (c) {
+
+	case 'c':	/* report values */
+	    cflag++;
+	    break;
+
+	case 'D':	/* debug options */
+	    sts = pmSetDebug(optarg);
+	    if (sts < 0) {
+		fprintf(stderr, "%s: unrecognized debug options specification (%s)\n",
+		    pmGetProgname(), optarg);
+		errflag++;
+	    }
+	    break;
+
+	case 'i':	/* instances */
+	    ninst = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || ninst < 1) {
+		fprintf(stderr, "%s: -i requires numeric argument\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case 'm':	/* copies of each derived metric */
+	    ncopy = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || ncopy < 1) {
+		fprintf(stderr, "%s: -m requires numeric argument\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case 'n':	/* samples */
+	    samples = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || samples < 1) {
+		fprintf(stderr, "%s: -n requires numeric argument\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case 'r':	/* passes over the archive */
+	    passes = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || passes < 1) {
+		fprintf(stderr, "%s: -r requires numeric argument\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case '?':
+	default:
+	    errflag++;
+	    break;
+	}
+    }
+
+    if (errflag || optind != argc - 1) {
+	fprintf(stderr,
+"Usage: %s [options] archive\n\
+\n\
+Options:\n\
+  -c		report values, not the fetch rate\n\
+  -D debug	set debug options\n\
+  -i count	instances [default 100]\n\
+  -m count	copies of each derived metric [default 1]\n\
+  -n count	samples [default 10]\n\
+  -r count	passes over the archive [default 1]\n",
+		pmGetProgname());
+	exit(1);
+    }
+    archive = argv[optind];
+
+    mkarchive(archive, ninst, samples);
+
+    nmetric = ncopy * NEXPR;
+    names = (char **)malloc(nmetric * sizeof(char *));
+    pmids = (pmID *)malloc(nmetric * sizeof(pmID));
+    desc = (pmDesc *)malloc(nmetric * sizeof(pmDesc));
+    if (names == NULL || pmids == NULL || desc == NULL) {
+	fprintf(stderr, "%s: out of memory\n", pmGetProgname());
+	exit(1);
+    }
+    for (i = 0; i < nmetric; i++) {
+	pmsprintf(name, sizeof(name), "bench.derived.e%02d.c%03d",
+		(int)(i % NEXPR), (int)(i / NEXPR));
+	names[i] = strdup(name);
+	if (pmRegisterDerived(names[i], exprs[i % NEXPR]) != NULL) {
+	    fprintf(stderr, "%s: %s: %s\n", pmGetProgname(), names[i], pmDerivedErrStr());
+	    exit(1);
+	}
+    }
+
+    if ((sts = pmNewContext(PM_CONTEXT_ARCHIVE, archive)) < 0) {
+	fprintf(stderr, "pmNewContext(%s): %s\n", archive, pmErrStr(sts));
+	exit(1);
+    }
+    if ((sts = pmGetArchiveLabel(&label)) < 0) {
+	fprintf(stderr, "pmGetArchiveLabel: %s\n", pmErrStr(sts));
+	exit(1);
+    }
+    if ((sts = pmLookupName(nmetric, names, pmids)) < 0) {
+	fprintf(stderr, "pmLookupName: %s\n", pmErrStr(sts));
+	exit(1);
+    }
+    for (i = 0; i < nmetric; i++) {
+	if ((sts = pmLookupDesc(pmids[i], &desc[i])) < 0) {
+	    fprintf(stderr, "pmLookupDesc(%s): %s\n", names[i], pmErrStr(sts));
+	    exit(1);
+	}
+    }
+
+    pmtimevalNow(&start);
+    for (p = 0; p < passes; p++) {
+	if ((sts = pmSetMode(PM_MODE_FORW, &label.ll_start, 0)) < 0) {
+	    fprintf(stderr, "pmSetMode: %s\n", pmErrStr(sts));
+	    exit(1);
+	}
+	while ((sts = pmFetch(nmetric, pmids, &rp)) >= 0) {
+	    nfetch++;
+	    for (k = 0; k < rp->numpmid; k++) {
+		if (rp->vset[k]->numval > 0)
+		    nvalues += rp->vset[k]->numval;
+	    }
+	    if (cflag)
+		report(rp, desc, names);
+	    pmFreeResult(rp);
+	}
+	if (sts != PM_ERR_EOL) {
+	    fprintf(stderr, "pmFetch: %s\n", pmErrStr(sts));
+	    exit(1);
+	}
+    }
+    t = elapsed(&start);
+
+    if (!cflag) {
+	printf("%d derived metrics, %d instances: %d fetches in %.3f sec\n",
+		nmetric, ninst, nfetch, t);
+	printf("%.0f fetches/sec, %.0f derived values/sec\n",
+		nfetch / t, nvalues / t);
+    }
+
+    exit(0);
+}
@@ -0,0 +1,335 @@
+/*
+ * Benchmark for pmlogextract merging many archives.
+ *
+ * Writes a set of synthetic archives, each with its own metrics (with
+ * instances) and sampling offset, so their records interleave, then
+ * times pmlogextract merging them all into one archive, and reads the
+ * merged archive back to check that every record is there and in time
+ * order, e.g.
+ *
+ *	extract_bench -k 64 -n 1000 /tmp/merge
+ *	extract_bench -k 8 -n 10000 -x /tmp/old/pmlogextract /tmp/merge
+ *
+ * Copyright (c) 2026 Red Hat.
+ */
+
+#include <pcp/pmapi.h>
+#include "libpcp.h"
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define FLUSHSIZE	100000	/* as in pmlogger */
+
+static double
+elapsed(struct timeval *start)
+{
+    struct timeval	now;
+
+    pmtimevalNow(&now);
+    return pmtimevalSub(&now, start);
+}
+
+/* remove any archive of this name from an earlier run */
+static void
+cleanup(const char *archive)
+{
+    static char	*suffix[] = { "0", "meta", "index" };
+    char	path[MAXPATHLEN];
+    int		i;
+
+    for (i = 0; i < 3; i++) {
+	pmsprintf(path, sizeof(path), "%s.%s", archive, suffix[i]);
+	unlink(path);
+    }
+}
+
+/*
+ * archive a of k, with samples one second apart, offset by a/k sec
+ */
+static int
+mkarchive(const char *archive, int a, int k, int samples, int nmetrics, int ninst)
+{
+    int			sts;
+    int			i, j;
+    int			*instlist;
+    char		**instnames;
+    char		name[32];
+    char		*namelist[1];
+    __pmLogCtl		logctl;
+    __pmArchCtl		archctl;
+    pmResult		*rp;
+    pmDesc		desc;
+    pmTimeval		stamp;
+    __pmPDU		*pb;
+    off_t		last_log_offset, new_offset, new_meta_offset;
+    off_t		flushsize = FLUSHSIZE;
+    int			usec = (int)((long)a * 1000000 / k);
+
+    rp = (pmResult *)malloc(sizeof(pmResult) + nmetrics * sizeof(pmValueSet *));
+    instlist = (int *)malloc(ninst * sizeof(int));
+    instnames = (char **)malloc(ninst * sizeof(char *));
+    if (rp == NULL || instlist == NULL || instnames == NULL)
+	return -ENOMEM;
+    rp->numpmid = nmetrics;
+    for (j = 0; j < ninst; j++) {
+	instlist[j] = j;
+	pmsprintf(name, sizeof(name), "inst%03d", j);
+	instnames[j] = strdup(name);
+    }
+    for (i = 0; i < nmetrics; i++) {
+	rp->vset[i] = (pmValueSet *)malloc(sizeof(pmValueSet) + ninst * sizeof(pmValue));
+	if (rp->vset[i] == NULL)
+	    return -ENOMEM;
+	rp->vset[i]->pmid = pmID_build(245, a, i);
+	rp->vset[i]->numval = ninst;
+	rp->vset[i]->valfmt = PM_VAL_INSITU;
+	for (j = 0; j < ninst; j++) {
+	    rp->vset[i]->vlist[j].inst = j;
+	    rp->vset[i]->vlist[j].value.lval = 0;
+	}
+    }
+
+    memset(&logctl, 0, sizeof(logctl));
+    memset(&archctl, 0, sizeof(archctl));
+    archctl.ac_log = &logctl;
+    if ((sts = __pmLogCreate("localhost", archive, PM_LOG_VERS02, &archctl)) < 0)
+	return sts;
+
+    stamp.tv_sec = 1000000000;
+    stamp.tv_usec = usec;
+    logctl.l_label.ill_start = stamp;
+    logctl.l_label.ill_vol = PM_LOG_VOL_TI;
+    __pmLogWriteLabel(logctl.l_tifp, &logctl.l_label);
+    logctl.l_label.ill_vol = PM_LOG_VOL_META;
+    __pmLogWriteLabel(logctl.l_mdfp, &logctl.l_label);
+    logctl.l_label.ill_vol = 0;
+    __pmLogWriteLabel(archctl.ac_mfp, &logctl.l_label);
+    logctl.l_state = PM_LOG_STATE_INIT;
+
+    desc.type = PM_TYPE_U32;
+    desc.indom = pmInDom_build(245, a);
+    desc.sem = PM_SEM_COUNTER;
+    memset(&desc.units, 0, sizeof(desc.units));
+    desc.units.dimCount = 1;
+    for (i = 0; i < nmetrics; i++) {
+	desc.pmid = rp->vset[i]->pmid;
+	pmsprintf(name, sizeof(name), "bench.extract.a%03d.m%03d", a, i);
+	namelist[0] = name;
+	if ((sts = __pmLogPutDesc(&archctl, &desc, 1, namelist)) < 0)
+	    return sts;
+    }
+    if ((sts = __pmLogPutInDom(&archctl, desc.indom, &stamp, ninst, instlist, instnames)) < 0)
+	return sts;
+
+    for (i = 0; i < samples; i++) {
+	rp->timestamp.tv_sec = stamp.tv_sec = 1000000000 + i;
+	rp->timestamp.tv_usec = stamp.tv_usec = usec;
+	for (j = 0; j < nmetrics * ninst; j++) {
+	    if ((j + a) % 3 != 0)
+		rp->vset[j / ninst]->vlist[j % ninst].value.lval += lrand48() % (1 << (j % 17));
+	}
+	if ((sts = __pmEncodeResult(__pmFileno(archctl.ac_mfp), rp, &pb)) < 0)
+	    return sts;
+	last_log_offset = __pmFtell(archctl.ac_mfp);
+	if ((sts = __pmLogPutResult2(&archctl, pb)) < 0)
+	    return sts;
+	__pmUnpinPDUBuf(pb);
+	if (i == 0 || __pmFtell(archctl.ac_mfp) > flushsize) {
+	    new_offset = __pmFtell(archctl.ac_mfp);
+	    new_meta_offset = __pmFtell(logctl.l_mdfp);
+	    __pmFseek(archctl.ac_mfp, last_log_offset, SEEK_SET);
+	    __pmLogPutIndex(&archctl, &stamp);
+	    __pmFseek(archctl.ac_mfp, new_offset, SEEK_SET);
+	    __pmFseek(logctl.l_mdfp, new_meta_offset, SEEK_SET);
+	    flushsize = new_offset + FLUSHSIZE;
+	}
+    }
+    __pmLogPutIndex(&archctl, &stamp);
+    __pmLogClose(&archctl);
+
+    for (i = 0; i < nmetrics; i++)
+	free(rp->vset[i]);
+    for (j = 0; j < ninst; j++)
+	free(instnames[j]);
+    free(rp);
+    free(instlist);
+    free(instnames);
+    return 0;
+}
+
+static int
+check(const char *archive, int records, int nvalues)
+{
+    pmResult		*rp;
+    struct timeval	last = { 0, 0 };
+    int			ctx, sts, i, count = 0, bad = 0;
+
+    if ((ctx = pmNewContext(PM_CONTEXT_ARCHIVE, archive)) < 0) {
+	fprintf(stderr, "pmNewContext(%s): %s\n", archive, pmErrStr(ctx));
+	return ctx;
+    }
+    while ((sts = pmFetchArchive(&rp)) >= 0) {
+	if (pmtimevalSub(&rp->timestamp, &last) < 0)
+	    bad++;
+	last = rp->timestamp;
+	if (rp->numpmid > 0) {
+	    count++;
+	    for (i = 0; i < rp->numpmid; i++) {
+		if (rp->vset[i]->numval != nvalues)
+		    bad++;
+	    }
+	}
+	pmFreeResult(rp);
+    }
+    pmDestroyContext(ctx);
+    if (count != records || bad) {
+	fprintf(stderr, "%s: read %d records (%d bad), expected %d\n",
+		archive, count, bad, records);
+	return -1;
+    }
+    return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+    int			c;
+    int			sts;
+    int			errflag = 0;
+    int			k = 16;
+    int			samples = 1000;
+    int			nmetrics = 20;
+    int			ninst = 10;
+    char		*extract = "pmlogextract";
+    char		*dir;
+    char		*endnum;
+    char		**args;
+    char		fname[MAXPATHLEN];
+    pid_t		pid;
+    struct stat		sbuf;
+    struct timeval	start;
+    double		t;
+    int			a;
+
+    pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "D:i:k:m:n:x:?")) != EOF) {
+	switch (c) {
+
+	case 'D':	/* debug options */
+	    sts = pmSetDebug(optarg);
+	    if (sts < 0) {
+		fprintf(stderr, "%s: unrecognized debug options specification (%s)\n",
+		    pmGetProgname(), optarg);
+		errflag++;
+	    }
+	    break;
+
+	case 'i':	/* instances per metric */
+	    ninst = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || ninst < 1) {
+		fprintf(stderr, "%s: -i requires numeric argument\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case 'k':	/* input archives */
+	    k = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || k < 1 || k > 4096) {
+		fprintf(stderr, "%s: -k requires numeric argument\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case 'm':	/* metrics per archive */
+	    nmetrics = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || nmetrics < 1) {
+		fprintf(stderr, "%s: -m requires numeric argument\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case 'n':	/* samples per archive */
+	    samples = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || samples < 1) {
+		fprintf(stderr, "%s: -n requires numeric argument\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case 'x':	/* pmlogextract to run */
+	    extract = optarg;
+	    break;
+
+	case '?':
+	default:
+	    errflag++;
+	    break;
+	}
+    }
+
+    if (errflag || optind != argc - 1) {
+	fprintf(stderr,
+"Usage: %s [options] directory\n\
+\n\
+Options:\n\
+  -D debug	set debug options\n\
+  -i count	instances per metric [default 10]\n\
+  -k count	input archives [default 16]\n\
+  -m count	metrics in each archive [default 20]\n\
+  -n count	samples in each archive [default 1000]\n\
+  -x path	pmlogextract to run [default pmlogextract]\n",
+		pmGetProgname());
+	exit(1);
+    }
+    dir = argv[optind];
+    if (mkdir(dir, 0755) < 0 && errno != EEXIST) {
+	fprintf(stderr, "%s: mkdir(%s): %s\n", pmGetProgname(), dir, strerror(errno));
+	exit(1);
+    }
+
+    if ((args = (char **)calloc(k + 3, sizeof(char *))) == NULL) {
+	fprintf(stderr, "%s: out of memory\n", pmGetProgname());
+	exit(1);
+    }
+    args[0] = extract;
+    pmtimevalNow(&start);
+    for (a = 0; a < k; a++) {
+	pmsprintf(fname, sizeof(fname), "%s/in%04d", dir, a);
+	cleanup(fname);
+	if ((sts = mkarchive(fname, a, k, samples, nmetrics, ninst)) < 0) {
+	    fprintf(stderr, "%s: %s: %s\n", pmGetProgname(), fname, pmErrStr(sts));
+	    exit(1);
+	}
+	args[a + 1] = strdup(fname);
+    }
+    printf("%d archives of %d samples of %d values written in %.3f sec\n",
+	    k, samples, nmetrics * ninst, elapsed(&start));
+
+    pmsprintf(fname, sizeof(fname), "%s/out", dir);
+    args[k + 1] = fname;
+    cleanup(fname);
+
+    pmtimevalNow(&start);
+    if ((pid = fork()) == 0) {
+	execvp(extract, args);
+	fprintf(stderr, "%s: exec %s: %s\n", pmGetProgname(), extract, strerror(errno));
+	_exit(127);
+    }
+    if (pid < 0 || waitpid(pid, &sts, 0) < 0 || !WIFEXITED(sts) || WEXITSTATUS(sts) != 0) {
+	fprintf(stderr, "%s: %s failed\n", pmGetProgname(), extract);
+	exit(1);
+    }
+    t = elapsed(&start);
+
+    pmsprintf(fname, sizeof(fname), "%s/out.0", dir);
+    if (stat(fname, &sbuf) < 0) {
+	fprintf(stderr, "%s: stat(%s): %s\n", pmGetProgname(), fname, strerror(errno));
+	exit(1);
+    }
+    printf("merged %d records in %.3f sec (%.0f records/sec, %.1f Mbyte/sec)\n",
+	    k * samples, t, k * samples / t, sbuf.st_size / t / (1024 * 1024));
+
+    pmsprintf(fname, sizeof(fname), "%s/out", dir);
+    exit(check(fname, k * samples, ninst) < 0);
+}
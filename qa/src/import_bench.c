@@ -0,0 +1,232 @@
+/*
+ * Benchmark for libpcp_import throughput.
+ *
+ * Defines a set of metrics with instances, then imports rows of values
+ * (one row per timestamp, a value for every metric-instance pair) the
+ * way a converter like sar2pcp or collectl2pcp does, by one of
+ *	-x name		pmiPutValue(metric, instance, value) for each value
+ *	-x handle	pmiGetHandle() up front, then pmiPutValueHandle()
+ *	-x row		pmiGetHandle() up front, then pmiPutRow() for each row
+ * and reports the time to define the metrics and instances and the
+ * import rate, then reads the archive back to check it, e.g.
+ *
+ *	import_bench -m 200 -i 200 -n 50 -x name /tmp/byname
+ *	import_bench -m 200 -i 200 -n 50 -x row /tmp/byrow
+ *
+ * Copyright (c) 2026 Red Hat.
+ */
+
+#include <pcp/pmapi.h>
+#include <pcp/import.h>
+
+static double
+elapsed(struct timeval *start)
+{
+    struct timeval	now;
+
+    pmtimevalNow(&now);
+    return pmtimevalSub(&now, start);
+}
+
+static void
+fail(const char *what, int sts)
+{
+    fprintf(stderr, "%s: %s: %s\n", pmGetProgname(), what, pmiErrStr(sts));
+    exit(1);
+}
+
+static int
+check(const char *archive, int rows, int nvalues)
+{
+    pmResult		*rp;
+    int			ctx, sts, i;
+    int			count = 0, values = 0;
+
+    if ((ctx = pmNewContext(PM_CONTEXT_ARCHIVE, archive)) < 0) {
+	fprintf(stderr, "pmNewContext(%s): %s\n", archive, pmErrStr(ctx));
+	return ctx;
+    }
+    while ((sts = pmFetchArchive(&rp)) >= 0) {
+	count++;
+	for (i = 0; i < rp->numpmid; i++)
+	    values += rp->vset[i]->numval;
+	pmFreeResult(rp);
+    }
+    pmDestroyContext(ctx);
+    if (count != rows || values != rows * nvalues) {
+	fprintf(stderr, "%s: read %d records of %d values, expected %d of %d\n",
+		archive, count, count ? values / count : 0, rows, nvalues);
+	return -1;
+    }
+    return 0;
+}
+
+int
+main(int argc, char **argv)
+{
+    int			c;
+    int			sts;
+    int			errflag = 0;
+    int			rows = 100;
+    int			nmetrics = 100;
+    int			ninst = 100;
+    int			nvalues;
+    char		*mode = "row";
+    char		*archive;
+    char		*endnum;
+    char		**metrics;
+    char		**instances;
+    char		**values;
+    int			*handles;
+    char		name[64];
+    pmInDom		indom = pmInDom_build(245, 0);
+    struct timeval	start;
+    double		setup, t;
+    int			i, j, k, n;
+
+    pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "D:i:m:n:x:?")) != EOF) {
+	switch (c) {
+
+	case 'D':	/* debug options */
+	    sts = pmSetDebug(optarg);
+	    if (sts < 0) {
+		fprintf(stderr, "%s: unrecognized debug options specification (%s)\n",
+		    pmGetProgname(), optarg);
+		errflag++;
+	    }
+	    break;
+
+	case 'i':	/* instances per metric */
+	    ninst = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || ninst < 1) {
+		fprintf(stderr, "%s: -i requires numeric argument\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case 'm':	/* metrics */
+	    nmetrics = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || nmetrics < 1) {
+		fprintf(stderr, "%s: -m requires numeric argument\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case 'n':	/* rows */
+	    rows = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || rows < 1) {
+		fprintf(stderr, "%s: -n requires numeric argument\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case 'x':	/* import method */
+	    mode = optarg;
+	    if (strcmp(mode, "name") != 0 && strcmp(mode, "handle") != 0 &&
+		strcmp(mode, "row") != 0) {
+		fprintf(stderr, "%s: -x expects name, handle or row\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case '?':
+	default:
+	    errflag++;
+	    break;
+	}
+    }
+
+    if (errflag || optind != argc - 1) {
+	fprintf(stderr,
+"Usage: %s [options] archive\n\
+\n\
+Options:\n\
+  -D debug	set debug options\n\
+  -i count	instances per metric [default 100]\n\
+  -m count	metrics [default 100]\n\
+  -n count	rows [default 100]\n\
+  -x method	import by name, handle or row [default row]\n",
+		pmGetProgname());
+	exit(1);
+    }
+    archive = argv[optind];
+    nvalues = nmetrics * ninst;
+
+    metrics = (char **)malloc(nmetrics * sizeof(char *));
+    instances = (char **)malloc(ninst * sizeof(char *));
+    values = (char **)malloc(nvalues * sizeof(char *));
+    handles = (int *)malloc(nvalues * sizeof(int));
+    if (metrics == NULL || instances == NULL || values == NULL || handles == NULL) {
+	fprintf(stderr, "%s: out of memory\n", pmGetProgname());
+	exit(1);
+    }
+    for (i = 0; i < nmetrics; i++) {
+	pmsprintf(name, sizeof(name), "bench.import.group%02d.m%04d", i % 10, i);
+	metrics[i] = strdup(name);
+    }
+    for (j = 0; j < ninst; j++) {
+	/* external names with a space, like process instances */
+	pmsprintf(name, sizeof(name), "%06d /usr/bin/worker-%d", j, j);
+	instances[j] = strdup(name);
+    }
+    for (k = 0; k < nvalues; k++) {
+	if ((values[k] = (char *)malloc(16)) == NULL) {
+	    fprintf(stderr, "%s: out of memory\n", pmGetProgname());
+	    exit(1);
+	}
+    }
+
+    pmtimevalNow(&start);
+    if ((sts = pmiStart(archive, 0)) < 0)
+	fail("pmiStart", sts);
+    for (i = 0; i < nmetrics; i++) {
+	if ((sts = pmiAddMetric(metrics[i], PM_ID_NULL, PM_TYPE_U32, indom,
+			PM_SEM_COUNTER, pmiUnits(0,0,1,0,0,PM_COUNT_ONE))) < 0)
+	    fail("pmiAddMetric", sts);
+    }
+    for (j = 0; j < ninst; j++) {
+	if ((sts = pmiAddInstance(indom, instances[j], j)) < 0)
+	    fail("pmiAddInstance", sts);
+    }
+    if (strcmp(mode, "name") != 0) {
+	for (k = 0; k < nvalues; k++) {
+	    if ((handles[k] = pmiGetHandle(metrics[k / ninst], instances[k % ninst])) < 0)
+		fail("pmiGetHandle", handles[k]);
+	}
+    }
+    setup = elapsed(&start);
+
+    pmtimevalNow(&start);
+    for (n = 0; n < rows; n++) {
+	/* new values, as if parsed from the input for this row */
+	for (k = 0; k < nvalues; k++)
+	    pmsprintf(values[k], 16, "%d", n * (k % 17));
+	if (strcmp(mode, "row") == 0) {
+	    if ((sts = pmiPutRow(1000000000 + n, 0, nvalues, handles, (const char **)values)) < 0)
+		fail("pmiPutRow", sts);
+	    continue;
+	}
+	for (k = 0; k < nvalues; k++) {
+	    if (strcmp(mode, "name") == 0)
+		sts = pmiPutValue(metrics[k / ninst], instances[k % ninst], values[k]);
+	    else
+		sts = pmiPutValueHandle(handles[k], values[k]);
+	    if (sts < 0)
+		fail("pmiPutValue", sts);
+	}
+	if ((sts = pmiWrite(1000000000 + n, 0)) < 0)
+	    fail("pmiWrite", sts);
+    }
+    if ((sts = pmiEnd()) < 0)
+	fail("pmiEnd", sts);
+    t = elapsed(&start);
+
+    printf("%d metrics, %d instances: defined in %.3f sec\n",
+	    nmetrics, ninst, setup);
+    printf("%d rows of %d values by %s in %.3f sec (%.0f rows/sec, %.0f values/sec)\n",
+	    rows, nvalues, mode, t, rows / t, (double)rows * nvalues / t);
+
+    exit(check(archive, rows, nvalues) < 0);
+}
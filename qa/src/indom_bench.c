@@ -0,0 +1,241 @@
+/*
+ * Benchmark for time-based instance domain lookups in archives.
+ *
+ * Unless -a is given, first creates a synthetic archive (using
+ * libpcp_import) where a new instance appears in every sample, like
+ * processes starting in a proc indom, so every record has its own
+ * version of the instance domain.  Then times pmGetInDom at random
+ * points in the archive (__pmLogGetInDom), and full passes of both
+ * pmFetchArchive and interpolated pmFetch with pmNameInDom for each
+ * value, as reporting tools do.
+ *
+ * Copyright (c) 2026 Red Hat.
+ */
+
+#include <pcp/pmapi.h>
+#include <pcp/import.h>
+
+static char	*metric = "bench.proc.value";
+
+static double
+elapsed(struct timeval *start)
+{
+    struct timeval	now;
+
+    pmtimevalNow(&now);
+    return pmtimevalSub(&now, start);
+}
+
+static void
+generate(const char *archive, int samples, int ninst)
+{
+    pmInDom		indom = pmInDom_build(245, 1);
+    char		name[32];
+    int			i, j, sts;
+
+    if ((sts = pmiStart(archive, 0)) < 0 ||
+	(sts = pmiAddMetric(metric, PM_ID_NULL, PM_TYPE_U32, indom,
+			PM_SEM_INSTANT, pmiUnits(0,0,0,0,0,0))) < 0) {
+	fprintf(stderr, "%s: cannot create %s: %s\n",
+		pmGetProgname(), archive, pmiErrStr(sts));
+	exit(1);
+    }
+    for (i = 0; i < samples; i++) {
+	/* one new instance per sample, after the initial set */
+	for (j = (i ? ninst - 1 + i : 0); j < ninst + i; j++) {
+	    pmsprintf(name, sizeof(name), "%06d proc", j);
+	    if ((sts = pmiAddInstance(indom, name, j)) < 0) {
+		fprintf(stderr, "pmiAddInstance: %s\n", pmiErrStr(sts));
+		exit(1);
+	    }
+	}
+	/* only the most recent ninst instances have values */
+	for (j = i; j < ninst + i; j++) {
+	    pmsprintf(name, sizeof(name), "%06d proc", j);
+	    pmiPutValue(metric, name, "1");
+	}
+	if ((sts = pmiWrite(1000000000 + i, 0)) < 0) {
+	    fprintf(stderr, "pmiWrite: %s\n", pmiErrStr(sts));
+	    exit(1);
+	}
+    }
+    pmiEnd();
+}
+
+static int
+fetch_pass(pmID pmid, pmInDom indom, int mode)
+{
+    pmResult		*rp;
+    pmValueSet		*vsp;
+    char		*name;
+    int			i, sts, count = 0;
+
+    for (;;) {
+	if (mode == PM_MODE_INTERP)
+	    sts = pmFetch(1, &pmid, &rp);
+	else
+	    sts = pmFetchArchive(&rp);
+	if (sts < 0)
+	    break;
+	for (vsp = rp->vset[0], i = 0; rp->numpmid > 0 && i < vsp->numval; i++) {
+	    if (pmNameInDom(indom, vsp->vlist[i].inst, &name) >= 0)
+		free(name);
+	}
+	pmFreeResult(rp);
+	count++;
+    }
+    if (sts != PM_ERR_EOL)
+	fprintf(stderr, "fetch: %s\n", pmErrStr(sts));
+    return count;
+}
+
+int
+main(int argc, char **argv)
+{
+    int			c;
+    int			sts;
+    int			errflag = 0;
+    int			samples = 1000;
+    int			ninst = 50;
+    int			lookups = 10000;
+    char		*archive = NULL;
+    char		*endnum;
+    int			*instlist;
+    char		**namelist;
+    pmLogLabel		label;
+    pmDesc		desc;
+    pmID		pmid;
+    struct timeval	start, when, end;
+    double		t, span;
+    int			i, count;
+
+    pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "a:D:i:l:m:n:?")) != EOF) {
+	switch (c) {
+
+	case 'a':	/* use existing archive */
+	    archive = optarg;
+	    break;
+
+	case 'D':	/* debug options */
+	    sts = pmSetDebug(optarg);
+	    if (sts < 0) {
+		fprintf(stderr, "%s: unrecognized debug options specification (%s)\n",
+		    pmGetProgname(), optarg);
+		errflag++;
+	    }
+	    break;
+
+	case 'i':	/* live instances per sample */
+	    ninst = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || ninst < 1) {
+		fprintf(stderr, "%s: -i requires numeric argument\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case 'l':	/* random pmGetInDom lookups */
+	    lookups = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || lookups < 1) {
+		fprintf(stderr, "%s: -l requires numeric argument\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case 'm':	/* metric with an instance domain */
+	    metric = optarg;
+	    break;
+
+	case 'n':	/* samples (and indom versions) */
+	    samples = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || samples < 1) {
+		fprintf(stderr, "%s: -n requires numeric argument\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case '?':
+	default:
+	    errflag++;
+	    break;
+	}
+    }
+
+    if (errflag || (archive == NULL && optind != argc - 1) ||
+	(archive != NULL && optind != argc)) {
+	fprintf(stderr,
+"Usage: %s [options] [archive]\n\
+\n\
+Options:\n\
+  -a archive	use existing archive, rather than creating one\n\
+  -D debug	set debug options\n\
+  -i count	instances with values in each sample [default 50]\n\
+  -l count	number of random pmGetInDom lookups [default 10000]\n\
+  -m metric	metric to fetch [default %s]\n\
+  -n count	samples (instance domain versions) [default 1000]\n",
+		pmGetProgname(), metric);
+	exit(1);
+    }
+
+    if (archive == NULL) {
+	archive = argv[optind];
+	pmtimevalNow(&start);
+	generate(archive, samples, ninst);
+	printf("created %s: %d samples in %.3f sec\n",
+		archive, samples, elapsed(&start));
+    }
+
+    pmtimevalNow(&start);
+    if ((sts = pmNewContext(PM_CONTEXT_ARCHIVE, archive)) < 0) {
+	fprintf(stderr, "pmNewContext(%s): %s\n", archive, pmErrStr(sts));
+	exit(1);
+    }
+    printf("opened %s in %.3f sec\n", archive, elapsed(&start));
+
+    if ((sts = pmLookupName(1, &metric, &pmid)) < 0 ||
+	(sts = pmLookupDesc(pmid, &desc)) < 0 ||
+	(sts = pmGetArchiveLabel(&label)) < 0 ||
+	(sts = pmGetArchiveEnd(&end)) < 0) {
+	fprintf(stderr, "%s: %s\n", metric, pmErrStr(sts));
+	exit(1);
+    }
+    if (desc.indom == PM_INDOM_NULL) {
+	fprintf(stderr, "%s: metric has no instance domain\n", metric);
+	exit(1);
+    }
+    span = pmtimevalSub(&end, &label.ll_start);
+
+    srandom(42);
+    count = 0;
+    pmtimevalNow(&start);
+    for (i = 0; i < lookups; i++) {
+	pmtimevalFromReal(pmtimevalToReal(&label.ll_start) +
+			span * (random() / (double)RAND_MAX), &when);
+	pmSetMode(PM_MODE_INTERP, &when, 0);
+	if ((sts = pmGetInDom(desc.indom, &instlist, &namelist)) > 0) {
+	    count += sts;
+	    free(instlist);
+	    free(namelist);
+	}
+    }
+    t = elapsed(&start);
+    printf("pmGetInDom: %d lookups in %.3f sec (%.3f usec/call, %d instances)\n",
+	    lookups, t, t * 1e6 / lookups, count);
+
+    pmSetMode(PM_MODE_FORW, &label.ll_start, 0);
+    pmtimevalNow(&start);
+    count = fetch_pass(pmid, desc.indom, PM_MODE_FORW);
+    t = elapsed(&start);
+    printf("pmFetchArchive: %d records in %.3f sec (%.3f msec/record)\n",
+	    count, t, count ? t * 1e3 / count : 0.0);
+
+    pmSetMode(PM_MODE_INTERP, &label.ll_start, 1000);
+    pmtimevalNow(&start);
+    count = fetch_pass(pmid, desc.indom, PM_MODE_INTERP);
+    t = elapsed(&start);
+    printf("pmFetch (interp): %d samples in %.3f sec (%.3f msec/sample)\n",
+	    count, t, count ? t * 1e3 / count : 0.0);
+
+    exit(0);
+}
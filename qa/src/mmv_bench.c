@@ -0,0 +1,247 @@
+/*
+ * Benchmark for MMV value lookups, on both sides of the mapping.
+ *
+ * Creates a large synthetic MMV file (nmetrics metrics, each with
+ * ninst instances), times mmv_stats_inc() over every value from the
+ * producer side, and then (unless -P) times pmFetch of every value
+ * via pmcd and the MMV PMDA.
+ *
+ * Copyright (c) 2026 Red Hat.
+ */
+
+#include <unistd.h>
+#include <pcp/pmapi.h>
+#include <pcp/mmv_stats.h>
+
+static double
+elapsed(struct timeval *start)
+{
+    struct timeval	now;
+
+    pmtimevalNow(&now);
+    return pmtimevalSub(&now, start);
+}
+
+/*
+ * The PMDA only notices new files when the directory timestamp changes
+ * (one second granularity), so ask it to reload explicitly.
+ */
+static void
+reload(void)
+{
+    char	*name = "mmv.control.reload";
+    pmID	pmid;
+    pmResult	*rp;
+    int		sts;
+
+    if ((sts = pmLookupName(1, &name, &pmid)) < 0) {
+	fprintf(stderr, "pmLookupName(%s): %s\n", name, pmErrStr(sts));
+	return;
+    }
+    if ((sts = pmFetch(1, &pmid, &rp)) < 0) {
+	fprintf(stderr, "pmFetch(%s): %s\n", name, pmErrStr(sts));
+	return;
+    }
+    if (rp->vset[0]->numval == 1) {
+	rp->vset[0]->vlist[0].value.lval = 1;
+	if ((sts = pmStore(rp)) < 0)
+	    fprintf(stderr, "pmStore(%s): %s\n", name, pmErrStr(sts));
+    }
+    pmFreeResult(rp);
+    if (pmFetch(1, &pmid, &rp) >= 0)
+	pmFreeResult(rp);
+}
+
+int
+main(int argc, char **argv)
+{
+    int			c;
+    int			sts;
+    int			errflag = 0;
+    int			nmetrics = 100;
+    int			ninst = 100;
+    int			samples = 10;
+    int			producer_only = 0;
+    char		*host = "local:";
+    char		*file = "mmv_bench";
+    char		*endnum;
+    char		name[MAXPATHLEN];
+    char		inst[32];
+    char		**namelist;
+    pmID		*pmidlist;
+    pmResult		*rp;
+    mmv_registry_t	*registry;
+    pmUnits		units = MMV_UNITS(0,0,1,0,0,PM_COUNT_ONE);
+    void		*addr;
+    struct timeval	start;
+    double		t;
+    int			i, j, s, nvalues;
+
+    pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "D:h:i:m:Ps:?")) != EOF) {
+	switch (c) {
+
+	case 'D':	/* debug options */
+	    sts = pmSetDebug(optarg);
+	    if (sts < 0) {
+		fprintf(stderr, "%s: unrecognized debug options specification (%s)\n",
+		    pmGetProgname(), optarg);
+		errflag++;
+	    }
+	    break;
+
+	case 'h':	/* contact PMCD on this hostname */
+	    host = optarg;
+	    break;
+
+	case 'i':	/* instances per metric */
+	    ninst = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || ninst < 1) {
+		fprintf(stderr, "%s: -i requires numeric argument\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case 'm':	/* metric count */
+	    nmetrics = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || nmetrics < 1 || nmetrics > 1023) {
+		fprintf(stderr, "%s: -m requires numeric argument (1-1023)\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case 'P':	/* producer side only, no pmcd */
+	    producer_only = 1;
+	    break;
+
+	case 's':	/* sample count */
+	    samples = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || samples < 1) {
+		fprintf(stderr, "%s: -s requires numeric argument\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case '?':
+	default:
+	    errflag++;
+	    break;
+	}
+    }
+
+    if (optind < argc - 1)
+	errflag++;
+    else if (optind == argc - 1)
+	file = argv[optind];
+
+    if (errflag) {
+	fprintf(stderr,
+"Usage: %s [options] [file]\n\
+\n\
+Options:\n\
+  -D debug	set debug options\n\
+  -h host	fetch via pmcd on host [default local:]\n\
+  -i count	instances per metric [default 100]\n\
+  -m count	number of metrics [default 100]\n\
+  -P		time the producer side only\n\
+  -s count	number of timed passes [default 10]\n",
+		pmGetProgname());
+	exit(1);
+    }
+
+    if ((registry = mmv_stats_registry(file, 321, MMV_FLAG_PROCESS)) == NULL) {
+	fprintf(stderr, "mmv_stats_registry: %s - %s\n", file, strerror(errno));
+	exit(1);
+    }
+    if (mmv_stats_add_indom(registry, 1, "synthetic instances", NULL) < 0) {
+	fprintf(stderr, "mmv_stats_add_indom: %s\n", strerror(errno));
+	exit(1);
+    }
+    for (j = 0; j < ninst; j++) {
+	pmsprintf(inst, sizeof(inst), "inst%05d", j);
+	/* NB: registry keeps the name pointers, not copies */
+	if (mmv_stats_add_instance(registry, 1, j, strdup(inst)) < 0) {
+	    fprintf(stderr, "mmv_stats_add_instance: %s - %s\n", inst, strerror(errno));
+	    exit(1);
+	}
+    }
+    for (i = 0; i < nmetrics; i++) {
+	pmsprintf(name, sizeof(name), "bench.m%04d", i);
+	if (mmv_stats_add_metric(registry, strdup(name), i + 1, MMV_TYPE_U64,
+			MMV_SEM_COUNTER, units, 1, "synthetic counter", NULL) < 0) {
+	    fprintf(stderr, "mmv_stats_add_metric: %s - %s\n", name, strerror(errno));
+	    exit(1);
+	}
+    }
+    if ((addr = mmv_stats_start(registry)) == NULL) {
+	fprintf(stderr, "mmv_stats_start: %s - %s\n", file, strerror(errno));
+	exit(1);
+    }
+    nvalues = nmetrics * ninst;
+    printf("%d metrics x %d instances = %d values\n", nmetrics, ninst, nvalues);
+
+    pmtimevalNow(&start);
+    for (s = 0; s < samples; s++) {
+	for (i = 0; i < nmetrics; i++) {
+	    pmsprintf(name, sizeof(name), "bench.m%04d", i);
+	    for (j = 0; j < ninst; j++) {
+		pmsprintf(inst, sizeof(inst), "inst%05d", j);
+		mmv_stats_inc(addr, name, inst);
+	    }
+	}
+    }
+    t = elapsed(&start);
+    printf("producer: %d x mmv_stats_inc in %.3f sec (%.3f usec/call)\n",
+	    samples * nvalues, t, t * 1e6 / (samples * nvalues));
+
+    if (producer_only)
+	goto done;
+
+    if ((sts = pmNewContext(PM_CONTEXT_HOST, host)) < 0) {
+	fprintf(stderr, "pmNewContext(%s): %s\n", host, pmErrStr(sts));
+	goto done;
+    }
+    namelist = (char **)malloc(nmetrics * sizeof(char *));
+    pmidlist = (pmID *)malloc(nmetrics * sizeof(pmID));
+    if (namelist == NULL || pmidlist == NULL) {
+	fprintf(stderr, "malloc: %s\n", strerror(errno));
+	exit(1);
+    }
+    for (i = 0; i < nmetrics; i++) {
+	pmsprintf(name, sizeof(name), "mmv.%s.bench.m%04d", file, i);
+	namelist[i] = strdup(name);
+    }
+    for (i = 0; i < 5; i++) {
+	if ((sts = pmLookupName(nmetrics, namelist, pmidlist)) == nmetrics)
+	    break;
+	reload();
+	sleep(1);
+    }
+    if (sts != nmetrics) {
+	fprintf(stderr, "pmLookupName: %s\n", sts < 0 ? pmErrStr(sts) : "missing names");
+	goto done;
+    }
+
+    pmtimevalNow(&start);
+    for (s = 0; s < samples; s++) {
+	if ((sts = pmFetch(nmetrics, pmidlist, &rp)) < 0) {
+	    fprintf(stderr, "pmFetch: %s\n", pmErrStr(sts));
+	    goto done;
+	}
+	if (s == 0) {
+	    for (j = i = 0; i < rp->numpmid; i++)
+		j += rp->vset[i]->numval > 0 ? rp->vset[i]->numval : 0;
+	    if (j != nvalues)
+		fprintf(stderr, "pmFetch: got %d values, expected %d\n", j, nvalues);
+	}
+	pmFreeResult(rp);
+    }
+    t = elapsed(&start);
+    printf("consumer: %d x pmFetch of %d values in %.3f sec (%.3f msec/fetch)\n",
+	    samples, nvalues, t, t * 1e3 / samples);
+
+done:
+    mmv_stats_free(registry);
+    exit(0);
+}
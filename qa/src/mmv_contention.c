@@ -0,0 +1,191 @@
+/*
+ * Contention benchmark for MMV counter updates from many threads.
+ *
+ * For 1 to N threads, every thread increments the same counter and
+ * the elapsed time and final value are reported for plain updates
+ * (mmv_inc_value, which may lose increments), atomic updates, and
+ * atomic updates to a counter striped across per-thread slots.
+ *
+ * Copyright (c) 2026 Red Hat.
+ */
+
+#include <pthread.h>
+#include <inttypes.h>
+#include <pcp/pmapi.h>
+#include <pcp/mmv_stats.h>
+#include <pcp/mmv_dev.h>
+
+static int		iterations = 1000000;
+static void		*addr;
+static pmAtomValue	*value;
+static int		atomic;
+
+static void *
+worker(void *arg)
+{
+    int		i;
+
+    (void)arg;
+    if (atomic) {
+	for (i = 0; i < iterations; i++)
+	    mmv_atomic_inc_value(addr, value, 1);
+    } else {
+	for (i = 0; i < iterations; i++)
+	    mmv_inc_value(addr, value, 1);
+    }
+    return NULL;
+}
+
+/* what pmdammv would report - the value plus any stripe slots */
+static __uint64_t
+total(void)
+{
+    mmv_disk_value_t	*v = (mmv_disk_value_t *)value;
+    mmv_disk_stripe_t	*sp;
+    pmAtomValue		*slot;
+    __uint64_t		sum = v->value.ull;
+    int			i;
+
+    if (v->extra != 0) {
+	sp = (mmv_disk_stripe_t *)((char *)addr + v->extra);
+	for (i = 0; i < sp->count; i++) {
+	    slot = (pmAtomValue *)((char *)addr + sp->offset + i * MMV_STRIPE_SIZE);
+	    sum += slot->ull;
+	}
+    }
+    return sum;
+}
+
+static void *
+start(const char *file, int stripes, mmv_registry_t **rp)
+{
+    mmv_registry_t	*registry;
+    pmUnits		units = MMV_UNITS(0,0,1,0,0,PM_COUNT_ONE);
+    void		*map;
+
+    if ((registry = mmv_stats_registry(file, 322, MMV_FLAG_PROCESS)) == NULL ||
+	mmv_stats_add_metric(registry, "counter", 1, MMV_TYPE_U64,
+			MMV_SEM_COUNTER, units, 0, "contended counter", NULL) < 0 ||
+	mmv_stats_set_stripes(registry, stripes) < 0 ||
+	(map = mmv_stats_start(registry)) == NULL) {
+	fprintf(stderr, "%s: cannot create %s: %s\n",
+		pmGetProgname(), file, strerror(errno));
+	exit(1);
+    }
+    *rp = registry;
+    return map;
+}
+
+static void
+run(const char *mode, void *map, int nthreads)
+{
+    pthread_t		*tids;
+    struct timeval	then, now;
+    __uint64_t		expect = (__uint64_t)nthreads * iterations;
+    __uint64_t		got;
+    double		t;
+    int			i;
+
+    addr = map;
+    value = mmv_lookup_value_desc(addr, "counter", NULL);
+    mmv_atomic_set_value(addr, value, 0);
+
+    if ((tids = (pthread_t *)malloc(nthreads * sizeof(pthread_t))) == NULL) {
+	fprintf(stderr, "malloc: %s\n", strerror(errno));
+	exit(1);
+    }
+    pmtimevalNow(&then);
+    for (i = 0; i < nthreads; i++)
+	pthread_create(&tids[i], NULL, worker, NULL);
+    for (i = 0; i < nthreads; i++)
+	pthread_join(tids[i], NULL);
+    pmtimevalNow(&now);
+    free(tids);
+
+    t = pmtimevalSub(&now, &then);
+    got = total();
+    printf("%-8s %3d threads %8.3f sec %8.2f Mops/sec lost %"PRIu64"\n",
+	    mode, nthreads, t, expect / t / 1e6, expect - got);
+}
+
+int
+main(int argc, char **argv)
+{
+    int			c;
+    int			errflag = 0;
+    int			maxthreads = 8;
+    int			stripes = 0;
+    int			n;
+    char		*endnum;
+    mmv_registry_t	*plain_reg, *striped_reg;
+    void		*plain, *striped;
+
+    pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "i:S:t:?")) != EOF) {
+	switch (c) {
+
+	case 'i':	/* iterations per thread */
+	    iterations = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || iterations < 1) {
+		fprintf(stderr, "%s: -i requires numeric argument\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case 'S':	/* stripe slots per counter */
+	    stripes = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || stripes < 1) {
+		fprintf(stderr, "%s: -S requires numeric argument\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case 't':	/* maximum thread count */
+	    maxthreads = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || maxthreads < 1) {
+		fprintf(stderr, "%s: -t requires numeric argument\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case '?':
+	default:
+	    errflag++;
+	    break;
+	}
+    }
+
+    if (errflag || optind != argc) {
+	fprintf(stderr,
+"Usage: %s [options]\n\
+\n\
+Options:\n\
+  -i count	increments per thread [default 1000000]\n\
+  -S count	stripe slots for the striped counter [default -t value]\n\
+  -t count	maximum number of threads [default 8]\n",
+		pmGetProgname());
+	exit(1);
+    }
+    if (stripes == 0)
+	stripes = maxthreads;
+
+    plain = start("mmv_contention", 0, &plain_reg);
+    striped = start("mmv_contention_striped", stripes, &striped_reg);
+
+    for (n = 1; ; n *= 2) {
+	if (n > maxthreads)
+	    n = maxthreads;
+	atomic = 0;
+	run("plain", plain, n);
+	atomic = 1;
+	run("atomic", plain, n);
+	run("striped", striped, n);
+	if (n == maxthreads)
+	    break;
+    }
+
+    mmv_stats_free(plain_reg);
+    mmv_stats_free(striped_reg);
+    exit(0);
+}
@@ -0,0 +1,192 @@
+/*
+ * Multi-threaded benchmark for the libpcp PDU buffer pool.
+ *
+ * Each of N threads opens its own context for the archive given with
+ * -a and makes passes through it with pmFetchArchive (every record is
+ * read into a PDU buffer, its pmResult pinned and unpinned value by
+ * value in pmFreeResult), reporting the aggregate fetch rate.  With -b
+ * the threads instead allocate, pin (by addresses within the buffer)
+ * and unpin PDU buffers of assorted sizes directly, to measure just
+ * the pool itself, e.g.
+ *
+ *	pdubuf_bench -P 4 -a archives/20041125 -i 100
+ *	pdubuf_bench -P 4 -b -i 1000000
+ *
+ * Copyright (c) 2026 Red Hat.
+ */
+
+#include <pcp/pmapi.h>
+#include "libpcp.h"
+#include <pthread.h>
+
+static char	*archive;
+static int	iterations = 20;
+
+static pmLongOptions longopts[] = {
+    PMAPI_OPTIONS_HEADER("General options"),
+    PMOPT_ARCHIVE,
+    PMOPT_DEBUG,
+    PMOPT_HELP,
+    PMAPI_OPTIONS_HEADER("Benchmark options"),
+    { "buffers", 0, 'b', 0, "exercise PDU buffers directly, no archive" },
+    { "iterations", 1, 'i', "N", "passes (or buffers) per thread [default 20]" },
+    { "threads", 1, 'P', "N", "number of threads [default 4]" },
+    PMAPI_OPTIONS_END
+};
+
+static pmOptions opts = {
+    .short_options = "a:bD:i:P:?",
+    .long_options = longopts,
+    .short_usage = "[options]",
+};
+
+static double
+elapsed(struct timeval *start)
+{
+    struct timeval	now;
+
+    pmtimevalNow(&now);
+    return pmtimevalSub(&now, start);
+}
+
+static void *
+fetch_thread(void *arg)
+{
+    long		*count = (long *)arg;
+    pmLogLabel		label;
+    pmResult		*rp;
+    int			ctx, sts, i;
+
+    if ((ctx = pmNewContext(PM_CONTEXT_ARCHIVE, archive)) < 0) {
+	fprintf(stderr, "%s: pmNewContext(%s): %s\n",
+		pmGetProgname(), archive, pmErrStr(ctx));
+	return NULL;
+    }
+    if ((sts = pmGetArchiveLabel(&label)) < 0) {
+	fprintf(stderr, "%s: pmGetArchiveLabel: %s\n", pmGetProgname(), pmErrStr(sts));
+	return NULL;
+    }
+    for (i = 0; i < iterations; i++) {
+	if ((sts = pmSetMode(PM_MODE_FORW, &label.ll_start, 0)) < 0) {
+	    fprintf(stderr, "%s: pmSetMode: %s\n", pmGetProgname(), pmErrStr(sts));
+	    break;
+	}
+	while (pmFetchArchive(&rp) >= 0) {
+	    pmFreeResult(rp);
+	    (*count)++;
+	}
+    }
+    pmDestroyContext(ctx);
+    return NULL;
+}
+
+static void *
+buffer_thread(void *arg)
+{
+    static int		sizes[] = { 64, 200, 1000, 4096, 300, 20000, 100 };
+    int			nsizes = sizeof(sizes) / sizeof(sizes[0]);
+    long		*count = (long *)arg;
+    __pmPDU		*pb[4];
+    int			i, j, need;
+
+    for (i = 0; i < iterations; i++) {
+	/* a few buffers in use at once, like a pmResult and its PDUs */
+	for (j = 0; j < 4; j++) {
+	    need = sizes[(i + j) % nsizes];
+	    if ((pb[j] = __pmFindPDUBuf(need)) == NULL) {
+		fprintf(stderr, "%s: __pmFindPDUBuf(%d) failed\n",
+			pmGetProgname(), need);
+		return NULL;
+	    }
+	    __pmPinPDUBuf(&pb[j][need / sizeof(__pmPDU) / 2]);
+	}
+	for (j = 0; j < 4; j++) {
+	    need = sizes[(i + j) % nsizes];
+	    __pmUnpinPDUBuf(&pb[j][need / sizeof(__pmPDU) - 1]);
+	    __pmUnpinPDUBuf(pb[j]);
+	}
+	(*count)++;
+    }
+    return NULL;
+}
+
+int
+main(int argc, char **argv)
+{
+    int			c;
+    int			sts;
+    int			bflag = 0;
+    int			nthreads = 4;
+    char		*endnum;
+    pthread_t		*tids;
+    long		*counts, total = 0;
+    struct timeval	start;
+    double		t;
+    int			i;
+
+    pmSetProgname(argv[0]);
+
+    while ((c = pmGetOptions(argc, argv, &opts)) != EOF) {
+	switch (c) {
+
+	case 'b':	/* buffers only */
+	    bflag = 1;
+	    break;
+
+	case 'i':	/* passes per thread */
+	    iterations = (int)strtol(opts.optarg, &endnum, 10);
+	    if (*endnum != '\0' || iterations < 1) {
+		pmprintf("%s: -i requires numeric argument\n", pmGetProgname());
+		opts.errors++;
+	    }
+	    break;
+
+	case 'P':	/* threads */
+	    nthreads = (int)strtol(opts.optarg, &endnum, 10);
+	    if (*endnum != '\0' || nthreads < 1) {
+		pmprintf("%s: -P requires numeric argument\n", pmGetProgname());
+		opts.errors++;
+	    }
+	    break;
+	}
+    }
+
+    if (!bflag && opts.narchives != 1) {
+	pmprintf("%s: one archive (-a) is required, unless -b\n", pmGetProgname());
+	opts.errors++;
+    }
+    if (opts.errors || (opts.flags & PM_OPTFLAG_EXIT) || opts.optind != argc) {
+	sts = !(opts.flags & PM_OPTFLAG_EXIT);
+	pmUsageMessage(&opts);
+	exit(sts);
+    }
+    if (!bflag)
+	archive = opts.archives[0];
+
+    if ((tids = (pthread_t *)malloc(nthreads * sizeof(pthread_t))) == NULL ||
+	(counts = (long *)calloc(nthreads, sizeof(long))) == NULL) {
+	fprintf(stderr, "%s: out of memory\n", pmGetProgname());
+	exit(1);
+    }
+
+    pmtimevalNow(&start);
+    for (i = 0; i < nthreads; i++) {
+	sts = pthread_create(&tids[i], NULL,
+			bflag ? buffer_thread : fetch_thread, &counts[i]);
+	if (sts != 0) {
+	    fprintf(stderr, "%s: pthread_create: %s\n",
+		    pmGetProgname(), strerror(sts));
+	    exit(1);
+	}
+    }
+    for (i = 0; i < nthreads; i++) {
+	pthread_join(tids[i], NULL);
+	total += counts[i];
+    }
+    t = elapsed(&start);
+
+    printf("%d threads, %ld %s in %.3f sec (%.0f/sec, %.3f usec each)\n",
+	    nthreads, total, bflag ? "buffer sets" : "records", t,
+	    t > 0 ? total / t : 0.0, total ? t * 1e6 / total : 0.0);
+    exit(total == 0);
+}
@@ -0,0 +1,239 @@
+/*
+ * Benchmark for pmie rule evaluation over large instance domains.
+ *
+ * Creates an archive with two metrics over -i instances and -n samples
+ * (using libpcp_import) and a pmie configuration with -r copies of a
+ * set of rules that aggregate and quantify over the instance domain,
+ * then runs pmie on the archive and reports the time taken, e.g.
+ *
+ *	pmie_bench -i 100000 -n 20 -r 5 /tmp/pmiebench
+ *
+ * The rule values (from pmie -v) go to the -o file, so the results can
+ * be checked.  -p names the pmie binary [default pmie from $PATH].
+ * With -u the values only change every -u samples, so pmie can reuse
+ * the results of rules whose metric values did not change.
+ *
+ * Copyright (c) 2026 Red Hat.
+ */
+
+#include <pcp/pmapi.h>
+#include <pcp/import.h>
+#include <sys/wait.h>
+
+static char *rules[] = {
+    "sum_inst (bench.pmie.v)",
+    "avg_inst (bench.pmie.v)",
+    "max_inst (bench.pmie.v * 2 + bench.pmie.w)",
+    "min_inst (bench.pmie.v - bench.pmie.w)",
+    "count_inst (bench.pmie.v > bench.pmie.w)",
+    "all_inst (bench.pmie.v >= 0)",
+    "some_inst (bench.pmie.v > 1000000)",
+    "some_inst (bench.pmie.w == 7 && bench.pmie.v < 100)",
+    "50%_inst (bench.pmie.w < 50)",
+    "sum_inst (-bench.pmie.v / 4)",
+};
+#define NRULES (sizeof(rules) / sizeof(rules[0]))
+
+static double
+elapsed(struct timeval *start)
+{
+    struct timeval	now;
+
+    pmtimevalNow(&now);
+    return pmtimevalSub(&now, start);
+}
+
+static void
+fail(const char *what, int sts)
+{
+    fprintf(stderr, "%s: %s: %s\n", pmGetProgname(), what, pmiErrStr(sts));
+    exit(1);
+}
+
+static void
+mkarchive(const char *archive, int ninst, int samples, int update)
+{
+    pmInDom	indom = pmInDom_build(245, 0);
+    char	name[64];
+    char	value[32];
+    int		*handles;
+    char	**values;
+    int		sts;
+    int		j;
+    int		n;
+    int		u;
+
+    handles = (int *)malloc(2 * ninst * sizeof(int));
+    values = (char **)malloc(2 * ninst * sizeof(char *));
+    if (handles == NULL || values == NULL) {
+	fprintf(stderr, "%s: out of memory\n", pmGetProgname());
+	exit(1);
+    }
+
+    if ((sts = pmiStart(archive, 0)) < 0)
+	fail("pmiStart", sts);
+    if ((sts = pmiAddMetric("bench.pmie.v", PM_ID_NULL, PM_TYPE_DOUBLE, indom,
+		PM_SEM_INSTANT, pmiUnits(0,0,0,0,0,0))) < 0 ||
+	(sts = pmiAddMetric("bench.pmie.w", PM_ID_NULL, PM_TYPE_U32, indom,
+		PM_SEM_INSTANT, pmiUnits(0,0,0,0,0,0))) < 0)
+	fail("pmiAddMetric", sts);
+    for (j = 0; j < ninst; j++) {
+	pmsprintf(name, sizeof(name), "inst%d", j);
+	if ((sts = pmiAddInstance(indom, name, j)) < 0)
+	    fail("pmiAddInstance", sts);
+	if ((handles[2*j] = pmiGetHandle("bench.pmie.v", name)) < 0)
+	    fail("pmiGetHandle", handles[2*j]);
+	if ((handles[2*j+1] = pmiGetHandle("bench.pmie.w", name)) < 0)
+	    fail("pmiGetHandle", handles[2*j+1]);
+	if ((values[2*j] = (char *)malloc(16)) == NULL ||
+	    (values[2*j+1] = (char *)malloc(16)) == NULL) {
+	    fprintf(stderr, "%s: out of memory\n", pmGetProgname());
+	    exit(1);
+	}
+    }
+    for (n = 0; n < samples; n++) {
+	u = n / update;
+	for (j = 0; j < ninst; j++) {
+	    pmsprintf(value, sizeof(value), "%.2f", ((u * 31 + j * 7) % 1000) * 0.25);
+	    strcpy(values[2*j], value);
+	    pmsprintf(value, sizeof(value), "%d", (u + j) % 100);
+	    strcpy(values[2*j+1], value);
+	}
+	if ((sts = pmiPutRow(1000000000 + n, 0, 2 * ninst, handles,
+				(const char **)values)) < 0)
+	    fail("pmiPutRow", sts);
+    }
+    if ((sts = pmiEnd()) < 0)
+	fail("pmiEnd", sts);
+}
+
+int
+main(int argc, char **argv)
+{
+    int			c;
+    int			sts;
+    int			errflag = 0;
+    int			ninst = 1000;
+    int			samples = 10;
+    int			ncopy = 1;
+    int			update = 1;
+    char		*archive;
+    char		*endnum;
+    char		*pmie = "pmie";
+    char		*output = "/dev/null";
+    char		config[MAXPATHLEN];
+    FILE		*f;
+    pid_t		pid;
+    struct timeval	start;
+    double		t;
+    int			i;
+
+    pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "i:n:o:p:r:u:?")) != EOF) {
+	switch (c) {
+
+	case 'i':	/* instances */
+	    ninst = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || ninst < 1) {
+		fprintf(stderr, "%s: -i requires numeric argument\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case 'n':	/* samples */
+	    samples = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || samples < 1) {
+		fprintf(stderr, "%s: -n requires numeric argument\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case 'o':	/* pmie -v output */
+	    output = optarg;
+	    break;
+
+	case 'p':	/* pmie binary */
+	    pmie = optarg;
+	    break;
+
+	case 'r':	/* copies of each rule */
+	    ncopy = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || ncopy < 1) {
+		fprintf(stderr, "%s: -r requires numeric argument\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case 'u':	/* samples between value changes */
+	    update = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || update < 1) {
+		fprintf(stderr, "%s: -u requires numeric argument\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case '?':
+	default:
+	    errflag++;
+	    break;
+	}
+    }
+
+    if (errflag || optind != argc - 1) {
+	fprintf(stderr,
+"Usage: %s [options] archive\n\
+\n\
+Options:\n\
+  -i count	instances [default 1000]\n\
+  -n count	samples [default 10]\n\
+  -o file	pmie -v output [default /dev/null]\n\
+  -p pmie	pmie binary [default pmie]\n\
+  -r count	copies of each rule [default 1]\n\
+  -u count	samples between value changes [default 1]\n",
+		pmGetProgname());
+	exit(1);
+    }
+    archive = argv[optind];
+
+    mkarchive(archive, ninst, samples, update);
+
+    pmsprintf(config, sizeof(config), "%s.config", archive);
+    if ((f = fopen(config, "w")) == NULL) {
+	fprintf(stderr, "%s: %s: %s\n", pmGetProgname(), config, strerror(errno));
+	exit(1);
+    }
+    fprintf(f, "delta = 1 sec;\n");
+    for (i = 0; i < ncopy * NRULES; i++)
+	fprintf(f, "r%02d_%03d = %s;\n", (int)(i % NRULES), (int)(i / NRULES),
+		rules[i % NRULES]);
+    fclose(f);
+
+    fflush(stdout);
+    pmtimevalNow(&start);
+    if ((pid = fork()) == 0) {
+	if (freopen(output, "w", stdout) == NULL) {
+	    fprintf(stderr, "%s: %s: %s\n", pmGetProgname(), output, strerror(errno));
+	    _exit(1);
+	}
+	execlp(pmie, pmie, "-z", "-v", "-a", archive, "-c", config, NULL);
+	fprintf(stderr, "%s: exec %s: %s\n", pmGetProgname(), pmie, strerror(errno));
+	_exit(1);
+    }
+    if (pid < 0 || waitpid(pid, &sts, 0) < 0) {
+	fprintf(stderr, "%s: fork/wait: %s\n", pmGetProgname(), strerror(errno));
+	exit(1);
+    }
+    t = elapsed(&start);
+    if (!WIFEXITED(sts) || WEXITSTATUS(sts) != 0) {
+	fprintf(stderr, "%s: %s failed, status %d\n", pmGetProgname(), pmie, sts);
+	exit(1);
+    }
+
+    printf("%d rules, %d instances, %d samples: %.3f sec\n",
+	    (int)(ncopy * NRULES), ninst, samples, t);
+    printf("%.0f rule evaluations/sec, %.0f instance values/sec\n",
+	    ncopy * NRULES * samples / t, (double)ncopy * NRULES * samples * ninst / t);
+
+    exit(0);
+}
@@ -0,0 +1,182 @@
+/*
+ * Benchmark for proc PMDA fetch latency with N processes.
+ *
+ * Starts nprocs idle child processes, then times pmFetch of a set of
+ * per-process metrics (by default the psinfo, schedstat and io values
+ * a process monitoring tool would use) for every process on the host.
+ * Run it against the proc PMDA with and without the taskstats backend
+ * or worker threads, e.g. with PROC_TASKSTATS=0 and PROC_TASKSTATS=1,
+ * or PROC_WORKERS=0 and PROC_WORKERS=4, in the environment for a local
+ * context:
+ *
+ *	proc_bench -L -K clear -K add,3,$PCP_PMDAS_DIR/proc/pmda_proc.so,proc_init
+ *
+ * Copyright (c) 2026 Red Hat.
+ */
+
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <pcp/pmapi.h>
+
+static char	*defmetrics[] = {
+    "proc.psinfo.utime",
+    "proc.psinfo.stime",
+    "proc.psinfo.rss",
+    "proc.schedstat.cpu_time",
+    "proc.schedstat.run_delay",
+    "proc.schedstat.pcount",
+    "proc.io.read_bytes",
+    "proc.io.write_bytes",
+};
+
+static pmLongOptions longopts[] = {
+    PMAPI_OPTIONS_HEADER("General options"),
+    PMOPT_DEBUG,
+    PMOPT_HOST,
+    PMOPT_SPECLOCAL,
+    PMOPT_LOCALPMDA,
+    PMOPT_HELP,
+    PMAPI_OPTIONS_HEADER("Benchmark options"),
+    { "iterations", 1, 'i', "N", "number of timed fetches [default 20]" },
+    { "processes", 1, 'c', "N", "idle processes to start [default 1000]" },
+    PMAPI_OPTIONS_END
+};
+
+static pmOptions opts = {
+    .short_options = "c:D:h:i:K:L?",
+    .long_options = longopts,
+    .short_usage = "[options] [metric ...]",
+};
+
+static double
+elapsed(struct timeval *start)
+{
+    struct timeval	now;
+
+    pmtimevalNow(&now);
+    return pmtimevalSub(&now, start);
+}
+
+int
+main(int argc, char **argv)
+{
+    int			c;
+    int			sts;
+    int			ctx;
+    int			iterations = 20;
+    int			nprocs = 1000;
+    int			nmetrics;
+    char		**metrics;
+    char		*endnum;
+    pid_t		*children;
+    pmID		*pmids;
+    pmResult		*rp;
+    struct timeval	start;
+    double		t;
+    int			i, j, nvalues = 0, ninst = 0;
+
+    pmSetProgname(argv[0]);
+
+    while ((c = pmGetOptions(argc, argv, &opts)) != EOF) {
+	switch (c) {
+
+	case 'c':	/* idle child processes */
+	    nprocs = (int)strtol(opts.optarg, &endnum, 10);
+	    if (*endnum != '\0' || nprocs < 0) {
+		pmprintf("%s: -c requires numeric argument\n", pmGetProgname());
+		opts.errors++;
+	    }
+	    break;
+
+	case 'i':	/* timed fetches */
+	    iterations = (int)strtol(opts.optarg, &endnum, 10);
+	    if (*endnum != '\0' || iterations < 1) {
+		pmprintf("%s: -i requires numeric argument\n", pmGetProgname());
+		opts.errors++;
+	    }
+	    break;
+	}
+    }
+
+    if (opts.errors || (opts.flags & PM_OPTFLAG_EXIT)) {
+	sts = !(opts.flags & PM_OPTFLAG_EXIT);
+	pmUsageMessage(&opts);
+	exit(sts);
+    }
+
+    if (opts.optind < argc) {
+	metrics = &argv[opts.optind];
+	nmetrics = argc - opts.optind;
+    }
+    else {
+	metrics = defmetrics;
+	nmetrics = sizeof(defmetrics) / sizeof(defmetrics[0]);
+    }
+
+    if (opts.Lflag)
+	ctx = pmNewContext(PM_CONTEXT_LOCAL, NULL);
+    else
+	ctx = pmNewContext(PM_CONTEXT_HOST, opts.nhosts ? opts.hosts[0] : "local:");
+    if (ctx < 0) {
+	fprintf(stderr, "%s: pmNewContext: %s\n", pmGetProgname(), pmErrStr(ctx));
+	exit(1);
+    }
+    if ((pmids = (pmID *)malloc(nmetrics * sizeof(pmID))) == NULL ||
+	(children = (pid_t *)malloc((nprocs + 1) * sizeof(pid_t))) == NULL) {
+	fprintf(stderr, "%s: out of memory\n", pmGetProgname());
+	exit(1);
+    }
+    if ((sts = pmLookupName(nmetrics, metrics, pmids)) < 0) {
+	fprintf(stderr, "%s: pmLookupName: %s\n", pmGetProgname(), pmErrStr(sts));
+	exit(1);
+    }
+
+    pmtimevalNow(&start);
+    for (i = 0; i < nprocs; i++) {
+	if ((children[i] = fork()) == 0) {
+	    pause();
+	    _exit(0);
+	}
+	if (children[i] < 0) {
+	    fprintf(stderr, "%s: fork: %s\n", pmGetProgname(), strerror(errno));
+	    nprocs = i;
+	    break;
+	}
+    }
+    printf("started %d processes in %.3f sec\n", nprocs, elapsed(&start));
+
+    /* first fetch populates the PMDA caches, not timed */
+    if ((sts = pmFetch(nmetrics, pmids, &rp)) < 0) {
+	fprintf(stderr, "%s: pmFetch: %s\n", pmGetProgname(), pmErrStr(sts));
+	goto done;
+    }
+    pmFreeResult(rp);
+
+    pmtimevalNow(&start);
+    for (i = 0; i < iterations; i++) {
+	if ((sts = pmFetch(nmetrics, pmids, &rp)) < 0) {
+	    fprintf(stderr, "%s: pmFetch: %s\n", pmGetProgname(), pmErrStr(sts));
+	    goto done;
+	}
+	for (j = 0, nvalues = 0; j < rp->numpmid; j++) {
+	    if (rp->vset[j]->numval > 0)
+		nvalues += rp->vset[j]->numval;
+	}
+	ninst = rp->vset[0]->numval;
+	pmFreeResult(rp);
+    }
+    t = elapsed(&start);
+    printf("%d metrics, %d processes, %d values per fetch\n",
+	    nmetrics, ninst, nvalues);
+    printf("pmFetch: %d fetches in %.3f sec (%.3f msec/fetch, %.3f usec/process)\n",
+	    iterations, t, t * 1e3 / iterations,
+	    ninst ? t * 1e6 / iterations / ninst : 0.0);
+
+done:
+    for (i = 0; i < nprocs; i++)
+	kill(children[i], SIGTERM);
+    for (i = 0; i < nprocs; i++)
+	waitpid(children[i], NULL, 0);
+    exit(sts < 0);
+}
@@ -0,0 +1,238 @@
+/*
+ * Benchmark for libpcp_trace call latency over each of the transports.
+ *
+ * For each transport (-T, any of sync, async and shm, default all of
+ * them) a child process makes -n pmtracepoint(3) calls (or the -c call
+ * type) from each of -t threads, timing every call, and reports the
+ * mean and percentiles of the call latency, e.g.
+ *
+ *	trace_bench -n 100000 -t 4
+ *
+ * The socket transports (sync and async) need pmdatrace to be running,
+ * and so does the shm transport for the data to go anywhere, but not
+ * for the calls to succeed.
+ *
+ * Copyright (c) 2026 Red Hat.
+ */
+
+#include <pcp/pmapi.h>
+#include <pcp/trace.h>
+#include <pthread.h>
+#include <sys/wait.h>
+
+static int	ncalls = 10000;
+static int	nthreads = 1;
+static char	*call = "point";
+
+typedef struct {
+    int		id;
+    double	*lat;		/* nsec for each call */
+    int		errors;
+} bench_t;
+
+static double
+nsec(struct timespec *a, struct timespec *b)
+{
+    return (b->tv_sec - a->tv_sec) * 1e9 + (b->tv_nsec - a->tv_nsec);
+}
+
+static int
+compare(const void *a, const void *b)
+{
+    double	x = *(const double *)a;
+    double	y = *(const double *)b;
+
+    return (x < y) ? -1 : (x > y);
+}
+
+static void *
+worker(void *arg)
+{
+    bench_t		*bp = (bench_t *)arg;
+    struct timespec	start, end;
+    char		tag[32];
+    int			sts = 0;
+    int			i;
+
+    pmsprintf(tag, sizeof(tag), "bench.%s.%d", call, bp->id);
+    for (i = 0; i < ncalls; i++) {
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	switch (call[0]) {
+	case 'p':
+	    sts = pmtracepoint(tag);
+	    break;
+	case 'o':
+	    sts = pmtraceobs(tag, (double)i);
+	    break;
+	case 'c':
+	    sts = pmtracecounter(tag, (double)i);
+	    break;
+	case 't':
+	    if ((sts = pmtracebegin(tag)) >= 0)
+		sts = pmtraceend(tag);
+	    break;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	bp->lat[i] = nsec(&start, &end);
+	if (sts < 0 && bp->errors++ == 0)
+	    fprintf(stderr, "%s: %s: %s\n", pmGetProgname(), tag,
+			pmtraceerrstr(sts));
+    }
+    return NULL;
+}
+
+static void
+bench(const char *transport, int state)
+{
+    pthread_t		*tids;
+    bench_t		*bp;
+    double		*all;
+    double		sum = 0;
+    struct timespec	start, end;
+    double		elapsed;
+    int			total = ncalls * nthreads;
+    int			errors = 0;
+    int			sts;
+    int			i;
+
+    tids = (pthread_t *)malloc(nthreads * sizeof(pthread_t));
+    bp = (bench_t *)malloc(nthreads * sizeof(bench_t));
+    all = (double *)malloc(total * sizeof(double));
+    if (tids == NULL || bp == NULL || all == NULL) {
+	fprintf(stderr, "%s: out of memory\n", pmGetProgname());
+	exit(1);
+    }
+
+    if ((sts = pmtracestate(state)) < 0) {
+	fprintf(stderr, "%s: pmtracestate(%d): %s\n", pmGetProgname(),
+		state, pmtraceerrstr(sts));
+	exit(1);
+    }
+    /* connect (or create the ring) outside of the timed calls */
+    if ((sts = pmtracepoint("bench.connect")) < 0) {
+	printf("%-6s %s\n", transport, pmtraceerrstr(sts));
+	exit(1);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < nthreads; i++) {
+	bp[i].id = i;
+	bp[i].lat = &all[i * ncalls];
+	bp[i].errors = 0;
+	if ((sts = pthread_create(&tids[i], NULL, worker, &bp[i])) != 0) {
+	    fprintf(stderr, "%s: pthread_create: %s\n", pmGetProgname(),
+		    strerror(sts));
+	    exit(1);
+	}
+    }
+    for (i = 0; i < nthreads; i++) {
+	pthread_join(tids[i], NULL);
+	errors += bp[i].errors;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    elapsed = nsec(&start, &end);
+
+    for (i = 0; i < total; i++)
+	sum += all[i];
+    qsort(all, total, sizeof(double), compare);
+    printf("%-6s %10.0f %8.3f %8.3f %8.3f %8.3f %10.3f %7d\n", transport,
+	    total * 1e9 / elapsed, sum / total / 1000,
+	    all[total / 2] / 1000, all[(int)(total * 0.99)] / 1000,
+	    all[(int)(total * 0.999)] / 1000, all[total - 1] / 1000, errors);
+    exit(0);
+}
+
+int
+main(int argc, char **argv)
+{
+    int		c;
+    int		sts;
+    int		errflag = 0;
+    char	*transports = "sync,async,shm";
+    char	*endnum;
+    char	*tp;
+    pid_t	pid;
+
+    pmSetProgname(argv[0]);
+
+    while ((c = getopt(argc, argv, "c:n:t:T:?")) != EOF) {
+	switch (c) {
+
+	case 'c':	/* trace call type */
+	    call = optarg;
+	    if (strcmp(call, "point") != 0 && strcmp(call, "obs") != 0 &&
+		strcmp(call, "counter") != 0 && strcmp(call, "transact") != 0) {
+		fprintf(stderr, "%s: -c requires point, obs, counter or transact\n",
+			pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case 'n':	/* calls per thread */
+	    ncalls = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || ncalls < 1) {
+		fprintf(stderr, "%s: -n requires numeric argument\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case 't':	/* threads */
+	    nthreads = (int)strtol(optarg, &endnum, 10);
+	    if (*endnum != '\0' || nthreads < 1) {
+		fprintf(stderr, "%s: -t requires numeric argument\n", pmGetProgname());
+		errflag++;
+	    }
+	    break;
+
+	case 'T':	/* transports */
+	    transports = optarg;
+	    break;
+
+	case '?':
+	default:
+	    errflag++;
+	    break;
+	}
+    }
+
+    if (errflag || optind != argc) {
+	fprintf(stderr,
+"Usage: %s [options]\n\
+\n\
+Options:\n\
+  -c call	trace call, point, obs, counter or transact [default point]\n\
+  -n count	calls per thread [default 10000]\n\
+  -t count	threads [default 1]\n\
+  -T list	transports, any of sync, async and shm [default all]\n",
+		pmGetProgname());
+	exit(1);
+    }
+
+    printf("%d %s calls from each of %d threads, latency in usec\n",
+	    ncalls, call, nthreads);
+    printf("%-6s %10s %8s %8s %8s %8s %10s %7s\n", "", "calls/sec",
+	    "mean", "p50", "p99", "p99.9", "max", "errors");
+    fflush(stdout);
+
+    /* the transport is fixed once connected, so one process each */
+    transports = strdup(transports);
+    for (tp = strtok(transports, ","); tp != NULL; tp = strtok(NULL, ",")) {
+	if ((pid = fork()) == 0) {
+	    if (strcmp(tp, "sync") == 0)
+		bench(tp, PMTRACE_STATE_NONE);
+	    else if (strcmp(tp, "async") == 0)
+		bench(tp, PMTRACE_STATE_ASYNC);
+	    else if (strcmp(tp, "shm") == 0)
+		bench(tp, PMTRACE_STATE_SHM);
+	    fprintf(stderr, "%s: unknown transport \"%s\"\n", pmGetProgname(), tp);
+	    exit(1);
+	}
+	if (pid < 0 || waitpid(pid, &sts, 0) < 0) {
+	    fprintf(stderr, "%s: fork/wait: %s\n", pmGetProgname(), strerror(errno));
+	    exit(1);
+	}
+	fflush(stdout);
+    }
+
+    exit(0);
+}
@@ -69,8 +69,8 @@ _pcp_complete()
         arg_regex="-[cSsTvZ]"
     ;;
     pmlogsummary)
-        all_args="aBbFfHIilMmNnpSTVvxZz"
-        arg_regex="-[BnpSTZ]"
+        all_args="aBbFfHIilMmNnpSTVvwxZz"
+        arg_regex="-[BnpSTwZ]"
     ;;
     pmprobe)
         all_args="abdfFhIiKLnOVvZz"
@@ -664,6 +664,18 @@ typedef struct __pmLogInDom {
     int			allinbuf; 
 } __pmLogInDom;
 
+/*
+ * __pmLogInDomIndex holds the versions of one instance domain in an
+ * array (same reverse chronological order as the __pmLogInDom list),
+ * for binary searching by time.  It is rebuilt after metadata loading
+ * whenever the list for this instance domain has changed (stale).
+ */
+typedef struct __pmLogInDomIndex {
+    int			stale;
+    int			count;
+    __pmLogInDom	**versions;
+} __pmLogInDomIndex;
+
 /*
  * __pmLogText is used to hold the metric and instance domain help text
  * internally, for help text associated with an archive context.
@@ -742,6 +754,7 @@ typedef struct {
     int		l_state;	/* (when writing) log state */
     __pmHashCtl	l_hashpmid;	/* PMID hashed access */
     __pmHashCtl	l_hashindom;	/* instance domain hashed access */
+    __pmHashCtl	l_hashindomidx;	/* time index of instance domains */
     __pmHashCtl	l_hashrange;	/* ptr to first and last value in log for */
 				/* each metric */
     __pmHashCtl	l_hashlabels;	/* maps the various metadata label types */
@@ -790,7 +803,7 @@ typedef struct {
     void		*ac_want;	/* used in interp.c */
     void		*ac_unbound;	/* used in interp.c */
     void		*ac_cache;	/* used in interp.c */
-    int			ac_cache_idx;	/* used in interp.c */
+    int			ac_cache_idx;	/* unused, retained for the ABI */
     /*
      * These were added to the ABI in order to support multiple archives
      * in a single context.
@@ -832,6 +845,7 @@ typedef struct {
 PCP_CALL extern int __pmLogChkLabel(__pmArchCtl *, __pmFILE *, __pmLogLabel *, int);
 PCP_CALL extern int __pmLogCreate(const char *, const char *, int, __pmArchCtl *);
 PCP_CALL extern __pmFILE *__pmLogNewFile(const char *, int);
+PCP_CALL extern int __pmLogSetCompress(const char *);
 PCP_CALL extern void __pmLogClose(__pmArchCtl *);
 PCP_CALL extern int __pmLogPutDesc(__pmArchCtl *, const pmDesc *, int, char **);
 PCP_CALL extern int __pmLogPutInDom(__pmArchCtl *, pmInDom, const pmTimeval *, int, int *, char **);
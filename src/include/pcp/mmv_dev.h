@@ -28,6 +28,7 @@ typedef enum mmv_toc_type {
     MMV_TOC_VALUES	= 4,	/* mmv_disk_value_t */
     MMV_TOC_STRINGS	= 5,	/* mmv_disk_string_t */
     MMV_TOC_LABELS	= 6,	/* mmv_disk_label_t */
+    MMV_TOC_STRIPES	= 7,	/* mmv_disk_stripe_t */
 } mmv_toc_type_t;
 
 /* The way the Table Of Contents is written into the file */
@@ -96,11 +97,26 @@ typedef struct mmv_disk_metric2 {
 
 typedef struct mmv_disk_value {
     pmAtomValue		value;		/* Union of all possible value types */
-    __int64_t		extra;		/* INTEGRAL(starttime)/STRING(offset) */
+    __int64_t		extra;		/* INTEGRAL(starttime)/STRING(offset)/
+					   striped counter (stripe offset) */
     __uint64_t		metric;		/* Offset into the metric section */
     __uint64_t		instance;	/* Offset into the instance section */
 } mmv_disk_value_t;
 
+/*
+ * Striped counters: each stripe slot starts on its own cache line and
+ * holds a pmAtomValue that readers add to the value it belongs to.
+ */
+#define MMV_STRIPE_SIZE	64	/* bytes per stripe slot */
+#define MMV_STRIPE_MAX	1024	/* upper bound on slots per value */
+
+typedef struct mmv_disk_stripe {
+    __uint64_t		value;		/* Offset of the striped value */
+    __uint32_t		count;		/* Number of stripe slots */
+    __uint32_t		padding;	/* zero filled, alignment bits */
+    __uint64_t		offset;		/* Offset of the first stripe slot */
+} mmv_disk_stripe_t;
+
 typedef struct mmv_disk_header {
     char		magic[4];	/* MMV\0 */
     __int32_t		version;	/* version */
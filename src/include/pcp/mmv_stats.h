@@ -139,6 +139,8 @@ extern int mmv_stats_add_metric_label(mmv_registry_t *,
 extern int mmv_stats_add_instance_label(mmv_registry_t *,
 		int, int, const char *, const char *, mmv_value_type_t, int);
 
+extern int mmv_stats_set_stripes(mmv_registry_t *, int);
+
 extern void * mmv_stats_start(mmv_registry_t *);
 extern void mmv_stats_free(mmv_registry_t *);
 
@@ -147,6 +149,16 @@ extern void mmv_inc_value(void *, pmAtomValue *, double);
 extern void mmv_set_value(void *, pmAtomValue *, double);
 extern void mmv_set_string(void *, pmAtomValue *, const char *, int);
 
+/* Atomic variants, safe for concurrent updates from many threads */
+extern void mmv_atomic_inc_value(void *, pmAtomValue *, double);
+extern void mmv_atomic_set_value(void *, pmAtomValue *, double);
+extern void mmv_stats_atomic_add(void *, const char *, const char *, double);
+extern void mmv_stats_atomic_inc(void *, const char *, const char *);
+extern void mmv_stats_atomic_set(void *, const char *, const char *, double);
+extern pmAtomValue * mmv_stats_atomic_interval_start(void *, pmAtomValue *,
+				const char *, const char *);
+extern void mmv_stats_atomic_interval_end(void *, pmAtomValue *);
+
 extern void mmv_stats_add(void *, const char *, const char *, double);
 extern void mmv_stats_inc(void *, const char *, const char *);
 extern void mmv_stats_set(void *, const char *, const char *, double);
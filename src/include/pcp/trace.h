@@ -1,4 +1,5 @@
 /*
+ * Copyright (c) 2026 Red Hat.
  * Copyright (c) 1997 Silicon Graphics, Inc.  All Rights Reserved.
  *
  * This library is free software; you can redistribute it and/or modify it
@@ -102,6 +103,7 @@ extern int pmtracestate(int code);
 #define PMTRACE_STATE_PDUBUF  8  /* debug:   internal IPC buffer management */
 #define PMTRACE_STATE_NOAGENT 16 /* debug:   no PMDA communications at all  */
 #define PMTRACE_STATE_ASYNC   32 /* control: use asynchronous PDU protocol  */
+#define PMTRACE_STATE_SHM     64 /* control: use shared memory ring buffer  */
 
 #ifdef __cplusplus
 }
@@ -1,4 +1,5 @@
 /*
+ * Copyright (c) 2026 Red Hat.
  * Copyright (c) 1997-2001,2003 Silicon Graphics, Inc.  All Rights Reserved.
  *
  * This library is free software; you can redistribute it and/or modify it
@@ -30,6 +31,8 @@ extern "C" {
 #define TRACE_ENV_NOAGENT	"PCP_TRACE_NOAGENT"
 #define TRACE_ENV_REQTIMEOUT	"PCP_TRACE_REQTIMEOUT"
 #define TRACE_ENV_RECTIMEOUT	"PCP_TRACE_RECONNECT"
+#define TRACE_ENV_SHM		"PCP_TRACE_SHM"
+#define TRACE_ENV_SHMSIZE	"PCP_TRACE_SHM_SIZE"
 #define TRACE_PORT		4323
 #define TRACE_PDU_VERSION	1
 
@@ -85,6 +88,46 @@ extern int __pmtracedecodedata(__pmTracePDU *, char **, int *, int *, int *, dou
 
 extern int __pmtraceprotocol(int);
 
+/*
+ * Shared memory transport - each process writes fixed-size records into
+ * a ring buffer in the file $PCP_TMP_DIR/trace/<pid>, which pmdatrace
+ * maps read-only and drains periodically.
+ *
+ * Writers claim a position by atomically incrementing head, then mark
+ * the record as being written (seq 0), fill it in and publish it by
+ * setting seq to position+1.  Nothing is ever written by the reader, so
+ * a slow or absent pmdatrace never blocks the writers - the oldest
+ * records are overwritten instead, and the reader counts those as lost
+ * when it finds a record from a later lap of the ring.
+ */
+#define TRACE_SHM_DIR		"trace"
+#define TRACE_SHM_MAGIC		"PCPt"
+#define TRACE_SHM_VERSION	1
+#define TRACE_SHM_RECORDS	4096	/* default, always a power of two */
+#define TRACE_SHM_MINRECORDS	64
+#define TRACE_SHM_MAXRECORDS	(1 << 20)
+
+typedef struct {
+    char		magic[4];	/* TRACE_SHM_MAGIC */
+    __int32_t		version;	/* TRACE_SHM_VERSION */
+    __int32_t		pid;		/* process writing into this ring */
+    __uint32_t		nrecords;	/* ring size, a power of two */
+    char		pad1[48];
+    __uint64_t		head;		/* next position to be claimed */
+    char		pad2[56];
+} __pmTraceShmHdr;
+
+typedef struct {
+    __uint64_t		seq;		/* position+1 when valid, else 0 */
+    double		value;
+    __int32_t		type;		/* TRACE_TYPE_* */
+    __int32_t		taglength;	/* includes the null byte */
+    char		tag[MAXTAGNAMELEN];
+} __pmTraceShmRecord;
+
+extern int __pmtraceshmopen(void);
+extern int __pmtraceshmput(const char *, int, int, double);
+
 extern int __pmstate;
 
 #ifdef __cplusplus
@@ -1,4 +1,5 @@
 /*
+ * Copyright (c) 2026 Red Hat.
  * Copyright (c) 2009 Ken McDonell.  All Rights Reserved.
  * 
  * This library is free software; you can redistribute it and/or modify it
@@ -30,6 +31,7 @@ typedef struct {		/* dynamic information for an expression node */
     int			mul_scale;	/* scale multiplier */
     int			div_scale;	/* scale divisor */
     val_t		*ivlist;	/* instance-value pairs */
+    int			ivsize;		/* allocated length of ivlist[], see plan_ivlist() */
     struct timeval	stamp;		/* timestamp from current fetch */
     double		time_scale;	/* time utilization scaling for rate() */
     int			last_numval;	/* length of last_ivlist[] */
@@ -47,12 +49,32 @@ typedef struct node {		/* expression tree node */
     info_t	*info;
 } node_t;
 
+typedef struct {		/* one step in a compiled expression */
+    int		op;		/* node_t type of np */
+    int		type;		/* operand values are promoted to this type */
+    node_t	*np;		/* values computed here go in np->info */
+    int		lscale;		/* 1 if left operand needs units scaling */
+    int		rscale;		/* 1 if right operand needs units scaling */
+    int		count;		/* step for enclosing count(), else -1 */
+} step_t;
+
+typedef struct {		/* compiled expression, see __dmcompile() */
+    int		nstep;
+    step_t	*step;		/* in evaluation order, root node last */
+    int		size;		/* allocated length of the work arrays */
+    int		*lidx;		/* operand instance pairings */
+    int		*ridx;
+    pmAtomValue	*lval;		/* operand values after type promotion */
+    pmAtomValue	*rval;
+} plan_t;
+
 typedef struct {		/* one derived metric */
     char	*name;
     int		anon;		/* 1 for anonymous derived metrics */
     pmID	pmid;
     int		bind;		/* 0/1 if bind_expr() has been called */
     node_t	*expr;		/* NULL => invalid, e.g. dup or missing operands */
+    plan_t	*plan;		/* NULL => not compiled, use eval_expr() */
 } dm_t;
 
 /*
@@ -112,5 +134,7 @@ extern int __dmdesc(__pmContext *, pmID, pmDesc *) _PCP_HIDDEN;
 extern int __dmprefetch(__pmContext *, int, const pmID *, pmID **) _PCP_HIDDEN;
 extern void __dmpostfetch(__pmContext *, pmResult **) _PCP_HIDDEN;
 extern void __dmdumpexpr(node_t *, int) _PCP_HIDDEN;
+extern plan_t *__dmcompile(node_t *) _PCP_HIDDEN;
+extern void __dmfreeplan(plan_t *) _PCP_HIDDEN;
 
 #endif	/* _DERIVE_H */
@@ -1,4 +1,5 @@
 /*
+ * Copyright (c) 2026 Red Hat.
  * Copyright (c) 2009,2014 Ken McDonell.  All Rights Reserved.
  * 
  * This library is free software; you can redistribute it and/or modify it
@@ -179,6 +180,7 @@ free_ivlist(node_t *np)
 	np->info->last_numval = np->info->numval;
 	np->info->last_ivlist = np->info->ivlist;
 	np->info->ivlist = NULL;
+	np->info->ivsize = 0;
     }
     else {
 	/* no history */
@@ -202,6 +204,7 @@ free_ivlist(node_t *np)
 	free(np->info->ivlist);
 	np->info->numval = 0;
 	np->info->ivlist = NULL;
+	np->info->ivsize = 0;
     }
 }
 
@@ -1554,6 +1557,692 @@ eval_expr(__pmContext *ctxp, node_t *np, pmResult *rp, int level)
     /*NOTREACHED*/
 }
 
+/*
+ * Compiled expressions.
+ *
+ * eval_expr() walks the expression tree for every fetch, and for every
+ * value of a binary operator bin_op() dispatches on the operator and
+ * on the operand and result types.  For the common expressions (metrics,
+ * constants, the arithmetic, relational and boolean operators, unary
+ * minus and not, and the instance aggregation functions) __dmcompile()
+ * flattens the tree at bind time into a list of steps in evaluation
+ * order, with the promoted operand type and the need for units scaling
+ * resolved up front.  eval_plan() then computes each step for all of
+ * the instances in a few tight loops.
+ *
+ * Each step leaves its values in the info block of its node, exactly
+ * as eval_expr() would, so the results are the same and __dmpostfetch()
+ * does not need to know which was used.  The ivlist[] of each node is
+ * kept from one fetch to the next, rather than being freed and
+ * allocated again.
+ *
+ * Expressions with any other operator (delta(), rate(), instant(), ?:,
+ * rescale(), defined(), ...) or non-numeric operands are not compiled,
+ * and are evaluated by eval_expr().  So are all expressions when the
+ * derive debug option is set, so that the diagnostics are the same.
+ */
+
+static int
+plan_node(node_t *np)
+{
+    if (np->info == NULL || np->save_last)
+	return 0;
+    if (np->desc.type < PM_TYPE_32 || np->desc.type > PM_TYPE_DOUBLE)
+	return 0;
+    switch (np->type) {
+	case N_NAME:
+	    return np->info->pmid != PM_ID_NULL;
+	case N_INTEGER:
+	case N_DOUBLE:
+	    return 1;
+	case N_NEG:
+	case N_NOT:
+	case N_AVG:
+	case N_COUNT:
+	case N_SUM:
+	case N_MAX:
+	case N_MIN:
+	    return np->left != NULL && np->right == NULL;
+	case N_PLUS:
+	case N_MINUS:
+	case N_STAR:
+	case N_SLASH:
+	case N_LT:
+	case N_LEQ:
+	case N_EQ:
+	case N_GEQ:
+	case N_GT:
+	case N_NEQ:
+	case N_AND:
+	case N_OR:
+	    return np->left != NULL && np->right != NULL;
+    }
+    return 0;
+}
+
+/*
+ * append the steps for np and its operands to the plan, return -1
+ * if this cannot be done
+ */
+static int
+compile_node(plan_t *pp, node_t *np)
+{
+    step_t	*sp;
+    int		first = pp->nstep;
+    int		s;
+
+    if (!plan_node(np))
+	return -1;
+    if (np->left != NULL && compile_node(pp, np->left) < 0)
+	return -1;
+    if (np->right != NULL && compile_node(pp, np->right) < 0)
+	return -1;
+
+    if ((sp = (step_t *)realloc(pp->step, (pp->nstep+1)*sizeof(step_t))) == NULL) {
+	pmNoMem("__dmcompile: step", (pp->nstep+1)*sizeof(step_t), PM_FATAL_ERR);
+	/*NOTREACHED*/
+    }
+    pp->step = sp;
+    sp = &pp->step[pp->nstep];
+    sp->op = np->type;
+    sp->np = np;
+    sp->type = np->desc.type;
+    sp->lscale = sp->rscale = 0;
+    sp->count = -1;
+    if (np->left != NULL && np->right != NULL) {
+	/* binary operator, see bin_op() */
+	if (np->left->desc.type < PM_TYPE_32 || np->left->desc.type > PM_TYPE_DOUBLE ||
+	    np->right->desc.type < PM_TYPE_32 || np->right->desc.type > PM_TYPE_DOUBLE)
+	    return -1;
+	if (np->type == N_LT || np->type == N_LEQ || np->type == N_EQ ||
+	    np->type == N_GEQ || np->type == N_GT || np->type == N_NEQ ||
+	    np->type == N_AND || np->type == N_OR)
+	    sp->type = promote[np->left->desc.type][np->right->desc.type];
+	if (sp->type == PM_TYPE_DOUBLE) {
+	    sp->lscale = np->left->info->mul_scale != 1 || np->left->info->div_scale != 1;
+	    sp->rscale = np->right->info->mul_scale != 1 || np->right->info->div_scale != 1;
+	}
+	else if (np->type == N_SLASH)
+	    return -1;
+    }
+    if (np->type == N_COUNT) {
+	/* count() maps errors in its operand to a count of zero */
+	for (s = first; s < pp->nstep; s++) {
+	    if (pp->step[s].count < 0)
+		pp->step[s].count = pp->nstep;
+	}
+    }
+    pp->nstep++;
+    return 0;
+}
+
+/*
+ * compile a bound expression, return NULL if it cannot be compiled
+ */
+plan_t *
+__dmcompile(node_t *expr)
+{
+    plan_t	*pp;
+
+    if ((pp = (plan_t *)calloc(1, sizeof(plan_t))) == NULL) {
+	pmNoMem("__dmcompile: plan", sizeof(plan_t), PM_FATAL_ERR);
+	/*NOTREACHED*/
+    }
+    if (compile_node(pp, expr) < 0) {
+	__dmfreeplan(pp);
+	return NULL;
+    }
+    return pp;
+}
+
+void
+__dmfreeplan(plan_t *pp)
+{
+    free(pp->step);
+    free(pp->lidx);
+    free(pp->ridx);
+    free(pp->lval);
+    free(pp->rval);
+    free(pp);
+}
+
+/*
+ * make sure the ivlist[] for np has room for numval values
+ */
+static void
+plan_ivlist(node_t *np, int numval)
+{
+    if (np->info->ivsize >= numval)
+	return;
+    free(np->info->ivlist);
+    if ((np->info->ivlist = (val_t *)malloc(numval*sizeof(val_t))) == NULL) {
+	pmNoMem("eval_plan: ivlist", numval*sizeof(val_t), PM_FATAL_ERR);
+	/*NOTREACHED*/
+    }
+    np->info->ivsize = numval;
+}
+
+static void
+plan_work(plan_t *pp, int numval)
+{
+    if (pp->size >= numval)
+	return;
+    free(pp->lidx);
+    free(pp->ridx);
+    free(pp->lval);
+    free(pp->rval);
+    pp->lidx = (int *)malloc(numval*sizeof(int));
+    pp->ridx = (int *)malloc(numval*sizeof(int));
+    pp->lval = (pmAtomValue *)malloc(numval*sizeof(pmAtomValue));
+    pp->rval = (pmAtomValue *)malloc(numval*sizeof(pmAtomValue));
+    if (pp->lidx == NULL || pp->ridx == NULL || pp->lval == NULL || pp->rval == NULL) {
+	pmNoMem("eval_plan: work", numval*2*(sizeof(int)+sizeof(pmAtomValue)), PM_FATAL_ERR);
+	/*NOTREACHED*/
+    }
+    pp->size = numval;
+}
+
+/*
+ * metric operand, values from the pmResult
+ */
+static int
+plan_name(node_t *np, pmResult *rp)
+{
+    pmValueSet	*vsp;
+    val_t	*vp;
+    int		numval;
+    int		i;
+    int		j;
+
+    for (j = 0; j < rp->numpmid; j++) {
+	if (np->info->pmid == rp->vset[j]->pmid)
+	    break;
+    }
+    if (j == rp->numpmid)
+	return PM_ERR_PMID;
+    vsp = rp->vset[j];
+    numval = np->info->numval = vsp->numval;
+    if (numval <= 0)
+	return numval;
+    plan_ivlist(np, numval);
+    vp = np->info->ivlist;
+
+    switch (np->desc.type) {
+	case PM_TYPE_32:
+	case PM_TYPE_U32:
+	    for (i = 0; i < numval; i++) {
+		vp[i].inst = vsp->vlist[i].inst;
+		vp[i].value.l = vsp->vlist[i].value.lval;
+	    }
+	    break;
+	case PM_TYPE_64:
+	case PM_TYPE_U64:
+	    if (vsp->valfmt != PM_VAL_DPTR && vsp->valfmt != PM_VAL_SPTR)
+		return PM_ERR_LOGREC;
+	    for (i = 0; i < numval; i++) {
+		vp[i].inst = vsp->vlist[i].inst;
+		memcpy((void *)&vp[i].value.ll, (void *)vsp->vlist[i].value.pval->vbuf, sizeof(__int64_t));
+	    }
+	    break;
+	case PM_TYPE_FLOAT:
+	    if (vsp->valfmt == PM_VAL_INSITU) {
+		/* old style insitu float */
+		for (i = 0; i < numval; i++) {
+		    vp[i].inst = vsp->vlist[i].inst;
+		    vp[i].value.l = vsp->vlist[i].value.lval;
+		}
+	    }
+	    else if (vsp->valfmt == PM_VAL_DPTR || vsp->valfmt == PM_VAL_SPTR) {
+		for (i = 0; i < numval; i++) {
+		    assert(vsp->vlist[i].value.pval->vtype == PM_TYPE_FLOAT);
+		    vp[i].inst = vsp->vlist[i].inst;
+		    memcpy((void *)&vp[i].value.f, (void *)vsp->vlist[i].value.pval->vbuf, sizeof(float));
+		}
+	    }
+	    else
+		return PM_ERR_LOGREC;
+	    break;
+	case PM_TYPE_DOUBLE:
+	    if (vsp->valfmt != PM_VAL_DPTR && vsp->valfmt != PM_VAL_SPTR)
+		return PM_ERR_LOGREC;
+	    for (i = 0; i < numval; i++) {
+		vp[i].inst = vsp->vlist[i].inst;
+		memcpy((void *)&vp[i].value.d, (void *)vsp->vlist[i].value.pval->vbuf, sizeof(double));
+	    }
+	    break;
+    }
+    return numval;
+}
+
+/*
+ * operand values for a binary operator, promoted to the type of the
+ * operation (and units scaled) as in bin_op()
+ */
+static void
+plan_promote(pmAtomValue *out, const val_t *in, const int *idx, int n, int from, int to, int scale, int mul, int div)
+{
+    int		k;
+
+    switch (to) {
+	case PM_TYPE_64:
+	    if (from == PM_TYPE_32) {
+		for (k = 0; k < n; k++)
+		    out[k].ll = in[idx[k]].value.l;
+		return;
+	    }
+	    if (from == PM_TYPE_U32) {
+		for (k = 0; k < n; k++)
+		    out[k].ll = in[idx[k]].value.ul;
+		return;
+	    }
+	    break;
+	case PM_TYPE_U64:
+	    if (from == PM_TYPE_32) {
+		for (k = 0; k < n; k++)
+		    out[k].ull = in[idx[k]].value.l;
+		return;
+	    }
+	    if (from == PM_TYPE_U32) {
+		for (k = 0; k < n; k++)
+		    out[k].ull = in[idx[k]].value.ul;
+		return;
+	    }
+	    break;
+	case PM_TYPE_FLOAT:
+	    switch (from) {
+		case PM_TYPE_32:
+		    for (k = 0; k < n; k++)
+			out[k].f = in[idx[k]].value.l;
+		    return;
+		case PM_TYPE_U32:
+		    for (k = 0; k < n; k++)
+			out[k].f = in[idx[k]].value.ul;
+		    return;
+		case PM_TYPE_64:
+		    for (k = 0; k < n; k++)
+			out[k].f = in[idx[k]].value.ll;
+		    return;
+		case PM_TYPE_U64:
+		    for (k = 0; k < n; k++)
+			out[k].f = in[idx[k]].value.ull;
+		    return;
+	    }
+	    break;
+	case PM_TYPE_DOUBLE:
+	    switch (from) {
+		case PM_TYPE_32:
+		    for (k = 0; k < n; k++)
+			out[k].d = in[idx[k]].value.l;
+		    break;
+		case PM_TYPE_U32:
+		    for (k = 0; k < n; k++)
+			out[k].d = in[idx[k]].value.ul;
+		    break;
+		case PM_TYPE_64:
+		    for (k = 0; k < n; k++)
+			out[k].d = in[idx[k]].value.ll;
+		    break;
+		case PM_TYPE_U64:
+		    for (k = 0; k < n; k++)
+			out[k].d = in[idx[k]].value.ull;
+		    break;
+		case PM_TYPE_FLOAT:
+		    for (k = 0; k < n; k++)
+			out[k].d = in[idx[k]].value.f;
+		    break;
+		case PM_TYPE_DOUBLE:
+		    for (k = 0; k < n; k++)
+			out[k].d = in[idx[k]].value.d;
+		    break;
+	    }
+	    if (scale) {
+		for (k = 0; k < n; k++)
+		    out[k].d = (out[k].d / div) * mul;
+	    }
+	    return;
+    }
+    /* no promotion needed */
+    for (k = 0; k < n; k++)
+	out[k] = in[idx[k]].value;
+}
+
+#define PLAN_LOOP(expr) for (k = 0; k < n; k++) expr; break
+
+/* arithmetic, result is the same type as the operands */
+#define PLAN_ARITH(f) \
+	case N_PLUS:	PLAN_LOOP(res[k].value.f = a[k].f + b[k].f); \
+	case N_MINUS:	PLAN_LOOP(res[k].value.f = a[k].f - b[k].f); \
+	case N_STAR:	PLAN_LOOP(res[k].value.f = a[k].f * b[k].f)
+
+/* relational and boolean, result is always U32 */
+#define PLAN_BOOL(f) \
+	case N_LT:	PLAN_LOOP(res[k].value.ul = a[k].f < b[k].f); \
+	case N_LEQ:	PLAN_LOOP(res[k].value.ul = a[k].f <= b[k].f); \
+	case N_EQ:	PLAN_LOOP(res[k].value.ul = a[k].f == b[k].f); \
+	case N_GEQ:	PLAN_LOOP(res[k].value.ul = a[k].f >= b[k].f); \
+	case N_GT:	PLAN_LOOP(res[k].value.ul = a[k].f > b[k].f); \
+	case N_NEQ:	PLAN_LOOP(res[k].value.ul = a[k].f != b[k].f); \
+	case N_AND:	PLAN_LOOP(res[k].value.ul = (a[k].f != 0) && (b[k].f != 0)); \
+	case N_OR:	PLAN_LOOP(res[k].value.ul = (a[k].f != 0) || (b[k].f != 0))
+
+static void
+plan_op(int op, int type, val_t *res, const pmAtomValue *a, const pmAtomValue *b, int n)
+{
+    int		k;
+
+    switch (type) {
+	case PM_TYPE_32:
+	    switch (op) {
+		PLAN_ARITH(l);
+		PLAN_BOOL(l);
+	    }
+	    break;
+	case PM_TYPE_U32:
+	    switch (op) {
+		PLAN_ARITH(ul);
+		PLAN_BOOL(ul);
+	    }
+	    break;
+	case PM_TYPE_64:
+	    switch (op) {
+		PLAN_ARITH(ll);
+		PLAN_BOOL(ll);
+	    }
+	    break;
+	case PM_TYPE_U64:
+	    switch (op) {
+		PLAN_ARITH(ull);
+		PLAN_BOOL(ull);
+	    }
+	    break;
+	case PM_TYPE_FLOAT:
+	    switch (op) {
+		PLAN_ARITH(f);
+		PLAN_BOOL(f);
+	    }
+	    break;
+	case PM_TYPE_DOUBLE:
+	    switch (op) {
+		PLAN_ARITH(d);
+		PLAN_BOOL(d);
+		case N_SLASH:
+		    PLAN_LOOP(res[k].value.d = (a[k].d == 0) ? 0 : a[k].d / b[k].d);
+	    }
+	    break;
+    }
+}
+
+/*
+ * binary operator ... instances are paired up exactly as in eval_expr()
+ */
+static int
+plan_binary(plan_t *pp, step_t *sp)
+{
+    node_t	*np = sp->np;
+    info_t	*lp = np->left->info;
+    info_t	*rp = np->right->info;
+    int		lindom = (np->left->desc.indom != PM_INDOM_NULL);
+    int		rindom = (np->right->desc.indom != PM_INDOM_NULL);
+    int		numval;
+    int		i;
+    int		j;
+    int		k;
+
+    if (lp->numval <= 0 || rp->numval <= 0) {
+	np->info->numval = 0;
+	return 0;
+    }
+    if (!lindom)
+	numval = rp->numval;
+    else if (!rindom)
+	numval = lp->numval;
+    else
+	numval = lp->numval <= rp->numval ? lp->numval : rp->numval;
+    plan_work(pp, numval);
+    plan_ivlist(np, numval);
+
+    for (i = j = k = 0; k < numval; ) {
+	if (i >= lp->numval || j >= rp->numval)
+	    /* run out of operand instances */
+	    break;
+	if (lindom && rindom && lp->ivlist[i].inst != rp->ivlist[j].inst) {
+	    /* left ith inst != right jth inst ... search in right */
+	    for (j = 0; j < rp->numval; j++) {
+		if (lp->ivlist[i].inst == rp->ivlist[j].inst)
+		    break;
+	    }
+	    if (j == rp->numval) {
+		/* no match, next left instance and rescan right */
+		i++;
+		j = 0;
+		continue;
+	    }
+	}
+	pp->lidx[k] = i;
+	pp->ridx[k] = j;
+	np->info->ivlist[k].inst = lindom ? lp->ivlist[i].inst : rp->ivlist[j].inst;
+	k++;
+	if (lindom) {
+	    i++;
+	    if (rindom) {
+		j++;
+		if (j >= rp->numval)
+		    j = 0;
+	    }
+	}
+	else if (rindom)
+	    j++;
+    }
+    np->info->numval = k;
+
+    plan_promote(pp->lval, lp->ivlist, pp->lidx, k, np->left->desc.type,
+		sp->type, sp->lscale, lp->mul_scale, lp->div_scale);
+    plan_promote(pp->rval, rp->ivlist, pp->ridx, k, np->right->desc.type,
+		sp->type, sp->rscale, rp->mul_scale, rp->div_scale);
+    plan_op(sp->op, sp->type, np->info->ivlist, pp->lval, pp->rval, k);
+
+    return k;
+}
+
+/*
+ * unary minus and not, as in eval_expr()
+ */
+static int
+plan_unary(node_t *np)
+{
+    val_t	*res;
+    val_t	*a = np->left->info->ivlist;
+    int		n = np->left->info->numval;
+    int		k;
+
+    np->info->numval = n;
+    if (n <= 0)
+	return n;
+    plan_ivlist(np, n);
+    res = np->info->ivlist;
+    for (k = 0; k < n; k++)
+	res[k].inst = a[k].inst;
+
+    if (np->type == N_NOT) {
+	switch (np->left->desc.type) {
+	    case PM_TYPE_32:	PLAN_LOOP(res[k].value.ul = (a[k].value.l == 0));
+	    case PM_TYPE_U32:	PLAN_LOOP(res[k].value.ul = (a[k].value.ul == 0));
+	    case PM_TYPE_64:	PLAN_LOOP(res[k].value.ul = (a[k].value.ll == 0));
+	    case PM_TYPE_U64:	PLAN_LOOP(res[k].value.ul = (a[k].value.ull == 0));
+	    case PM_TYPE_FLOAT:	PLAN_LOOP(res[k].value.ul = (a[k].value.f == 0));
+	    case PM_TYPE_DOUBLE:	PLAN_LOOP(res[k].value.ul = (a[k].value.d == 0));
+	}
+    }
+    else {
+	switch (np->left->desc.type) {
+	    case PM_TYPE_32:	PLAN_LOOP(res[k].value.l = -a[k].value.l);
+	    case PM_TYPE_U32:	PLAN_LOOP(res[k].value.l = -a[k].value.ul);
+	    case PM_TYPE_64:	PLAN_LOOP(res[k].value.ll = -a[k].value.ll);
+	    case PM_TYPE_U64:	PLAN_LOOP(res[k].value.ll = -a[k].value.ull);
+	    case PM_TYPE_FLOAT:	PLAN_LOOP(res[k].value.f = -a[k].value.f);
+	    case PM_TYPE_DOUBLE:	PLAN_LOOP(res[k].value.d = -a[k].value.d);
+	}
+    }
+    return n;
+}
+
+/*
+ * instance aggregation functions, as in eval_expr() ... there is
+ * always one value, kept from one fetch to the next
+ */
+static int
+plan_aggr(node_t *np)
+{
+    pmAtomValue	*res;
+    val_t	*a = np->left->info->ivlist;
+    int		n = np->left->info->numval;
+    int		k;
+
+    if (np->info->ivlist == NULL) {
+	if ((np->info->ivlist = (val_t *)malloc(sizeof(val_t))) == NULL) {
+	    pmNoMem("eval_plan: aggr ivlist", sizeof(val_t), PM_FATAL_ERR);
+	    /*NOTREACHED*/
+	}
+	np->info->ivlist[0].inst = PM_IN_NULL;
+    }
+    np->info->numval = 1;
+    res = &np->info->ivlist[0].value;
+
+    switch (np->type) {
+	case N_COUNT:
+	    res->l = n;
+	    break;
+
+	case N_AVG:
+	    res->f = 0;
+	    switch (np->left->desc.type) {
+		case PM_TYPE_32:	PLAN_LOOP(res->f += (float)a[k].value.l / n);
+		case PM_TYPE_U32:	PLAN_LOOP(res->f += (float)a[k].value.ul / n);
+		case PM_TYPE_64:	PLAN_LOOP(res->f += (float)a[k].value.ll / n);
+		case PM_TYPE_U64:	PLAN_LOOP(res->f += (float)a[k].value.ull / n);
+		case PM_TYPE_FLOAT:	PLAN_LOOP(res->f += (float)a[k].value.f / n);
+		case PM_TYPE_DOUBLE:	PLAN_LOOP(res->f += (float)a[k].value.d / n);
+	    }
+	    break;
+
+	case N_SUM:
+	    switch (np->desc.type) {
+		case PM_TYPE_32:
+		    res->l = 0;
+		    PLAN_LOOP(res->l += a[k].value.l);
+		case PM_TYPE_U32:
+		    res->ul = 0;
+		    PLAN_LOOP(res->ul += a[k].value.ul);
+		case PM_TYPE_64:
+		    res->ll = 0;
+		    PLAN_LOOP(res->ll += a[k].value.ll);
+		case PM_TYPE_U64:
+		    res->ull = 0;
+		    PLAN_LOOP(res->ull += a[k].value.ull);
+		case PM_TYPE_FLOAT:
+		    res->f = 0;
+		    PLAN_LOOP(res->f += a[k].value.f);
+		case PM_TYPE_DOUBLE:
+		    res->d = 0;
+		    PLAN_LOOP(res->d += a[k].value.d);
+	    }
+	    break;
+
+	case N_MAX:
+	    switch (np->desc.type) {
+		case PM_TYPE_32:
+		    PLAN_LOOP(if (k == 0 || res->l < a[k].value.l) res->l = a[k].value.l);
+		case PM_TYPE_U32:
+		    PLAN_LOOP(if (k == 0 || res->ul < a[k].value.ul) res->ul = a[k].value.ul);
+		case PM_TYPE_64:
+		    PLAN_LOOP(if (k == 0 || res->ll < a[k].value.ll) res->ll = a[k].value.ll);
+		case PM_TYPE_U64:
+		    PLAN_LOOP(if (k == 0 || res->ull < a[k].value.ull) res->ull = a[k].value.ull);
+		case PM_TYPE_FLOAT:
+		    PLAN_LOOP(if (k == 0 || res->f < a[k].value.f) res->f = a[k].value.f);
+		case PM_TYPE_DOUBLE:
+		    PLAN_LOOP(if (k == 0 || res->d < a[k].value.d) res->d = a[k].value.d);
+	    }
+	    break;
+
+	case N_MIN:
+	    switch (np->desc.type) {
+		case PM_TYPE_32:
+		    PLAN_LOOP(if (k == 0 || res->l > a[k].value.l) res->l = a[k].value.l);
+		case PM_TYPE_U32:
+		    PLAN_LOOP(if (k == 0 || res->ul > a[k].value.ul) res->ul = a[k].value.ul);
+		case PM_TYPE_64:
+		    PLAN_LOOP(if (k == 0 || res->ll > a[k].value.ll) res->ll = a[k].value.ll);
+		case PM_TYPE_U64:
+		    PLAN_LOOP(if (k == 0 || res->ull > a[k].value.ull) res->ull = a[k].value.ull);
+		case PM_TYPE_FLOAT:
+		    PLAN_LOOP(if (k == 0 || res->f > a[k].value.f) res->f = a[k].value.f);
+		case PM_TYPE_DOUBLE:
+		    PLAN_LOOP(if (k == 0 || res->d > a[k].value.d) res->d = a[k].value.d);
+	    }
+	    break;
+    }
+    return 1;
+}
+
+/*
+ * Evaluate a compiled expression, returns the same as eval_expr()
+ * for the root node of the expression.
+ */
+static int
+eval_plan(__pmContext *ctxp, plan_t *pp, pmResult *rp)
+{
+    step_t	*sp;
+    node_t	*np;
+    int		sts;
+    int		s;
+
+    for (s = 0; s < pp->nstep; s++) {
+	sp = &pp->step[s];
+	switch (sp->op) {
+	    case N_NAME:
+		sts = plan_name(sp->np, rp);
+		break;
+	    case N_INTEGER:
+	    case N_DOUBLE:
+		/* constant, initialized the first time through */
+		sts = eval_expr(ctxp, sp->np, rp, 1);
+		break;
+	    case N_NEG:
+	    case N_NOT:
+		sts = plan_unary(sp->np);
+		break;
+	    case N_AVG:
+	    case N_COUNT:
+	    case N_SUM:
+	    case N_MAX:
+	    case N_MIN:
+		sts = plan_aggr(sp->np);
+		break;
+	    default:
+		sts = plan_binary(pp, sp);
+		break;
+	}
+	if (sts < 0) {
+	    if (sp->count < 0)
+		return sts;
+	    /* error in the operand of count(), skip to the count() */
+	    s = sp->count;
+	    np = pp->step[s].np;
+	    if (np->info->ivlist == NULL) {
+		if ((np->info->ivlist = (val_t *)malloc(sizeof(val_t))) == NULL) {
+		    pmNoMem("eval_plan: count ivlist", sizeof(val_t), PM_FATAL_ERR);
+		    /*NOTREACHED*/
+		}
+		np->info->ivlist[0].inst = PM_IN_NULL;
+	    }
+	    np->info->numval = 1;
+	    np->info->ivlist[0].value.l = 0;
+	}
+    }
+    return pp->step[pp->nstep-1].np->info->numval;
+}
+
 /*
  * Algorithm here is complicated by trying to re-write the pmResult.
  *
@@ -1632,7 +2321,10 @@ __dmpostfetch(__pmContext *ctxp, pmResult **result)
 			    valfmt = PM_VAL_INSITU;
 			else
 			    valfmt = PM_VAL_DPTR;
-			numval = eval_expr(ctxp, cp->mlist[m].expr, rp, 1);
+			if (cp->mlist[m].plan != NULL && !pmDebugOptions.derive)
+			    numval = eval_plan(ctxp, cp->mlist[m].plan, rp);
+			else
+			    numval = eval_expr(ctxp, cp->mlist[m].expr, rp, 1);
     if (pmDebugOptions.derive && pmDebugOptions.appl2) {
 	int	k;
 	char	strbuf[20];
@@ -326,6 +326,9 @@ extern int pmGetInDomArchive_ctx(__pmContext *, pmInDom, int **, char ***) _PCP_
 extern int pmFetch_ctx(__pmContext *, int, pmID *, pmResult **) _PCP_HIDDEN;
 extern int pmStore_ctx(__pmContext *, const pmResult *) _PCP_HIDDEN;
 extern int __pmDecodeResult_ctx(__pmContext *, __pmPDU *, pmResult **) _PCP_HIDDEN;
+#if defined(HAVE_64BIT_PTR)
+extern int __pmDecodeLogRecord_ctx(__pmContext *, const char *, int, pmResult **) _PCP_HIDDEN;
+#endif
 extern int __pmSendResult_ctx(__pmContext *, int, int, const pmResult *) _PCP_HIDDEN;
 extern void __pmDumpResult_ctx(__pmContext *, FILE *, const pmResult *) _PCP_HIDDEN;
 extern int pmGetArchiveEnd_ctx(__pmContext *, struct timeval *) _PCP_HIDDEN;
@@ -426,6 +429,8 @@ extern pmInDomProfile *__pmFindProfile(pmInDom, const pmProfile *) _PCP_HIDDEN;
 
 extern void __pmFreeInterpData(__pmContext *) _PCP_HIDDEN;
 
+extern const char *__pmFmapped(__pmFILE *, size_t) _PCP_HIDDEN;
+
 extern void __pmDumpNameAndStatusList(FILE *, int, char **, int *) _PCP_HIDDEN;
 
 #define MAXLABELNAMELEN		((1<<8)-1)
@@ -105,18 +105,62 @@ typedef struct pmidcntl {		/* metric control */
     __pmHashCtl		hc;		/* metric-instances */
 } pmidcntl_t;
 
-typedef struct {
-    pmResult	*rp;		/* cached pmResult from __pmLogRead */
-    int		sts;		/* from __pmLogRead */
-    char	*c_name;	/* log name */
-    int		vol;		/* log volume */
-    long	head_posn;	/* posn in file before forwards __pmLogRead */
-    long	tail_posn;	/* posn in file after forwards __pmLogRead */
-    int		mode;		/* PM_MODE_FORW or PM_MODE_BACK */
-    int		used;		/* used count for LFU replacement */
+typedef struct cache {
+    pmResult		*rp;		/* cached pmResult from __pmLogRead */
+    int			sts;		/* from __pmLogRead */
+    char		*c_name;	/* log name */
+    int			vol;		/* log volume */
+    long		head_posn;	/* posn in file before forwards __pmLogRead */
+    long		tail_posn;	/* posn in file after forwards __pmLogRead */
+    int			mode;		/* PM_MODE_FORW or PM_MODE_BACK */
+    int			ahead;		/* read ahead (batch) and not used yet */
+    size_t		size;		/* approximate memory used */
+    struct cache	*prev;		/* more recently used */
+    struct cache	*next;		/* less recently used */
 } cache_t;
 
-#define NUMCACHE 4
+/*
+ * Per-context read cache ... pmResults from __pmLogRead on an LRU list
+ * bounded by (approximate) memory use, and hashed on the file position
+ * at both ends of the record so a read in either direction can hit.
+ *
+ * When consecutive misses in one direction are for adjacent records
+ * (the common case for interpolation over a long time window) the
+ * following records are read ahead, with the number read doubling on
+ * each sequential miss up to maxahead.  Records read ahead go at the
+ * LRU end of the list until they are used, so they are evicted before
+ * anything that has been.
+ */
+typedef struct {
+    cache_t		*mru;		/* most recently used */
+    cache_t		*lru;		/* least recently used, evicted first */
+    __pmHashCtl		head_hc;	/* by head_posn, for forwards reads */
+    __pmHashCtl		tail_hc;	/* by tail_posn, for backwards reads */
+    int			count;
+    size_t		bytes;
+    size_t		maxbytes;	/* $PCP_INTERP_CACHE_SIZE */
+    int			maxahead;	/* $PCP_INTERP_READAHEAD */
+    pmResult		*uncached;	/* last result returned but not cached */
+    /* read-ahead state, indexed by PM_MODE_FORW and PM_MODE_BACK */
+    __pmLogCtl		*ra_log[PM_MODE_BACK+1];
+    int			ra_vol[PM_MODE_BACK+1];
+    long		ra_posn[PM_MODE_BACK+1];	/* next sequential miss */
+    int			ra_window[PM_MODE_BACK+1];
+    /* statistics, reported for -Dinterp when the context is destroyed */
+    long		hits;
+    long		misses;
+    int			ra_batch;	/* current read-ahead, for cache_t ahead */
+    long		ahead;		/* records read ahead */
+    long		ahead_hits;	/* ... and subsequently used */
+    long		evicted;
+} cachectl_t;
+
+#define CACHE_MIN	4		/* never evict below this many entries */
+#define CACHE_SIZE	(2*1024*1024)	/* default memory bound (bytes) */
+#define CACHE_AHEAD	16		/* default maximum read-ahead (records) */
+
+static size_t	cache_size;
+static int	cache_ahead = -1;
 
 /*
  * diagnostic counters ... indexed by PM_MODE_FORW (2) and
@@ -125,6 +169,296 @@ typedef struct {
 static long	nr_cache[PM_MODE_BACK+1];
 static long	nr[PM_MODE_BACK+1];
 
+static long
+cache_env(const char *name, long dflt)
+{
+    char	*str;
+    char	*endnum;
+    long	val;
+
+    if ((str = getenv(name)) == NULL)		/* THREADSAFE */
+	return dflt;
+    val = strtol(str, &endnum, 10);
+    if (*endnum != '\0' || val < 0) {
+	/* see PCP_IGNORE_MARK_RECORDS below for why not pmprintf() */
+	fprintf(stderr, "%s: Warning: bad $%s: \"%s\", using %ld\n",
+		pmGetProgname(), name, str, dflt);
+	return dflt;
+    }
+    return val;
+}
+
+/*
+ * one-trip initialization of the per-process cache limits
+ */
+static void
+cache_config(void)
+{
+    PM_LOCK(__pmLock_extcall);
+    if (cache_ahead == -1) {
+	cache_size = (size_t)cache_env("PCP_INTERP_CACHE_SIZE", CACHE_SIZE);
+	cache_ahead = (int)cache_env("PCP_INTERP_READAHEAD", CACHE_AHEAD);
+    }
+    PM_UNLOCK(__pmLock_extcall);
+}
+
+/*
+ * Record positions are multiples of the (often constant) record length,
+ * which collide badly modulo the __pmHash table sizes, so mix the bits.
+ */
+static unsigned int
+cache_key(long posn)
+{
+    unsigned int	key = (unsigned int)posn;
+
+    key ^= key >> 16;
+    key *= 0x85ebca6b;
+    key ^= key >> 13;
+    key *= 0xc2b2ae35;
+    key ^= key >> 16;
+    return key;
+}
+
+static cache_t *
+cache_lookup(cachectl_t *ccp, __pmArchCtl *acp, int mode, long posn)
+{
+    __pmHashCtl		*hcp;
+    __pmHashNode	*hp;
+    cache_t		*cp;
+    unsigned int	key = cache_key(posn);
+
+    hcp = (mode == PM_MODE_FORW) ? &ccp->head_hc : &ccp->tail_hc;
+    for (hp = __pmHashSearch(key, hcp); hp != NULL; hp = hp->next) {
+	if (hp->key != key)
+	    continue;
+	cp = (cache_t *)hp->data;
+	if (cp->vol == acp->ac_vol &&
+	    ((mode == PM_MODE_FORW && cp->head_posn == posn) ||
+	     (mode == PM_MODE_BACK && cp->tail_posn == posn)) &&
+	    strcmp(cp->c_name, acp->ac_log->l_name) == 0)
+	    return cp;
+    }
+    return NULL;
+}
+
+static void
+cache_unlink(cachectl_t *ccp, cache_t *cp)
+{
+    if (cp->prev)
+	cp->prev->next = cp->next;
+    else
+	ccp->mru = cp->next;
+    if (cp->next)
+	cp->next->prev = cp->prev;
+    else
+	ccp->lru = cp->prev;
+    cp->prev = cp->next = NULL;
+}
+
+static void
+cache_link(cachectl_t *ccp, cache_t *cp)
+{
+    cp->prev = NULL;
+    cp->next = ccp->mru;
+    if (ccp->mru)
+	ccp->mru->prev = cp;
+    else
+	ccp->lru = cp;
+    ccp->mru = cp;
+}
+
+/* below everything else, for records read ahead */
+static void
+cache_link_lru(cachectl_t *ccp, cache_t *cp)
+{
+    cp->next = NULL;
+    cp->prev = ccp->lru;
+    if (ccp->lru)
+	ccp->lru->next = cp;
+    else
+	ccp->mru = cp;
+    ccp->lru = cp;
+}
+
+static void
+cache_free(cache_t *cp)
+{
+    if (cp->rp != NULL)
+	pmFreeResult(cp->rp);
+    if (cp->c_name != NULL)
+	free(cp->c_name);
+    free(cp);
+}
+
+/*
+ * Build a cache entry for a pmResult just read from the current
+ * volume, between file positions posn and the current position.
+ */
+static cache_t *
+cache_entry(__pmArchCtl *acp, int mode, long posn, pmResult *rp)
+{
+    cache_t	*cp;
+    int		i, n;
+
+    if ((cp = (cache_t *)calloc(1, sizeof(cache_t))) == NULL)
+	return NULL;
+    if ((cp->c_name = strdup(acp->ac_log->l_name)) == NULL) {
+	free(cp);
+	return NULL;
+    }
+    cp->rp = rp;
+    cp->vol = acp->ac_vol;
+    cp->mode = mode;
+    if (mode == PM_MODE_FORW) {
+	cp->head_posn = posn;
+	cp->tail_posn = __pmFtell(acp->ac_mfp);
+	assert(cp->tail_posn >= 0);
+    }
+    else {
+	cp->tail_posn = posn;
+	cp->head_posn = __pmFtell(acp->ac_mfp);
+	assert(cp->head_posn >= 0);
+    }
+    /*
+     * the on-disk record length is a good estimate of the PDU buffer
+     * that pmValueBlocks point into, plus the decoded value sets
+     */
+    cp->size = sizeof(cache_t) + sizeof(pmResult) + strlen(cp->c_name) +
+		(cp->tail_posn - cp->head_posn);
+    for (i = 0; i < rp->numpmid; i++) {
+	n = rp->vset[i]->numval;
+	cp->size += sizeof(pmValueSet) + (n > 1 ? (n - 1) * sizeof(pmValue) : 0);
+    }
+    return cp;
+}
+
+static int
+cache_insert(cachectl_t *ccp, cache_t *cp)
+{
+    int		sts;
+
+    if ((sts = __pmHashAdd(cache_key(cp->head_posn), cp, &ccp->head_hc)) < 0)
+	return sts;
+    if ((sts = __pmHashAdd(cache_key(cp->tail_posn), cp, &ccp->tail_hc)) < 0) {
+	__pmHashDel(cache_key(cp->head_posn), cp, &ccp->head_hc);
+	return sts;
+    }
+    if (cp->ahead)
+	cache_link_lru(ccp, cp);
+    else
+	cache_link(ccp, cp);
+    ccp->count++;
+    ccp->bytes += cp->size;
+    return 0;
+}
+
+static void
+cache_evict(cachectl_t *ccp, cache_t *cp)
+{
+    if (pmDebugOptions.log && pmDebugOptions.desperate)
+	fprintf(stderr, "cache_read: evict vol=%d head=%ld tail=%ld%s\n",
+		cp->vol, (long)cp->head_posn, (long)cp->tail_posn,
+		cp->ahead ? " (read ahead)" : "");
+    cache_unlink(ccp, cp);
+    __pmHashDel(cache_key(cp->head_posn), cp, &ccp->head_hc);
+    __pmHashDel(cache_key(cp->tail_posn), cp, &ccp->tail_hc);
+    ccp->count--;
+    ccp->bytes -= cp->size;
+    ccp->evicted++;
+    cache_free(cp);
+}
+
+/*
+ * Evict least recently used entries until we are within the memory
+ * bound, but never keep (the entry about to be returned to the caller).
+ */
+static void
+cache_trim(cachectl_t *ccp, cache_t *keep)
+{
+    cache_t	*cp = ccp->lru;
+    cache_t	*prev;
+
+    while (cp != NULL && ccp->bytes > ccp->maxbytes && ccp->count > CACHE_MIN) {
+	prev = cp->prev;
+	if (cp != keep)
+	    cache_evict(ccp, cp);
+	cp = prev;
+    }
+}
+
+/*
+ * Make room for another record read ahead in a full cache, evicting a
+ * record from an earlier read-ahead that was never used.  These are all
+ * at the LRU end, below those of this read-ahead.  Returns 0 if there
+ * is none, as records that have been used are not evicted for this.
+ */
+static int
+cache_make_room(cachectl_t *ccp)
+{
+    cache_t	*cp;
+
+    if (ccp->count <= CACHE_MIN)
+	return 0;
+    for (cp = ccp->lru; cp != NULL && cp->ahead != 0; cp = cp->prev) {
+	if (cp->ahead != ccp->ra_batch) {
+	    cache_evict(ccp, cp);
+	    return 1;
+	}
+    }
+    return 0;
+}
+
+/*
+ * Read up to n records beyond the current position in the direction
+ * of mode, without leaving the current volume (peek at ac_mfp), and
+ * cache them.  The file position is restored.  Returns the position
+ * at which the next sequential miss in this direction would occur.
+ *
+ * The records are linked at the LRU end in the order read, so the
+ * furthest ahead is evicted first.  Nothing is read when the cache is
+ * full, unless an unused record from an earlier read-ahead can make
+ * room, as cache_trim() would only evict it again.
+ */
+static long
+cache_readahead(__pmContext *ctxp, cachectl_t *ccp, int mode, int n)
+{
+    __pmArchCtl	*acp = ctxp->c_archctl;
+    pmResult	*rp;
+    cache_t	*cp;
+    long	save;
+    long	posn;
+    int		i;
+
+    save = posn = __pmFtell(acp->ac_mfp);
+    assert(save >= 0);
+    if (++ccp->ra_batch <= 0)
+	ccp->ra_batch = 1;
+    for (i = 0; i < n; i++) {
+	if (cache_lookup(ccp, acp, mode, posn) != NULL)
+	    break;
+	if (ccp->bytes >= ccp->maxbytes && !cache_make_room(ccp))
+	    break;
+	if (__pmLogRead_ctx(ctxp, mode, acp->ac_mfp, &rp, PMLOGREAD_NEXT) < 0)
+	    break;
+	if ((cp = cache_entry(acp, mode, posn, rp)) == NULL) {
+	    pmFreeResult(rp);
+	    break;
+	}
+	cp->ahead = ccp->ra_batch;
+	if (cache_insert(ccp, cp) < 0) {
+	    cache_free(cp);
+	    break;
+	}
+	ccp->ahead++;
+	posn = (mode == PM_MODE_FORW) ? cp->tail_posn : cp->head_posn;
+    }
+    if (pmDebugOptions.log && pmDebugOptions.desperate)
+	fprintf(stderr, "cache_read: read ahead %d of %d %s records\n",
+		i, n, mode == PM_MODE_FORW ? "forw" : "back");
+    __pmFseek(acp->ac_mfp, save, SEEK_SET);
+    return posn;
+}
+
 /*
  * called with the context lock held
  */
@@ -132,21 +466,38 @@ static int
 cache_read(__pmContext *ctxp, int mode, pmResult **rp)
 {
     __pmArchCtl	*acp = ctxp->c_archctl;
-    long	posn;
+    cachectl_t	*ccp;
     cache_t	*cp;
-    cache_t	*lfup;
-    cache_t	*cache;
+    pmResult	*result;
+    long	posn;
+    long	next;
     char	*save_curlog_name;
     int		sts;
     int		save_curvol;
     int		archive_changed;
 
+    if ((ccp = (cachectl_t *)acp->ac_cache) == NULL) {
+	/* cache initialization */
+	if ((ccp = (cachectl_t *)calloc(1, sizeof(cachectl_t))) == NULL)
+	    return -ENOMEM;
+	cache_config();
+	ccp->maxbytes = cache_size;
+	ccp->maxahead = cache_ahead;
+	acp->ac_cache = ccp;
+    }
+
     /*
      * If the previous __pmLogRead generated a virtual MARK record and we have
      * changed direction, then we need to generate that record again.
      */
     if (acp->ac_mark_done != 0 && acp->ac_mark_done != mode) {
+	if (ccp->uncached != NULL) {
+	    pmFreeResult(ccp->uncached);
+	    ccp->uncached = NULL;
+	}
 	sts = __pmLogGenerateMark_ctx(ctxp, acp->ac_mark_done, rp);
+	if (sts >= 0)
+	    ccp->uncached = *rp;
 	acp->ac_mark_done = 0;
 	return sts;
     }
@@ -159,16 +510,6 @@ cache_read(__pmContext *ctxp, int mode, pmResult **rp)
     else
 	posn = 0;
 
-    if (acp->ac_cache == NULL) {
-	/* cache initialization */
-	acp->ac_cache = cache = (cache_t *)calloc(NUMCACHE, sizeof(cache_t));
-	if (!cache)
-	    return -ENOMEM;
-	acp->ac_cache_idx = 0;
-    }
-    else
-	cache = acp->ac_cache;
-
     if (pmDebugOptions.log && pmDebugOptions.desperate) {
 	fprintf(stderr, "cache_read: fd=%d mode=%s vol=%d (curvol=%d) %s_posn=%ld ",
 	    __pmFileno(acp->ac_mfp),
@@ -178,42 +519,44 @@ cache_read(__pmContext *ctxp, int mode, pmResult **rp)
 	    (long)posn);
     }
 
-    acp->ac_cache_idx = (acp->ac_cache_idx + 1) % NUMCACHE;
-    lfup = &cache[acp->ac_cache_idx];
-    for (cp = cache; cp < &cache[NUMCACHE]; cp++) {
-	if (cp->c_name != NULL && strcmp(cp->c_name, acp->ac_log->l_name) == 0 &&
-	    cp->vol == acp->ac_vol &&
-	    ((mode == PM_MODE_FORW && cp->head_posn == posn) ||
-	     (mode == PM_MODE_BACK && cp->tail_posn == posn)) &&
-	    cp->rp != NULL) {
-	    *rp = cp->rp;
-	    cp->used++;
-	    if (mode == PM_MODE_FORW)
-		__pmFseek(acp->ac_mfp, cp->tail_posn, SEEK_SET);
-	    else
-		__pmFseek(acp->ac_mfp, cp->head_posn, SEEK_SET);
-	    if (pmDebugOptions.log && pmDebugOptions.desperate) {
-		pmTimeval	tmp;
-		double		t_this;
-		tmp.tv_sec = (__int32_t)cp->rp->timestamp.tv_sec;
-		tmp.tv_usec = (__int32_t)cp->rp->timestamp.tv_usec;
-		t_this = __pmTimevalSub(&tmp, __pmLogStartTime(acp));
-		fprintf(stderr, "hit cache[%d] t=%.6f\n",
-		    (int)(cp - cache), t_this);
-		nr_cache[mode]++;
-	    }
-	    acp->ac_mark_done = 0;
-	    sts = cp->sts;
-	    return sts;
+    if (posn != 0 && (cp = cache_lookup(ccp, acp, mode, posn)) != NULL) {
+	*rp = cp->rp;
+	if (cp != ccp->mru) {
+	    cache_unlink(ccp, cp);
+	    cache_link(ccp, cp);
 	}
+	if (mode == PM_MODE_FORW)
+	    __pmFseek(acp->ac_mfp, cp->tail_posn, SEEK_SET);
+	else
+	    __pmFseek(acp->ac_mfp, cp->head_posn, SEEK_SET);
+	if (pmDebugOptions.log && pmDebugOptions.desperate) {
+	    pmTimeval	tmp;
+	    double	t_this;
+	    tmp.tv_sec = (__int32_t)cp->rp->timestamp.tv_sec;
+	    tmp.tv_usec = (__int32_t)cp->rp->timestamp.tv_usec;
+	    t_this = __pmTimevalSub(&tmp, __pmLogStartTime(acp));
+	    fprintf(stderr, "hit cache%s t=%.6f\n",
+		cp->ahead ? " (read ahead)" : "", t_this);
+	    nr_cache[mode]++;
+	}
+	ccp->hits++;
+	if (cp->ahead) {
+	    cp->ahead = 0;
+	    ccp->ahead_hits++;
+	}
+	acp->ac_mark_done = 0;
+	return cp->sts;
     }
 
     if (pmDebugOptions.log && pmDebugOptions.desperate)
 	fprintf(stderr, "miss\n");
     nr[mode]++;
+    ccp->misses++;
 
-    if (lfup->rp != NULL)
-	pmFreeResult(lfup->rp);
+    if (ccp->uncached != NULL) {
+	pmFreeResult(ccp->uncached);
+	ccp->uncached = NULL;
+    }
 
     /*
      * We need to know when we cross archive or volume boundaries.
@@ -226,10 +569,13 @@ cache_read(__pmContext *ctxp, int mode, pmResult **rp)
     }
     save_curvol = acp->ac_curvol;
 
-    lfup->sts = __pmLogRead_ctx(ctxp, mode, NULL, &lfup->rp, PMLOGREAD_NEXT);
-    if (lfup->sts < 0)
-	lfup->rp = NULL;
-    *rp = lfup->rp;
+    sts = __pmLogRead_ctx(ctxp, mode, NULL, &result, PMLOGREAD_NEXT);
+    if (sts < 0) {
+	free(save_curlog_name);
+	*rp = NULL;
+	return sts;
+    }
+    *rp = result;
 
     archive_changed = strcmp(save_curlog_name, acp->ac_log->l_name) != 0;
     free(save_curlog_name);
@@ -241,54 +587,45 @@ cache_read(__pmContext *ctxp, int mode, pmResult **rp)
      * ... don't cache
      */
     if (posn == 0 || save_curvol != acp->ac_curvol || archive_changed ||
-	acp->ac_mark_done) {
-	if (lfup->c_name) {
-	    free(lfup->c_name);
-	    lfup->c_name = NULL;
-	}
+	acp->ac_mark_done ||
+	(cp = cache_entry(acp, mode, posn, result)) == NULL) {
 	if (pmDebugOptions.log && pmDebugOptions.desperate)
-	    fprintf(stderr, "cache_read: reload vol switch, mark cache[%d] unused\n",
-		(int)(lfup - cache));
+	    fprintf(stderr, "cache_read: reload vol switch, not cached\n");
+	ccp->uncached = result;
+	return sts;
     }
-    else {
-	lfup->mode = mode;
-	lfup->vol = acp->ac_vol;
-	lfup->used = 1;
-	/* Try to avoid excessive copying/freeing of the archive name. */
-	if (lfup->c_name != NULL && strcmp(lfup->c_name, acp->ac_log->l_name) != 0) {
-	    free(lfup->c_name);
-	    lfup->c_name = NULL;
-	}
-	if (lfup->c_name == NULL) {
-	    if ((lfup->c_name = strdup(acp->ac_log->l_name)) == NULL) {
-		pmNoMem("__pmLogFetchInterp.l_name",
-			  strlen(acp->ac_log->l_name) + 1, PM_FATAL_ERR);
-	    }
-	}
-	if (mode == PM_MODE_FORW) {
-	    lfup->head_posn = posn;
-	    lfup->tail_posn = __pmFtell(acp->ac_mfp);
-	    assert(lfup->tail_posn >= 0);
-	}
-	else {
-	    lfup->tail_posn = posn;
-	    lfup->head_posn = __pmFtell(acp->ac_mfp);
-	    assert(lfup->head_posn >= 0);
-	}
-	if (pmDebugOptions.log && pmDebugOptions.desperate) {
-	    fprintf(stderr, "cache_read: reload cache[%d] vol=%d (curvol=%d) head=%ld tail=%ld ",
-		(int)(lfup - cache), lfup->vol, acp->ac_curvol,
-		(long)lfup->head_posn, (long)lfup->tail_posn);
-	    if (lfup->sts == 0)
-		fprintf(stderr, "sts=%d\n", lfup->sts);
-	    else {
-		char	errmsg[PM_MAXERRMSGLEN];
-		fprintf(stderr, "sts=%s\n", pmErrStr_r(lfup->sts, errmsg, sizeof(errmsg)));
-	    }
+    if (cache_insert(ccp, cp) < 0) {
+	cp->rp = NULL;
+	cache_free(cp);
+	ccp->uncached = result;
+	return sts;
+    }
+    if (pmDebugOptions.log && pmDebugOptions.desperate)
+	fprintf(stderr, "cache_read: reload cache vol=%d (curvol=%d) head=%ld tail=%ld\n",
+	    cp->vol, acp->ac_curvol, (long)cp->head_posn, (long)cp->tail_posn);
+
+    /* adaptive read-ahead for sequential misses in this direction */
+    next = (mode == PM_MODE_FORW) ? cp->tail_posn : cp->head_posn;
+    if (ccp->maxahead > 0) {
+	if (ccp->ra_log[mode] == acp->ac_log && ccp->ra_vol[mode] == cp->vol &&
+	    ccp->ra_posn[mode] == posn) {
+	    if (ccp->ra_window[mode] == 0)
+		ccp->ra_window[mode] = 1;
+	    else if (ccp->ra_window[mode] < ccp->maxahead)
+		ccp->ra_window[mode] *= 2;
+	    if (ccp->ra_window[mode] > ccp->maxahead)
+		ccp->ra_window[mode] = ccp->maxahead;
+	    next = cache_readahead(ctxp, ccp, mode, ccp->ra_window[mode]);
 	}
+	else
+	    ccp->ra_window[mode] = 0;
+	ccp->ra_log[mode] = acp->ac_log;
+	ccp->ra_vol[mode] = cp->vol;
+	ccp->ra_posn[mode] = next;
     }
+    cache_trim(ccp, cp);
 
-    return lfup->sts;
+    return sts;
 }
 
 /*
@@ -1987,6 +2324,14 @@ __pmLogResetInterp(__pmContext *ctxp)
     }
 }
 
+static __pmHashWalkState
+cache_hash_free(const __pmHashNode *tp, void *cp)
+{
+    (void)tp;
+    (void)cp;
+    return PM_HASH_WALK_DELETE_NEXT;
+}
+
 /*
  * Free interp data when context is closed ...
  * - pinned PDU buffers holding values used for interpolation
@@ -2086,10 +2431,18 @@ __pmFreeInterpData(__pmContext *ctxp)
 
     if (ctxp->c_archctl->ac_cache != NULL) {
 	/* read cache allocated, work to be done */
-	cache_t		*cache = (cache_t *)ctxp->c_archctl->ac_cache;
+	cachectl_t	*ccp = (cachectl_t *)ctxp->c_archctl->ac_cache;
 	cache_t		*cp;
 
-	for (cp = cache; cp < &cache[NUMCACHE]; cp++) {
+	if (pmDebugOptions.interp) {
+	    fprintf(stderr, "read cache: %ld hits %ld misses, "
+			"%ld read ahead (%ld used), %ld evicted, "
+			"%d entries %ld bytes (max %ld)\n",
+		    ccp->hits, ccp->misses, ccp->ahead, ccp->ahead_hits,
+		    ccp->evicted, ccp->count, (long)ccp->bytes,
+		    (long)ccp->maxbytes);
+	}
+	while ((cp = ccp->mru) != NULL) {
 	    if (pmDebugOptions.log && pmDebugOptions.interp) {
 		fprintf(stderr, "read cache entry "
 			PRINTF_P_PFX "%p: c_name=%s rp="
@@ -2097,15 +2450,18 @@ __pmFreeInterpData(__pmContext *ctxp)
 			cp, cp->c_name ? cp->c_name : "(none)",
 			cp->rp);
 	    }
-	    if (cp->c_name != NULL) {
-		free(cp->c_name);
-		cp->c_name = NULL;
-	    }
-	    if (cp->rp != NULL) {
-		pmFreeResult(cp->rp);
-		cp->rp = NULL;
-	    }
-	    cp->used = 0;
+	    cache_unlink(ccp, cp);
+	    cache_free(cp);
+	}
+	__pmHashWalkCB(cache_hash_free, NULL, &ccp->head_hc);
+	__pmHashClear(&ccp->head_hc);
+	__pmHashWalkCB(cache_hash_free, NULL, &ccp->tail_hc);
+	__pmHashClear(&ccp->tail_hc);
+	if (ccp->uncached != NULL) {
+	    pmFreeResult(ccp->uncached);
+	    ccp->uncached = NULL;
 	}
+	ccp->count = 0;
+	ccp->bytes = 0;
     }
 }
@@ -25,6 +25,9 @@
 #include "internal.h"
 
 extern __pm_fops __pm_stdio;
+#if defined(HAVE_SYS_MMAN_H)
+extern __pm_fops __pm_mmap;
+#endif
 #if HAVE_TRANSPARENT_DECOMPRESSION && HAVE_LZMA_DECOMPRESSION
 extern __pm_fops __pm_xz;
 #endif
@@ -413,11 +416,33 @@ __pmAccess(const char *path, int amode)
     return access(path, amode);
 }
 
+#if defined(HAVE_SYS_MMAN_H)
+/*
+ * Uncompressed files opened read-only are memory mapped unless
+ * $PCP_ARCHIVE_MMAP is set to 0.
+ */
+static int
+use_mmap(void)
+{
+    char	*val;
+    int		sts = 1;
+
+    PM_LOCK(__pmLock_extcall);
+    val = getenv("PCP_ARCHIVE_MMAP");		/* THREADSAFE */
+    if (val != NULL && strcmp(val, "0") == 0)
+	sts = 0;
+    PM_UNLOCK(__pmLock_extcall);
+    return sts;
+}
+#endif
+
 /*
  * Open a PCP file with given mode and return a __pmFILE. An i/o
  * handler is automatically chosen based on filename suffix, e.g. .xz, .gz,
- * etc. The stdio pass-thru handler will be chosen for other files.
- * The stdio handler is the only handler currently supporting write operations.
+ * etc. Uncompressed files opened for reading use the mmap handler and
+ * the stdio pass-thru handler will be chosen for other files.
+ * The stdio handler supports write operations, and the xz handler
+ * supports appending to new files (mode "w").
  * Return a valid __pmFILE pointer on success or NULL on failure.
  */
 __pmFILE *
@@ -453,9 +478,19 @@ __pmFopen(const char *path, const char *mode)
 	    fputc('\n', stderr);
 	}
     }
-    if (compress_ix >= 0) {
+    if (compress_ix >= 0 && mode[0] == 'w' && mode[1] == '\0' &&
+	compress_ctl[compress_ix].appl == USE_XZ &&
+	compress_ctl[compress_ix].handler != NULL &&
+	strcmp(path, tmpname) == 0) {
+	/*
+	 * Compressed on-the-fly, append only (see io_xz.c), for names
+	 * given with the suffix, not some existing compressed file.
+	 */
+	handler = compress_ctl[compress_ix].handler;
+    }
+    else if (compress_ix >= 0) {
 	if (mode[0] != 'r' || mode[1] != '\0') {
-	    /* We don't (yet) support opening compressed files for writing. */
+	    /* We don't support opening other compressed files for writing. */
 	    return NULL;
 	}
 
@@ -474,6 +509,16 @@ __pmFopen(const char *path, const char *mode)
  	/* Fall through and use the default handler. */
     }
 
+#if defined(HAVE_SYS_MMAN_H)
+    if (handler == NULL && mode[0] == 'r' && mode[1] == '\0' && use_mmap()) {
+	/*
+	 * Uncompressed and read-only, try to map the whole file and
+	 * fall back to stdio if that fails for any reason.
+	 */
+	handler = &__pm_mmap;
+    }
+#endif
+
     if (handler == NULL) {
 	/*
 	 * The file is either not compressed, or we can not decompress it
@@ -495,6 +540,18 @@ __pmFopen(const char *path, const char *mode)
      * be used to deallocate and close, see __pmClose() below.
      */
     if (f->fops->__pmopen(f, path, mode) == NULL) {
+#if defined(HAVE_SYS_MMAN_H)
+	if (handler == &__pm_mmap) {
+	    if (pmDebugOptions.log) {
+		char	errmsg[PM_MAXERRMSGLEN];
+		fprintf(stderr, "__pmFopen(\"%s\", \"%s\"): mmap failed: %s, using stdio\n", path, mode, osstrerror_r(errmsg, sizeof(errmsg)));
+	    }
+	    memset(f, 0, sizeof(__pmFILE));
+	    f->fops = &__pm_stdio;
+	    if (f->fops->__pmopen(f, path, mode) != NULL)
+		goto done;
+	}
+#endif
 	free(f);
     	return NULL;
     }
@@ -0,0 +1,363 @@
+/*
+ * Copyright (c) 2026 Red Hat.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ *
+ */
+
+/*
+ * mmap - read-only access to uncompressed archive files
+ *
+ * The whole file is mapped, reads are a memcpy() from the mapping and
+ * seeks are simply arithmetic, so there are no system calls on the
+ * archive read paths once the file is open.  __pmFmapped() lets the
+ * archive record decoding work directly from the mapping.
+ *
+ * Archives may still be growing (pmlogger is writing them) when they
+ * are read, so a read or seek past the end of the mapping checks the
+ * file size and remaps if the file has been extended.
+ */
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include "pmapi.h"
+#include "libpcp.h"
+#include "internal.h"
+
+#if defined(HAVE_SYS_MMAN_H)
+#include <sys/mman.h>
+
+typedef struct {
+    int		fd;
+    char	*base;		/* start of the mapping, NULL if empty */
+    size_t	size;		/* bytes mapped, file size when mapped */
+    off_t	posn;		/* current logical file position */
+    int		eof;
+    int		err;
+} mmapfile;
+
+/*
+ * Map (or remap) the file if it has grown since it was last mapped.
+ * Return 1 if the mapping grew, else 0 (no change or error).
+ */
+static int
+mmap_refresh(mmapfile *m)
+{
+    struct stat	sbuf;
+    void	*base;
+
+    if (fstat(m->fd, &sbuf) < 0) {
+	m->err = oserror();
+	return 0;
+    }
+    if (sbuf.st_size <= (off_t)m->size)
+	return 0;
+    if ((size_t)sbuf.st_size != sbuf.st_size) {
+	/* too big to map in this address space */
+	m->err = EFBIG;
+	return 0;
+    }
+    base = mmap(NULL, (size_t)sbuf.st_size, PROT_READ, MAP_SHARED, m->fd, 0);
+    if (base == MAP_FAILED) {
+	m->err = oserror();
+	return 0;
+    }
+    if (m->base != NULL)
+	munmap(m->base, m->size);
+    m->base = (char *)base;
+    m->size = (size_t)sbuf.st_size;
+    return 1;
+}
+
+static void *
+mmap_open(__pmFILE *f, const char *path, const char *mode)
+{
+    mmapfile	*m;
+    struct stat	sbuf;
+    int		fd;
+    int		sts;
+
+    if (mode[0] != 'r' || mode[1] != '\0') {
+	/* read-only, see __pmFopen() */
+	setoserror(EINVAL);
+	return NULL;
+    }
+    if ((fd = open(path, O_RDONLY)) < 0)
+	return NULL;
+    if (fstat(fd, &sbuf) < 0 || !S_ISREG(sbuf.st_mode)) {
+	/* not a plain file (or fstat failed), caller falls back to stdio */
+	close(fd);
+	setoserror(EINVAL);
+	return NULL;
+    }
+    if ((m = (mmapfile *)calloc(1, sizeof(mmapfile))) == NULL) {
+	sts = oserror();
+	close(fd);
+	setoserror(sts);
+	return NULL;
+    }
+    m->fd = fd;
+    if (sbuf.st_size > 0 && mmap_refresh(m) == 0) {
+	sts = m->err;
+	close(fd);
+	free(m);
+	setoserror(sts);
+	return NULL;
+    }
+    m->err = 0;
+
+    f->priv = (void *)m;
+    f->position = 0;
+
+    return f;
+}
+
+static void *
+mmap_fdopen(__pmFILE *f, int fd, const char *mode)
+{
+    /* not needed, __pmFdopen() always uses stdio */
+    setoserror(EOPNOTSUPP);
+    return NULL;
+}
+
+static int
+mmap_seek(__pmFILE *f, off_t offset, int whence)
+{
+    mmapfile	*m = (mmapfile *)f->priv;
+    off_t	posn;
+
+    if (whence == SEEK_SET)
+	posn = offset;
+    else if (whence == SEEK_CUR)
+	posn = m->posn + offset;
+    else if (whence == SEEK_END) {
+	mmap_refresh(m);
+	posn = (off_t)m->size + offset;
+    }
+    else {
+	setoserror(EINVAL);
+	return -1;
+    }
+    if (posn < 0) {
+	setoserror(EINVAL);
+	return -1;
+    }
+    m->posn = posn;
+    m->eof = 0;
+    f->position = posn;
+    return 0;
+}
+
+static void
+mmap_rewind(__pmFILE *f)
+{
+    mmapfile	*m = (mmapfile *)f->priv;
+
+    m->posn = 0;
+    m->eof = m->err = 0;
+    f->position = 0;
+}
+
+static off_t
+mmap_tell(__pmFILE *f)
+{
+    mmapfile	*m = (mmapfile *)f->priv;
+    return m->posn;
+}
+
+/*
+ * Return the number of bytes available at the current position,
+ * up to len, remapping the file if it has grown.
+ */
+static size_t
+mmap_avail(mmapfile *m, size_t len)
+{
+    size_t	avail;
+
+    if (m->posn + len > m->size)
+	mmap_refresh(m);
+    if (m->posn >= (off_t)m->size)
+	return 0;
+    avail = m->size - m->posn;
+    return avail < len ? avail : len;
+}
+
+static int
+mmap_getc(__pmFILE *f)
+{
+    mmapfile	*m = (mmapfile *)f->priv;
+    int		c;
+
+    if (mmap_avail(m, 1) == 0) {
+	m->eof = 1;
+	return EOF;
+    }
+    c = (unsigned char)m->base[m->posn++];
+    f->position = m->posn;
+    return c;
+}
+
+static size_t
+mmap_read(void *ptr, size_t size, size_t nmemb, __pmFILE *f)
+{
+    mmapfile	*m = (mmapfile *)f->priv;
+    size_t	len = size * nmemb;
+    size_t	n;
+
+    if (len == 0)
+	return 0;
+    if ((n = mmap_avail(m, len)) < len)
+	m->eof = 1;
+    if (n > 0) {
+	memcpy(ptr, &m->base[m->posn], n);
+	m->posn += n;
+	f->position = m->posn;
+    }
+    return n / size;
+}
+
+static size_t
+mmap_write(void *ptr, size_t size, size_t nmemb, __pmFILE *f)
+{
+    mmapfile	*m = (mmapfile *)f->priv;
+
+    m->err = EBADF;
+    setoserror(EBADF);
+    return 0;
+}
+
+static int
+mmap_flush(__pmFILE *f)
+{
+    return 0;
+}
+
+static int
+mmap_fsync(__pmFILE *f)
+{
+    return 0;
+}
+
+static int
+mmap_fileno(__pmFILE *f)
+{
+    mmapfile	*m = (mmapfile *)f->priv;
+    return m->fd;
+}
+
+static off_t
+mmap_lseek(__pmFILE *f, off_t offset, int whence)
+{
+    if (mmap_seek(f, offset, whence) < 0)
+	return (off_t)-1;
+    return mmap_tell(f);
+}
+
+static int
+mmap_fstat(__pmFILE *f, struct stat *buf)
+{
+    mmapfile	*m = (mmapfile *)f->priv;
+    return fstat(m->fd, buf);
+}
+
+static int
+mmap_feof(__pmFILE *f)
+{
+    mmapfile	*m = (mmapfile *)f->priv;
+    return m->eof;
+}
+
+static int
+mmap_ferror(__pmFILE *f)
+{
+    mmapfile	*m = (mmapfile *)f->priv;
+    if (m->err)
+	setoserror(m->err);
+    return m->err != 0;
+}
+
+static void
+mmap_clearerr(__pmFILE *f)
+{
+    mmapfile	*m = (mmapfile *)f->priv;
+    m->eof = m->err = 0;
+}
+
+static int
+mmap_setvbuf(__pmFILE *f, char *buf, int mode, size_t size)
+{
+    /* no buffering */
+    return 0;
+}
+
+static int
+mmap_close(__pmFILE *f)
+{
+    mmapfile	*m = (mmapfile *)f->priv;
+    int		sts;
+
+    if (m->base != NULL)
+	munmap(m->base, m->size);
+    sts = close(m->fd);
+    free(m);
+    return sts;
+}
+
+__pm_fops __pm_mmap = {
+    /*
+     * mmap - read-only, no compression
+     */
+    .__pmopen = mmap_open,
+    .__pmfdopen = mmap_fdopen,
+    .__pmseek = mmap_seek,
+    .__pmrewind = mmap_rewind,
+    .__pmtell = mmap_tell,
+    .__pmfgetc = mmap_getc,
+    .__pmread = mmap_read,
+    .__pmwrite = mmap_write,
+    .__pmflush = mmap_flush,
+    .__pmfsync = mmap_fsync,
+    .__pmfileno = mmap_fileno,
+    .__pmlseek = mmap_lseek,
+    .__pmfstat = mmap_fstat,
+    .__pmfeof = mmap_feof,
+    .__pmferror = mmap_ferror,
+    .__pmclearerr = mmap_clearerr,
+    .__pmsetvbuf = mmap_setvbuf,
+    .__pmclose = mmap_close
+};
+
+/*
+ * If f is memory mapped and the next len bytes from the current
+ * position are in the mapping, return a pointer to them (the position
+ * is not changed), else NULL.  The pointer is valid until the next
+ * operation on f.
+ */
+const char *
+__pmFmapped(__pmFILE *f, size_t len)
+{
+    mmapfile	*m;
+
+    if (f->fops != &__pm_mmap)
+	return NULL;
+    m = (mmapfile *)f->priv;
+    if (mmap_avail(m, len) < len)
+	return NULL;
+    return &m->base[m->posn];
+}
+#else /* !HAVE_SYS_MMAN_H */
+const char *
+__pmFmapped(__pmFILE *f, size_t len)
+{
+    return NULL;
+}
+#endif
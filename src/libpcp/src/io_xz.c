@@ -49,6 +49,22 @@
 #define PCP_XZ_CACHE_BLOCKS 4 /* 4 blocks in the cache, for now */
 #endif
 
+/*
+ * Compressed writing.  Data is buffered and, on each __pmFflush() or
+ * once PCP_XZ_BLOCK_SIZE bytes are pending, compressed and appended as
+ * a complete single-block xz stream.  The file is then always a valid
+ * multi-stream xz file (xz -dc, and the block cache reader below both
+ * handle these), each block independently decompressible, so readers
+ * can seek to the uncompressed offsets recorded in the temporal index.
+ * pmlogger flushes at each temporal index update, about every 100KB.
+ */
+#ifndef PCP_XZ_BLOCK_SIZE
+#define PCP_XZ_BLOCK_SIZE (1024 * 1024) /* largest block written */
+#endif
+#ifndef PCP_XZ_PRESET
+#define PCP_XZ_PRESET 0 /* favour speed, little gain from more effort */
+#endif
+
 #define XZ_HEADER_MAGIC     "\xfd" "7zXZ\0"
 #define XZ_HEADER_MAGIC_LEN 6
 #define XZ_FOOTER_MAGIC     "YZ"
@@ -83,12 +99,20 @@ typedef struct xzfile {
     FILE *f;
     int fd;
     lzma_index *idx;
+    off_t scanned;		/* file size when idx was last updated */
     size_t nr_streams;
     size_t nr_blocks;
     blkcache *cache;
     off_t uncompressed_offset;
   __uint64_t uncompressed_size;
   __uint64_t max_uncompressed_block_size;
+    int writing;		/* opened for writing */
+    int error;			/* write error seen */
+    char *wbuf;			/* data not yet compressed */
+    size_t wlen;
+    size_t wsize;
+    uint8_t *obuf;		/* compressed stream output */
+    size_t osize;
 } xzfile;
 
 static void
@@ -150,6 +174,8 @@ static int
 xz_feof(__pmFILE *f)
 {
     xzfile *xz = f->priv;
+    if (xz->writing)
+	return 0;
     if (xz->uncompressed_offset >= xz->uncompressed_size)
 	return 1;
     return 0;
@@ -158,28 +184,36 @@ xz_feof(__pmFILE *f)
 static int
 xz_ferror(__pmFILE *f)
 {
-    xz_debug("libpcp internal error: %s not implemented\n", __func__);
-    return 0;
+    xzfile *xz = f->priv;
+    return xz->error;
 }
 
 static void
 xz_clearerr(__pmFILE *f)
 {
-    /* Do nothing --- for now */
+    xzfile *xz = f->priv;
+    xz->error = 0;
 }
 
+/*
+ * A file being written may be empty, or hold only part of its first
+ * stream header, so just check as much of the magic as there is.
+ */
 static int
-check_header_magic(FILE *f)
+check_header_magic(FILE *f, off_t size)
 {
   char buf[XZ_HEADER_MAGIC_LEN];
+  size_t len = sizeof(buf);
 
+  if (size < len)
+      len = size;
   if (fseek(f, 0, SEEK_SET) == -1)
       return 1; /* error */
-  if (fread(buf, 1, sizeof(buf), f) != sizeof(buf)) {
+  if (fread(buf, 1, len, f) != len) {
       setoserror(-PM_ERR_LOGREC);
       return 1; /* error */
   }
-  if (memcmp(buf, XZ_HEADER_MAGIC, sizeof(buf)) != 0) {
+  if (memcmp(buf, XZ_HEADER_MAGIC, len) != 0) {
       setoserror(-PM_ERR_LOGREC);
       return 1; /* error */
   }
@@ -188,15 +222,15 @@ check_header_magic(FILE *f)
 }
 
 /* For explanation of this function, see src/xz/list.c:parse_indexes
- * in the xz sources.
+ * in the xz sources.  Here only the streams between the start and end
+ * file offsets are parsed, so a growing file can be indexed as it grows.
  */
 static lzma_index *
-parse_indexes(FILE *f, size_t *nr_streams)
+parse_indexes(FILE *f, off_t start, off_t end, size_t *nr_streams)
 {
   lzma_ret r;
   off_t index_size;
-  int pos;
-  int sts;
+  off_t pos;
   uint8_t footer[LZMA_STREAM_HEADER_SIZE];
   uint8_t header[LZMA_STREAM_HEADER_SIZE];
   lzma_stream_flags footer_flags;
@@ -210,25 +244,21 @@ parse_indexes(FILE *f, size_t *nr_streams)
   *nr_streams = 0;
 
   /* Check file size is a multiple of 4 bytes. */
-  sts = fseek(f, 0, SEEK_END);
-  if (sts != 0)
-      goto err;
-  pos = ftell(f);
-  if (pos == -1)
-      goto err;
+  pos = end;
   if ((pos & 3) != 0) {
       setoserror(-PM_ERR_LOGREC);
       goto err;
   }
 
   /* Jump backwards through the file identifying each stream. */
-  while (pos > 0) {
-      if (pos < LZMA_STREAM_HEADER_SIZE) {
+  while (pos > start) {
+      if (pos - start < LZMA_STREAM_HEADER_SIZE) {
 	  setoserror(-PM_ERR_LOGREC);
 	  goto err;
       }
 
-      if (fseek(f, -LZMA_STREAM_HEADER_SIZE, SEEK_CUR) != 0) {
+      /* Absolute, as the file position is past the previous header. */
+      if (fseeko(f, pos - LZMA_STREAM_HEADER_SIZE, SEEK_SET) != 0) {
 	  xz_debug("%s: fseek: %m", __func__);
 	  setoserror(-PM_ERR_LOGREC);
 	  goto err;
@@ -249,7 +279,7 @@ parse_indexes(FILE *f, size_t *nr_streams)
       pos -= LZMA_STREAM_HEADER_SIZE;
       (*nr_streams)++;
 
-      xz_debug("decode stream footer at pos = %d", pos);
+      xz_debug("decode stream footer at pos = %ld", (long)pos);
 
       /* Does the stream footer look reasonable? */
       r = lzma_stream_footer_decode(&footer_flags, footer);
@@ -261,17 +291,17 @@ parse_indexes(FILE *f, size_t *nr_streams)
       xz_debug("backward_size = %lu",
 	       (unsigned long) footer_flags.backward_size);
       index_size = footer_flags.backward_size;
-      if (pos < index_size + LZMA_STREAM_HEADER_SIZE) {
+      if (pos - start < index_size + LZMA_STREAM_HEADER_SIZE) {
 	  xz_debug("%s: invalid stream footer", __func__);
 	  setoserror(-PM_ERR_LOGREC);
 	  goto err;
       }
 
       pos -= index_size;
-      xz_debug("decode index at pos = %d", pos);
+      xz_debug("decode index at pos = %ld", (long)pos);
 
       /* Seek backwards to the index of this stream. */
-      if (fseek(f, pos, SEEK_SET) != 0) {
+      if (fseeko(f, pos, SEEK_SET) != 0) {
 	  xz_debug("%s: fseek: %m", __func__);
 	  setoserror(-PM_ERR_LOGREC);
 	  goto err;
@@ -312,11 +342,16 @@ parse_indexes(FILE *f, size_t *nr_streams)
       }
 
       pos -= lzma_index_total_size(this_index) + LZMA_STREAM_HEADER_SIZE;
+      if (pos < start) {
+	  xz_debug("%s: stream header before start of streams", __func__);
+	  setoserror(-PM_ERR_LOGREC);
+	  goto err;
+      }
 
-      xz_debug("decode stream header at pos = %d", pos);
+      xz_debug("decode stream header at pos = %ld", (long)pos);
 
       /* Read and decode the stream header. */
-      if (fseek(f, pos, SEEK_SET) != 0) {
+      if (fseeko(f, pos, SEEK_SET) != 0) {
 	  xz_debug("%s: fseek: %m", __func__);
 	  setoserror(-PM_ERR_LOGREC);
 	  goto err;
@@ -387,6 +422,47 @@ parse_indexes(FILE *f, size_t *nr_streams)
   return NULL;
 }
 
+/*
+ * When a volume is being written (see write_stream below), the last
+ * stream may be incomplete.  Find the end of the last complete stream,
+ * searching back from the end of the file (but not before start) for a
+ * valid stream footer followed by the start of a stream header.
+ * Returns start if there is no complete stream after start.
+ */
+static off_t
+find_stream_end(FILE *f, off_t start, off_t size)
+{
+  uint8_t buf[BUFSIZ + XZ_HEADER_MAGIC_LEN];
+  lzma_stream_flags flags;
+  off_t base, end, pos;
+  size_t len, n;
+  uint8_t *p;
+
+  end = size & ~3;
+  while (end - start >= LZMA_STREAM_HEADER_SIZE) {
+      base = end - BUFSIZ;
+      if (base < start)
+	  base = start;
+      len = (end + XZ_HEADER_MAGIC_LEN < size ? end + XZ_HEADER_MAGIC_LEN : size) - base;
+      if (fseeko(f, base, SEEK_SET) != 0 || fread(buf, 1, len, f) != len) {
+	  xz_debug("%s: read: %m", __func__);
+	  break;
+      }
+      for (pos = end; pos - base >= LZMA_STREAM_HEADER_SIZE; pos -= 4) {
+	  p = &buf[pos - base];
+	  if (memcmp(p - XZ_FOOTER_MAGIC_LEN, XZ_FOOTER_MAGIC, XZ_FOOTER_MAGIC_LEN) != 0)
+	      continue;
+	  if (lzma_stream_footer_decode(&flags, p - LZMA_STREAM_HEADER_SIZE) != LZMA_OK)
+	      continue;
+	  n = size - pos < XZ_HEADER_MAGIC_LEN ? size - pos : XZ_HEADER_MAGIC_LEN;
+	  if (memcmp(p, XZ_HEADER_MAGIC, n) == 0)
+	      return pos;
+      }
+      end = pos;
+  }
+  return start;
+}
+
 /* Iterate over the indexes to find the number of blocks and
  * the largest block.
  */
@@ -409,24 +485,77 @@ iter_indexes(lzma_index *idx,
   return 0;
 }
 
+/*
+ * Index any streams added since the file was last indexed.  pmlogger
+ * (see write_stream below) appends complete streams to a volume while
+ * it may be being read, so a trailing stream that is only partly
+ * written is ignored until a later refresh finds it complete.
+ * Returns 1 if new data was indexed, 0 if not, -1 for errors.
+ */
 static int
-init(xzfile *xz)
+refresh(xzfile *xz)
 {
-  /* Check file magic. */
-  if (check_header_magic(xz->f) != 0)
-      return 1; /* error */
+  struct stat sbuf;
+  lzma_index *idx;
+  size_t nr_streams;
+  off_t start, end;
+
+  if (fstat(fileno(xz->f), &sbuf) < 0)
+      return -1;
+  if (sbuf.st_size <= xz->scanned)
+      return 0;
+
+  start = xz->idx == NULL ? 0 : lzma_index_file_size(xz->idx);
+  idx = parse_indexes(xz->f, start, sbuf.st_size, &nr_streams);
+  if (idx == NULL) {
+      end = find_stream_end(xz->f, start, sbuf.st_size);
+      if (end > start)
+	  idx = parse_indexes(xz->f, start, end, &nr_streams);
+      if (idx == NULL) {
+	  /* nothing complete yet, or corrupt */
+	  xz->scanned = sbuf.st_size;
+	  return end > start ? -1 : 0;
+      }
+      xz_debug("%s: ignored partial stream at %ld", __func__, (long)end);
+  }
+  xz->scanned = sbuf.st_size;
 
-  /* Read and parse the indexes. */
-  xz->idx = parse_indexes(xz->f, &xz->nr_streams);
   if (xz->idx == NULL)
-      return 1; /* error */
+      xz->idx = idx;
+  else if (lzma_index_cat(xz->idx, idx, NULL) != LZMA_OK) {
+      xz_debug("%s: cannot combine indexes", __func__);
+      lzma_index_end(idx, NULL);
+      return -1;
+  }
+  xz->nr_streams += nr_streams;
 
   /* Iterate over indexes to find the number of and largest block. */
   if (iter_indexes(xz->idx,
                     &xz->nr_blocks, &xz->max_uncompressed_block_size) == -1)
-      return 1; /* error */
+      return -1;
 
   xz->uncompressed_size = lzma_index_uncompressed_size(xz->idx);
+  return 1;
+}
+
+static int
+init(xzfile *xz)
+{
+  struct stat sbuf;
+
+  /* Check file magic. */
+  if (fstat(fileno(xz->f), &sbuf) < 0)
+      return 1; /* error */
+  if (check_header_magic(xz->f, sbuf.st_size) != 0)
+      return 1; /* error */
+
+  /*
+   * Read and parse the indexes.  A volume that is being written may
+   * have no complete stream yet, it is then empty until it grows.
+   */
+  if (refresh(xz) < 0)
+      return 1; /* error */
+
   xz->uncompressed_offset = 0;
   xz->cache = new_blkcache(PCP_XZ_CACHE_BLOCKS);
   
@@ -438,7 +567,7 @@ xz_open(__pmFILE *f, const char *path, const char *mode)
 {
   xzfile *xz;
 
-  xz = malloc(sizeof *xz);
+  xz = calloc(1, sizeof *xz);
   if (xz == NULL) {
       pmNoMem("xz_open", sizeof(*xz), PM_FATAL_ERR);
       return NULL;
@@ -449,6 +578,14 @@ xz_open(__pmFILE *f, const char *path, const char *mode)
   if (xz->f == NULL)
       goto err;
 
+  if (mode[0] == 'w') {
+      /* New file, nothing to parse until the first stream is written. */
+      xz->writing = 1;
+      xz->fd = fileno(xz->f);
+      f->priv = xz;
+      return xz;
+  }
+
   if (init(xz) == 0) {
       xz->fd = fileno(xz->f);
       f->priv = xz;
@@ -466,7 +603,7 @@ xz_fdopen(__pmFILE *f, int fd, const char *mode)
 {
   xzfile *xz;
 
-  xz = malloc(sizeof *xz);
+  xz = calloc(1, sizeof *xz);
   if (xz == NULL) {
       pmNoMem("xz_open", sizeof(*xz), PM_FATAL_ERR);
       return NULL;
@@ -503,6 +640,8 @@ xz_seek(__pmFILE *f, off_t offset, int whence)
 	new_offset = xz->uncompressed_offset + offset;
 	break;
     case SEEK_END:
+	if (!xz->writing)
+	    refresh(xz);
 	new_offset = xz->uncompressed_size + offset;
 	break;
     default:
@@ -752,6 +891,8 @@ reposition(xzfile *xz)
      * first.
      */
     cache = xz->cache;
+    if (xz->uncompressed_offset >= xz->uncompressed_size && refresh(xz) <= 0)
+	return NULL; /* end of file, or error */
     for (slot = 0; slot < cache->maxdepth; ++slot) {
 	blk = &cache->blocks[slot];
 	if (blk->data == NULL)
@@ -782,10 +923,10 @@ static int
 xz_getc(__pmFILE *f)
 {
     xzfile *xz = (xzfile *)f->priv;;
-    block *blk = reposition(xz);
+    block *blk;
     int c;
 
-    if (blk == NULL)
+    if (xz->writing || (blk = reposition(xz)) == NULL)
 	return EOF;
 
     /* It's a single byte. It is guaranteed that we can copy it. */
@@ -804,6 +945,11 @@ xz_read(void *ptr, size_t size, size_t nmemb, __pmFILE *f)
     size_t n;
     size_t copied;
 
+    if (xz->writing) {
+	setoserror(EBADF);
+	return 0;
+    }
+
     /* Obtain the requested size in bytes. */
     size *= nmemb;
 
@@ -838,25 +984,128 @@ xz_read(void *ptr, size_t size, size_t nmemb, __pmFILE *f)
     return copied;
 }
 
+/*
+ * Compress the pending data into a new xz stream at the end of the file.
+ */
+static int
+write_stream(xzfile *xz)
+{
+    lzma_options_lzma opt;
+    lzma_filter filters[2];
+    lzma_ret r;
+    size_t bound, pos = 0;
+    ssize_t n;
+    uint8_t *p;
+
+    if (xz->wlen == 0)
+	return 0;
+    if (xz->error)
+	return -1;
+
+    bound = lzma_stream_buffer_bound(xz->wlen);
+    if (bound > xz->osize) {
+	if ((p = realloc(xz->obuf, bound)) == NULL)
+	    goto fail;
+	xz->obuf = p;
+	xz->osize = bound;
+    }
+
+    /* no point in a dictionary bigger than the block */
+    lzma_lzma_preset(&opt, PCP_XZ_PRESET);
+    if (opt.dict_size > xz->wlen)
+	opt.dict_size = xz->wlen < LZMA_DICT_SIZE_MIN ?
+			LZMA_DICT_SIZE_MIN : xz->wlen;
+    filters[0].id = LZMA_FILTER_LZMA2;
+    filters[0].options = &opt;
+    filters[1].id = LZMA_VLI_UNKNOWN;
+    filters[1].options = NULL;
+
+    r = lzma_stream_buffer_encode(filters, LZMA_CHECK_CRC32, NULL,
+			(uint8_t *)xz->wbuf, xz->wlen, xz->obuf, &pos, xz->osize);
+    if (r != LZMA_OK) {
+	xz_debug("lzma_stream_buffer_encode: error %d\n", r);
+	setoserror(r == LZMA_MEM_ERROR ? ENOMEM : EINVAL);
+	goto fail;
+    }
+    for (p = xz->obuf; pos > 0; p += n, pos -= n) {
+	if ((n = write(xz->fd, p, pos)) < 0) {
+	    if (oserror() == EINTR) {
+		n = 0;
+		continue;
+	    }
+	    goto fail;
+	}
+    }
+    xz->wlen = 0;
+    return 0;
+
+ fail:
+    xz->error = 1;
+    return -1;
+}
+
 static size_t
 xz_write(void *ptr, size_t size, size_t nmemb, __pmFILE *f)
 {
-    xz_debug("libpcp internal error: %s not implemented\n", __func__);
-    return 0;
+    xzfile *xz = (xzfile *)f->priv;;
+    size_t n = size * nmemb;
+    char *p;
+
+    if (!xz->writing) {
+	setoserror(EBADF);
+	return 0;
+    }
+    /* Compressed streams are append only, seeks are for __pmFtell */
+    if (xz->uncompressed_offset != xz->uncompressed_size) {
+	setoserror(ESPIPE);
+	return 0;
+    }
+    if (xz->wlen + n > xz->wsize) {
+	size_t need = xz->wsize ? xz->wsize : BUFSIZ;
+
+	while (need < xz->wlen + n)
+	    need *= 2;
+	if ((p = realloc(xz->wbuf, need)) == NULL) {
+	    xz->error = 1;
+	    return 0;
+	}
+	xz->wbuf = p;
+	xz->wsize = need;
+    }
+    memcpy(xz->wbuf + xz->wlen, ptr, n);
+    xz->wlen += n;
+    xz->uncompressed_offset += n;
+    xz->uncompressed_size += n;
+
+    if (xz->wlen >= PCP_XZ_BLOCK_SIZE && write_stream(xz) < 0)
+	return 0;
+    return nmemb;
 }
 
 static int
 xz_flush(__pmFILE *f)
 {
-    xz_debug("libpcp internal error: %s not implemented\n", __func__);
-    return EOF;
+    xzfile *xz = f->priv;
+
+    if (!xz->writing) {
+	xz_debug("libpcp internal error: %s not implemented\n", __func__);
+	return EOF;
+    }
+    return write_stream(xz) < 0 ? EOF : 0;
 }
 
 static int
 xz_fsync(__pmFILE *f)
 {
-    xz_debug("libpcp internal error: %s not implemented\n", __func__);
-    return -1;
+    xzfile *xz = f->priv;
+
+    if (!xz->writing) {
+	xz_debug("libpcp internal error: %s not implemented\n", __func__);
+	return -1;
+    }
+    if (write_stream(xz) < 0)
+	return -1;
+    return fsync(xz->fd);
 }
 
 static int
@@ -871,7 +1120,11 @@ xz_fstat(__pmFILE *f, struct stat *buf)
 {
     xzfile *xz = f->priv;
     FILE *fp = xz->f;
-    int rc = fstat(fileno(fp), buf);
+    int rc;
+
+    if (!xz->writing)
+	refresh(xz);
+    rc = fstat(fileno(fp), buf);
 
     /* What the caller really wants for st_size is the uncompressed size. */
     if (rc != -1)
@@ -883,6 +1136,11 @@ xz_fstat(__pmFILE *f, struct stat *buf)
 static int
 xz_setvbuf(__pmFILE *f, char *buf, int mode, size_t size)
 {
+    xzfile *xz = f->priv;
+
+    /* Writes are always buffered until the next flush. */
+    if (xz->writing)
+	return 0;
     xz_debug("libpcp internal error: %s not implemented\n", __func__);
     return -1;
 }
@@ -891,18 +1149,27 @@ static int
 xz_close(__pmFILE *f)
 {
     xzfile *xz = f->priv;
-    int sts;
-    
-    lzma_index_end (xz->idx, NULL);
-    sts = fclose(xz->f);
-    free_blkcache(xz->cache);
+    int sts = 0;
+
+    if (xz->writing) {
+	if (write_stream(xz) < 0)
+	    sts = EOF;
+	free(xz->wbuf);
+	free(xz->obuf);
+    }
+    else {
+	lzma_index_end (xz->idx, NULL);
+	free_blkcache(xz->cache);
+    }
+    if (fclose(xz->f) != 0)
+	sts = EOF;
     free(xz);
     return sts;
 }
 
 __pm_fops __pm_xz = {
     /*
-     * xz decompression
+     * xz decompression, and append-only compression
      */
     .__pmopen = xz_open,
     .__pmfdopen = xz_fdopen,
@@ -103,7 +103,7 @@ addindom(__pmLogCtl *lcp, pmInDom indom, const pmTimeval *tp, int numinst,
 {
     __pmLogInDom	*idp, *idp_prev;
     __pmLogInDom	*idp_cached, *idp_time;
-    __pmHashNode	*hp;
+    __pmHashNode	*hp, *hp_idx;
     int			timecmp;
     int			sts;
 
@@ -132,6 +132,10 @@ PM_FAULT_POINT("libpcp/" __FILE__ ":1", PM_FAULT_ALLOC);
 	return sts;
     }
 
+    /* the version list is about to change, so any time index is stale */
+    if ((hp_idx = __pmHashSearch((unsigned int)indom, &lcp->l_hashindomidx)) != NULL)
+	((__pmLogInDomIndex *)hp_idx->data)->stale = 1;
+
     /*
      * Filter out identical indoms. This is very common in multi-archive
      * contexts where the individual archives almost always use the same
@@ -241,6 +245,74 @@ PM_FAULT_POINT("libpcp/" __FILE__ ":1", PM_FAULT_ALLOC);
     return sts;
 }
 
+/*
+ * Instance domains with fewer versions than this are searched linearly.
+ */
+#define INDOM_INDEX_MIN	8
+
+/*
+ * (Re)build the time index for one instance domain version list.
+ */
+static int
+indexindom(__pmLogCtl *lcp, pmInDom indom, __pmLogInDom *list)
+{
+    __pmLogInDomIndex	*ip = NULL;
+    __pmLogInDom	*idp, **versions;
+    __pmHashNode	*hp;
+    int			count = 0;
+    int			sts;
+
+    if ((hp = __pmHashSearch((unsigned int)indom, &lcp->l_hashindomidx)) != NULL) {
+	ip = (__pmLogInDomIndex *)hp->data;
+	if (ip->stale == 0)
+	    return 0;
+    }
+
+    /* version lists only ever grow, so an existing index stays */
+    for (idp = list; idp != NULL; idp = idp->next)
+	count++;
+    if (count < INDOM_INDEX_MIN && ip == NULL)
+	return 0;
+
+    if (ip == NULL) {
+	if ((ip = (__pmLogInDomIndex *)calloc(1, sizeof(*ip))) == NULL)
+	    return -oserror();
+	ip->stale = 1;
+	if ((sts = __pmHashAdd((unsigned int)indom, (void *)ip, &lcp->l_hashindomidx)) < 0) {
+	    free(ip);
+	    return sts;
+	}
+    }
+
+    /* on failure leave it stale, so searchindom walks the list instead */
+    if ((versions = (__pmLogInDom **)realloc(ip->versions,
+				count * sizeof(__pmLogInDom *))) == NULL)
+	return -oserror();
+    count = 0;
+    for (idp = list; idp != NULL; idp = idp->next)
+	versions[count++] = idp;
+    ip->versions = versions;
+    ip->count = count;
+    ip->stale = 0;
+    return 0;
+}
+
+/*
+ * After (re)loading metadata, index instance domains that have many
+ * versions (e.g. proc, cgroups, containers) so that searches by time
+ * are O(log n) rather than a walk along the list.
+ */
+static void
+indexindoms(__pmLogCtl *lcp)
+{
+    __pmHashNode	*hp;
+
+    for (hp = __pmHashWalk(&lcp->l_hashindom, PM_HASH_WALK_START);
+	 hp != NULL;
+	 hp = __pmHashWalk(&lcp->l_hashindom, PM_HASH_WALK_NEXT))
+	indexindom(lcp, (pmInDom)hp->key, (__pmLogInDom *)hp->data);
+}
+
 static int
 addlabel(__pmArchCtl *acp, unsigned int type, unsigned int ident, int nsets,
 		pmLabelSet *labelsets, const pmTimeval *tp)
@@ -1040,6 +1112,9 @@ end:
 
     /* Check for duplicate label sets. */
     check_dup_labels(acp);
+
+    /* Index instance domains with many versions, for time lookups. */
+    indexindoms(lcp);
     
     __pmFseek(f, (long)(sizeof(__pmLogLabel) + 2*sizeof(int)), SEEK_SET);
 
@@ -1164,6 +1239,8 @@ searchindom(__pmLogCtl *lcp, pmInDom indom, pmTimeval *tp)
 {
     __pmHashNode	*hp;
     __pmLogInDom	*idp;
+    __pmLogInDomIndex	*ip;
+    int			lo, hi, mid;
 
     if (pmDebugOptions.logmeta) {
 	char	strbuf[20];
@@ -1176,7 +1253,35 @@ searchindom(__pmLogCtl *lcp, pmInDom indom, pmTimeval *tp)
 	return NULL;
 
     idp = (__pmLogInDom *)hp->data;
-    if (tp != NULL) {
+    if (tp != NULL &&
+	(hp = __pmHashSearch((unsigned int)indom, &lcp->l_hashindomidx)) != NULL &&
+	(ip = (__pmLogInDomIndex *)hp->data)->stale == 0 && ip->count > 0) {
+	/*
+	 * binary search for the first (latest) version at or earlier
+	 * than the requested time - versions are in descending order
+	 */
+	lo = 0;
+	hi = ip->count;
+	while (lo < hi) {
+	    mid = lo + (hi - lo) / 2;
+	    if (__pmTimevalCmp(&ip->versions[mid]->stamp, tp) <= 0)
+		hi = mid;
+	    else
+		lo = mid + 1;
+	}
+	if (lo == ip->count) {
+	    if (pmDebugOptions.logmeta) {
+		fprintf(stderr, "request @ ");
+		StrTimeval(tp);
+		fprintf(stderr, " is too early for indom @ ");
+		StrTimeval(&ip->versions[ip->count - 1]->stamp);
+		fputc('\n', stderr);
+	    }
+	    return NULL;
+	}
+	idp = ip->versions[lo];
+    }
+    else if (tp != NULL) {
 	for ( ; idp != NULL; idp = idp->next) {
 	    /*
 	     * need first one at or earlier than the requested time
@@ -413,6 +413,29 @@ __pmLogName(const char *base, int vol)
     return __pmLogName_r(base, vol, tbuf, sizeof(tbuf));
 }
 
+/*
+ * Compress data volumes as they are written, with this suffix (see
+ * io_xz.c), or not at all if NULL.  Set up by __pmLogSetCompress()
+ * before archive creation, for a single writer (e.g. pmlogger).
+ */
+static const char	*log_compress;
+
+int
+__pmLogSetCompress(const char *suffix)
+{
+    if (suffix == NULL || suffix[0] == '\0') {
+	log_compress = NULL;
+	return 0;
+    }
+#if HAVE_TRANSPARENT_DECOMPRESSION && HAVE_LZMA_DECOMPRESSION
+    if (strcmp(suffix, "xz") == 0 || strcmp(suffix, ".xz") == 0) {
+	log_compress = ".xz";
+	return 0;
+    }
+#endif
+    return -EOPNOTSUPP;
+}
+
 __pmFILE *
 __pmLogNewFile(const char *base, int vol)
 {
@@ -421,6 +444,16 @@ __pmLogNewFile(const char *base, int vol)
     int		save_error;
 
     __pmLogName_r(base, vol, fname, sizeof(fname));
+    if (vol >= 0 && log_compress != NULL) {
+	/* the metadata and index are always written uncompressed */
+	if (access(fname, F_OK) != -1) {
+	    pmprintf("__pmLogNewFile: \"%s\" already exists, not over-written\n", fname);
+	    pmflush();
+	    setoserror(EEXIST);
+	    return NULL;
+	}
+	strncat(fname, log_compress, sizeof(fname) - strlen(fname) - 1);
+    }
 
     if (access(fname, R_OK) != -1) {
 	/* exists and readable ... */
@@ -503,6 +536,7 @@ __pmLogCreate(const char *host, const char *base, int log_version,
     lcp->l_minvol = lcp->l_maxvol = acp->ac_curvol = 0;
     lcp->l_hashpmid.nodes = lcp->l_hashpmid.hsize = 0;
     lcp->l_hashindom.nodes = lcp->l_hashindom.hsize = 0;
+    lcp->l_hashindomidx.nodes = lcp->l_hashindomidx.hsize = 0;
     lcp->l_hashlabels.nodes = lcp->l_hashlabels.hsize = 0;
     lcp->l_hashtext.nodes = lcp->l_hashtext.hsize = 0;
     lcp->l_tifp = lcp->l_mdfp = acp->ac_mfp = NULL;
@@ -699,6 +733,19 @@ logFreeHashText(__pmHashCtl *type_ctl)
     free(type_ctl->hash);
 }
 
+static __pmHashWalkState
+logFreeInDomIndex(const __pmHashNode *hp, void *cp)
+{
+    __pmLogInDomIndex	*ip = (__pmLogInDomIndex *)hp->data;
+
+    (void)cp;
+    if (ip) {
+	free(ip->versions);
+	free(ip);
+    }
+    return PM_HASH_WALK_DELETE_NEXT;
+}
+
 static void
 logFreeMeta(__pmLogCtl *lcp)
 {
@@ -713,6 +760,11 @@ logFreeMeta(__pmLogCtl *lcp)
     if (lcp->l_hashindom.hsize != 0)
 	logFreeHashInDom(&lcp->l_hashindom);
 
+    if (lcp->l_hashindomidx.hsize != 0) {
+	__pmHashWalkCB(logFreeInDomIndex, NULL, &lcp->l_hashindomidx);
+	__pmHashClear(&lcp->l_hashindomidx);
+    }
+
     if (lcp->l_hashlabels.hsize != 0)
 	logFreeHashLabels(&lcp->l_hashlabels);
 
@@ -1339,7 +1391,7 @@ paranoidCheck(int len, __pmPDU *pb)
 	    if (valfmt != PM_VAL_INSITU) {
 		for (j = 0; j < numval; j++) {
 		    int			index = (int)ntohl((long)vlp->vlist[j].value.lval);
-		    pmValueBlock	*pduvbp;
+		    pmValueBlock	vbhdr;
 		    int			vlen;
 		    
 		    if (index < 0 || index * sizeof(__pmPDU) > len) {
@@ -1350,10 +1402,10 @@ paranoidCheck(int len, __pmPDU *pb)
 			}
 			return -1;
 		    }
-		    pduvbp = (pmValueBlock *)&pb[index];
-		    __ntohpmValueBlock(pduvbp);
-		    vlen = pduvbp->vlen;
-		    __htonpmValueBlock(pduvbp);		/* restore pdubuf! */
+		    /* pb may be read-only, swab a copy of the header */
+		    memcpy(&vbhdr, &pb[index], sizeof(__pmPDU));
+		    *(__pmPDU *)&vbhdr = ntohl(*(__pmPDU *)&vbhdr);
+		    vlen = vbhdr.vlen;
 		    if (vlen < sizeof(__pmPDU)) {
 			if (pmDebugOptions.log) {
 			    fprintf(stderr, "\nparanoidCheck: vset[%d] val[%d], bad vlen=%d\n",
@@ -1688,6 +1740,56 @@ again:
 	sts = PM_ERR_LOGREC;
 	goto func_return;
     }
+#if defined(HAVE_64BIT_PTR)
+    /*
+     * Memory mapped volume, decode the record in place rather than
+     * reading it into a PDU buffer first.  Records are always a
+     * multiple of __pmPDU in length, but be careful in case some
+     * archive is not.  The -Dpdu dumps below need a real PDU buffer.
+     */
+    if (!pmDebugOptions.pdu) {
+	const char	*rec;
+
+	if (mode == PM_MODE_BACK)
+	    __pmFseek(f, -(long)(sizeof(head) + rlen), SEEK_CUR);
+	rec = __pmFmapped(f, rlen + sizeof(trail));
+	if (rec != NULL && ((__psint_t)rec % sizeof(__pmPDU)) == 0) {
+	    /* going backwards, head was read from the end of the record */
+	    if (mode == PM_MODE_FORW)
+		memcpy(&trail, &rec[rlen], sizeof(trail));
+	    else
+		memcpy(&trail, rec - sizeof(trail), sizeof(trail));
+	    trail = ntohl(trail);
+	    if (trail != head) {
+		if (pmDebugOptions.log)
+		    fprintf(stderr, "\nError: record length mismatch: header (%d) != trailer (%d)\n", head, trail);
+		if (mode == PM_MODE_FORW)
+		    __pmFseek(f, rlen + sizeof(trail), SEEK_CUR);
+		sts = PM_ERR_LOGREC;
+		goto func_return;
+	    }
+	    /* notional PDU buffer, see __pmDecodeLogRecord_ctx() */
+	    pb = (__pmPDU *)(rec - sizeof(__pmPDUHdr));
+	    if (option == PMLOGREAD_TO_EOF && paranoidCheck(head, pb) == -1) {
+		if (mode == PM_MODE_FORW)
+		    __pmFseek(f, rlen + sizeof(trail), SEEK_CUR);
+		sts = PM_ERR_LOGREC;
+		goto func_return;
+	    }
+	    if (mode == PM_MODE_FORW)
+		__pmFseek(f, rlen + sizeof(trail), SEEK_CUR);
+	    else
+		__pmFseek(f, -(long)sizeof(head), SEEK_CUR);
+	    __pmOverrideLastFd(__pmFileno(f));
+	    sts = __pmDecodeLogRecord_ctx(ctxp, rec, rlen, result);
+	    pb = NULL;
+	    goto decoded;
+	}
+	if (mode == PM_MODE_BACK)
+	    __pmFseek(f, sizeof(head) + rlen, SEEK_CUR);
+    }
+#endif
+
     /*
      * need to add int at end for trailer in case buffer is used
      * subsequently by __pmLogPutResult2()
@@ -1797,6 +1899,9 @@ again:
     __pmOverrideLastFd(__pmFileno(f));
     sts = __pmDecodeResult_ctx(ctxp, pb, result); /* also swabs the result */
 
+#if defined(HAVE_64BIT_PTR)
+decoded:
+#endif
     if (pmDebugOptions.log) {
 	head -= sizeof(head) + sizeof(trail);
 	if (sts >= 0) {
@@ -1819,7 +1924,8 @@ again:
     __pmLogReads++;
 
     if (sts < 0) {
-	__pmUnpinPDUBuf(pb);
+	if (pb != NULL)
+	    __pmUnpinPDUBuf(pb);
 	sts = PM_ERR_LOGREC;
 	goto func_return;
     }
@@ -1832,7 +1938,8 @@ again:
 	dumpbuf(rlen, &pb[3]);		/* see above to explain "3" */
     }
 
-    __pmUnpinPDUBuf(pb);
+    if (pb != NULL)
+	__pmUnpinPDUBuf(pb);
     sts = 0;
 
 func_return:
@@ -182,13 +182,16 @@ __pmSendResult(int fd, int from, const pmResult *result)
 }
 
 /*
- * Internal variant of __pmDecodeResult() with current context.
+ * Decode a pmResult from pdubuf, where len is the PDU length in bytes
+ * and the PDU header itself is not used.
  *
- * Enter here with pdubuf already pinned ... result may point into
- * _another_ pdu buffer that is pinned on exit
+ * For 64-bit pointers the input buffer is only read, not modified, so
+ * this may be used to decode records in place (see
+ * __pmDecodeLogRecord_ctx() below), for 32-bit pointers the pmResult is
+ * built in the input buffer.
  */
-int
-__pmDecodeResult_ctx(__pmContext *ctxp, __pmPDU *pdubuf, pmResult **result)
+static int
+DecodeResult(__pmContext *ctxp, __pmPDU *pdubuf, int len, pmResult **result)
 {
     int		numpmid;	/* number of metrics */
     int		i;		/* range of metrics */
@@ -213,6 +216,8 @@ __pmDecodeResult_ctx(__pmContext *ctxp, __pmPDU *pdubuf, pmResult **result)
     int		offset;		/* differences in sizes */
     int		vbsize;		/* size of pmValueBlocks */
     pmValueSet	*nvsp;
+    pmValueBlock vbhdr;		/* pmValueBlock header, host byte order */
+    char	*vbend;		/* end of last pmValueBlock swabbed */
 #elif defined(HAVE_32BIT_PTR)
     pmValueSet	*vsp;		/* vlist_t == pmValueSet */
 #else
@@ -223,18 +228,18 @@ __pmDecodeResult_ctx(__pmContext *ctxp, __pmPDU *pdubuf, pmResult **result)
 	PM_ASSERT_IS_LOCKED(ctxp->c_lock);
 
     pp = (result_t *)pdubuf;
-    pduend = (char *)pdubuf + pp->hdr.len;
+    pduend = (char *)pdubuf + len;
     if (pduend - (char *)pdubuf < sizeof(result_t) - sizeof(__pmPDU)) {
 	if (pmDebugOptions.pdu && pmDebugOptions.desperate) {
-	    fprintf(stderr, "__pmDecodeResult: Bad: len=%d smaller than min %d\n", pp->hdr.len, (int)(sizeof(result_t) - sizeof(__pmPDU)));
+	    fprintf(stderr, "__pmDecodeResult: Bad: len=%d smaller than min %d\n", len, (int)(sizeof(result_t) - sizeof(__pmPDU)));
 	}
 	return PM_ERR_IPC;
     }
 
     numpmid = ntohl(pp->numpmid);
-    if (numpmid < 0 || numpmid > pp->hdr.len) {
+    if (numpmid < 0 || numpmid > len) {
 	if (pmDebugOptions.pdu && pmDebugOptions.desperate) {
-	    fprintf(stderr, "__pmDecodeResult: Bad: numpmid=%d negative or not smaller than PDU len %d\n", numpmid, pp->hdr.len);
+	    fprintf(stderr, "__pmDecodeResult: Bad: numpmid=%d negative or not smaller than PDU len %d\n", numpmid, len);
 	}
 	return PM_ERR_IPC;
     }
@@ -276,9 +281,9 @@ __pmDecodeResult_ctx(__pmContext *ctxp, __pmPDU *pdubuf, pmResult **result)
 			i, pmIDStr_r(pmid, strbuf, sizeof(strbuf)), numval);
 	}
 	/* numval may be negative - it holds an error code in that case */
-	if (numval > pp->hdr.len) {
+	if (numval > len) {
 	    if (pmDebugOptions.pdu && pmDebugOptions.desperate) {
-		fprintf(stderr, "__pmDecodeResult: Bad: pmid[%d] numval=%d > len=%d\n", i, numval, pp->hdr.len);
+		fprintf(stderr, "__pmDecodeResult: Bad: pmid[%d] numval=%d > len=%d\n", i, numval, len);
 	    }
 	    goto corrupt;
 	}
@@ -314,7 +319,7 @@ __pmDecodeResult_ctx(__pmContext *ctxp, __pmPDU *pdubuf, pmResult **result)
 			goto corrupt;
 		    }
 		    index = ntohl(pduvp->value.lval);
-		    if (index < 0 || index > pp->hdr.len) {
+		    if (index < 0 || index > len) {
 			if (pmDebugOptions.pdu && pmDebugOptions.desperate) {
 			    fprintf(stderr, "__pmDecodeResult: Bad: pmid[%d] value[%d] index=%d\n", i, j, index);
 			}
@@ -329,23 +334,25 @@ __pmDecodeResult_ctx(__pmContext *ctxp, __pmPDU *pdubuf, pmResult **result)
 			}
 			goto corrupt;
 		    }
-		    __ntohpmValueBlock(pduvbp);
-		    if (pduvbp->vlen < PM_VAL_HDR_SIZE || pduvbp->vlen > pp->hdr.len) {
+		    /* input is not modified, swab a copy of the header */
+		    memcpy(&vbhdr, pduvbp, sizeof(__pmPDU));
+		    *(__pmPDU *)&vbhdr = ntohl(*(__pmPDU *)&vbhdr);
+		    if (vbhdr.vlen < PM_VAL_HDR_SIZE || vbhdr.vlen > len) {
 			if (pmDebugOptions.pdu && pmDebugOptions.desperate) {
-			    fprintf(stderr, "__pmDecodeResult: Bad: pmid[%d] value[%d] vlen=%d\n", i, j, pduvbp->vlen);
+			    fprintf(stderr, "__pmDecodeResult: Bad: pmid[%d] value[%d] vlen=%d\n", i, j, vbhdr.vlen);
 			}
 			goto corrupt;
 		    }
-		    if (pduvbp->vlen > (size_t)(pduend - (char *)pduvbp)) {
+		    if (vbhdr.vlen > (size_t)(pduend - (char *)pduvbp)) {
 			if (pmDebugOptions.pdu && pmDebugOptions.desperate) {
 			    fprintf(stderr, "__pmDecodeResult: Bad: pmid[%d] value[%d] pduvp past end of PDU buffer\n", i, j);
 			}
 			goto corrupt;
 		    }
-		    vbsize += PM_PDU_SIZE_BYTES(pduvbp->vlen);
+		    vbsize += PM_PDU_SIZE_BYTES(vbhdr.vlen);
 		    if (pmDebugOptions.pdu && pmDebugOptions.desperate) {
 			fprintf(stderr, " len: %d type: %d",
-			    pduvbp->vlen - PM_VAL_HDR_SIZE, pduvbp->vtype);
+			    vbhdr.vlen - PM_VAL_HDR_SIZE, vbhdr.vtype);
 		    }
 		}
 	    }
@@ -359,13 +366,13 @@ __pmDecodeResult_ctx(__pmContext *ctxp, __pmPDU *pdubuf, pmResult **result)
     offset = sizeof(result_t) - sizeof(__pmPDU) + vsize;
 
     if (pmDebugOptions.pdu && pmDebugOptions.desperate) {
-	fprintf(stderr, "need: %d vsize: %d nvsize: %d vbsize: %d offset: %d hdr.len: %d pduend: %p vsplit: %p (diff %d) pdubuf: %p (diff %d)\n", need, vsize, nvsize, vbsize, offset, pp->hdr.len, pduend, vsplit, (int)(pduend-vsplit), pdubuf, (int)(pduend-(char *)pdubuf));
+	fprintf(stderr, "need: %d vsize: %d nvsize: %d vbsize: %d offset: %d hdr.len: %d pduend: %p vsplit: %p (diff %d) pdubuf: %p (diff %d)\n", need, vsize, nvsize, vbsize, offset, len, pduend, vsplit, (int)(pduend-vsplit), pdubuf, (int)(pduend-(char *)pdubuf));
     }
 
     if (need < 0 ||
 	vsize > INT_MAX / sizeof(__pmPDU) ||
 	vbsize > INT_MAX / sizeof(pmValueBlock) ||
-	offset != pp->hdr.len - (pduend - vsplit) ||
+	offset != len - (pduend - vsplit) ||
 	offset + vbsize != pduend - (char *)pdubuf) {
 	if (pmDebugOptions.pdu && pmDebugOptions.desperate) {
 	    if (need < 0)
@@ -374,8 +381,8 @@ __pmDecodeResult_ctx(__pmContext *ctxp, __pmPDU *pdubuf, pmResult **result)
 		fprintf(stderr, "__pmDecodeResult: Bad: vsize (%d) > %d\n", vsize, (int)(INT_MAX / sizeof(__pmPDU)));
 	    if (vbsize > INT_MAX / sizeof(pmValueBlock))
 		fprintf(stderr, "__pmDecodeResult: Bad: vbsize (%d) > %d\n", vbsize, (int)(INT_MAX / sizeof(pmValueBlock)));
-	    if (offset != pp->hdr.len - (pduend - vsplit))
-		fprintf(stderr, "__pmDecodeResult: Bad: offset (%d) != %d\n", offset, (int)(pp->hdr.len - (pduend - vsplit)));
+	    if (offset != len - (pduend - vsplit))
+		fprintf(stderr, "__pmDecodeResult: Bad: offset (%d) != %d\n", offset, (int)(len - (pduend - vsplit)));
 	    if (offset + vbsize != pduend - (char *)pdubuf)
 		fprintf(stderr, "__pmDecodeResult: Bad: offset+vbsize (%d) != pduend-pdubuf (%d)\n", (int)(offset + vbsize), (int)(pduend - (char *)pdubuf));
 	}
@@ -408,10 +415,14 @@ __pmDecodeResult_ctx(__pmContext *ctxp, __pmPDU *pdubuf, pmResult **result)
      */
 
     if (vbsize) {
-	/* pmValueBlocks (if any) are copied across "as is" */
+	/*
+	 * pmValueBlocks (if any) are copied across "as is", and converted
+	 * to host byte order in the new buffer below
+	 */
 	index = vsize / sizeof(__pmPDU);
 	memcpy((void *)&newbuf[nvsize], (void *)&pp->data[index], vbsize);
     }
+    vbend = NULL;
 
     /*
      * offset is a bit tricky ... _add_ the expansion due to the
@@ -460,14 +471,34 @@ __pmDecodeResult_ctx(__pmContext *ctxp, __pmPDU *pdubuf, pmResult **result)
 		     * in the input PDU buffer, lval is an index to the
 		     * start of the pmValueBlock, in units of __pmPDU
 		     */
+		    char	*pduvbp;
+		    size_t	vbcopy;
+
+		    pduvbp = (char *)&pdubuf[ntohl(vp->value.lval)];
 		    index = sizeof(__pmPDU) * ntohl(vp->value.lval) + offset;
 		    nvp->value.pval = (pmValueBlock *)&newbuf[index];
+		    if (pduvbp < vbend) {
+			/*
+			 * pmValueBlocks are normally in value order, this one
+			 * is not (or overlaps another) and may have been
+			 * swabbed already, so copy it again before swabbing
+			 */
+			memcpy(&vbhdr, pduvbp, sizeof(__pmPDU));
+			*(__pmPDU *)&vbhdr = ntohl(*(__pmPDU *)&vbhdr);
+			vbcopy = PM_PDU_SIZE_BYTES(vbhdr.vlen);
+			if (vbcopy > (size_t)(pduend - pduvbp))
+			    vbcopy = pduend - pduvbp;
+			memcpy((void *)nvp->value.pval, pduvbp, vbcopy);
+		    }
+		    __ntohpmValueBlock(nvp->value.pval);
+		    if (pduvbp + PM_PDU_SIZE_BYTES(nvp->value.pval->vlen) > vbend)
+			vbend = pduvbp + PM_PDU_SIZE_BYTES(nvp->value.pval->vlen);
 		    if (pmDebugOptions.pdu && pmDebugOptions.desperate) {
-			int		k, len;
-			len = nvp->value.pval->vlen - PM_VAL_HDR_SIZE;
-			fprintf(stderr, " len: %d type: %d value: 0x", len,
+			int		k, vlen;
+			vlen = nvp->value.pval->vlen - PM_VAL_HDR_SIZE;
+			fprintf(stderr, " len: %d type: %d value: 0x", vlen,
 				nvp->value.pval->vtype);
-			for (k = 0; k < len; k++)
+			for (k = 0; k < vlen; k++)
 			    fprintf(stderr, "%02x", nvp->value.pval->vbuf[k]);
 		    }
 		}
@@ -510,9 +541,9 @@ __pmDecodeResult_ctx(__pmContext *ctxp, __pmPDU *pdubuf, pmResult **result)
 	vsp->pmid = __ntohpmID(vsp->pmid);
 	vsp->numval = ntohl(vsp->numval);
 	/* numval may be negative - it holds an error code in that case */
-	if (vsp->numval > pp->hdr.len) {
+	if (vsp->numval > len) {
 	    if (pmDebugOptions.pdu && pmDebugOptions.desperate) {
-		fprintf(stderr, "__pmDecodeResult: Bad: pmid[%d] numval=%d > len=%d\n", i, vsp->numval, pp->hdr.len);
+		fprintf(stderr, "__pmDecodeResult: Bad: pmid[%d] numval=%d > len=%d\n", i, vsp->numval, len);
 	    }
 	    goto corrupt;
 	}
@@ -551,7 +582,7 @@ __pmDecodeResult_ctx(__pmContext *ctxp, __pmPDU *pdubuf, pmResult **result)
 		} else {
 		    /* salvage pmValueBlocks from end of PDU */
 		    index = ntohl(pduvp->value.lval);
-		    if (index < 0 || index > pp->hdr.len) {
+		    if (index < 0 || index > len) {
 			if (pmDebugOptions.pdu && pmDebugOptions.desperate) {
 			    fprintf(stderr, "__pmDecodeResult: Bad: pmid[%d] value[%d] index=%d\n", i, j, index);
 			}
@@ -567,7 +598,7 @@ __pmDecodeResult_ctx(__pmContext *ctxp, __pmPDU *pdubuf, pmResult **result)
 			goto corrupt;
 		    }
 		    __ntohpmValueBlock(pduvbp);
-		    if (pduvbp->vlen < PM_VAL_HDR_SIZE || pduvbp->vlen > pp->hdr.len) {
+		    if (pduvbp->vlen < PM_VAL_HDR_SIZE || pduvbp->vlen > len) {
 			if (pmDebugOptions.pdu && pmDebugOptions.desperate) {
 			    fprintf(stderr, "__pmDecodeResult: Bad: pmid[%d] value[%d] vlen=%d\n", i, j, pduvbp->vlen);
 			}
@@ -589,7 +620,7 @@ __pmDecodeResult_ctx(__pmContext *ctxp, __pmPDU *pdubuf, pmResult **result)
 	}
     }
     if (numpmid > 0) {
-	if (sizeof(result_t) - sizeof(__pmPDU) + vsize != pp->hdr.len - (pduend - vsplit)) {
+	if (sizeof(result_t) - sizeof(__pmPDU) + vsize != len - (pduend - vsplit)) {
 	    if (pmDebugOptions.pdu && pmDebugOptions.desperate) {
 		fprintf(stderr, "__pmDecodeResult: Bad: vsplit past end of PDU buffer\n");
 	    }
@@ -620,6 +651,41 @@ corrupt:
     return PM_ERR_IPC;
 }
 
+/*
+ * Internal variant of __pmDecodeResult() with current context.
+ *
+ * Enter here with pdubuf already pinned ... result may point into
+ * _another_ pdu buffer that is pinned on exit
+ */
+int
+__pmDecodeResult_ctx(__pmContext *ctxp, __pmPDU *pdubuf, pmResult **result)
+{
+    return DecodeResult(ctxp, pdubuf, ((__pmPDUHdr *)pdubuf)->len, result);
+}
+
+#if defined(HAVE_64BIT_PTR)
+/*
+ * Decode a pmResult from an archive record of rlen bytes (timestamp,
+ * numpmid and vlists, without the record header and trailer) that
+ * need not be in a PDU buffer and is not modified, e.g. a memory
+ * mapped archive volume.  The pmResult is built in a new pinned PDU
+ * buffer, exactly as for __pmDecodeResult_ctx().
+ */
+int
+__pmDecodeLogRecord_ctx(__pmContext *ctxp, const char *rec, int rlen, pmResult **result)
+{
+    /*
+     * DecodeResult() never looks at the PDU header, so the pdubuf
+     * address is notional ... the words before the record (the record
+     * header, and the end of the previous record or the label) stand
+     * in for it and record relative indices work unchanged
+     */
+    __pmPDU	*pdubuf = (__pmPDU *)(rec - sizeof(__pmPDUHdr));
+
+    return DecodeResult(ctxp, pdubuf, rlen + (int)sizeof(__pmPDUHdr), result);
+}
+#endif
+
 int
 __pmDecodeResult(__pmPDU *pdubuf, pmResult **result)
 {
@@ -1,12 +1,12 @@
 /*
  * Copyright (c) 1995 Silicon Graphics, Inc.  All Rights Reserved.
- * Copyright (c) 2015 Red Hat, Inc.
- * 
+ * Copyright (c) 2015,2026 Red Hat, Inc.
+ *
  * This library is free software; you can redistribute it and/or modify it
  * under the terms of the GNU Lesser General Public License as published
  * by the Free Software Foundation; either version 2.1 of the License, or
  * (at your option) any later version.
- * 
+ *
  * This library is distributed in the hope that it will be useful, but
  * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
  * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
@@ -17,6 +17,42 @@
  * To avoid buffer trampling, on success __pmFindPDUBuf() now returns
  * a pinned PDU buffer.  It is the caller's responsibility to unpin the
  * PDU buffer when safe to do so.
+ *
+ * Every PDU sent or received, and every pin and unpin of the values
+ * in a pmResult, comes through here, so the common paths take no
+ * locks at all:
+ *
+ * - Buffers of up to MAX_CLASS bytes come in power-of-two size classes,
+ *   carved from SLAB_SIZE slabs (SLAB_SIZE aligned), each buffer with
+ *   its bufctl_t immediately before the payload.  Larger buffers are
+ *   allocated individually, rounded up to whole SLAB_SIZE chunks.
+ *
+ * - A two-level page map from SLAB_SIZE chunk to slab_t finds the buffer
+ *   for any address in constant time - the handles pinned and unpinned
+ *   are often addresses within a buffer (pmValueSets and pmValueBlocks
+ *   of a decoded pmResult), or not PDU buffers at all.  Chunks are never
+ *   shared with other memory, so any address mapping to a slab is either
+ *   inside one of its buffers or is not in the pool.  Slabs beyond the
+ *   reach of the page map (above 48-bit addresses) are found in a tree.
+ *
+ * - Unpinned buffers go on a per-thread free list for their class, and
+ *   from there (when it is full, or when the thread exits) to a global
+ *   free list, with lock-free pushes - a thread only ever takes the
+ *   whole of the global list (atomic exchange), avoiding the usual ABA
+ *   hazards of a lock-free stack.
+ *
+ * - Each slab counts its buffers on the global free lists, and once all
+ *   of them are there the slab is retired (one spare slab per class is
+ *   kept back).  Large buffers are retired as soon as they are unpinned.
+ *
+ * Slabs are never unmapped, nor taken out of the page map, so lookups
+ * need no lock: a retired slab keeps its slab_t and address range, but
+ * its pages are handed back to the kernel (MADV_DONTNEED), so they read
+ * as zeroes - no buffer there is pinned - until the slab is reused for
+ * the same class, or for a large buffer that fits.  Only the tree of
+ * slabs beyond the page map, which tsearch(3) rebalances, is guarded by
+ * map_lock.  The slab_lock mutex is taken to allocate and retire slabs,
+ * for large buffers, and for the diagnostic walks of all buffers.
  */
 
 #include "pmapi.h"
@@ -25,85 +61,772 @@
 #include <assert.h>
 #include <search.h>
 #include <stdint.h>
+#if defined(HAVE_SYS_MMAN_H)
+#include <sys/mman.h>
+#endif
+
+#define SLAB_SHIFT	18
+#define SLAB_SIZE	((size_t)1 << SLAB_SHIFT)	/* 256KB */
+#define MIN_SHIFT	8				/* 256 byte class */
+#define NUM_CLASS	9				/* ... up to 64KB */
+#define MAX_CLASS	(1 << (MIN_SHIFT + NUM_CLASS - 1))
+
+#define ALIGN16(x)	(((x) + 15) & ~((size_t)15))
+
+typedef struct slab slab_t;
 
 typedef struct bufctl
 {
-    int		bc_pincnt;
-    int		bc_size;
-    char	*bc_buf;
-    /* The actual buffer happens to follow this struct. */
+    int			bc_pincnt;
+    int			bc_size;	/* size requested */
+    char		*bc_buf;
+    slab_t		*bc_slab;
+    struct bufctl	*bc_next;	/* free list */
+    /* The actual buffer follows this struct (BUFCTL_SIZE bytes). */
 } bufctl_t;
 
-/* Protected by the pdubuf_lock mutex. */
-static void *buf_tree;
+struct slab
+{
+    int			sl_class;	/* size class, -1 for a large buffer */
+    int			sl_count;	/* buffers in this slab */
+    int			sl_nfree;	/* buffers on the global free list */
+    int			sl_mark;	/* for slab_trim(), under slab_lock */
+    size_t		sl_stride;	/* bytes from one bufctl_t to the next */
+    size_t		sl_length;	/* bytes allocated */
+    char		*sl_first;	/* first bufctl_t */
+    slab_t		*sl_next;	/* slab_list, or a retired list */
+    slab_t		*sl_prev;
+};
+
+#define BUFCTL_SIZE	ALIGN16(sizeof(bufctl_t))
+#define SLAB_HDR_SIZE	ALIGN16(sizeof(slab_t))
+
+/*
+ * Page map, SLAB_SIZE chunk address to slab, for up to 48-bit addresses,
+ * and a tsearch(3) tree of any slabs beyond that.  Entries are only ever
+ * added (with slab_lock held), so the page map is read without locking;
+ * the tree is updated with map_lock held for writing, and read with it
+ * held for reading.
+ */
+#define MAP_ADDR_BITS	48
+#define MAP_LEAF_BITS	16
+#define MAP_ROOT_BITS	(MAP_ADDR_BITS - SLAB_SHIFT - MAP_LEAF_BITS)
+#define MAP_LEAF_MASK	(((uintptr_t)1 << MAP_LEAF_BITS) - 1)
+static slab_t		**page_map[1 << MAP_ROOT_BITS];
+static void		*slab_tree;
+
+/* Global free lists, lock-free push and take-all. */
+static bufctl_t		*free_list[NUM_CLASS];
+
+/*
+ * All slabs and large buffers in use, and the retired ones (per class,
+ * and large) for reuse, protected by the slab_lock mutex.
+ */
+static slab_t		*slab_list;
+static slab_t		*retired[NUM_CLASS];
+static slab_t		*retired_large;
 
 #ifdef PM_MULTI_THREAD
-static pthread_mutex_t	pdubuf_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t	slab_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_rwlock_t	map_lock = PTHREAD_RWLOCK_INITIALIZER;
+#define MAP_RDLOCK()	pthread_rwlock_rdlock(&map_lock)
+#define MAP_WRLOCK()	pthread_rwlock_wrlock(&map_lock)
+#define MAP_UNLOCK()	pthread_rwlock_unlock(&map_lock)
 #else
-void			*pdubuf_lock;
+void			*slab_lock;
+#define MAP_RDLOCK()	do { } while (0)
+#define MAP_WRLOCK()	do { } while (0)
+#define MAP_UNLOCK()	do { } while (0)
 #endif
 
 #if defined(PM_MULTI_THREAD) && defined(PM_MULTI_THREAD_DEBUG)
 /*
- * return true if lock == pdubuf_lock
+ * return true if lock == slab_lock
  */
 int
 __pmIsPdubufLock(void *lock)
 {
-    return lock == (void *)&pdubuf_lock;
+    return lock == (void *)&slab_lock;
+}
+#endif
+
+/*
+ * Atomic operations, with the gcc/clang builtins where available
+ * (otherwise serialized with the atomic_lock mutex).  atomic_load,
+ * atomic_store, atomic_swap and atomic_cas are for pointers, and
+ * atomic_add, atomic_load_int, atomic_store_int and atomic_pin for
+ * ints - atomic_pin increments *p unless it is no longer positive,
+ * returning the new value, or 0.
+ */
+#ifdef __ATOMIC_ACQUIRE
+#define atomic_add(p, n)	__atomic_add_fetch((p), (n), __ATOMIC_ACQ_REL)
+#define atomic_load_int(p)	__atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define atomic_store_int(p, v)	__atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define atomic_load(p)		__atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define atomic_store(p, v)	__atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define atomic_swap(p, v)	__atomic_exchange_n((p), (v), __ATOMIC_ACQ_REL)
+#define atomic_cas(p, o, n)	__atomic_compare_exchange_n((p), (o), (n), 0, \
+					__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)
+static int
+atomic_pin(int *p)
+{
+    int		v = __atomic_load_n(p, __ATOMIC_ACQUIRE);
+
+    while (v > 0 && !__atomic_compare_exchange_n(p, &v, v + 1, 0,
+				__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+	;
+    return v > 0 ? v + 1 : 0;
 }
+#else
+#ifdef PM_MULTI_THREAD
+static pthread_mutex_t	atomic_lock = PTHREAD_MUTEX_INITIALIZER;
+#else
+void			*atomic_lock;
 #endif
+static int
+atomic_add(int *p, int n)
+{
+    int		v;
+
+    PM_LOCK(atomic_lock);
+    v = (*p += n);
+    PM_UNLOCK(atomic_lock);
+    return v;
+}
+static int
+atomic_pin(int *p)
+{
+    int		v = 0;
+
+    PM_LOCK(atomic_lock);
+    if (*p > 0)
+	v = ++*p;
+    PM_UNLOCK(atomic_lock);
+    return v;
+}
+#define atomic_load_int(p)	atomic_add((p), 0)
+static void
+atomic_store_int(int *p, int v)
+{
+    PM_LOCK(atomic_lock);
+    *p = v;
+    PM_UNLOCK(atomic_lock);
+}
+static void *
+atomic_load_ptr(void **p)
+{
+    void	*v;
 
+    PM_LOCK(atomic_lock);
+    v = *p;
+    PM_UNLOCK(atomic_lock);
+    return v;
+}
 static void
-pdubufdump1(const void *nodep, const VISIT which, const int depth)
+atomic_store_ptr(void **p, void *v)
 {
-    const bufctl_t	*pcp = *(bufctl_t **)nodep;
+    PM_LOCK(atomic_lock);
+    *p = v;
+    PM_UNLOCK(atomic_lock);
+}
+static void *
+atomic_swap_ptr(void **p, void *v)
+{
+    void	*old;
 
-    if (which == postorder || which == leaf)	/* called once per node */
-	fprintf(stderr, " " PRINTF_P_PFX "%p...%p[%d](%d)",
-		pcp->bc_buf, &pcp->bc_buf[pcp->bc_size - 1], pcp->bc_size,
-		pcp->bc_pincnt);
+    PM_LOCK(atomic_lock);
+    old = *p;
+    *p = v;
+    PM_UNLOCK(atomic_lock);
+    return old;
+}
+static int
+atomic_cas_ptr(void **p, void **old, void *v)
+{
+    int		sts;
+
+    PM_LOCK(atomic_lock);
+    if ((sts = (*p == *old)))
+	*p = v;
+    else
+	*old = *p;
+    PM_UNLOCK(atomic_lock);
+    return sts;
 }
+#define atomic_load(p)		((__typeof__(*(p)))atomic_load_ptr((void **)(p)))
+#define atomic_store(p, v)	atomic_store_ptr((void **)(p), (void *)(v))
+#define atomic_swap(p, v)	((__typeof__(*(p)))atomic_swap_ptr((void **)(p), (void *)(v)))
+#define atomic_cas(p, o, n)	atomic_cas_ptr((void **)(p), (void **)(o), (void *)(n))
+#endif
+
+/*
+ * Per-thread free lists, handed back to the global lists when the
+ * thread exits (via the cache_key destructor).  init is 1 once the
+ * destructor is set up, and -1 after it has run.
+ */
+typedef struct {
+    bufctl_t	*head[NUM_CLASS];
+    int		count[NUM_CLASS];
+    int		init;
+} bufcache_t;
+
+/* free buffers kept by a thread, per class: one slab's worth, at least 4 */
+#define CACHE_MAX(c)	((SLAB_SIZE >> ((c) + MIN_SHIFT + 1)) + 4)
+
+#if defined(PM_MULTI_THREAD) && defined(HAVE___THREAD)
+static __thread bufcache_t	buf_cache;
+static pthread_key_t		cache_key;
+static pthread_once_t		cache_once = PTHREAD_ONCE_INIT;
+#endif
+
+static void slab_trim(int);
 
 static void
-pdubufdump(void)
+free_list_link(int c, bufctl_t *first, bufctl_t *last)
 {
-    /*
-     * There is no longer a pdubuf free list, ergo no
-     * fprintf(stderr, "   free pdubuf[size]:\n");
-     */
-    PM_LOCK(pdubuf_lock);
-    if (buf_tree != NULL) {
-	fprintf(stderr, "   pinned pdubuf[size](pincnt):");
-	/* THREADSAFE - no locks acquired in pdubufdump1() */
-	twalk(buf_tree, &pdubufdump1);
-	fprintf(stderr, "\n");
+    bufctl_t	*head = atomic_load(&free_list[c]);
+
+    do {
+	last->bc_next = head;
+    } while (!atomic_cas(&free_list[c], &head, first));
+}
+
+/*
+ * Push a chain of buffers onto the global free list, and release any
+ * slabs that are then entirely free.
+ */
+static void
+free_list_push(int c, bufctl_t *first)
+{
+    bufctl_t	*last;
+    slab_t	*sp;
+    int		trim = 0;
+
+    for (last = first; ; last = last->bc_next) {
+	sp = last->bc_slab;
+	if (atomic_add(&sp->sl_nfree, 1) == sp->sl_count)
+	    trim = 1;
+	if (last->bc_next == NULL)
+	    break;
+    }
+    free_list_link(c, first, last);
+    if (trim)
+	slab_trim(c);
+}
+
+/*
+ * Take up to max buffers from the global free list, *countp is set to
+ * the number taken.  The whole list is taken (atomic exchange) and any
+ * buffers beyond max are linked back on.
+ */
+static bufctl_t *
+free_list_take(int c, int max, int *countp)
+{
+    bufctl_t	*first, *pcp, *last = NULL;
+    int		count = 0;
+
+    first = atomic_swap(&free_list[c], NULL);
+    for (pcp = first; pcp != NULL && count < max; pcp = pcp->bc_next) {
+	atomic_add(&pcp->bc_slab->sl_nfree, -1);
+	last = pcp;
+	count++;
+    }
+    if (pcp != NULL) {
+	last->bc_next = NULL;
+	for (last = pcp; last->bc_next != NULL; last = last->bc_next)
+	    ;
+	free_list_link(c, pcp, last);
+    }
+    *countp = count;
+    return first;
+}
+
+#if defined(PM_MULTI_THREAD) && defined(HAVE___THREAD)
+/*
+ * Thread exit - buffers freed from here on (e.g. by later destructors)
+ * go straight to the global lists.
+ */
+static void
+cache_flush(void *arg)
+{
+    bufcache_t	*cp = (bufcache_t *)arg;
+    int		c;
+
+    cp->init = -1;
+    for (c = 0; c < NUM_CLASS; c++) {
+	if (cp->head[c] == NULL)
+	    continue;
+	free_list_push(c, cp->head[c]);
+	cp->head[c] = NULL;
+	cp->count[c] = 0;
     }
-    PM_UNLOCK(pdubuf_lock);
 }
 
+static void
+cache_key_create(void)
+{
+    pthread_key_create(&cache_key, cache_flush);
+}
+#endif
+
 /*
- * A tsearch(3) comparison function for the buffer-segments used here.
+ * This thread's free lists, NULL if there are none (no thread private
+ * data support, or during thread exit).
  */
+static bufcache_t *
+cache_get(void)
+{
+#if defined(PM_MULTI_THREAD) && defined(HAVE___THREAD)
+    bufcache_t	*cp = &buf_cache;
+
+    if (likely(cp->init > 0))
+	return cp;
+    if (cp->init < 0)
+	return NULL;
+    pthread_once(&cache_once, cache_key_create);
+    if (pthread_setspecific(cache_key, cp) != 0)
+	return NULL;
+    cp->init = 1;
+    return cp;
+#else
+    return NULL;
+#endif
+}
+
 static int
-bufctl_t_compare(const void *a, const void *b)
+size_class(int need)
 {
-    const bufctl_t *aa = (const bufctl_t *)a;
-    const bufctl_t *bb = (const bufctl_t *)b;
+    int		c = 0;
 
-    /* NB: valid range is bc_buf[0 .. bc_size-1] */
-    if ((uintptr_t)&aa->bc_buf[aa->bc_size-1] < (uintptr_t)&bb->bc_buf[0])
+    if (need > MAX_CLASS)
 	return -1;
-    if ((uintptr_t)&bb->bc_buf[bb->bc_size-1] < (uintptr_t)&aa->bc_buf[0])
+    while ((1 << (c + MIN_SHIFT)) < need)
+	c++;
+    return c;
+}
+
+/*
+ * A tsearch(3) comparison function for the slab address ranges.
+ */
+static int
+slab_t_compare(const void *a, const void *b)
+{
+    const slab_t	*aa = (const slab_t *)a;
+    const slab_t	*bb = (const slab_t *)b;
+    const char		*abase = aa->sl_first - SLAB_HDR_SIZE;
+    const char		*bbase = bb->sl_first - SLAB_HDR_SIZE;
+
+    if (abase + aa->sl_length <= bbase)
+	return -1;
+    if (bbase + bb->sl_length <= abase)
 	return 1;
     return 0;		/* overlap */
 }
 
+/*
+ * Find the slab containing addr.  Once found a slab stays at that
+ * address for good, although it may have been retired since.
+ */
+static slab_t *
+map_lookup(const void *addr)
+{
+    uintptr_t	key = (uintptr_t)addr >> SLAB_SHIFT;
+    slab_t	**leaf;
+    slab_t	*sp = NULL;
+    slab_t	sp_search;
+    void	*node;
+
+    if ((key >> MAP_LEAF_BITS) < (1 << MAP_ROOT_BITS) &&
+	(leaf = atomic_load(&page_map[key >> MAP_LEAF_BITS])) != NULL)
+	sp = atomic_load(&leaf[key & MAP_LEAF_MASK]);
+    if (sp == NULL && unlikely(atomic_load(&slab_tree) != NULL)) {
+	/*
+	 * Dummy slab_t to use only as search key; only its sl_first and
+	 * sl_length fields are used by slab_t_compare.
+	 */
+	sp_search.sl_first = (char *)addr + SLAB_HDR_SIZE;
+	sp_search.sl_length = 1;
+	MAP_RDLOCK();
+	if ((node = tfind(&sp_search, &slab_tree, slab_t_compare)) != NULL)
+	    sp = *(slab_t **)node;
+	MAP_UNLOCK();
+    }
+    return sp;
+}
+
+/*
+ * Point the page map entries for the new slab sp at it, called with
+ * slab_lock held.  Any missing leaves are allocated first, so that on
+ * failure no entry has been set.  Slabs beyond the page map go in
+ * slab_tree instead.
+ */
+static int
+map_insert(slab_t *sp)
+{
+    uintptr_t	start = (uintptr_t)sp >> SLAB_SHIFT;
+    uintptr_t	end = start + (sp->sl_length >> SLAB_SHIFT);
+    uintptr_t	key;
+    slab_t	**leaf;
+    void	*node;
+
+    if (((end - 1) >> MAP_LEAF_BITS) >= (1 << MAP_ROOT_BITS)) {
+	MAP_WRLOCK();
+	node = tsearch(sp, &slab_tree, slab_t_compare);
+	MAP_UNLOCK();
+	return node ? 0 : -ENOMEM;
+    }
+    for (key = start; key < end; key++) {
+	if (page_map[key >> MAP_LEAF_BITS] != NULL)
+	    continue;
+	leaf = (slab_t **)calloc(MAP_LEAF_MASK + 1, sizeof(slab_t *));
+	if (leaf == NULL)
+	    return -ENOMEM;
+	atomic_store(&page_map[key >> MAP_LEAF_BITS], leaf);
+    }
+    for (key = start; key < end; key++) {
+	leaf = page_map[key >> MAP_LEAF_BITS];
+	atomic_store(&leaf[key & MAP_LEAF_MASK], sp);
+    }
+    return 0;
+}
+
+/*
+ * Take a retired slab of class c (or, for a large buffer, one of at
+ * least length bytes) for reuse, called with slab_lock held.
+ */
+static slab_t *
+slab_reuse(size_t length, int class)
+{
+    slab_t	*sp, **spp;
+
+    spp = class < 0 ? &retired_large : &retired[class];
+    for (; (sp = *spp) != NULL; spp = &sp->sl_next) {
+	if (sp->sl_length >= length) {
+	    *spp = sp->sl_next;
+	    sp->sl_nfree = 0;
+	    sp->sl_mark = 0;
+	    return sp;
+	}
+    }
+    return NULL;
+}
+
+/*
+ * Allocate length bytes, SLAB_SIZE aligned, or reuse a retired slab,
+ * and add it to the list of all slabs in use.
+ */
+static slab_t *
+slab_create(size_t length, int class, size_t stride, int count)
+{
+    slab_t	*sp;
+    void	*base;
+    int		sts;
+
+    PM_LOCK(slab_lock);
+    if ((sp = slab_reuse(length, class)) == NULL) {
+	if (posix_memalign(&base, SLAB_SIZE, length) != 0) {
+	    PM_UNLOCK(slab_lock);
+	    return NULL;
+	}
+	sp = (slab_t *)base;
+	sp->sl_class = class;
+	sp->sl_count = count;
+	sp->sl_nfree = 0;
+	sp->sl_mark = 0;
+	sp->sl_stride = stride;
+	sp->sl_length = length;
+	sp->sl_first = (char *)base + SLAB_HDR_SIZE;
+	if ((sts = map_insert(sp)) < 0) {
+	    PM_UNLOCK(slab_lock);
+	    free(base);
+	    setoserror(-sts);
+	    return NULL;
+	}
+    }
+    sp->sl_prev = NULL;
+    if ((sp->sl_next = slab_list) != NULL)
+	slab_list->sl_prev = sp;
+    slab_list = sp;
+    PM_UNLOCK(slab_lock);
+    return sp;
+}
+
+/*
+ * Take sp off the list of all slabs in use and onto the retired list
+ * for its class, called with slab_lock held.  It stays in the page map,
+ * but its pages (bar the one holding the slab_t) are handed back.
+ */
+static void
+slab_retire(slab_t *sp)
+{
+#if defined(HAVE_SYS_MMAN_H) && defined(MADV_DONTNEED)
+    uintptr_t	pagesize = getpagesize();
+    uintptr_t	start;
+
+    start = ((uintptr_t)sp->sl_first + pagesize - 1) & ~(pagesize - 1);
+    madvise((void *)start, (uintptr_t)sp + sp->sl_length - start,
+	    MADV_DONTNEED);
+#endif
+    if (sp->sl_prev)
+	sp->sl_prev->sl_next = sp->sl_next;
+    else
+	slab_list = sp->sl_next;
+    if (sp->sl_next)
+	sp->sl_next->sl_prev = sp->sl_prev;
+    if (sp->sl_class < 0) {
+	sp->sl_next = retired_large;
+	retired_large = sp;
+    }
+    else {
+	sp->sl_next = retired[sp->sl_class];
+	retired[sp->sl_class] = sp;
+    }
+}
+
+static void
+slab_destroy(slab_t *sp)
+{
+    /* no longer pinned, so lookups fail from here on */
+    PM_LOCK(slab_lock);
+    slab_retire(sp);
+    PM_UNLOCK(slab_lock);
+}
+
+/*
+ * Retire the class c slabs with all of their buffers on the global free
+ * list, bar one kept back so that use hovering around a slab boundary
+ * does not allocate and retire a slab each time.
+ */
+static void
+slab_trim(int c)
+{
+    bufctl_t	*pcp, *next, *first = NULL, *last = NULL;
+    slab_t	*sp, *spnext, *spare = NULL;
+
+    PM_LOCK(slab_lock);
+    pcp = atomic_swap(&free_list[c], NULL);
+    for (next = pcp; next != NULL; next = next->bc_next)
+	next->bc_slab->sl_mark++;
+    for (; pcp != NULL; pcp = next) {
+	next = pcp->bc_next;
+	sp = pcp->bc_slab;
+	if (sp->sl_mark == sp->sl_count) {
+	    if (spare == NULL)
+		spare = sp;
+	    if (sp != spare)
+		continue;	/* slab will be retired */
+	}
+	pcp->bc_next = NULL;
+	if (last == NULL)
+	    first = pcp;
+	else
+	    last->bc_next = pcp;
+	last = pcp;
+    }
+    for (sp = slab_list; sp != NULL; sp = spnext) {
+	spnext = sp->sl_next;
+	if (sp->sl_class != c)
+	    continue;
+	if (sp->sl_mark == sp->sl_count && sp != spare)
+	    slab_retire(sp);
+	else
+	    sp->sl_mark = 0;
+    }
+    if (first != NULL)
+	free_list_link(c, first, last);
+    PM_UNLOCK(slab_lock);
+}
+
+static bufctl_t *
+bufctl_init(slab_t *sp, char *addr)
+{
+    bufctl_t	*pcp = (bufctl_t *)addr;
+
+    pcp->bc_pincnt = 0;
+    pcp->bc_size = 0;
+    pcp->bc_buf = addr + BUFCTL_SIZE;
+    pcp->bc_slab = sp;
+    pcp->bc_next = NULL;
+    return pcp;
+}
+
+/*
+ * Carve a new slab into buffers of class c, returning one of them and
+ * adding the others to the free lists.
+ */
+static bufctl_t *
+slab_alloc(int c, bufcache_t *cp)
+{
+    size_t	stride = BUFCTL_SIZE + ALIGN16((size_t)1 << (c + MIN_SHIFT));
+    int		count = (SLAB_SIZE - SLAB_HDR_SIZE) / stride;
+    bufctl_t	*pcp, *first = NULL, *rest;
+    slab_t	*sp;
+    int		i;
+
+    if ((sp = slab_create(SLAB_SIZE, c, stride, count)) == NULL)
+	return NULL;
+    for (i = count - 1; i > 0; i--) {
+	pcp = bufctl_init(sp, sp->sl_first + i * stride);
+	pcp->bc_next = first;
+	first = pcp;
+    }
+    if (first != NULL && cp != NULL) {
+	/* up to CACHE_MAX for this thread, any others to the global list */
+	for (i = 1, pcp = first; i < CACHE_MAX(c) && pcp->bc_next; i++)
+	    pcp = pcp->bc_next;
+	rest = pcp->bc_next;
+	pcp->bc_next = cp->head[c];
+	cp->head[c] = first;
+	cp->count[c] += i;
+	first = rest;
+    }
+    if (first != NULL)
+	free_list_push(c, first);
+    return bufctl_init(sp, sp->sl_first);
+}
+
+static bufctl_t *
+large_alloc(int need)
+{
+    size_t	length = SLAB_HDR_SIZE + BUFCTL_SIZE + need;
+    slab_t	*sp;
+
+    /* whole chunks, so no other memory shares this page map entry */
+    length = (length + SLAB_SIZE - 1) & ~(SLAB_SIZE - 1);
+    if ((sp = slab_create(length, -1, 0, 1)) == NULL)
+	return NULL;
+    return bufctl_init(sp, sp->sl_first);
+}
+
+static bufctl_t *
+buf_alloc(int need)
+{
+    bufcache_t	*cp;
+    bufctl_t	*pcp;
+    int		count;
+    int		c;
+
+    if ((c = size_class(need)) < 0)
+	return large_alloc(need);
+
+    if ((cp = cache_get()) == NULL) {
+	/* no private free list, just the one buffer */
+	if ((pcp = free_list_take(c, 1, &count)) == NULL)
+	    return slab_alloc(c, NULL);
+	return pcp;
+    }
+    if (cp->head[c] == NULL) {
+	/* refill from the global free list for this class */
+	if ((cp->head[c] = free_list_take(c, CACHE_MAX(c), &count)) == NULL)
+	    return slab_alloc(c, cp);
+	cp->count[c] = count;
+    }
+    pcp = cp->head[c];
+    cp->head[c] = pcp->bc_next;
+    cp->count[c]--;
+    return pcp;
+}
+
+static void
+buf_free(bufctl_t *pcp)
+{
+    bufcache_t	*cp;
+    int		c = pcp->bc_slab->sl_class;
+
+    if (c < 0) {
+	slab_destroy(pcp->bc_slab);
+	return;
+    }
+    if ((cp = cache_get()) != NULL && cp->count[c] < CACHE_MAX(c)) {
+	pcp->bc_next = cp->head[c];
+	cp->head[c] = pcp;
+	cp->count[c]++;
+    }
+    else {
+	pcp->bc_next = NULL;
+	free_list_push(c, pcp);
+    }
+}
+
+/*
+ * Find the pinned buffer containing handle, if any.
+ */
+static bufctl_t *
+buf_lookup(void *handle)
+{
+    char	*p = (char *)handle;
+    slab_t	*sp;
+    bufctl_t	*pcp;
+    size_t	i;
+
+    if ((sp = map_lookup(handle)) == NULL)
+	return NULL;
+    if (sp->sl_class < 0)
+	pcp = (bufctl_t *)sp->sl_first;
+    else {
+	if (p < sp->sl_first)
+	    return NULL;
+	if ((i = (p - sp->sl_first) / sp->sl_stride) >= sp->sl_count)
+	    return NULL;
+	pcp = (bufctl_t *)(sp->sl_first + i * sp->sl_stride);
+    }
+    /* NB: valid range is bc_buf[0 .. bc_size-1] */
+    if (p < pcp->bc_buf || p >= &pcp->bc_buf[pcp->bc_size])
+	return NULL;
+    if (atomic_load_int(&pcp->bc_pincnt) <= 0)
+	return NULL;
+    return pcp;
+}
+
+/*
+ * Call func for each buffer with the slab_lock held, for diagnostics.
+ */
+static void
+buf_walk(void (*func)(const bufctl_t *, void *), void *arg)
+{
+    slab_t	*sp;
+    int		i;
+
+    PM_LOCK(slab_lock);
+    for (sp = slab_list; sp != NULL; sp = sp->sl_next) {
+	for (i = 0; i < sp->sl_count; i++)
+	    func((bufctl_t *)(sp->sl_first + i * sp->sl_stride), arg);
+    }
+    PM_UNLOCK(slab_lock);
+}
+
+static void
+pdubufdump1(const bufctl_t *pcp, void *arg)
+{
+    int		*npinned = (int *)arg;
+
+    if (atomic_load_int(&pcp->bc_pincnt) <= 0)
+	return;
+    if ((*npinned)++ == 0)
+	fprintf(stderr, "   pinned pdubuf[size](pincnt):");
+    fprintf(stderr, " " PRINTF_P_PFX "%p...%p[%d](%d)",
+	    pcp->bc_buf, &pcp->bc_buf[pcp->bc_size - 1], pcp->bc_size,
+	    pcp->bc_pincnt);
+}
+
+static void
+pdubufdump(void)
+{
+    int		npinned = 0;
+
+    /*
+     * Free buffers are not reported, as they are cached per-thread
+     * and (reused) in any order.
+     */
+    buf_walk(pdubufdump1, &npinned);
+    if (npinned > 0)
+	fprintf(stderr, "\n");
+}
+
 __pmPDU *
 __pmFindPDUBuf(int need)
 {
     bufctl_t	*pcp;
-    void	*bcp;
 
     if (unlikely(need < 0)) {
 	/* special diagnostic case ... dump buffer state */
@@ -112,24 +835,10 @@ __pmFindPDUBuf(int need)
 	return NULL;
     }
 
-    if ((pcp = (bufctl_t *)malloc(sizeof(*pcp) + need)) == NULL) {
+    if ((pcp = buf_alloc(need)) == NULL)
 	return NULL;
-    }
-
-    pcp->bc_pincnt = 1;
     pcp->bc_size = need;
-    pcp->bc_buf = ((char *)pcp) + sizeof(*pcp);
-
-    PM_LOCK(pdubuf_lock);
-    /* Insert the node in the tree. */
-    /* THREADSAFE - no locks acquired in bufctl_t_compare() */
-    bcp = tsearch((void *)pcp, &buf_tree, &bufctl_t_compare);
-    if (unlikely(bcp == NULL)) {	/* ENOMEM */
-	PM_UNLOCK(pdubuf_lock);
-	free(pcp);
-	return NULL;
-    }
-    PM_UNLOCK(pdubuf_lock);
+    atomic_store_int(&pcp->bc_pincnt, 1);
 
     if (unlikely(pmDebugOptions.pdubuf)) {
 	fprintf(stderr, "__pmFindPDUBuf(%d) -> " PRINTF_P_PFX "%p\n",
@@ -143,32 +852,15 @@ __pmFindPDUBuf(int need)
 void
 __pmPinPDUBuf(void *handle)
 {
-    bufctl_t	*pcp, pcp_search;
-    void	*bcp;
+    bufctl_t	*pcp;
+    int		pincnt = 0;
 
     assert(((__psint_t)handle % sizeof(int)) == 0);
-    /*
-     * Initialize a dummy bufctl_t to use only as search key;
-     * only its bc_buf & bc_size fields need to be set, as that's
-     * all that bufctl_t_compare will look at.
-     */
-    pcp_search.bc_buf = handle;
-    pcp_search.bc_size = 1;
 
-    PM_LOCK(pdubuf_lock);
-    /* THREADSAFE - no locks acquired in bufctl_t_compare() */
-    bcp = tfind(&pcp_search, &buf_tree, &bufctl_t_compare);
-    /*
-     * NB: don't release the lock until final disposition of this object;
-     * we don't want to play TOCTOU.
-     */
-    if (likely(bcp != NULL)) {
-	pcp = *(bufctl_t **)bcp;
-	assert((&pcp->bc_buf[0] <= (char *)handle) &&
-	       ((char *)handle < &pcp->bc_buf[pcp->bc_size]));
-	pcp->bc_pincnt++;
-    } else {
-	PM_UNLOCK(pdubuf_lock);
+    /* only while still pinned, it may be freed since the lookup */
+    if (likely((pcp = buf_lookup(handle)) != NULL))
+	pincnt = atomic_pin(&pcp->bc_pincnt);
+    if (unlikely(pincnt == 0)) {
 	pmNotifyErr(LOG_WARNING, "__pmPinPDUBuf: " PRINTF_P_PFX "%p not in pool!", handle);
 	if (pmDebugOptions.pdubuf)
 	    pdubufdump();
@@ -178,38 +870,18 @@ __pmPinPDUBuf(void *handle)
     if (unlikely(pmDebugOptions.pdubuf))
 	fprintf(stderr, "__pmPinPDUBuf(" PRINTF_P_PFX "%p) -> pdubuf="
 			PRINTF_P_PFX "%p, pincnt=%d\n", handle,
-		pcp->bc_buf, pcp->bc_pincnt);
-
-    PM_UNLOCK(pdubuf_lock);
+		pcp->bc_buf, pincnt);
 }
 
 int
 __pmUnpinPDUBuf(void *handle)
 {
-    bufctl_t	*pcp, pcp_search;
-    void	*bcp;
+    bufctl_t	*pcp;
+    int		pincnt;
 
     assert(((__psint_t)handle % sizeof(int)) == 0);
-    PM_LOCK(pdubuf_lock);
-
-    /*
-     * Initialize a dummy bufctl_t to use only as search key;
-     * only its bc_buf & bc_size fields need to be set, as that's
-     * all that bufctl_t_compare will look at.
-     */
-    pcp_search.bc_buf = handle;
-    pcp_search.bc_size = 1;
 
-    /* THREADSAFE - no locks acquired in bufctl_t_compare() */
-    bcp = tfind(&pcp_search, &buf_tree, &bufctl_t_compare);
-    /*
-     * NB: don't release the lock until final disposition of this object;
-     * we don't want to play TOCTOU.
-     */
-    if (likely(bcp != NULL)) {
-	pcp = *(bufctl_t **)bcp;
-    } else {
-	PM_UNLOCK(pdubuf_lock);
+    if (unlikely((pcp = buf_lookup(handle)) == NULL)) {
 	if (pmDebugOptions.pdubuf) {
 	    fprintf(stderr, "__pmUnpinPDUBuf(" PRINTF_P_PFX "%p) -> fails\n",
 		    handle);
@@ -217,57 +889,45 @@ __pmUnpinPDUBuf(void *handle)
 	}
 	return 0;
     }
+    pincnt = atomic_add(&pcp->bc_pincnt, -1);
 
     if (unlikely(pmDebugOptions.pdubuf))
 	fprintf(stderr, "__pmUnpinPDUBuf(" PRINTF_P_PFX "%p) -> pdubuf="
 			PRINTF_P_PFX "%p, pincnt=%d\n", handle,
-		pcp->bc_buf, pcp->bc_pincnt - 1);
+		pcp->bc_buf, pincnt);
 
-    assert((&pcp->bc_buf[0] <= (char*)handle) &&
-	   ((char*)handle < &pcp->bc_buf[pcp->bc_size]));
-
-    if (likely(--pcp->bc_pincnt == 0)) {
-	/* THREADSAFE - no locks acquired in bufctl_t_compare() */
-	tdelete(pcp, &buf_tree, &bufctl_t_compare);
-	PM_UNLOCK(pdubuf_lock);
-	free(pcp);
-    }
-    else {
-	PM_UNLOCK(pdubuf_lock);
-    }
+    if (likely(pincnt == 0))
+	buf_free(pcp);
 
     return 1;
 }
 
-/*
- * Used to pass context from __pmCountPDUBuf to the pdubufcount callback.
- * They are protected by the pdubuf_lock mutex.
- */
-static int	pdu_bufcnt_need;
-static unsigned	pdu_bufcnt;
+typedef struct {
+    int		need;
+    int		alloc;
+    int		free;
+} bufcount_t;
 
 static void
-pdubufcount(const void *nodep, const VISIT which, const int depth)
+pdubufcount(const bufctl_t *pcp, void *arg)
 {
-    const bufctl_t	*pcp = *(bufctl_t **)nodep;
+    bufcount_t	*bcp = (bufcount_t *)arg;
+    int		c = pcp->bc_slab->sl_class;
 
-    if (which == postorder || which == leaf)	/* called once per node */
-	if (pcp->bc_size >= pdu_bufcnt_need)
-	    pdu_bufcnt++;
+    if (atomic_load_int(&pcp->bc_pincnt) > 0) {
+	if (pcp->bc_size >= bcp->need)
+	    bcp->alloc++;
+    }
+    else if (c >= 0 && (1 << (c + MIN_SHIFT)) >= bcp->need)
+	bcp->free++;
 }
 
 void
 __pmCountPDUBuf(int need, int *alloc, int *free)
 {
-    PM_LOCK(pdubuf_lock);
-
-    pdu_bufcnt_need = need;
-    pdu_bufcnt = 0;
-    /* THREADSAFE - no locks acquired in pdubufcount() */
-    twalk(buf_tree, &pdubufcount);
-    *alloc = pdu_bufcnt;
-
-    *free = 0;			/* We don't retain freed nodes. */
+    bufcount_t	count = { need, 0, 0 };
 
-    PM_UNLOCK(pdubuf_lock);
+    buf_walk(pdubufcount, &count);
+    *alloc = count.alloc;
+    *free = count.free;
 }
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2017 Red Hat.
+ * Copyright (c) 2017,2026 Red Hat.
  * Copyright (c) 2010 Ken McDonell.  All Rights Reserved.
  * 
  * This library is free software; you can redistribute it and/or modify it
@@ -91,34 +91,28 @@ _pmi_put_result(pmi_context *current, pmResult *result)
 
     needti = 0;
     for (k = 0; k < result->numpmid; k++) {
-	for (m = 0; m < current->nmetric; m++) {
-	    if (result->vset[k]->pmid != current->metric[m].pmid)
-		continue;
-	    if (current->metric[m].meta_done == 0) {
-		char	**namelist = &current->metric[m].name;
-
-		if ((sts = __pmLogPutDesc(acp, &current->metric[m].desc, 1, namelist)) < 0) {
+	if ((m = _pmi_find_pmid(current, result->vset[k]->pmid)) < 0)
+	    continue;
+	if (current->metric[m].meta_done == 0) {
+	    char	**namelist = &current->metric[m].name;
+
+	    if ((sts = __pmLogPutDesc(acp, &current->metric[m].desc, 1, namelist)) < 0) {
+		__pmUnpinPDUBuf(pb);
+		return sts;
+	    }
+	    current->metric[m].meta_done = 1;
+	    needti = 1;
+	}
+	if (current->metric[m].desc.indom != PM_INDOM_NULL &&
+	    (i = _pmi_find_indom(current, current->metric[m].desc.indom)) >= 0) {
+	    if (current->indom[i].meta_done == 0) {
+		if ((sts = __pmLogPutInDom(acp, current->indom[i].indom, &stamp, current->indom[i].ninstance, current->indom[i].inst, current->indom[i].name)) < 0) {
 		    __pmUnpinPDUBuf(pb);
 		    return sts;
 		}
-		current->metric[m].meta_done = 1;
+		current->indom[i].meta_done = 1;
 		needti = 1;
 	    }
-	    if (current->metric[m].desc.indom != PM_INDOM_NULL) {
-		for (i = 0; i < current->nindom; i++) {
-		    if (current->metric[m].desc.indom == current->indom[i].indom) {
-			if (current->indom[i].meta_done == 0) {
-			    if ((sts = __pmLogPutInDom(acp, current->indom[i].indom, &stamp, current->indom[i].ninstance, current->indom[i].inst, current->indom[i].name)) < 0) {
-				__pmUnpinPDUBuf(pb);
-				return sts;
-			    }
-			    current->indom[i].meta_done = 1;
-			    needti = 1;
-			}
-		    }
-		}
-	    }
-	    break;
 	}
     }
     if (needti) {
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2013-2017 Red Hat.
+ * Copyright (c) 2013-2017,2026 Red Hat.
  * Copyright (c) 2010 Ken McDonell.  All Rights Reserved.
  * 
  * This library is free software; you can redistribute it and/or modify it
@@ -209,6 +209,140 @@ pmiErrStr_r(int code, char *buf, int buflen)
     return buf;
 }
 
+/*
+ * Hashed lookups for metrics, indoms and instances, so the cost of
+ * pmiAddMetric(), pmiAddInstance(), pmiPutValue() and pmiGetHandle()
+ * does not grow with the number of metrics and instances already
+ * defined.  The hash data is an index into the relevant array, which
+ * stays valid as the array is realloc'd.
+ */
+
+/*
+ * FNV string hash ... for external instance names only the part up to
+ * the first space is hashed, so names that "match to first space" (see
+ * inst_match() below) always hash to the same key
+ */
+static unsigned int
+strhash(const char *s, int tospace)
+{
+    unsigned int	h = 2166136261;	/* FNV offset_basis */
+    unsigned char	*us = (unsigned char *)s;
+
+    for (; *us != '\0'; us++) {
+	if (tospace && *us == ' ')
+	    break;
+	h ^= *us;
+	h *= 16777619;	/* fnv_prime */
+    }
+    return h;
+}
+
+static void
+index_metric(pmi_context *cp, int m)
+{
+    __pmHashAdd(strhash(cp->metric[m].name, 0), (void *)(__psint_t)m, &cp->hashmetric);
+    __pmHashAdd((unsigned int)cp->metric[m].pmid, (void *)(__psint_t)m, &cp->hashpmid);
+}
+
+static int
+find_metric(pmi_context *cp, const char *name)
+{
+    __pmHashNode	*hp;
+    unsigned int	key = strhash(name, 0);
+    int			m;
+
+    for (hp = __pmHashSearch(key, &cp->hashmetric); hp != NULL; hp = hp->next) {
+	if (hp->key != key)
+	    continue;
+	m = (int)(__psint_t)hp->data;
+	if (strcmp(name, cp->metric[m].name) == 0)
+	    return m;
+    }
+    return -1;
+}
+
+int
+_pmi_find_pmid(pmi_context *cp, pmID pmid)
+{
+    __pmHashNode	*hp;
+    int			m;
+
+    for (hp = __pmHashSearch((unsigned int)pmid, &cp->hashpmid); hp != NULL; hp = hp->next) {
+	if (hp->key != (unsigned int)pmid)
+	    continue;
+	m = (int)(__psint_t)hp->data;
+	if (cp->metric[m].pmid == pmid)
+	    return m;
+    }
+    return -1;
+}
+
+int
+_pmi_find_indom(pmi_context *cp, pmInDom indom)
+{
+    __pmHashNode	*hp;
+
+    for (hp = __pmHashSearch((unsigned int)indom, &cp->hashindom); hp != NULL; hp = hp->next) {
+	if (hp->key == (unsigned int)indom)
+	    return (int)(__psint_t)hp->data;
+    }
+    return -1;
+}
+
+static void
+index_instance(pmi_indom *idp, int j)
+{
+    __pmHashAdd(strhash(idp->name[j], 1), (void *)(__psint_t)j, &idp->hashname);
+    __pmHashAdd((unsigned int)idp->inst[j], (void *)(__psint_t)j, &idp->hashinst);
+}
+
+/*
+ * match to first space rule ... if instance contains a space, then
+ * name matches if it is the same up to and including the first space,
+ * else the whole of instance and name must be the same
+ */
+static int
+inst_match(const char *instance, int spaced, const char *name)
+{
+    if (spaced)
+	return strncmp(instance, name, spaced) == 0;
+    return strcmp(instance, name) == 0;
+}
+
+static int
+find_instance(pmi_indom *idp, const char *instance)
+{
+    __pmHashNode	*hp;
+    unsigned int	key = strhash(instance, 1);
+    const char		*p;
+    int			spaced;
+    int			j;
+
+    for (p = instance; *p && *p != ' '; p++)
+	;
+    spaced = (*p == ' ') ? p - instance + 1: 0;	/* +1 => *must* compare the space too */
+    for (hp = __pmHashSearch(key, &idp->hashname); hp != NULL; hp = hp->next) {
+	if (hp->key != key)
+	    continue;
+	j = (int)(__psint_t)hp->data;
+	if (inst_match(instance, spaced, idp->name[j]))
+	    return j;
+    }
+    return -1;
+}
+
+static int
+find_instid(pmi_indom *idp, int inst)
+{
+    __pmHashNode	*hp;
+
+    for (hp = __pmHashSearch((unsigned int)inst, &idp->hashinst); hp != NULL; hp = hp->next) {
+	if (hp->key == (unsigned int)inst)
+	    return (int)(__psint_t)hp->data;
+    }
+    return -1;
+}
+
 int
 pmiStart(const char *archive, int inherit)
 {
@@ -232,6 +366,10 @@ pmiStart(const char *archive, int inherit)
     current->hostname = NULL;
     current->timezone = NULL;
     current->result = NULL;
+    current->result_gen = 0;
+    __pmHashInit(&current->hashmetric);
+    __pmHashInit(&current->hashpmid);
+    __pmHashInit(&current->hashindom);
     memset((void *)&current->logctl, 0, sizeof(current->logctl));
     memset((void *)&current->archctl, 0, sizeof(current->archctl));
     current->archctl.ac_log = &current->logctl;
@@ -248,6 +386,8 @@ pmiStart(const char *archive, int inherit)
 		current->metric[m].pmid = old_current->metric[m].pmid;
 		current->metric[m].desc = old_current->metric[m].desc;
 		current->metric[m].meta_done = 0;
+		current->metric[m].result_gen = 0;
+		index_metric(current, m);
 	    }
 	}
 	else
@@ -264,6 +404,9 @@ pmiStart(const char *archive, int inherit)
 		current->indom[i].indom = old_current->indom[i].indom;
 		current->indom[i].ninstance = old_current->indom[i].ninstance;
 		current->indom[i].meta_done = 0;
+		__pmHashInit(&current->indom[i].hashname);
+		__pmHashInit(&current->indom[i].hashinst);
+		__pmHashAdd((unsigned int)current->indom[i].indom, (void *)(__psint_t)i, &current->hashindom);
 		if (old_current->indom[i].ninstance > 0) {
 		    current->indom[i].name = (char **)malloc(current->indom[i].ninstance*sizeof(char *));
 		    if (current->indom[i].name == NULL) {
@@ -284,6 +427,7 @@ pmiStart(const char *archive, int inherit)
 			current->indom[i].name[j] = np;
 			np += strlen(np)+1;
 			current->indom[i].inst[j] = old_current->indom[i].inst[j];
+			index_instance(&current->indom[i], j);
 		    }
 		}
 		else {
@@ -402,7 +546,6 @@ valid_pmns_name(const char *name)
 int
 pmiAddMetric(const char *name, pmID pmid, int type, pmInDom indom, int sem, pmUnits units)
 {
-    int		m;
     int		item;
     int		cluster;
     size_t	size;
@@ -414,15 +557,13 @@ pmiAddMetric(const char *name, pmID pmid, int type, pmInDom indom, int sem, pmUn
     if (valid_pmns_name(name) == 0)
 	return current->last_sts = PMI_ERR_BADMETRICNAME;
 
-    for (m = 0; m < current->nmetric; m++) {
-	if (strcmp(name, current->metric[m].name) == 0) {
-	    /* duplicate metric name is not good */
-	    return current->last_sts = PMI_ERR_DUPMETRICNAME;
-	}
-	if (pmid == current->metric[m].pmid) {
-	    /* duplicate metric pmID is not good */
-	    return current->last_sts = PMI_ERR_DUPMETRICID;
-	}
+    if (find_metric(current, name) >= 0) {
+	/* duplicate metric name is not good */
+	return current->last_sts = PMI_ERR_DUPMETRICNAME;
+    }
+    if (_pmi_find_pmid(current, pmid) >= 0) {
+	/* duplicate metric pmID is not good */
+	return current->last_sts = PMI_ERR_DUPMETRICID;
     }
 
     /*
@@ -480,6 +621,8 @@ pmiAddMetric(const char *name, pmID pmid, int type, pmInDom indom, int sem, pmUn
     mp->desc.sem = sem;
     mp->desc.units = units;
     mp->meta_done = 0;
+    mp->result_gen = 0;
+    index_metric(current, current->nmetric-1);
 
     return current->last_sts = 0;
 }
@@ -488,20 +631,16 @@ int
 pmiAddInstance(pmInDom indom, const char *instance, int inst)
 {
     pmi_indom	*idp;
-    const char	*p;
     char	*np;
-    int		spaced;
+    char	*oldbuf;
     int		i;
     int		j;
 
     if (current == NULL)
 	return PM_ERR_NOCONTEXT;
 
-    for (i = 0; i < current->nindom; i++) {
-	if (current->indom[i].indom == indom)
-	    break;
-    }
-    if (i == current->nindom) {
+    if ((i = _pmi_find_indom(current, indom)) < 0) {
+	i = current->nindom;
 	/* extend indom table */
 	current->nindom++;
 	current->indom = (pmi_indom *)realloc(current->indom, current->nindom*sizeof(pmi_indom));
@@ -514,6 +653,9 @@ pmiAddInstance(pmInDom indom, const char *instance, int inst)
 	current->indom[i].inst = NULL;
 	current->indom[i].namebuflen = 0;
 	current->indom[i].namebuf = NULL;
+	__pmHashInit(&current->indom[i].hashname);
+	__pmHashInit(&current->indom[i].hashinst);
+	__pmHashAdd((unsigned int)indom, (void *)(__psint_t)i, &current->hashindom);
     }
     idp = &current->indom[i];
     /*
@@ -521,21 +663,10 @@ pmiAddInstance(pmInDom indom, const char *instance, int inst)
      * to honour unique to first space rule ...
      * duplicate instance internal identifier is also not allowed
      */
-    for (p = instance; *p && *p != ' '; p++)
-	;
-    spaced = (*p == ' ') ? p - instance + 1: 0;	/* +1 => *must* compare the space too */
-    for (j = 0; j < idp->ninstance; j++) {
-	if (spaced) {
-	    if (strncmp(instance, idp->name[j], spaced) == 0)
-		return current->last_sts = PMI_ERR_DUPINSTNAME;
-	} else {
-	    if (strcmp(instance, idp->name[j]) == 0)
-		return current->last_sts = PMI_ERR_DUPINSTNAME;
-	}
-	if (inst == idp->inst[j]) {
-	    return current->last_sts = PMI_ERR_DUPINSTID;
-	}
-    }
+    if (find_instance(idp, instance) >= 0)
+	return current->last_sts = PMI_ERR_DUPINSTNAME;
+    if (find_instid(idp, inst) >= 0)
+	return current->last_sts = PMI_ERR_DUPINSTID;
     /* add instance marks whole indom as needing to be written */
     idp->meta_done = 0;
     idp->ninstance++;
@@ -547,6 +678,7 @@ pmiAddInstance(pmInDom indom, const char *instance, int inst)
     if (idp->inst == NULL) {
 	pmNoMem("pmiAddInstance: inst", idp->ninstance*sizeof(int), PM_FATAL_ERR);
     }
+    oldbuf = idp->namebuf;
     idp->namebuf = (char *)realloc(idp->namebuf, idp->namebuflen+strlen(instance)+1);
     if (idp->namebuf == NULL) {
 	pmNoMem("pmiAddInstance: namebuf", idp->namebuflen+strlen(instance)+1, PM_FATAL_ERR);
@@ -554,12 +686,17 @@ pmiAddInstance(pmInDom indom, const char *instance, int inst)
     strcpy(&idp->namebuf[idp->namebuflen], instance);
     idp->namebuflen += strlen(instance)+1;
     idp->inst[idp->ninstance-1] = inst;
-    /* in case namebuf moves, need to redo name[] pointers */
-    np = idp->namebuf;
-    for (j = 0; j < current->indom[i].ninstance; j++) {
-	idp->name[j] = np;
-	np += strlen(np)+1;
+    if (idp->namebuf != oldbuf) {
+	/* namebuf has moved, need to redo name[] pointers */
+	np = idp->namebuf;
+	for (j = 0; j < idp->ninstance; j++) {
+	    idp->name[j] = np;
+	    np += strlen(np)+1;
+	}
     }
+    else
+	idp->name[idp->ninstance-1] = &idp->namebuf[idp->namebuflen-strlen(instance)-1];
+    index_instance(idp, idp->ninstance-1);
 
     return current->last_sts = 0;
 }
@@ -567,24 +704,15 @@ pmiAddInstance(pmInDom indom, const char *instance, int inst)
 static int
 make_handle(const char *name, const char *instance, pmi_handle *hp)
 {
-    int		m;
     int		i;
     int		j;
-    int		spaced;
-    const char	*p;
-    pmi_indom	*idp;
 
     if (instance != NULL && instance[0] == '\0')
 	/* map "" to NULL to help Perl callers */
 	instance = NULL;
 
-    for (m = 0; m < current->nmetric; m++) {
-	if (strcmp(name, current->metric[m].name) == 0)
-	    break;
-    }
-    if (m == current->nmetric)
+    if ((hp->midx = find_metric(current, name)) < 0)
 	return current->last_sts = PM_ERR_NAME;
-    hp->midx = m;
 
     if (current->metric[hp->midx].desc.indom == PM_INDOM_NULL) {
 	if (instance != NULL) {
@@ -597,31 +725,12 @@ make_handle(const char *name, const char *instance, pmi_handle *hp)
 	if (instance == NULL)
 	    /* don't expect "instance" to be NULL */
 	    return current->last_sts = PMI_ERR_INSTNULL;
-	for (i = 0; i < current->nindom; i++) {
-	    if (current->metric[hp->midx].desc.indom == current->indom[i].indom)
-		break;
-	}
-	if (i == current->nindom)
+	if ((i = _pmi_find_indom(current, current->metric[hp->midx].desc.indom)) < 0)
 	    return current->last_sts = PM_ERR_INDOM;
-	idp = &current->indom[i];
-
 	/* match to first space rule */
-
-	for (p = instance; *p && *p != ' '; p++)
-	    ;
-	spaced = (*p == ' ') ? p - instance + 1: 0;	/* +1 => *must* compare the space too */
-	for (j = 0; j < idp->ninstance; j++) {
-	    if (spaced) {
-		if (strncmp(instance, idp->name[j], spaced) == 0)
-		    break;
-	    } else {
-		if (strcmp(instance, idp->name[j]) == 0)
-		    break;
-	    }
-	}
-	if (j == idp->ninstance)
+	if ((j = find_instance(&current->indom[i], instance)) < 0)
 	    return current->last_sts = PM_ERR_INST;
-	hp->inst = idp->inst[j];
+	hp->inst = current->indom[i].inst[j];
     }
 
     return current->last_sts = 0;
@@ -724,6 +833,99 @@ pmiWrite(int sec, int usec)
     return current->last_sts = sts;
 }
 
+/*
+ * Take the values added by a failed pmiPutRow() back out of the pending
+ * record, keeping any that were there before the row started, e.g. from
+ * pmiPutValue().  Each handle before the failing one added exactly one
+ * value at the end of its metric's vset.  The failing handle added at
+ * most one, and may have replaced its vset's numval with an error code,
+ * so that vset is reset to numval, its count from before the call.
+ * Value sets the row added are then empty, and are freed along with the
+ * record itself if nothing is left in it.
+ */
+static void
+discard_row(pmi_context *pc, int numpmid, const int *handles,
+	const char **values, int failed, int numval)
+{
+    pmResult	*rp = pc->result;
+    pmValueSet	*vsp;
+    pmi_metric	*mp;
+    int		i;
+
+    if (rp == NULL)
+	return;
+    if (handles[failed] > 0 && handles[failed] <= pc->nhandle) {
+	mp = &pc->metric[pc->handle[handles[failed]-1].midx];
+	if (mp->result_gen == pc->result_gen)
+	    rp->vset[mp->vset]->numval = numval;
+    }
+    for (i = failed - 1; i >= 0; i--) {
+	if (values[i] == NULL)
+	    continue;
+	vsp = rp->vset[pc->metric[pc->handle[handles[i]-1].midx].vset];
+	vsp->numval--;
+	if (vsp->valfmt == PM_VAL_DPTR)
+	    free(vsp->vlist[vsp->numval].value.pval);
+    }
+    for (i = 0; i <= failed; i++) {
+	if (values[i] == NULL || handles[i] <= 0 || handles[i] > pc->nhandle)
+	    continue;
+	mp = &pc->metric[pc->handle[handles[i]-1].midx];
+	if (mp->result_gen == pc->result_gen && mp->vset >= numpmid)
+	    mp->result_gen = 0;
+    }
+    for (i = numpmid; i < rp->numpmid; i++)
+	free(rp->vset[i]);
+    rp->numpmid = numpmid;
+    if (numpmid == 0) {
+	pmFreeResult(rp);
+	pc->result = NULL;
+    }
+}
+
+/*
+ * A whole row of values for one timestamp in one call, as if each
+ * handle-value pair was passed to pmiPutValueHandle() and then the
+ * record was written with pmiWrite() ... a NULL value means there
+ * is no value for that handle in this row.  The row is written in
+ * full or not at all.
+ */
+int
+pmiPutRow(int sec, int usec, int nvalue, const int *handles, const char **values)
+{
+    pmi_metric	*mp;
+    int		sts = 0;
+    int		numpmid;
+    int		numval = 0;
+    int		i;
+
+    if (current == NULL)
+	return PM_ERR_NOCONTEXT;
+
+    numpmid = current->result == NULL ? 0 : current->result->numpmid;
+    for (i = 0; i < nvalue; i++) {
+	if (values[i] == NULL)
+	    continue;
+	if (handles[i] <= 0 || handles[i] > current->nhandle) {
+	    sts = PMI_ERR_BADHANDLE;
+	    break;
+	}
+	mp = &current->metric[current->handle[handles[i]-1].midx];
+	if (current->result != NULL && mp->result_gen == current->result_gen)
+	    numval = current->result->vset[mp->vset]->numval;
+	else
+	    numval = 0;
+	if ((sts = _pmi_stuff_value(current, &current->handle[handles[i]-1], values[i])) < 0)
+	    break;
+    }
+    if (sts < 0) {
+	discard_row(current, numpmid, handles, values, i, numval);
+	return current->last_sts = sts;
+    }
+
+    return pmiWrite(sec, usec);
+}
+
 int
 pmiPutResult(const pmResult *result)
 {
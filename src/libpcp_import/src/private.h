@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2013 Red Hat.
+ * Copyright (c) 2013,2026 Red Hat.
  * Copyright (c) 2010 Ken McDonell.  All Rights Reserved.
  * 
  * This library is free software; you can redistribute it and/or modify it
@@ -20,6 +20,9 @@ typedef struct {
     pmID	pmid;
     pmDesc	desc;
     int		meta_done;
+    int		result_gen;	// vset[] is valid if this matches the
+    int		vset;		// context's result_gen
+    int		maxinst;	// largest instance in vset[] so far
 } pmi_metric;
 
 typedef struct {
@@ -30,6 +33,8 @@ typedef struct {
     int		namebuflen;	// names are packed in namebuf[] as
     char	*namebuf;	// required by __pmLogPutInDom()
     int		meta_done;
+    __pmHashCtl	hashname;	// external name (to first space) -> index
+    __pmHashCtl	hashinst;	// internal identifier -> index
 } pmi_indom;
 
 typedef struct {
@@ -45,10 +50,14 @@ typedef struct {
     __pmLogCtl	logctl;
     __pmArchCtl	archctl;
     pmResult	*result;
+    int		result_gen;	// bumped for each new result
     int		nmetric;
     pmi_metric	*metric;
+    __pmHashCtl	hashmetric;	// metric name -> index into metric[]
+    __pmHashCtl	hashpmid;	// pmID -> index into metric[]
     int		nindom;
     pmi_indom	*indom;
+    __pmHashCtl	hashindom;	// pmInDom -> index into indom[]
     int		nhandle;
     pmi_handle	*handle;
     int		last_sts;
@@ -65,6 +74,8 @@ typedef struct {
 # define _PMI_HIDDEN
 #endif
 
+extern int _pmi_find_pmid(pmi_context *, pmID) _PMI_HIDDEN;
+extern int _pmi_find_indom(pmi_context *, pmInDom) _PMI_HIDDEN;
 extern int _pmi_stuff_value(pmi_context *, pmi_handle *, const char *) _PMI_HIDDEN;
 extern int _pmi_put_result(pmi_context *, pmResult *) _PMI_HIDDEN;
 extern int _pmi_end(pmi_context *) _PMI_HIDDEN;
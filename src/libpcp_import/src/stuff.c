@@ -1,4 +1,5 @@
 /*
+ * Copyright (c) 2026 Red Hat.
  * Copyright (c) 2010 Ken McDonell.  All Rights Reserved.
  * 
  * This library is free software; you can redistribute it and/or modify it
@@ -46,19 +47,26 @@ _pmi_stuff_value(pmi_context *current, pmi_handle *hp, const char *value)
 	current->result->numpmid = 0;
 	current->result->timestamp.tv_sec = 0;
 	current->result->timestamp.tv_usec = 0;
+	current->result_gen++;
     }
     rp = current->result;
 
+    /*
+     * the metric remembers where its vset is in the result, so there
+     * is no need to search for it
+     */
     pmid = current->metric[hp->midx].pmid;
-    for (i = 0; i < rp->numpmid; i++) {
-	if (pmid == rp->vset[i]->pmid) {
-	    if (mp->desc.indom == PM_INDOM_NULL)
-		/* singular metric, cannot have more than one value */
-		return PMI_ERR_DUPVALUE;
-	    break;
-	}
+    if (mp->result_gen == current->result_gen) {
+	i = mp->vset;
+	if (mp->desc.indom == PM_INDOM_NULL)
+	    /* singular metric, cannot have more than one value */
+	    return PMI_ERR_DUPVALUE;
     }
+    else
+	i = rp->numpmid;
     if (i == rp->numpmid) {
+	mp->result_gen = current->result_gen;
+	mp->vset = i;
 	rp->numpmid++;
 	size = sizeof(pmResult) + (rp->numpmid - 1)*sizeof(pmValueSet *);
 	rp = current->result = (pmResult *)realloc(current->result, size);
@@ -72,13 +80,22 @@ _pmi_stuff_value(pmi_context *current, pmi_handle *hp, const char *value)
 	vsp = rp->vset[rp->numpmid-1];
 	vsp->pmid = pmid;
 	vsp->numval = 1;
+	mp->maxinst = hp->inst;
     }
     else {
 	int		j;
-	for (j = 0; j < rp->vset[i]->numval; j++) {
-	    if (rp->vset[i]->vlist[j].inst == hp->inst)
-		/* each metric-instance can appear at most once per pmResult */
-		return PMI_ERR_DUPVALUE;
+	/*
+	 * each metric-instance can appear at most once per pmResult ...
+	 * values usually arrive in ascending instance order, and then
+	 * there is no need to search for a duplicate
+	 */
+	if (hp->inst > mp->maxinst)
+	    mp->maxinst = hp->inst;
+	else {
+	    for (j = 0; j < rp->vset[i]->numval; j++) {
+		if (rp->vset[i]->vlist[j].inst == hp->inst)
+		    return PMI_ERR_DUPVALUE;
+	    }
 	}
 	rp->vset[i]->numval++;
 	size = sizeof(pmValueSet) + (rp->vset[i]->numval-1)*sizeof(pmValue);
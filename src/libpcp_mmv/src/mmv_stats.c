@@ -3,7 +3,7 @@
  *
  * Copyright (C) 2001,2009 Silicon Graphics, Inc.  All rights reserved.
  * Copyright (C) 2009 Aconex.  All rights reserved.
- * Copyright (C) 2013,2016,2018 Red Hat.
+ * Copyright (C) 2013,2016,2018,2026 Red Hat.
  *
  * This program is free software; you can redistribute it and/or modify
  * it under the terms of the GNU Lesser General Public License as published by
@@ -33,6 +33,7 @@ struct mmv_registry {
     __uint32_t		version;
     const char *	file;
     __uint32_t		cluster;
+    __uint32_t		stripes;
     mmv_stats_flags_t	flags;
     void *		addr;
 };
@@ -112,6 +113,29 @@ mmv_lookup_indom2(__int32_t indom, const mmv_indom2_t *in2, int nindoms)
     return NULL;
 }
 
+/*
+ * Integer and floating point counters may be striped across per-thread
+ * slots; other types and semantics always use the value itself.
+ */
+static int
+mmv_stripable(mmv_metric_type_t type, mmv_metric_sem_t semantics)
+{
+    if (semantics != MMV_SEM_COUNTER)
+	return 0;
+    switch (type) {
+    case MMV_TYPE_I32:
+    case MMV_TYPE_U32:
+    case MMV_TYPE_I64:
+    case MMV_TYPE_U64:
+    case MMV_TYPE_FLOAT:
+    case MMV_TYPE_DOUBLE:
+	return 1;
+    default:
+	break;
+    }
+    return 0;
+}
+
 static __uint64_t
 mmv_generation(void)
 {
@@ -131,7 +155,7 @@ mmv_init(const char *fname, int version,
 		const mmv_indom_t *in1, int nindom1,
 		const mmv_metric2_t *st2, int nmetric2,
 		const mmv_indom2_t *in2, int nindom2,
-		const mmv_label_t *lb, int nlabels)
+		const mmv_label_t *lb, int nlabels, int nstripes)
 {
     mmv_disk_instance2_t *inlist2;
     mmv_disk_instance_t *inlist1;
@@ -141,6 +165,7 @@ mmv_init(const char *fname, int version,
     mmv_disk_indom_t *domlist;
     mmv_disk_value_t *vlist;
     mmv_disk_label_t *lblist;
+    mmv_disk_stripe_t *stlist;
     mmv_disk_header_t *hdr;
     mmv_disk_toc_t *toc;
     const mmv_indom_t *mi1;
@@ -151,6 +176,8 @@ mmv_init(const char *fname, int version,
     __uint64_t values_offset;		/* anchor start of values section */
     __uint64_t strings_offset;		/* anchor start of any/all strings */
     __uint64_t labels_offset;		/* anchor start of any/all labels */
+    __uint64_t stripes_offset;		/* anchor start of stripe entries */
+    __uint64_t slots_offset;		/* anchor start of stripe slots */
     void *addr;
     size_t size;
     __uint64_t offset;
@@ -158,6 +185,7 @@ mmv_init(const char *fname, int version,
     int ninstances = 0;
     int nstrings = 0;
     int nvalues = 0;
+    int nstriped = 0;
 
     for (i = 0; i < nindom1; i++) {
 	ninstances += in1[i].count;
@@ -186,10 +214,14 @@ mmv_init(const char *fname, int version,
 	    mi1 = mmv_lookup_indom(st1[i].indom, in1, nindom1);
 	    if (st1[i].type == MMV_TYPE_STRING)
 		nstrings += mi1->count;
+	    if (nstripes && mmv_stripable(st1[i].type, st1[i].semantics))
+		nstriped += mi1->count;
 	    nvalues += mi1->count;
 	} else {
 	    if (st1[i].type == MMV_TYPE_STRING)
 		nstrings++;
+	    if (nstripes && mmv_stripable(st1[i].type, st1[i].semantics))
+		nstriped++;
 	    nvalues++;
 	}
     }
@@ -205,16 +237,20 @@ mmv_init(const char *fname, int version,
 	    mi2 = mmv_lookup_indom2(st2[i].indom, in2, nindom2);
 	    if (st2[i].type == MMV_TYPE_STRING)
 		nstrings += mi2->count;
+	    if (nstripes && mmv_stripable(st2[i].type, st2[i].semantics))
+		nstriped += mi2->count;
 	    nvalues += mi2->count;
 	} else {
 	    if (st2[i].type == MMV_TYPE_STRING)
 		nstrings++;
+	    if (nstripes && mmv_stripable(st2[i].type, st2[i].semantics))
+		nstriped++;
 	    nvalues++;
 	}
     }
     
     /* TOC follows header, with enough entries to hold */
-    /* indoms, instances, metrics, values, strings, and labels */
+    /* indoms, instances, metrics, values, strings, labels and stripes */
     size = sizeof(mmv_disk_toc_t) * 2;
     if (nindom1 || nindom2)
 	size += sizeof(mmv_disk_toc_t) * 2;
@@ -223,6 +259,8 @@ mmv_init(const char *fname, int version,
     if (nlabels) {
 	size += sizeof(mmv_disk_toc_t) * 1;
     }
+    if (nstriped)
+	size += sizeof(mmv_disk_toc_t) * 1;
     indoms_offset = sizeof(mmv_disk_header_t) + size;
 
     /* Following the indom definitions are the actual instances */
@@ -267,8 +305,15 @@ mmv_init(const char *fname, int version,
     size = nstrings * sizeof(mmv_disk_string_t);
     labels_offset = strings_offset + size;
 
-    /* End of file follows all of the actual strings */
-    size = labels_offset + nlabels * sizeof(mmv_disk_label_t);
+    /* Following the labels are the stripe entries */
+    stripes_offset = labels_offset + nlabels * sizeof(mmv_disk_label_t);
+
+    /* Then the stripe slots themselves, each on its own cache line */
+    size = stripes_offset + nstriped * sizeof(mmv_disk_stripe_t);
+    slots_offset = (size + MMV_STRIPE_SIZE - 1) & ~(MMV_STRIPE_SIZE - 1);
+
+    /* End of file follows all of the stripe slots */
+    size = slots_offset + (size_t)nstriped * nstripes * MMV_STRIPE_SIZE;
 
     if ((addr = mmv_mapping_init(fname, size)) == NULL)
 	return NULL;
@@ -296,6 +341,8 @@ mmv_init(const char *fname, int version,
 	hdr->tocs += 1;
     if (nlabels)
 	hdr->tocs += 1;    
+    if (nstriped)
+	hdr->tocs += 1;
     hdr->flags = fl;
     hdr->cluster = cluster;
     hdr->process = (__int32_t)getpid();
@@ -333,6 +380,12 @@ mmv_init(const char *fname, int version,
 	toc[tocidx].offset = labels_offset;
 	tocidx++;
     }
+    if (nstriped) {
+	toc[tocidx].type = MMV_TOC_STRIPES;
+	toc[tocidx].count = nstriped;
+	toc[tocidx].offset = stripes_offset;
+	tocidx++;
+    }
 
     /* Indom section */
     domlist = (mmv_disk_indom_t *)((char *)addr + indoms_offset);
@@ -613,6 +666,34 @@ mmv_init(const char *fname, int version,
 	memcpy(lblist[i].payload, lb[i].payload, MMV_LABELMAX);
     }
 
+    /* Stripes section - value extra field refers to its stripe entry */
+    stlist = (mmv_disk_stripe_t *)((char *)addr + stripes_offset);
+    for (i = j = 0; nstriped && i < nvalues; i++) {
+	mmv_metric_type_t type;
+	mmv_metric_sem_t semantics;
+
+	if (version == MMV_VERSION1) {
+	    mmv_disk_metric_t *m1 = (mmv_disk_metric_t *)
+			((char *)addr + vlist[i].metric);
+	    type = m1->type;
+	    semantics = m1->semantics;
+	} else {
+	    mmv_disk_metric2_t *m2 = (mmv_disk_metric2_t *)
+			((char *)addr + vlist[i].metric);
+	    type = m2->type;
+	    semantics = m2->semantics;
+	}
+	if (!mmv_stripable(type, semantics))
+	    continue;
+	stlist[j].value = values_offset + i * sizeof(mmv_disk_value_t);
+	stlist[j].count = nstripes;
+	stlist[j].padding = 0;
+	stlist[j].offset = slots_offset +
+			(__uint64_t)j * nstripes * MMV_STRIPE_SIZE;
+	vlist[i].extra = stripes_offset + j * sizeof(mmv_disk_stripe_t);
+	j++;
+    }
+
     /* Complete - unlock the header, PMDA can read now */
     hdr->g2 = hdr->g1;
 
@@ -684,7 +765,7 @@ mmv_stats_init(const char *fname,
 
     return mmv_init(fname, version, cluster, flags,
 		    st, nmetrics, in, nindoms, 
-		    NULL, 0, NULL, 0, NULL, 0);
+		    NULL, 0, NULL, 0, NULL, 0, 0);
 }
 
 static int
@@ -768,7 +849,7 @@ mmv_stats2_init(const char *fname,
 	return NULL;
 
     return mmv_init(fname, version, cluster, flags,
-		    NULL, 0, NULL, 0, st, nmetrics, in, nindoms, NULL, 0);
+		    NULL, 0, NULL, 0, st, nmetrics, in, nindoms, NULL, 0, 0);
 }
 
 mmv_registry_t *
@@ -905,7 +986,7 @@ mmv_stats_add_instance(mmv_registry_t *registry, int serial,
 	inst_aux[registry->indoms[i].count].external = (char *) instname;
 
 	registry->indoms[i].count++;
-
+	break;
     }
     if (i == registry->nindoms) {
 	/* indom with that serial number was not found */
@@ -1178,6 +1259,228 @@ mmv_stats_add_instance_label(mmv_registry_t *registry, int serial, int instid,
     return 0;
 }
 
+int
+mmv_stats_set_stripes(mmv_registry_t *registry, int count)
+{
+    if (registry == NULL) {
+	setoserror(EFAULT);
+	return -1;
+    }
+    if (count < 0 || count > MMV_STRIPE_MAX) {
+	setoserror(EINVAL);
+	return -1;
+    }
+    registry->stripes = count;
+    return 0;
+}
+
+/*
+ * Name-keyed index over the values of each mapping, built on the first
+ * lookup and keyed by the mapping address.  The header generation guards
+ * against a later mapping being placed at a recycled address.
+ *
+ * Each index is built under mmv_index_lock and only then published on
+ * the mmv_indexes list, after which it is read-only, so lookups walk the
+ * list and search the index without taking any lock (where the compiler
+ * provides atomic builtins).  List entries are never freed - an index
+ * that is dropped or out of date has its addr cleared and its values
+ * freed, and the entry is reused for the next index built.
+ */
+#if defined(__ATOMIC_RELAXED)
+#define MMV_ATOMICS	1
+#define mmv_index_load(p)	__atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define mmv_index_store(p, v)	__atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#else
+#define mmv_index_load(p)	(*(p))
+#define mmv_index_store(p, v)	(*(p) = (v))
+#endif
+
+typedef struct mmv_index {
+    void *		addr;		/* start of the mapping, or NULL */
+    __uint64_t		gen;		/* header generation when indexed */
+    __pmHashCtl		values;		/* name[/instance] -> value slot */
+    struct mmv_index *	next;
+} mmv_index_t;
+
+static mmv_index_t	*mmv_indexes;	/* published, entries never freed */
+#ifdef PM_MULTI_THREAD
+static pthread_mutex_t	mmv_index_lock = PTHREAD_MUTEX_INITIALIZER;
+#else
+static void		*mmv_index_lock;
+#endif
+
+static unsigned int
+mmv_name_hash(const char *metric, const char *inst)
+{
+    unsigned int h = 2166136261U;	/* FNV-1a */
+
+    while (*metric)
+	h = (h ^ (unsigned char)*metric++) * 16777619U;
+    if (inst != NULL) {
+	h = (h ^ '/') * 16777619U;
+	while (*inst)
+	    h = (h ^ (unsigned char)*inst++) * 16777619U;
+    }
+    return h;
+}
+
+/*
+ * Return the metric name and external instance name (NULL for singular
+ * metrics) of one value slot.
+ */
+static void
+mmv_value_names(void *addr, int version, mmv_disk_value_t *v,
+		const char **metric, const char **inst)
+{
+    mmv_disk_string_t *s;
+
+    if (version == MMV_VERSION1) {
+	mmv_disk_metric_t *m = (mmv_disk_metric_t *)
+					((char *)addr + v->metric);
+	*metric = m->name;
+	if (mmv_singular(m->indom))
+	    *inst = NULL;
+	else
+	    *inst = ((mmv_disk_instance_t *)
+			((char *)addr + v->instance))->external;
+    } else {
+	mmv_disk_metric2_t *m = (mmv_disk_metric2_t *)
+					((char *)addr + v->metric);
+	s = (mmv_disk_string_t *)((char *)addr + m->name);
+	*metric = s->payload;
+	if (mmv_singular(m->indom))
+	    *inst = NULL;
+	else {
+	    mmv_disk_instance2_t *in = (mmv_disk_instance2_t *)
+					((char *)addr + v->instance);
+	    s = (mmv_disk_string_t *)((char *)addr + in->external);
+	    *inst = s->payload;
+	}
+    }
+}
+
+static mmv_disk_value_t *
+mmv_index_search(__pmHashCtl *values, void *addr, int version,
+		const char *metric, const char *inst)
+{
+    __pmHashNode *hp;
+    const char *m, *i;
+    unsigned int key = mmv_name_hash(metric, inst);
+
+    for (hp = __pmHashSearch(key, values); hp != NULL; hp = hp->next) {
+	if (hp->key != key)
+	    continue;
+	mmv_value_names(addr, version, (mmv_disk_value_t *)hp->data, &m, &i);
+	if (strcmp(m, metric) != 0)
+	    continue;
+	if ((inst == NULL && i == NULL) ||
+	    (inst != NULL && i != NULL && strcmp(i, inst) == 0))
+	    return (mmv_disk_value_t *)hp->data;
+    }
+    return NULL;
+}
+
+static __pmHashWalkState
+mmv_index_free_value(const __pmHashNode *tp, void *cp)
+{
+    (void)tp;
+    (void)cp;
+    return PM_HASH_WALK_DELETE_NEXT;
+}
+
+static void
+mmv_index_free_values(__pmHashCtl *values)
+{
+    __pmHashWalkCB(mmv_index_free_value, NULL, values);
+    __pmHashClear(values);
+}
+
+/*
+ * Find the published index of the mapping at addr, if it is current.
+ */
+static mmv_index_t *
+mmv_index_find(void *addr, __uint64_t gen)
+{
+    mmv_index_t *ip;
+
+    for (ip = mmv_index_load(&mmv_indexes); ip != NULL; ip = ip->next) {
+	if (mmv_index_load(&ip->addr) == addr)
+	    return ip->gen == gen ? ip : NULL;
+    }
+    return NULL;
+}
+
+/*
+ * Retire the index of the mapping at addr, called with mmv_index_lock
+ * held.  The entry stays on the list for reuse.
+ */
+static void
+mmv_index_retire(void *addr)
+{
+    mmv_index_t *ip;
+
+    for (ip = mmv_indexes; ip != NULL; ip = ip->next) {
+	if (ip->addr == addr) {
+	    mmv_index_store(&ip->addr, NULL);
+	    mmv_index_free_values(&ip->values);
+	    break;
+	}
+    }
+}
+
+/*
+ * Build and publish the index of the mapping at addr, called with
+ * mmv_index_lock held.
+ */
+static mmv_index_t *
+mmv_index_create(void *addr, mmv_disk_toc_t *toc)
+{
+    mmv_disk_header_t *hdr = (mmv_disk_header_t *)addr;
+    mmv_disk_value_t *v = (mmv_disk_value_t *)((char *)addr + toc->offset);
+    mmv_index_t *ip;
+    __pmHashCtl values;
+    const char *metric, *inst;
+    int j;
+
+    memset(&values, 0, sizeof(values));
+    for (j = 0; j < toc->count; j++) {
+	mmv_value_names(addr, hdr->version, &v[j], &metric, &inst);
+	/* first value slot with a given name wins, as for a linear scan */
+	if (mmv_index_search(&values, addr, hdr->version, metric, inst) != NULL)
+	    continue;
+	if (__pmHashAdd(mmv_name_hash(metric, inst), &v[j], &values) < 0) {
+	    mmv_index_free_values(&values);
+	    return NULL;
+	}
+    }
+
+    /* any index of an earlier mapping at this address is out of date */
+    mmv_index_retire(addr);
+    for (ip = mmv_indexes; ip != NULL; ip = ip->next)
+	if (ip->addr == NULL)
+	    break;
+    if (ip == NULL) {
+	if ((ip = (mmv_index_t *)calloc(1, sizeof(mmv_index_t))) == NULL) {
+	    mmv_index_free_values(&values);
+	    return NULL;
+	}
+	ip->next = mmv_indexes;
+	mmv_index_store(&mmv_indexes, ip);
+    }
+    ip->gen = hdr->g1;
+    ip->values = values;
+    mmv_index_store(&ip->addr, addr);
+    return ip;
+}
+
+static void
+mmv_index_drop(void *addr)
+{
+    PM_LOCK(mmv_index_lock);
+    mmv_index_retire(addr);
+    PM_UNLOCK(mmv_index_lock);
+}
+
 void *
 mmv_stats_start(mmv_registry_t *registry) 
 {
@@ -1195,7 +1498,8 @@ mmv_stats_start(mmv_registry_t *registry)
 				registry->flags, NULL, 0, NULL, 0, 
 				registry->metrics, registry->nmetrics, 
 				registry->indoms, registry->nindoms,
-				registry->labels, registry->nlabels);
+				registry->labels, registry->nlabels,
+				registry->stripes);
     return registry->addr;
 }
 
@@ -1220,8 +1524,10 @@ mmv_stats_stop(const char *fname, void *addr)
 	unlink(path);
     if (fd >= 0)
 	close(fd);
-    if (addr)
+    if (addr) {
+	mmv_index_drop(addr);
 	__pmMemoryUnmap(addr, sbuf.st_size);
+    }
 }
 
 void
@@ -1312,6 +1618,38 @@ mmv_lookup_value_desc2(void *addr, const char *metric, const char *inst,
     return NULL;
 }
 
+static pmAtomValue *
+mmv_lookup_value_index(void *addr, const char *metric, const char *inst,
+			mmv_disk_toc_t *toc)
+{
+    mmv_disk_header_t *hdr = (mmv_disk_header_t *)addr;
+    mmv_disk_value_t *v = NULL;
+    mmv_index_t *ip = NULL;
+
+#if defined(MMV_ATOMICS)
+    /* the common case, no locking once the index is published */
+    ip = mmv_index_find(addr, hdr->g1);
+#endif
+    if (ip == NULL) {
+	PM_LOCK(mmv_index_lock);
+	if ((ip = mmv_index_find(addr, hdr->g1)) == NULL)
+	    ip = mmv_index_create(addr, toc);
+	PM_UNLOCK(mmv_index_lock);
+    }
+    if (ip != NULL) {
+	v = mmv_index_search(&ip->values, addr, hdr->version, metric, inst);
+	if (v == NULL && inst != NULL)
+	    /* instance names are ignored for singular metrics */
+	    v = mmv_index_search(&ip->values, addr, hdr->version, metric, NULL);
+    }
+
+    if (ip == NULL)	/* out of memory, fallback to scanning */
+	return (hdr->version == MMV_VERSION1) ?
+		mmv_lookup_value_desc1(addr, metric, inst, toc) :
+		mmv_lookup_value_desc2(addr, metric, inst, toc);
+    return v ? &v->value : NULL;
+}
+
 pmAtomValue *
 mmv_lookup_value_desc(void *addr, const char *metric, const char *inst)
 {
@@ -1324,16 +1662,58 @@ mmv_lookup_value_desc(void *addr, const char *metric, const char *inst)
 	if (hdr->version == MMV_VERSION1) {
 	    for (i = 0; i < hdr->tocs; i++)
 		if (toc[i].type == MMV_TOC_VALUES)
-		    return mmv_lookup_value_desc1(addr, metric, inst, &toc[i]);
+		    return mmv_lookup_value_index(addr, metric, inst, &toc[i]);
 	} else {
 	    for (i = 0; i < hdr->tocs; i++)
 		if (toc[i].type == MMV_TOC_VALUES)
-		    return mmv_lookup_value_desc2(addr, metric, inst, &toc[i]);
+		    return mmv_lookup_value_index(addr, metric, inst, &toc[i]);
 	}
     }
     return NULL;
 }
 
+/*
+ * Atomic value updates, for use by multi-threaded producers.  Where the
+ * compiler provides no atomic builtins a single mutex is used instead.
+ */
+#if !defined(MMV_ATOMICS)
+#ifdef PM_MULTI_THREAD
+static pthread_mutex_t	mmv_atomic_lock = PTHREAD_MUTEX_INITIALIZER;
+#else
+static void		*mmv_atomic_lock;
+#endif
+#endif
+
+static __uint32_t	mmv_stripe_next;	/* stripe for the next thread */
+#ifdef HAVE___THREAD
+static __thread __uint32_t mmv_stripe_id;	/* stripe of this thread + 1 */
+#endif
+
+static int
+mmv_value_type(void *addr, mmv_disk_value_t *v)
+{
+    mmv_disk_header_t *hdr = (mmv_disk_header_t *)addr;
+
+    if (hdr->version == MMV_VERSION1)
+	return ((mmv_disk_metric_t *)((char *)addr + v->metric))->type;
+    return ((mmv_disk_metric2_t *)((char *)addr + v->metric))->type;
+}
+
+static mmv_disk_stripe_t *
+mmv_value_stripe(void *addr, mmv_disk_value_t *v, int type)
+{
+    if (v->extra == 0 || type == MMV_TYPE_STRING || type == MMV_TYPE_ELAPSED)
+	return NULL;
+    return (mmv_disk_stripe_t *)((char *)addr + v->extra);
+}
+
+static pmAtomValue *
+mmv_stripe_slot(void *addr, mmv_disk_stripe_t *sp, __uint32_t slot)
+{
+    return (pmAtomValue *)((char *)addr + sp->offset +
+			    (__uint64_t)slot * MMV_STRIPE_SIZE);
+}
+
 void
 mmv_inc_value(void *addr, pmAtomValue *av, double inc)
 {
@@ -1390,7 +1770,8 @@ mmv_set_value(void *addr, pmAtomValue *av, double val)
     if (av != NULL && addr != NULL) {
 	mmv_disk_header_t *hdr = (mmv_disk_header_t *)addr;
 	mmv_disk_value_t *v = (mmv_disk_value_t *)av;
-	int type;
+	mmv_disk_stripe_t *sp;
+	int i, type;
 
 	if (hdr->version == MMV_VERSION1) {
 	    mmv_disk_metric_t *m = (mmv_disk_metric_t *)
@@ -1427,6 +1808,10 @@ mmv_set_value(void *addr, pmAtomValue *av, double val)
 	default:
 	    break;
 	}
+	if ((sp = mmv_value_stripe(addr, v, type)) != NULL) {
+	    for (i = 0; i < sp->count; i++)
+		memset(mmv_stripe_slot(addr, sp, i), 0, sizeof(pmAtomValue));
+	}
     }
 }
 
@@ -1464,6 +1849,197 @@ mmv_set_string(void *addr, pmAtomValue *av, const char *string, int size)
     }
 }
 
+/*
+ * Threads are handed stripes round-robin on their first striped update
+ * and keep that stripe thereafter; without thread-private storage all
+ * threads share the first stripe.
+ */
+static __uint32_t
+mmv_stripe_index(__uint32_t count)
+{
+#ifdef HAVE___THREAD
+    if (mmv_stripe_id == 0) {
+#if defined(MMV_ATOMICS)
+	mmv_stripe_id = __atomic_add_fetch(&mmv_stripe_next, 1, __ATOMIC_RELAXED);
+#else
+	PM_LOCK(mmv_atomic_lock);
+	mmv_stripe_id = ++mmv_stripe_next;
+	PM_UNLOCK(mmv_atomic_lock);
+#endif
+    }
+    return (mmv_stripe_id - 1) % count;
+#else
+    (void)mmv_stripe_next;
+    return 0;
+#endif
+}
+
+static void
+mmv_atomic_add(pmAtomValue *av, int type, double inc)
+{
+#if defined(MMV_ATOMICS)
+    switch (type) {
+    case MMV_TYPE_I32:
+	__atomic_fetch_add(&av->l, (__int32_t)inc, __ATOMIC_RELAXED);
+	break;
+    case MMV_TYPE_U32:
+	__atomic_fetch_add(&av->ul, (__uint32_t)inc, __ATOMIC_RELAXED);
+	break;
+    case MMV_TYPE_I64:
+    case MMV_TYPE_ELAPSED:
+	__atomic_fetch_add(&av->ll, (__int64_t)inc, __ATOMIC_RELAXED);
+	break;
+    case MMV_TYPE_U64:
+	__atomic_fetch_add(&av->ull, (__uint64_t)inc, __ATOMIC_RELAXED);
+	break;
+    case MMV_TYPE_FLOAT: {
+	float old, new;
+
+	__atomic_load(&av->f, &old, __ATOMIC_RELAXED);
+	do {
+	    new = old + (float)inc;
+	} while (!__atomic_compare_exchange(&av->f, &old, &new, 1,
+				__ATOMIC_RELAXED, __ATOMIC_RELAXED));
+	break;
+    }
+    case MMV_TYPE_DOUBLE: {
+	double old, new;
+
+	__atomic_load(&av->d, &old, __ATOMIC_RELAXED);
+	do {
+	    new = old + inc;
+	} while (!__atomic_compare_exchange(&av->d, &old, &new, 1,
+				__ATOMIC_RELAXED, __ATOMIC_RELAXED));
+	break;
+    }
+    default:
+	break;
+    }
+#else
+    PM_LOCK(mmv_atomic_lock);
+    switch (type) {
+    case MMV_TYPE_I32:
+	av->l += (__int32_t)inc;
+	break;
+    case MMV_TYPE_U32:
+	av->ul += (__uint32_t)inc;
+	break;
+    case MMV_TYPE_I64:
+    case MMV_TYPE_ELAPSED:
+	av->ll += (__int64_t)inc;
+	break;
+    case MMV_TYPE_U64:
+	av->ull += (__uint64_t)inc;
+	break;
+    case MMV_TYPE_FLOAT:
+	av->f += (float)inc;
+	break;
+    case MMV_TYPE_DOUBLE:
+	av->d += inc;
+	break;
+    default:
+	break;
+    }
+    PM_UNLOCK(mmv_atomic_lock);
+#endif
+}
+
+static void
+mmv_atomic_store(pmAtomValue *av, int type, double val)
+{
+    pmAtomValue tmp;
+
+    memset(&tmp, 0, sizeof(tmp));
+    switch (type) {
+    case MMV_TYPE_I32:
+	tmp.l = (__int32_t)val;
+	break;
+    case MMV_TYPE_U32:
+	tmp.ul = (__uint32_t)val;
+	break;
+    case MMV_TYPE_I64:
+    case MMV_TYPE_ELAPSED:
+	tmp.ll = (__int64_t)val;
+	break;
+    case MMV_TYPE_U64:
+	tmp.ull = (__uint64_t)val;
+	break;
+    case MMV_TYPE_FLOAT:
+	tmp.f = (float)val;
+	break;
+    case MMV_TYPE_DOUBLE:
+	tmp.d = val;
+	break;
+    default:
+	return;
+    }
+    /* all pmAtomValue numeric fields share the first 8 bytes */
+#if defined(MMV_ATOMICS)
+    __atomic_store_n(&av->ull, tmp.ull, __ATOMIC_RELAXED);
+#else
+    PM_LOCK(mmv_atomic_lock);
+    av->ull = tmp.ull;
+    PM_UNLOCK(mmv_atomic_lock);
+#endif
+}
+
+static __int64_t
+mmv_atomic_exchange(__int64_t *ip, __int64_t val)
+{
+    __int64_t old;
+
+#if defined(MMV_ATOMICS)
+    old = __atomic_exchange_n(ip, val, __ATOMIC_RELAXED);
+#else
+    PM_LOCK(mmv_atomic_lock);
+    old = *ip;
+    *ip = val;
+    PM_UNLOCK(mmv_atomic_lock);
+#endif
+    return old;
+}
+
+void
+mmv_atomic_inc_value(void *addr, pmAtomValue *av, double inc)
+{
+    if (av != NULL && addr != NULL) {
+	mmv_disk_value_t *v = (mmv_disk_value_t *)av;
+	mmv_disk_stripe_t *sp;
+	int type = mmv_value_type(addr, v);
+
+	if (type == MMV_TYPE_ELAPSED) {
+	    if (inc < 0)
+		mmv_atomic_exchange(&v->extra, (__int64_t)inc);
+	    else
+		mmv_atomic_add(&v->value, type,
+			mmv_atomic_exchange(&v->extra, 0) + (__int64_t)inc);
+	} else if ((sp = mmv_value_stripe(addr, v, type)) != NULL) {
+	    mmv_atomic_add(mmv_stripe_slot(addr, sp, mmv_stripe_index(sp->count)),
+			type, inc);
+	} else {
+	    mmv_atomic_add(&v->value, type, inc);
+	}
+    }
+}
+
+void
+mmv_atomic_set_value(void *addr, pmAtomValue *av, double val)
+{
+    if (av != NULL && addr != NULL) {
+	mmv_disk_value_t *v = (mmv_disk_value_t *)av;
+	mmv_disk_stripe_t *sp;
+	int i, type = mmv_value_type(addr, v);
+
+	mmv_atomic_store(&v->value, type, val);
+	if (type == MMV_TYPE_ELAPSED)
+	    mmv_atomic_exchange(&v->extra, 0);
+	else if ((sp = mmv_value_stripe(addr, v, type)) != NULL) {
+	    for (i = 0; i < sp->count; i++)
+		mmv_atomic_store(mmv_stripe_slot(addr, sp, i), type, 0);
+	}
+    }
+}
+
 /*
  * Simple wrapper routines
  */
@@ -1567,3 +2143,59 @@ mmv_stats_set_strlen(void *addr, const char *metric,
 	mmv_set_string(addr, mmv_metric, string, len);
     }
 }
+
+void
+mmv_stats_atomic_add(void *addr,
+	const char *metric, const char *instance, double count)
+{
+    if (addr) {
+	pmAtomValue *mmv_metric;
+	mmv_metric = mmv_lookup_value_desc(addr, metric, instance);
+	if (mmv_metric)
+	    mmv_atomic_inc_value(addr, mmv_metric, count);
+    }
+}
+
+void
+mmv_stats_atomic_inc(void *addr, const char *metric, const char *instance)
+{
+    mmv_stats_atomic_add(addr, metric, instance, 1);
+}
+
+void
+mmv_stats_atomic_set(void *addr,
+	const char *metric, const char *instance, double value)
+{
+    if (addr) {
+	pmAtomValue *mmv_metric;
+	mmv_metric = mmv_lookup_value_desc(addr, metric, instance);
+	if (mmv_metric)
+	    mmv_atomic_set_value(addr, mmv_metric, value);
+    }
+}
+
+pmAtomValue *
+mmv_stats_atomic_interval_start(void *addr, pmAtomValue *value,
+	const char *metric, const char *instance)
+{
+    if (addr) {
+	if (value == NULL)
+	    value = mmv_lookup_value_desc(addr, metric, instance);
+	if (value) {
+	    struct timeval tv;
+	    pmtimevalNow(&tv);
+	    mmv_atomic_inc_value(addr, value, -(tv.tv_sec*1e6 + tv.tv_usec));
+	}
+    }
+    return value;
+}
+
+void
+mmv_stats_atomic_interval_end(void *addr, pmAtomValue *value)
+{
+    if (value && addr) {
+	struct timeval tv;
+	pmtimevalNow(&tv);
+	mmv_atomic_inc_value(addr, value, (tv.tv_sec*1e6 + tv.tv_usec));
+    }
+}
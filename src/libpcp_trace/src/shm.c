@@ -0,0 +1,210 @@
+/*
+ * shm.c - shared memory ring buffer transport for trace data
+ *
+ * Copyright (c) 2026 Red Hat.
+ *
+ * This library is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation; either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public
+ * License for more details.
+ */
+
+#include <inttypes.h>
+#include "pmapi.h"
+#include "libpcp.h"
+#if defined(HAVE_PTHREAD_H)
+#include <pthread.h>
+#endif
+#include "trace.h"
+#include "trace_dev.h"
+
+/*
+ * The ring layout and the protocol between the writers here and the
+ * reader in pmdatrace are described in trace_dev.h.  The mask and the
+ * record base are private copies, so nothing in the shared mapping can
+ * steer a write outside of the ring.
+ *
+ * The ring is created once, under _pmshmlock, and _pmshmhdr is set last
+ * (release) so that a writer seeing it (acquire) sees the rest too.
+ */
+static __pmTraceShmHdr		*_pmshmhdr;
+static __pmTraceShmRecord	*_pmshmring;
+static __uint64_t		_pmshmmask;
+
+#if defined(HAVE_PTHREAD_H)
+static pthread_mutex_t		_pmshmlock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * A forked child must not write into its parent's ring, so drop the
+ * (inherited) mapping and let the next trace call make a new ring.
+ * Only the forking thread survives, so the lock is reset in case some
+ * other thread held it.
+ */
+static void
+_pmtraceshmchild(void)
+{
+    pthread_mutex_init(&_pmshmlock, NULL);
+    _pmshmhdr = NULL;
+    _pmshmring = NULL;
+}
+#endif
+
+static unsigned int
+_pmtraceshmrecords(void)
+{
+    unsigned int	nrecords = TRACE_SHM_RECORDS;
+    unsigned int	want;
+    char		*sptr, *endnum;
+
+    if ((sptr = getenv(TRACE_ENV_SHMSIZE)) != NULL) {
+	want = (unsigned int)strtoul(sptr, &endnum, 0);
+	if (*endnum != '\0' || want == 0)
+	    fprintf(stderr, "trace warning: bad PCP_TRACE_SHM_SIZE ignored.");
+	else {
+	    if (want > TRACE_SHM_MAXRECORDS)
+		want = TRACE_SHM_MAXRECORDS;
+	    for (nrecords = TRACE_SHM_MINRECORDS; nrecords < want; nrecords <<= 1)
+		;
+	}
+    }
+    return nrecords;
+}
+
+#if !defined(IS_MINGW)
+static int
+_pmtraceshmcreate(void)
+{
+    static int		first = 1;
+    __pmTraceShmHdr	*hdr;
+    __pmTraceShmRecord	*ring;
+    unsigned int	nrecords;
+    char		path[MAXPATHLEN];
+    mode_t		cur_umask;
+    size_t		size;
+    pid_t		pid = getpid();
+    int			sep = pmPathSeparator();
+    int			fd, sts = 0;
+
+    if (_pmshmhdr != NULL)	/* another thread got here first */
+	return 0;
+
+#if defined(HAVE_PTHREAD_H)
+    if (first && pthread_atfork(NULL, NULL, _pmtraceshmchild) != 0)
+	return -ENOMEM;
+#endif
+    first = 0;
+
+    nrecords = _pmtraceshmrecords();
+    size = sizeof(__pmTraceShmHdr) + nrecords * sizeof(__pmTraceShmRecord);
+    pmsprintf(path, sizeof(path), "%s%c%s%c%" FMT_PID,
+		pmGetConfig("PCP_TMP_DIR"), sep, TRACE_SHM_DIR, sep, pid);
+
+#ifdef PMTRACE_DEBUG
+    if (__pmstate & PMTRACE_STATE_COMMS)
+	fprintf(stderr, "__pmtraceshmopen: %u records (%zu bytes) in %s\n",
+		nrecords, size, path);
+#endif
+
+    /* a leftover ring from an earlier process with this pid */
+    unlink(path);
+    cur_umask = umask(S_IWGRP | S_IWOTH);
+    fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0644);
+    umask(cur_umask);
+    if (fd < 0)
+	return -oserror();
+    if (ftruncate(fd, size) < 0) {
+	sts = -oserror();
+	close(fd);
+	unlink(path);
+	return sts;
+    }
+    hdr = (__pmTraceShmHdr *)__pmMemoryMap(fd, size, 1);
+    close(fd);
+    if (hdr == NULL) {
+	sts = -oserror();
+	unlink(path);
+	return sts;
+    }
+
+    /*
+     * The new file is zero filled, so no record has a valid seq until
+     * it is written.  Magic goes last, the reader ignores rings without.
+     */
+    ring = (__pmTraceShmRecord *)(hdr + 1);
+    hdr->version = TRACE_SHM_VERSION;
+    hdr->pid = (__int32_t)pid;
+    hdr->nrecords = nrecords;
+    hdr->head = 0;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(hdr->magic, TRACE_SHM_MAGIC, sizeof(hdr->magic));
+
+    _pmshmmask = nrecords - 1;
+    _pmshmring = ring;
+    __atomic_store_n(&_pmshmhdr, hdr, __ATOMIC_RELEASE);
+    return 0;
+}
+#endif
+
+int
+__pmtraceshmopen(void)
+{
+#if defined(IS_MINGW)
+    return -EOPNOTSUPP;
+#else
+    int		sts;
+
+    if (__atomic_load_n(&_pmshmhdr, __ATOMIC_ACQUIRE) != NULL)
+	return 0;
+#if defined(HAVE_PTHREAD_H)
+    pthread_mutex_lock(&_pmshmlock);
+#endif
+    sts = _pmtraceshmcreate();
+#if defined(HAVE_PTHREAD_H)
+    pthread_mutex_unlock(&_pmshmlock);
+#endif
+    return sts;
+#endif
+}
+
+/*
+ * Append one record to the ring - no locks and no system calls, the
+ * only shared write before the record itself is the claim on head.
+ */
+int
+__pmtraceshmput(const char *tag, int taglength, int type, double value)
+{
+    __pmTraceShmHdr	*hdr;
+    __pmTraceShmRecord	*rp;
+    __uint64_t		pos;
+
+    if ((hdr = __atomic_load_n(&_pmshmhdr, __ATOMIC_ACQUIRE)) == NULL) {
+	int	sts;
+
+	/* only after fork, see _pmtraceshmchild() */
+	if ((sts = __pmtraceshmopen()) < 0)
+	    return sts;
+	hdr = __atomic_load_n(&_pmshmhdr, __ATOMIC_ACQUIRE);
+    }
+
+    pos = __atomic_fetch_add(&hdr->head, 1, __ATOMIC_RELAXED);
+    rp = &_pmshmring[pos & _pmshmmask];
+    __atomic_store_n(&rp->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    rp->value = value;
+    rp->type = type;
+    rp->taglength = taglength;
+    memcpy(rp->tag, tag, taglength);
+    __atomic_store_n(&rp->seq, pos + 1, __ATOMIC_RELEASE);
+
+#ifdef PMTRACE_DEBUG
+    if (__pmstate & PMTRACE_STATE_PDU)
+	fprintf(stderr, "__pmtraceshmput: pos=%" PRIu64 " tag=%s type=%d "
+		"value=%g\n", pos, tag, type, value);
+#endif
+    return 0;
+}
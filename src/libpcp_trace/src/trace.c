@@ -1,7 +1,7 @@
 /*
  * trace.c - client-side interface for trace PMDA
  *
- * Copyright (c) 2014 Red Hat.
+ * Copyright (c) 2014,2026 Red Hat.
  * Copyright (c) 1997-2004 Silicon Graphics, Inc.  All Rights Reserved.
  * 
  * This library is free software; you can redistribute it and/or modify it
@@ -33,6 +33,7 @@
 
 static int	_pmtimedout = 1;
 static time_t	_pmttimeout = 0;
+static int	_pmconnected = 0;
 
 static int _pmtraceconnect(int);
 static int _pmtracereconnect(void);
@@ -232,6 +233,12 @@ pmtraceend(const char *tag)
 	hptr->inprogress = 0;
 	hptr->data = pmtimevalSub(&now, &hptr->start);
 
+	if (__pmstate & PMTRACE_STATE_SHM) {
+	    sts = __pmtraceshmput(hptr->tag, hptr->taglength,
+					TRACE_TYPE_TRANSACT, hptr->data);
+	    goto done;
+	}
+
 	if (sts >= 0 && _pmtimedout) {
 	    sts = _pmtracereconnect();
 	    sts = _pmtraceremaperr(sts);
@@ -254,6 +261,8 @@ pmtraceend(const char *tag)
 	}
     }
 
+done:
+
     if (TRACE_UNLOCK != 0)
 	return -oserror();
 
@@ -336,6 +345,9 @@ _pmtracecommon(const char *label, double value, int type)
     }
     first = 0;
 
+    if (__pmstate & PMTRACE_STATE_SHM)	/* no lock and no system calls */
+	return __pmtraceshmput(label, taglength, type, value);
+
     TRACE_LOCK;
 
     if (sts >= 0 && _pmtimedout) {
@@ -648,6 +660,7 @@ static int
 _pmtraceconnect(int doit)
 {
     static int	first = 1;
+    static int	shmsts = 0;
     int		sts = 0;
 
     if (!_pmtimedout)
@@ -657,19 +670,38 @@ _pmtraceconnect(int doit)
 	if (TRACE_LOCK_INIT < 0)
 	    return -oserror();
 	first = 0;
+	if (getenv(TRACE_ENV_SHM) != NULL)
+	    __pmstate |= PMTRACE_STATE_SHM;
 	TRACE_LOCK;
 	sts = __pmhashinit(&_pmtable, 0, sizeof(_pmTraceLibdata),
 						_pmlibcmp, _pmlibdel);
     if (TRACE_UNLOCK != 0)
 	return -oserror();
     }
+    else if (__pmstate & PMTRACE_STATE_SHM)
+	return shmsts;	/* no retries, the ring would not be any different */
     else if (__pmtraceprotocol(TRACE_PROTOCOL_QUERY) == TRACE_PROTOCOL_ASYNC)
 	return PMTRACE_ERR_IPC;
 
-    if (sts >= 0 && doit)
+    if (sts >= 0 && doit && (__pmstate & PMTRACE_STATE_SHM)) {
+	/* any number of threads may be making their first trace call */
+	TRACE_LOCK;
+	if ((sts = shmsts = __pmtraceshmopen()) >= 0)
+	    _pmtimedout = 0;
+	if (TRACE_UNLOCK != 0)
+	    return -oserror();
+#ifdef PMTRACE_DEBUG
+	if (sts < 0 && (__pmstate & PMTRACE_STATE_COMMS))
+	    fprintf(stderr, "_pmtraceconnect: shared memory ring failed: %s\n",
+		    pmErrStr(sts));
+#endif
+    }
+    else if (sts >= 0 && doit)
 	sts = _pmauxtraceconnect();
-    if (sts >= 0)
+    if (sts >= 0) {
 	__pmtraceprotocol(TRACE_PROTOCOL_FINAL);
+	_pmconnected = 1;
+    }
 
     return sts;
 }
@@ -936,6 +968,12 @@ pmtracestate(int code)
 	    /* only can do this before connection established */
 	    return -EINVAL;
     }
+    if (_pmconnected) {
+	/* nor can the transport be changed */
+	if ((code & PMTRACE_STATE_SHM) && !(__pmstate & PMTRACE_STATE_SHM))
+	    return -EINVAL;
+	code = (code & ~PMTRACE_STATE_SHM) | (__pmstate & PMTRACE_STATE_SHM);
+    }
 
     __pmstate = code;
     return old;
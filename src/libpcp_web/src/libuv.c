@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2017-2018 Red Hat.
+ * Copyright (c) 2017-2018,2026 Red Hat.
  * Copyright (c) 2018 Challa Venkata Naga Prajwal <cvnprajwal at gmail dot com>
  * Copyright (c) 2009-2011, Salvatore Sanfilippo <antirez at gmail dot com>
  * Copyright (c) 2010-2011, Pieter Noordhuis <pcnoordhuis at gmail dot com>
@@ -45,8 +45,12 @@ redisLibuvPoll(uv_poll_t *handle, int status, int events)
 {
     redisLibuvEvents	*p = (redisLibuvEvents *)handle->data;
 
+    /*
+     * On error (e.g. connection refused) hand on the events asked for,
+     * so that hiredis finds the socket error and fails the connection.
+     */
     if (status != 0)
-        return;
+        events = p->events;
     if (p->context != NULL && (events & UV_READABLE))
         redisAsyncHandleRead(p->context);
     if (p->context != NULL && (events & UV_WRITABLE))
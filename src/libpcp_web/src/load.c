@@ -19,6 +19,9 @@
 #include "schema.h"
 #include "util.h"
 
+/* batches of requests awaiting replies before archive loading pauses */
+#define LOAD_INFLIGHT_BATCHES	8
+
 void initSeriesLoadBaton(seriesLoadBaton *, void *, pmSeriesFlags, 
 	pmLogInfoCallBack, pmSeriesDoneCallBack, redisSlots *, void *);
 void freeSeriesLoadBaton(seriesLoadBaton *);
@@ -125,7 +128,7 @@ get_instance_metadata(seriesLoadBaton *baton, pmInDom indom)
 }
 
 static metric_t *
-new_metric(seriesLoadBaton *baton, pmValueSet *vsp)
+new_metric(seriesLoadBaton *baton, pmID pmid)
 {
     context_t		*context = &baton->pmapi.context;
     metric_t		*metric;
@@ -135,14 +138,14 @@ new_metric(seriesLoadBaton *baton, pmValueSet *vsp)
     sds			msg;
     int			count, sts, i;
 
-    if ((sts = pmLookupDesc(vsp->pmid, &desc)) < 0) {
+    if ((sts = pmLookupDesc(pmid, &desc)) < 0) {
 	infofmt(msg, "failed to lookup metric %s descriptor: %s",
-		pmIDStr_r(vsp->pmid, idbuf, sizeof(idbuf)),
+		pmIDStr_r(pmid, idbuf, sizeof(idbuf)),
 		pmErrStr_r(sts, errmsg, sizeof(errmsg)));
 	batoninfo(baton, PMLOG_WARNING, msg);
-    } else if ((sts = count = pmNameAll(vsp->pmid, &nameall)) < 0) {
+    } else if ((sts = count = pmNameAll(pmid, &nameall)) < 0) {
 	infofmt(msg, "failed to lookup metric %s names: %s",
-		pmIDStr_r(vsp->pmid, idbuf, sizeof(idbuf)),
+		pmIDStr_r(pmid, idbuf, sizeof(idbuf)),
 		pmErrStr_r(sts, errmsg, sizeof(errmsg)));
 	batoninfo(baton, PMLOG_WARNING, msg);
     }
@@ -165,7 +168,7 @@ new_metric(seriesLoadBaton *baton, pmValueSet *vsp)
 
     if (pmDebugOptions.series) {
 	fprintf(stderr, "new_metric [%s] names:",
-		pmIDStr_r(vsp->pmid, idbuf, sizeof(idbuf)));
+		pmIDStr_r(pmid, idbuf, sizeof(idbuf)));
 	for (i = 0; i < count; i++) {
 	    pmwebapi_hash_str(metric->names[i].hash, idbuf, sizeof(idbuf));
 	    fprintf(stderr, "SHA1=%s [%s]\n", idbuf, metric->names[i].sds);
@@ -301,6 +304,166 @@ pmwebapi_add_valueset(metric_t *metric, pmValueSet *vsp)
     return count;
 }
 
+/*
+ * Add every instance ever observed in an archive instance domain (from
+ * the metadata file alone) along with any instance labels.
+ */
+static unsigned int
+get_archive_instances(seriesLoadBaton *baton, pmInDom indom)
+{
+    context_t		*cp = &baton->pmapi.context;
+    unsigned int	count = 0;
+    domain_t		*dp;
+    indom_t		*ip;
+    char		**namelist = NULL;
+    int			*instlist = NULL;
+    int			i, sts;
+
+    if (indom == PM_INDOM_NULL)
+	return 0;
+    if ((dp = pmwebapi_add_domain(cp, pmInDom_domain(indom))))
+	pmwebapi_add_domain_labels(dp);
+    if ((ip = pmwebapi_add_indom(cp, dp, indom)) == NULL)
+	return 0;
+    if ((sts = pmGetInDomArchive(indom, &instlist, &namelist)) > 0) {
+	for (i = 0; i < sts; i++)
+	    if (pmwebapi_add_instance(ip, instlist[i], namelist[i]) != NULL)
+		count++;
+    }
+    if (instlist)
+	free(instlist);
+    if (namelist)
+	free(namelist);
+    if (count > 0)
+	pmwebapi_add_indom_labels(ip);
+    return count;
+}
+
+static int
+compare_inst(const void *a, const void *b)
+{
+    int			ia = *(const int *)a;
+    int			ib = *(const int *)b;
+
+    return (ia < ib) ? -1 : (ia > ib);
+}
+
+/*
+ * Setup the metric value list with all archive instances, in the same
+ * (ascending) order later used for pmSortInstances'd fetch results.
+ */
+static void
+set_archive_values(metric_t *metric)
+{
+    dictIterator	*iterator;
+    dictEntry		*entry;
+    instance_t		*instance;
+    int			*insts;
+    int			i, count;
+
+    if (metric->indom == NULL || metric->u.vlist != NULL)
+	return;
+    if ((count = dictSize(metric->indom->insts)) == 0)
+	return;
+    if ((insts = (int *)malloc(count * sizeof(int))) == NULL)
+	return;
+    i = 0;
+    iterator = dictGetIterator(metric->indom->insts);
+    while ((entry = dictNext(iterator)) != NULL && i < count) {
+	instance = (instance_t *)dictGetVal(entry);
+	insts[i++] = instance->inst;
+    }
+    dictReleaseIterator(iterator);
+    qsort(insts, i, sizeof(int), compare_inst);
+    count = i;
+    for (i = 0; i < count; i++)
+	if (pmwebapi_add_value(metric, insts[i], i) < 0)
+	    break;
+    free(insts);
+}
+
+static void
+series_cache_pmid(seriesLoadBaton *baton, pmID pmid, sds timestamp)
+{
+    context_t		*cp = &baton->pmapi.context;
+    metric_t		*metric;
+    pmDesc		desc;
+
+    /* skip metrics already cached (via another name) or not wanted */
+    if (dictFetchValue(cp->pmids, &pmid) != NULL)
+	return;
+    if (dictSize(baton->wanted) &&
+	dictFetchValue(baton->wanted, &pmid) == NULL)
+	return;
+
+    /* instances must be known before instance labels can be added */
+    if (pmLookupDesc(pmid, &desc) >= 0)
+	get_archive_instances(baton, desc.indom);
+    if ((metric = new_metric(baton, pmid)) == NULL)
+	return;
+    set_archive_values(metric);
+
+    server_cache_metric(baton, metric, timestamp, 1, 0);
+}
+
+static void
+series_cache_name(const char *name, void *arg)
+{
+    seriesLoadBaton	*baton = (seriesLoadBaton *)arg;
+    pmID		pmid;
+
+    if (pmLookupName(1, (char **)&name, &pmid) == 1)
+	series_cache_pmid(baton, pmid, baton->stamp);
+}
+
+/*
+ * Metadata-only pass over an archive - descriptors, names, instance
+ * domains and labels all come from the metadata file, so every series
+ * identifier can be calculated and cached up front without reading any
+ * values.  Value streaming (if any) then only writes new metadata for
+ * series not described here, e.g. metrics with a changed instance name.
+ */
+static int
+server_cache_metadata(seriesLoadBaton *baton)
+{
+    char		pmmsg[PM_MAXERRMSGLEN], ts[64];
+    dictIterator	*iterator;
+    dictEntry		*entry;
+    pmLogLabel		label;
+    sds			msg;
+    int			sts;
+
+    if (baton->pmapi.context.type != PM_CONTEXT_ARCHIVE)
+	return -ENOTSUP;
+
+    if ((sts = pmGetArchiveLabel(&label)) < 0) {
+	infofmt(msg, "pmGetArchiveLabel failed: %s",
+		pmErrStr_r(sts, pmmsg, sizeof(pmmsg)));
+	batoninfo(baton, PMLOG_ERROR, msg);
+	return sts;
+    }
+    baton->stamp = sdsnew(timeval_stream_str(&label.ll_start, ts, sizeof(ts)));
+
+    if (dictSize(baton->wanted)) {
+	iterator = dictGetIterator(baton->wanted);
+	while ((entry = dictNext(iterator)) != NULL)
+	    series_cache_pmid(baton, *(pmID *)dictGetKey(entry), baton->stamp);
+	dictReleaseIterator(iterator);
+    } else if ((sts = pmTraversePMNS_r("", series_cache_name, baton)) < 0) {
+	infofmt(msg, "PMNS traversal failed: %s",
+		pmErrStr_r(sts, pmmsg, sizeof(pmmsg)));
+	batoninfo(baton, PMLOG_WARNING, msg);
+    }
+
+    if (pmDebugOptions.series)
+	fprintf(stderr, "server_cache_metadata: cached %lu metrics\n",
+		(unsigned long)dictSize(baton->pmapi.context.pmids));
+
+    /* send all metadata now rather than after the batching interval */
+    redisSlotsFlush(baton->slots);
+    return 0;
+}
+
 static void
 series_cache_update(seriesLoadBaton *baton)
 {
@@ -337,7 +500,7 @@ series_cache_update(seriesLoadBaton *baton)
 	/* check if pmid already in hash list */
 	if ((metric = dictFetchValue(cp->pmids, &vsp->pmid)) == NULL) {
 	    /* create a new metric, and add it to load context */
-	    if ((metric = new_metric(baton, vsp)) == NULL)
+	    if ((metric = new_metric(baton, vsp->pmid)) == NULL)
 		continue;
 	    write_meta = 1;
 	} else {	/* pmid already observed */
@@ -386,6 +549,8 @@ server_cache_series(seriesLoadBaton *baton)
 	return sts;
     }
 
+    baton->yielded = baton->slots->stats.requests;
+
     seriesBatonReference(baton, "server_cache_series");
     server_cache_window(baton);
     return 0;
@@ -399,10 +564,64 @@ server_cache_series_finished(void *arg)
 
     assert(context->result == NULL);
 
+    /* send any partially filled batches without further delay */
+    redisSlotsFlush(baton->slots);
+
     /* drop load reference taken in server_cache_series */
     doneSeriesLoadBaton(baton, "server_cache_series_finished");
 }
 
+#if defined(HAVE_LIBUV)
+static void
+server_cache_resume(uv_timer_t *handle)
+{
+    server_cache_window(handle->data);
+}
+
+static void
+server_cache_timer_close(uv_handle_t *handle)
+{
+    free(handle);
+}
+
+/*
+ * Once a full batch of requests has been queued return to the event
+ * loop, so batches are written and replies processed while loading
+ * continues.  If too many requests are awaiting replies, pause for a
+ * batch flush interval to allow the servers to catch up.
+ */
+static int
+server_cache_yield(seriesLoadBaton *baton)
+{
+    redisSlots		*slots = baton->slots;
+    uv_timer_t		*timer = (uv_timer_t *)baton->timer;
+    unsigned long long	inflight;
+    unsigned int	delay = 0;
+
+    if (slots->batchsize <= 1)
+	return 0;
+    inflight = slots->stats.requests - slots->stats.replies;
+    if (inflight > (unsigned long long)LOAD_INFLIGHT_BATCHES * slots->batchsize)
+	delay = slots->interval;
+    else if (slots->stats.requests - baton->yielded < slots->batchsize)
+	return 0;
+
+    if (timer == NULL) {
+	if ((timer = (uv_timer_t *)calloc(1, sizeof(uv_timer_t))) == NULL)
+	    return 0;
+	uv_timer_init((uv_loop_t *)slots->events, timer);
+	timer->data = (void *)baton;
+	baton->timer = (void *)timer;
+    }
+    baton->yielded = slots->stats.requests;
+    redisSlotsFlush(slots);
+    uv_timer_start(timer, server_cache_resume, delay, 0);
+    return 1;
+}
+#else
+#define server_cache_yield(baton)	0
+#endif
+
 static void
 server_cache_update_done(void *arg)
 {
@@ -416,7 +635,8 @@ server_cache_update_done(void *arg)
     context->done = NULL;
 
     /* begin processing of the next record if any */
-    server_cache_window(baton);
+    if (!server_cache_yield(baton))
+	server_cache_window(baton);
 }
 
 void
@@ -701,6 +921,24 @@ series_cache_source(void *arg)
     server_cache_source(baton);
 }
 
+static void
+series_cache_descs(void *arg)
+{
+    seriesLoadBaton	*baton = (seriesLoadBaton *)arg;
+    int			sts;
+
+    seriesBatonCheckMagic(baton, MAGIC_LOAD, "series_cache_descs");
+
+    baton->stats = baton->slots->stats;
+    pmtimevalNow(&baton->started);
+
+    /* hold a reference until all metadata requests have been issued */
+    seriesBatonReference(baton, "series_cache_descs");
+    if ((sts = server_cache_metadata(baton)) < 0)
+	baton->error = sts;
+    doneSeriesLoadBaton(baton, "series_cache_descs");
+}
+
 static void
 series_cache_metrics(void *arg)
 {
@@ -712,11 +950,35 @@ series_cache_metrics(void *arg)
 	baton->error = sts;
 }
 
+static void
+series_load_throughput(seriesLoadBaton *baton)
+{
+    redisSlotsStats	*stats = &baton->slots->stats;
+    unsigned long long	requests, batches;
+    struct timeval	now;
+    double		elapsed;
+    sds			msg;
+
+    requests = stats->requests - baton->stats.requests;
+    batches = stats->batches - baton->stats.batches;
+    pmtimevalNow(&now);
+    elapsed = pmtimevalSub(&now, &baton->started);
+
+    infofmt(msg, "sent %llu requests in %llu batches in %.3f sec "
+		"(%.1f requests/sec, average batch size %.1f)",
+		requests, batches, elapsed,
+		elapsed > 0 ? requests / elapsed : 0.0,
+		batches ? (double)requests / batches : 0.0);
+    batoninfo(baton, PMLOG_INFO, msg);
+}
+
 static void
 series_load_finished(void *arg)
 {
     seriesLoadBaton	*baton = (seriesLoadBaton *)arg;
 
+    if (baton->started.tv_sec && baton->slots)
+	series_load_throughput(baton);
     freeSeriesLoadBaton(baton);
 }
 
@@ -810,7 +1072,12 @@ freeSeriesLoadBaton(seriesLoadBaton *baton)
     if (baton->done)
 	baton->done(baton->error, baton->userdata);
 
+#if defined(HAVE_LIBUV)
+    if (baton->timer)
+	uv_close((uv_handle_t *)baton->timer, server_cache_timer_close);
+#endif
     freeSeriesGetContext(&baton->pmapi, 0);
+    sdsfree(baton->stamp);
     dictRelease(baton->errors);
     dictRelease(baton->wanted);
     free(baton->metrics);
@@ -863,7 +1130,9 @@ series_load(pmSeriesSettings *settings,
     baton->phases[i++].func = setup_source_services;
     baton->phases[i++].func = series_source_mapping;	/* assign source/host string map */
     baton->phases[i++].func = series_cache_source;	/* write source info into schema */
-    baton->phases[i++].func = series_cache_metrics;	/* write time series into schema */
+    baton->phases[i++].func = series_cache_descs;	/* write time series metadata */
+    if (!(flags & PM_SERIES_FLAG_METADATA))
+	baton->phases[i++].func = series_cache_metrics;	/* write time series values */
     baton->phases[i++].func = series_load_finished;
     assert(i <= LOAD_PHASES);
     seriesBatonPhases(baton->current, i, baton);
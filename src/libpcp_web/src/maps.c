@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2017-2018 Red Hat.
+ * Copyright (c) 2017-2018,2026 Red Hat.
  *
  * This library is free software; you can redistribute it and/or modify it
  * under the terms of the GNU Lesser General Public License as published
@@ -15,6 +15,7 @@
 #include "slots.h"
 #include "util.h"
 #include "maps.h"
+#include "libpcp.h"
 
 /* reverse hash mapping of all SHA1 hashes to strings */
 redisMap *instmap;
@@ -22,6 +23,19 @@ redisMap *namesmap;
 redisMap *labelsmap;
 redisMap *contextmap;
 
+/*
+ * The maps above are shared by every thread using the library (e.g.
+ * each pmproxy worker event loop), and a dict lookup can also modify
+ * the table (incremental rehashing), so all map accesses are locked.
+ * Entries are never removed from these maps, so an entry found under
+ * the lock remains valid after it is dropped.
+ */
+#ifdef PM_MULTI_THREAD
+static pthread_mutex_t	maps_lock = PTHREAD_MUTEX_INITIALIZER;
+#else
+static void		*maps_lock;
+#endif
+
 static uint64_t
 intHashCallBack(const void *key)
 {
@@ -120,14 +134,15 @@ redisMapsInit(void)
     };
     static int		setup;
 
-    if (setup)
-	return;
-    setup = 1;
-
-    instmap = dictCreate(&sdsDictCallBacks, (void *)mapnames[0]);
-    namesmap = dictCreate(&sdsDictCallBacks, (void *)mapnames[1]);
-    labelsmap = dictCreate(&sdsDictCallBacks, (void *)mapnames[2]);
-    contextmap = dictCreate(&sdsDictCallBacks, (void *)mapnames[3]);
+    PM_LOCK(maps_lock);
+    if (!setup) {
+	instmap = dictCreate(&sdsDictCallBacks, (void *)mapnames[0]);
+	namesmap = dictCreate(&sdsDictCallBacks, (void *)mapnames[1]);
+	labelsmap = dictCreate(&sdsDictCallBacks, (void *)mapnames[2]);
+	contextmap = dictCreate(&sdsDictCallBacks, (void *)mapnames[3]);
+	setup = 1;
+    }
+    PM_UNLOCK(maps_lock);
 }
 
 redisMap *
@@ -151,15 +166,22 @@ redisMapCreate(const char *name)
 redisMapEntry *
 redisMapLookup(redisMap *map, sds key)
 {
-    if (map)
-	return dictFind(map, key);
-    return NULL;
+    redisMapEntry	*entry;
+
+    if (map == NULL)
+	return NULL;
+    PM_LOCK(maps_lock);
+    entry = dictFind(map, key);
+    PM_UNLOCK(maps_lock);
+    return entry;
 }
 
 void
 redisMapInsert(redisMap *map, sds key, sds value)
 {
+    PM_LOCK(maps_lock);
     dictAdd(map, key, value);
+    PM_UNLOCK(maps_lock);
 }
 
 sds
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2017-2018 Red Hat.
+ * Copyright (c) 2017-2018,2026 Red Hat.
  *
  * This library is free software; you can redistribute it and/or modify it
  * under the terms of the GNU Lesser General Public License as published
@@ -14,6 +14,7 @@
 #include <assert.h>
 #include "pmapi.h"
 #include "pmda.h"
+#include "libpcp.h"
 #include "schema.h"
 #include "discover.h"
 #include "util.h"
@@ -31,6 +32,11 @@ typedef struct redisScript {
 
 static redisScript	*scripts;
 static int		nscripts;
+#ifdef PM_MULTI_THREAD
+static pthread_mutex_t	scripts_lock = PTHREAD_MUTEX_INITIALIZER;
+#else
+static void		*scripts_lock;
+#endif
 
 static void
 redisScriptsInit(void)
@@ -40,8 +46,17 @@ redisScriptsInit(void)
     char		hashbuf[42];
     redisScript		*script;
     SHA1_CTX		shactx;
+    static int		setup;
     int			i;
 
+    /* once only, though setup may be called from several threads */
+    PM_LOCK(scripts_lock);
+    if (setup) {
+	PM_UNLOCK(scripts_lock);
+	return;
+    }
+    setup = 1;
+
     for (i = 0; i < nscripts; i++) {
 	script = &scripts[i];
 	text = (const unsigned char *)script->text;
@@ -53,6 +68,7 @@ redisScriptsInit(void)
 	pmwebapi_hash_str(hash, hashbuf, sizeof(hashbuf));
 	scripts->hash = sdsnew(hashbuf);
     }
+    PM_UNLOCK(scripts_lock);
 }
 
 static int
@@ -319,7 +335,7 @@ redis_series_source(redisSlots *slots, void *arg)
     cmd = redis_param_str(cmd, SADD, SADD_LEN);
     cmd = redis_param_sds(cmd, key);
     cmd = redis_param_sha(cmd, context->name.hash);
-    redisSlotsRequest(slots, SADD, key, cmd, redis_source_context_name, arg);
+    redisSlotsBatchRequest(slots, SADD, key, cmd, redis_source_context_name, arg);
 
     pmwebapi_hash_str(context->hostid, hashbuf, sizeof(hashbuf));
     key = sdscatfmt(sdsempty(), "pcp:source:context.name:%s", hashbuf);
@@ -327,7 +343,7 @@ redis_series_source(redisSlots *slots, void *arg)
     cmd = redis_param_str(cmd, SADD, SADD_LEN);
     cmd = redis_param_sds(cmd, key);
     cmd = redis_param_sha(cmd, context->name.hash);
-    redisSlotsRequest(slots, SADD, key, cmd, redis_source_context_name, arg);
+    redisSlotsBatchRequest(slots, SADD, key, cmd, redis_source_context_name, arg);
 
     pmwebapi_hash_str(context->name.hash, hashbuf, sizeof(hashbuf));
     key = sdscatfmt(sdsempty(), "pcp:context.name:source:%s", hashbuf);
@@ -336,7 +352,7 @@ redis_series_source(redisSlots *slots, void *arg)
     cmd = redis_param_sds(cmd, key);
     cmd = redis_param_sha(cmd, context->name.id);
     cmd = redis_param_sha(cmd, context->hostid);
-    redisSlotsRequest(slots, SADD, key, cmd, redis_context_name_source, arg);
+    redisSlotsBatchRequest(slots, SADD, key, cmd, redis_context_name_source, arg);
 
     key = sdsnew("pcp:source:location");
     val = sdscatprintf(sdsempty(), "%.8f", context->location[0]);
@@ -349,7 +365,7 @@ redis_series_source(redisSlots *slots, void *arg)
     cmd = redis_param_sha(cmd, context->name.hash);
     sdsfree(val2);
     sdsfree(val);
-    redisSlotsRequest(slots, GEOADD, key, cmd, redis_source_location, arg);
+    redisSlotsBatchRequest(slots, GEOADD, key, cmd, redis_source_location, arg);
 }
 
 static void
@@ -402,7 +418,7 @@ redis_series_instance(redisSlots *slots, metric_t *metric, instance_t *instance,
     cmd = redis_param_sds(cmd, key);
     for (i = 0; i < metric->numnames; i++)
 	cmd = redis_param_sha(cmd, metric->names[i].hash);
-    redisSlotsRequest(slots, SADD, key, cmd, redis_series_inst_name_callback, arg);
+    redisSlotsBatchRequest(slots, SADD, key, cmd, redis_series_inst_name_callback, arg);
 
     for (i = 0; i < metric->numnames; i++) {
 	seriesBatonReference(baton, "redis_series_instance");
@@ -412,7 +428,7 @@ redis_series_instance(redisSlots *slots, metric_t *metric, instance_t *instance,
 	cmd = redis_param_str(cmd, SADD, SADD_LEN);
 	cmd = redis_param_sds(cmd, key);
 	cmd = redis_param_sha(cmd, instance->name.hash);
-	redisSlotsRequest(slots, SADD, key, cmd, redis_instances_series_callback, arg);
+	redisSlotsBatchRequest(slots, SADD, key, cmd, redis_instances_series_callback, arg);
     }
 
     pmwebapi_hash_str(instance->name.hash, hashbuf, sizeof(hashbuf));
@@ -428,7 +444,7 @@ redis_series_instance(redisSlots *slots, metric_t *metric, instance_t *instance,
     cmd = redis_param_str(cmd, "source", sizeof("series")-1);
     cmd = redis_param_sha(cmd, metric->indom->domain->context->name.hash);
     sdsfree(val);
-    redisSlotsRequest(slots, HMSET, key, cmd, redis_series_inst_callback, arg);
+    redisSlotsBatchRequest(slots, HMSET, key, cmd, redis_series_inst_callback, arg);
 }
 
 static void
@@ -585,7 +601,7 @@ redis_series_label(redisSlots *slots, metric_t *metric, char *hash,
 	cmd = redis_param_sha(cmd, list->nameid);
 	cmd = redis_param_sds(cmd, val);
 	sdsfree(val);
-	redisSlotsRequest(slots, HMSET, key, cmd,
+	redisSlotsBatchRequest(slots, HMSET, key, cmd,
 				redis_series_labelflags_callback, arg);
     }
 
@@ -595,7 +611,7 @@ redis_series_label(redisSlots *slots, metric_t *metric, char *hash,
     cmd = redis_param_sds(cmd, key);
     cmd = redis_param_sha(cmd, list->nameid);
     cmd = redis_param_sha(cmd, list->valueid);
-    redisSlotsRequest(slots, HMSET, key, cmd,
+    redisSlotsBatchRequest(slots, HMSET, key, cmd,
 			redis_series_labelvalue_callback, arg);
 
     pmwebapi_hash_str(list->nameid, namehash, sizeof(namehash));
@@ -607,7 +623,7 @@ redis_series_label(redisSlots *slots, metric_t *metric, char *hash,
     cmd = redis_param_sds(cmd, key);
     for (i = 0; i < metric->numnames; i++)
 	cmd = redis_param_sha(cmd, metric->names[i].hash);
-    redisSlotsRequest(slots, SADD, key, cmd,
+    redisSlotsBatchRequest(slots, SADD, key, cmd,
 				redis_series_label_set_callback, arg);
 }
 
@@ -812,7 +828,7 @@ redis_series_metadata(context_t *context, metric_t *metric, void *arg)
 	cmd = redis_param_str(cmd, SADD, SADD_LEN);
 	cmd = redis_param_sds(cmd, key);
 	cmd = redis_param_sha(cmd, metric->names[i].hash);
-	redisSlotsRequest(slots, SADD, key, cmd,
+	redisSlotsBatchRequest(slots, SADD, key, cmd,
 			redis_series_metric_name_callback, arg);
 
 	pmwebapi_hash_str(metric->names[i].hash, hashbuf, sizeof(hashbuf));
@@ -821,7 +837,7 @@ redis_series_metadata(context_t *context, metric_t *metric, void *arg)
 	cmd = redis_param_str(cmd, SADD, SADD_LEN);
 	cmd = redis_param_sds(cmd, key);
 	cmd = redis_param_sha(cmd, metric->names[i].id);
-	redisSlotsRequest(slots, SADD, key, cmd,
+	redisSlotsBatchRequest(slots, SADD, key, cmd,
 			redis_metric_name_series_callback, arg);
 
 	key = sdscatfmt(sdsempty(), "pcp:desc:series:%s", hashbuf);
@@ -840,7 +856,7 @@ redis_series_metadata(context_t *context, metric_t *metric, void *arg)
 	cmd = redis_param_str(cmd, type, strlen(type));
 	cmd = redis_param_str(cmd, "units", sizeof("units")-1);
 	cmd = redis_param_str(cmd, units, strlen(units));
-	redisSlotsRequest(slots, HMSET, key, cmd, redis_desc_series_callback, arg);
+	redisSlotsBatchRequest(slots, HMSET, key, cmd, redis_desc_series_callback, arg);
     }
 
     seriesBatonReference(baton, "redis_series_metadata");
@@ -852,7 +868,7 @@ redis_series_metadata(context_t *context, metric_t *metric, void *arg)
     cmd = redis_param_sds(cmd, key);
     for (i = 0; i < metric->numnames; i++)
         cmd = redis_param_sha(cmd, metric->names[i].hash);
-    redisSlotsRequest(slots, SADD, key, cmd, redis_series_source_callback, arg);
+    redisSlotsBatchRequest(slots, SADD, key, cmd, redis_series_source_callback, arg);
 
     if (metric->desc.indom == PM_INDOM_NULL) {
 	redis_series_labelset(slots, metric, NULL, baton);
@@ -1033,6 +1049,8 @@ redis_series_stream(redisSlots *slots, sds stamp, metric_t *metric,
 		instance_t	*inst;
 		value_t		*v = &metric->u.vlist->value[i];
 
+		if (v->updated == 0)	/* no value in this sample */
+		    continue;
 		if ((inst = dictFetchValue(metric->indom->insts, &v->inst)) == NULL)
 		    continue;
 		name = sdscpylen(name, (const char *)inst->name.hash, sizeof(inst->name.hash));
@@ -1050,7 +1068,7 @@ redis_series_stream(redisSlots *slots, sds stamp, metric_t *metric,
     cmd = redis_param_raw(cmd, stream);
     sdsfree(stream);
 
-    redisSlotsRequest(slots, XADD, key, cmd, redis_series_stream_callback, baton);
+    redisSlotsBatchRequest(slots, XADD, key, cmd, redis_series_stream_callback, baton);
 }
 
 static void
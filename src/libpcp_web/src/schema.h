@@ -104,7 +104,7 @@ extern void redis_series_metric(redisSlots *, metric_t *, sds, int, int, void *)
 /*
  * Asynchronous schema load baton structures
  */
-#define LOAD_PHASES	5
+#define LOAD_PHASES	6
 
 typedef struct seriesGetContext {
     seriesBatonMagic	header;		/* MAGIC_CONTEXT */
@@ -139,6 +139,12 @@ typedef struct seriesLoadBaton {
     dict		*errors;	/* PMIDs where errors observed */
     dict		*wanted;	/* PMIDs from query whitelist */
 
+    sds			stamp;		/* archive start, for metadata */
+    redisSlotsStats	stats;		/* batching counters at load start */
+    struct timeval	started;	/* time archive value loading began */
+    unsigned long long	yielded;	/* batched requests at last yield */
+    void		*timer;		/* resume loading after a yield */
+
     int			error;
     void		*arg;
 } seriesLoadBaton;
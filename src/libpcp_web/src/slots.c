@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2017-2018 Red Hat.
+ * Copyright (c) 2017-2018,2026 Red Hat.
  *
  * This library is free software; you can redistribute it and/or modify it
  * under the terms of the GNU Lesser General Public License as published
@@ -21,9 +21,34 @@
 #ifdef HAVE_STRINGS_H
 #include <strings.h>
 #endif
+#if defined(HAVE_LIBUV)
+#include <uv.h>
+#endif
 
 static char default_server[] = "localhost:6379";
 
+struct redisSlotsCommand {
+    redisSlots		*slots;
+    redisAsyncCallBack	*callback;
+    void		*arg;
+    sds			cmd;
+    redisSlotsCommand	*next;
+};
+
+static unsigned int
+slots_tunable(const char *name, unsigned int fallback)
+{
+    unsigned int	value;
+    char		*env, *endnum;
+
+    if ((env = getenv(name)) == NULL || *env == '\0')
+	return fallback;
+    value = (unsigned int)strtoul(env, &endnum, 10);
+    if (*endnum != '\0')
+	return fallback;
+    return value;
+}
+
 redisSlots *
 redisSlotsInit(sds hostspec, void *events)
 {
@@ -33,9 +58,11 @@ redisSlotsInit(sds hostspec, void *events)
 	return NULL;
 
     slots->events = events;
+    slots->batchsize = slots_tunable("PCP_SERIES_BATCH_SIZE", SLOTS_BATCH_SIZE);
+    slots->interval = slots_tunable("PCP_SERIES_BATCH_INTERVAL", SLOTS_BATCH_INTERVAL);
     slots->keymap = dictCreate(&sdsDictCallBacks, "command keymap");
     slots->control.hostspec = sdsdup(hostspec);
-    slots->control.redis = redisAttach(slots, hostspec);
+    slots->control.redis = redisAttach(slots, &slots->control);
     return slots;
 }
 
@@ -72,10 +99,13 @@ redisSlotRangeInsert(redisSlots *redis, redisSlotRange *range)
 static void
 redisSlotServerFree(redisSlots *pool, redisSlotServer *server)
 {
-    if (server->redis != pool->control.redis)
-	redisAsyncDisconnect(server->redis);
-    if (server->hostspec != pool->control.hostspec)
+    if (server->hostspec != pool->control.hostspec) {
+	if (server->redis) {
+	    server->redis->data = NULL;
+	    redisAsyncDisconnect(server->redis);
+	}
 	sdsfree(server->hostspec);
+    }
     memset(server, 0, sizeof(*server));
 }
 
@@ -91,19 +121,43 @@ redisSlotRangeFree(redisSlots *pool, redisSlotRange *range)
     memset(range, 0, sizeof(*range));
 }
 
+#if defined(HAVE_LIBUV)
+static void
+redis_batch_timer_close(uv_handle_t *handle)
+{
+    free(handle);
+}
+#endif
+
 void
 redisSlotsFree(redisSlots *pool)
 {
     void		*root = pool->slots;
+    redisAsyncContext	*redis;
     redisSlotRange	*range;
+    redisSlotsBatch	*batch, *next;
+
+    redisSlotsFlush(pool);
+    for (batch = pool->batches; batch; batch = next) {
+	next = batch->next;
+	free(batch);
+    }
+#if defined(HAVE_LIBUV)
+    if (pool->timer) {
+	uv_timer_stop((uv_timer_t *)pool->timer);
+	uv_close((uv_handle_t *)pool->timer, redis_batch_timer_close);
+    }
+#endif
 
     while (root != NULL) {
 	range = *(redisSlotRange **)root;
 	tdelete(range, &root, slotsCompare);
 	redisSlotRangeFree(pool, range);
     }
-    redisAsyncDisconnect(pool->control.redis);
-    redisAsyncFree(pool->control.redis);
+    if ((redis = pool->control.redis) != NULL) {
+	redis->data = NULL;
+	redisAsyncFree(redis);
+    }
     sdsfree(pool->control.hostspec);
     dictRelease(pool->keymap);
     memset(pool, 0, sizeof(*pool));
@@ -138,9 +192,25 @@ keySlot(const char *key, unsigned int keylen)
     return crc16(key + start + 1, end - start - 1) & SLOTMASK;
 }
 
+/*
+ * hiredis frees a context once it is disconnected, or fails to connect,
+ * so clear the slot map reference to it - the next request for that
+ * server then attaches a new connection.
+ */
+static void
+redis_forget(const redisAsyncContext *redis)
+{
+    redisSlotServer	*server = (redisSlotServer *)redis->data;
+
+    if (server != NULL && server->redis == redis)
+	server->redis = NULL;
+}
+
 static void
 redis_connect_callback(const redisAsyncContext *redis, int status)
 {
+    if (status != REDIS_OK)
+	redis_forget(redis);
     if (status == REDIS_OK) {
 	if (pmDebugOptions.series)
 	    fprintf(stderr, "Connected to redis on %s:%d\n",
@@ -159,6 +229,7 @@ redis_connect_callback(const redisAsyncContext *redis, int status)
 static void
 redis_disconnect_callback(const redisAsyncContext *redis, int status)
 {
+    redis_forget(redis);
     if (status == REDIS_OK) {
 	if (pmDebugOptions.series)
 	    fprintf(stderr, "Disconnected from redis on %s:%d\n",
@@ -199,12 +270,12 @@ redis_connect(const char *server)
 }
 
 redisAsyncContext *
-redisAttach(redisSlots *slots, const char *server)
+redisAttach(redisSlots *slots, redisSlotServer *server)
 {
-    redisAsyncContext	*redis = redis_connect(server);
+    redisAsyncContext	*redis = redis_connect(server->hostspec);
 
     if (redis) {
-	redis->data = (void *)slots;
+	redis->data = (void *)server;
 	redisEventAttach(redis, slots->events);
 	redisAsyncSetConnectCallBack(redis, redis_connect_callback);
 	redisAsyncSetDisconnectCallBack(redis, redis_disconnect_callback);
@@ -212,16 +283,19 @@ redisAttach(redisSlots *slots, const char *server)
     return redis;
 }
 
-redisAsyncContext *
-redisGetAsyncContext(redisSlots *slots, const char *command, sds key)
+/*
+ * Find the server for the key slot - each call moves on to the next
+ * replica, where there are any, so a request resolves this just once.
+ */
+static redisSlotServer *
+redis_slot_server(redisSlots *slots, const char *command, sds key)
 {
-    redisSlotServer	*server;
     redisSlotRange	*range, s;
     unsigned int	slot;
     void		*p;
 
     if (key == NULL)
-	return slots->control.redis;
+	return &slots->control;
 
     slot = keySlot(key, sdslen(key));
     if (UNLIKELY(pmDebugOptions.series))
@@ -229,33 +303,225 @@ redisGetAsyncContext(redisSlots *slots, const char *command, sds key)
     s.start = s.end = slot;
 
     p = tfind((const void *)&s, (void **)&slots->slots, slotsCompare);
-    if ((range = *(redisSlotRange **)p) == NULL)
+    if (p == NULL || (range = *(redisSlotRange **)p) == NULL)
 	return NULL;
 
     range->counter++;
-    server = (range->nreplicas == 0) ? &range->master :
-	     &range->replicas[range->counter % range->nreplicas];
-    if (server->redis == NULL)
-	server->redis = redisAttach(slots, server->hostspec);
+    return (range->nreplicas == 0) ? &range->master :
+	   &range->replicas[range->counter % range->nreplicas];
+}
+
+static redisAsyncContext *
+redis_server_context(redisSlots *slots, redisSlotServer *server)
+{
+    if (server->hostspec == slots->control.hostspec)
+	return slots->control.redis;	/* sharing the control connection */
+    if (server->redis == NULL &&
+	(server->redis = redisAttach(slots, server)) != NULL &&
+	server->redis->err) {
+	/* failed already, e.g. connection refused */
+	if (UNLIKELY(pmDebugOptions.series))
+	    fprintf(stderr, "Connecting to %s failed - %s\n",
+			server->hostspec, server->redis->errstr);
+	server->redis->data = NULL;
+	redisAsyncFree(server->redis);
+	server->redis = NULL;
+    }
     return server->redis;
 }
 
+redisAsyncContext *
+redisGetAsyncContext(redisSlots *slots, const char *command, sds key)
+{
+    redisSlotServer	*server = redis_slot_server(slots, command, key);
+
+    return server ? redis_server_context(slots, server) : NULL;
+}
+
+static int
+redis_server_request(redisSlots *slots, redisSlotServer *server,
+	sds cmd, redisAsyncCallBack *callback, void *arg)
+{
+    redisAsyncContext	*context = NULL;
+    int			sts;
+
+    if (UNLIKELY(pmDebugOptions.desperate))
+	fputs(cmd, stderr);
+
+    if (server)
+	context = redis_server_context(slots, server);
+    if (context == NULL)
+	sts = -ENOTCONN;
+    else if (redisAsyncFormattedCommand(context, callback, arg,
+			cmd, sdslen(cmd)) != REDIS_OK)
+	sts = -ENOMEM;
+    else
+	sts = 0;
+    sdsfree(cmd);
+    return sts;
+}
+
 int
 redisSlotsRequest(redisSlots *slots, const char *command, sds key, sds cmd,
 	redisAsyncCallBack *callback, void *arg)
 {
-    redisAsyncContext	*context = redisGetAsyncContext(slots, command, key);
+    redisSlotServer	*server = redis_slot_server(slots, command, key);
+
+    if (key)
+	sdsfree(key);
+    return redis_server_request(slots, server, cmd, callback, arg);
+}
+
+static void
+redis_batch_callback(redisAsyncContext *redis, redisReply *reply, void *arg)
+{
+    redisSlotsCommand	*command = (redisSlotsCommand *)arg;
+
+    command->slots->stats.replies++;
+    command->callback(redis, reply, command->arg);
+    free(command);
+}
+
+static void
+redis_batch_flush(redisSlots *slots, redisSlotsBatch *batch)
+{
+    redisSlotsCommand	*command, *next;
+    redisAsyncContext	*context;
     int			sts;
 
+    if (batch->count == 0)
+	return;
+
+    /* the connection may have been dropped since commands were queued */
+    context = redis_server_context(slots, batch->server);
+
+    if (UNLIKELY(pmDebugOptions.series))
+	fprintf(stderr, "Redis batch of %u commands\n", batch->count);
+
+    /*
+     * Commands are appended to the connection output buffer here and
+     * written out together on the next event loop iteration; replies
+     * are read back (also in order) as they arrive from the server.
+     */
+    for (command = batch->head; command; command = next) {
+	next = command->next;
+	command->next = NULL;
+	if (context == NULL)
+	    sts = REDIS_ERR;
+	else
+	    sts = redisAsyncFormattedCommand(context,
+			redis_batch_callback, command,
+			command->cmd, sdslen(command->cmd));
+	sdsfree(command->cmd);
+	command->cmd = NULL;
+	if (sts != REDIS_OK)	/* as hiredis does on disconnection */
+	    redis_batch_callback(context, NULL, command);
+    }
+    batch->head = batch->tail = NULL;
+    batch->count = 0;
+    slots->stats.batches++;
+}
+
+void
+redisSlotsFlush(redisSlots *slots)
+{
+    redisSlotsBatch	*batch;
+
+    for (batch = slots->batches; batch; batch = batch->next)
+	redis_batch_flush(slots, batch);
+}
+
+#if defined(HAVE_LIBUV)
+static void
+redis_batch_timer(uv_timer_t *handle)
+{
+    redisSlotsFlush((redisSlots *)handle->data);
+}
+
+static void
+redis_batch_timer_start(redisSlots *slots)
+{
+    uv_timer_t		*timer = (uv_timer_t *)slots->timer;
+
+    if (timer == NULL) {
+	if ((timer = (uv_timer_t *)calloc(1, sizeof(uv_timer_t))) == NULL)
+	    return;
+	uv_timer_init((uv_loop_t *)slots->events, timer);
+	timer->data = (void *)slots;
+	slots->timer = (void *)timer;
+    }
+    if (!uv_is_active((uv_handle_t *)timer))
+	uv_timer_start(timer, redis_batch_timer, slots->interval, 0);
+}
+#else
+#define redis_batch_timer_start(slots)	do { } while (0)
+#endif
+
+static redisSlotsBatch *
+redis_batch_lookup(redisSlots *slots, redisSlotServer *server)
+{
+    redisSlotsBatch	*batch;
+
+    for (batch = slots->batches; batch; batch = batch->next)
+	if (batch->server == server)
+	    return batch;
+    if ((batch = (redisSlotsBatch *)calloc(1, sizeof(redisSlotsBatch))) == NULL)
+	return NULL;
+    batch->server = server;
+    batch->next = slots->batches;
+    slots->batches = batch;
+    return batch;
+}
+
+/*
+ * Queue a command for a pipelined write to the server owning the key
+ * slot - used for bulk (load) writes where individual command latency
+ * matters less than overall throughput.  Callbacks are run as usual,
+ * once each reply arrives.  Batches are kept per slot map server, and
+ * its connection is only looked up when the batch is sent.
+ */
+int
+redisSlotsBatchRequest(redisSlots *slots, const char *command, sds key,
+	sds cmd, redisAsyncCallBack *callback, void *arg)
+{
+    redisSlotServer	*server;
+    redisSlotsCommand	*request;
+    redisSlotsBatch	*batch;
+
+    if (slots->batchsize <= 1)
+	return redisSlotsRequest(slots, command, key, cmd, callback, arg);
+
+    server = redis_slot_server(slots, command, key);
+    if (server == NULL ||
+	(batch = redis_batch_lookup(slots, server)) == NULL ||
+	(request = (redisSlotsCommand *)malloc(sizeof(*request))) == NULL) {
+	/* unbatched, but to the same server */
+	if (key)
+	    sdsfree(key);
+	return redis_server_request(slots, server, cmd, callback, arg);
+    }
+
     if (UNLIKELY(pmDebugOptions.desperate))
 	fputs(cmd, stderr);
 
-    sts = redisAsyncFormattedCommand(context, callback, arg, cmd, sdslen(cmd));
+    request->slots = slots;
+    request->callback = callback;
+    request->arg = arg;
+    request->cmd = cmd;
+    request->next = NULL;
+    if (batch->tail)
+	batch->tail->next = request;
+    else
+	batch->head = request;
+    batch->tail = request;
+    slots->stats.requests++;
     if (key)
 	sdsfree(key);
-    sdsfree(cmd);
-    if (sts != REDIS_OK)
-	return -ENOMEM;
+
+    if (++batch->count >= slots->batchsize)
+	redis_batch_flush(slots, batch);
+    else
+	redis_batch_timer_start(slots);
     return 0;
 }
 
@@ -298,6 +564,8 @@ redisSlotsProxyConnect(redisSlots *slots, redisInfoCallBack info,
 	context = redisGetAsyncContext(slots, cmd, key);
 	if (key)
 	    sdsfree(key);
+	if (context == NULL)
+	    return -ENOTCONN;
 	sts = redisAsyncFormattedCommand(context,
 			callback, arg, reader->buf, reader->len);
 	if (sts != REDIS_OK)
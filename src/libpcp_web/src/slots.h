@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2017-2018 Red Hat.
+ * Copyright (c) 2017-2018,2026 Red Hat.
  * 
  * This library is free software; you can redistribute it and/or modify it
  * under the terms of the GNU Lesser General Public License as published
@@ -41,24 +41,58 @@ typedef struct redisSlotRange {
     redisSlotServer	*replicas;
 } redisSlotRange;
 
+/*
+ * Batched (pipelined) requests are queued per server connection and
+ * sent together once batchsize commands have accumulated, or after
+ * at most interval milliseconds, whichever comes first.  Defaults can
+ * be overridden via $PCP_SERIES_BATCH_SIZE and $PCP_SERIES_BATCH_INTERVAL
+ * - a batch size of one (or less) disables batching altogether.
+ */
+#define SLOTS_BATCH_SIZE	256
+#define SLOTS_BATCH_INTERVAL	10
+
+typedef struct redisSlotsCommand redisSlotsCommand;
+
+typedef struct redisSlotsBatch {
+    redisSlotServer	*server;	/* slot map server for this batch */
+    unsigned int	count;		/* number of queued commands */
+    redisSlotsCommand	*head;
+    redisSlotsCommand	*tail;
+    struct redisSlotsBatch *next;
+} redisSlotsBatch;
+
+typedef struct redisSlotsStats {
+    unsigned long long	requests;	/* commands queued into batches */
+    unsigned long long	replies;	/* responses to batched commands */
+    unsigned long long	batches;	/* pipelined batch writes issued */
+} redisSlotsStats;
+
 typedef struct redisSlots {
     redisSlotServer	control;	/* control socket/host specification */
     redisSlotRange	*slots;		/* all instances; e.g. CLUSTER SLOTS */
     redisMap		*keymap;	/* map command names to key position */
     void		*events;
+    unsigned int	batchsize;	/* commands per pipelined write */
+    unsigned int	interval;	/* maximum batch delay (msec) */
+    redisSlotsBatch	*batches;	/* pending commands, per server */
+    void		*timer;		/* batch flush interval timer */
+    redisSlotsStats	stats;
 } redisSlots;
 
 typedef void (*redisPhase)(redisSlots *, void *);	/* phased operations */
 
 extern redisSlots *redisSlotsInit(sds, void *);
 extern int redisSlotRangeInsert(redisSlots *, redisSlotRange *);
-extern redisAsyncContext *redisAttach(redisSlots *, const char *);
+extern redisAsyncContext *redisAttach(redisSlots *, redisSlotServer *);
 extern redisAsyncContext *redisGetAsyncContext(redisSlots *, const char *, sds);
 
 extern redisSlots *redisSlotsConnect(sds, redisSlotsFlags,
 		redisInfoCallBack, redisDoneCallBack, void *, void *, void *);
 extern int redisSlotsRequest(redisSlots *, const char *, sds, sds,
 		redisAsyncCallBack *, void *);
+extern int redisSlotsBatchRequest(redisSlots *, const char *, sds, sds,
+		redisAsyncCallBack *, void *);
+extern void redisSlotsFlush(redisSlots *);
 extern void redisSlotsFree(redisSlots *);
 
 extern int redisSlotsProxyConnect(redisSlots *,
@@ -177,6 +177,8 @@ CleanupAgent(AgentInfo* aPtr, int why, int status)
     fputc('\n', stderr);
     aPtr->reason = reason;
     aPtr->status.connected = 0;
+    AbortAgentFetches(aPtr);
+    FlushFetchCache(aPtr);
     aPtr->status.busy = 0;
     aPtr->status.notReady = 0;
     aPtr->status.flags = 0;
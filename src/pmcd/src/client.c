@@ -34,8 +34,7 @@ NotifyEndContext(int ctx)
     int i;
 
     for (i = 0; i < nAgents; i++) {
-	if (!agent[i].status.connected ||
-	    agent[i].status.busy || agent[i].status.notReady)
+	if (!agent[i].status.connected || agent[i].status.notReady)
 	    continue;
 	if (agent[i].ipcType == AGENT_DSO) {
 	    pmdaInterface	*dp = &agent[i].ipc.dso.dispatch;
@@ -570,6 +570,7 @@ FreeAgent(AgentInfo *ap)
     char	**argv = NULL;
 
     free(ap->pmDomainLabel);
+    FlushFetchCache(ap);
     if (ap->ipcType == AGENT_DSO) {
 	free(ap->ipc.dso.pathName);
 	free(ap->ipc.dso.entryPoint);
@@ -768,6 +769,7 @@ ParsePipe(char *pmDomainLabel, int pmDomainId)
     int		i;
     AgentInfo	*newAgent;
     int notReady = 0;
+    int cacheMsec = 0;
 
     FindNextToken();
     if (!TokenIs("binary")) {
@@ -787,6 +789,16 @@ ParsePipe(char *pmDomainLabel, int pmDomainId)
 	    return -1;
 	} else if ((i = TokenIs ("notready"))) {
 	    notReady = 1;
+	} else if ((i = (strncasecmp(token, "cache=", 6) == 0))) {
+	    char	*end;
+
+	    cacheMsec = (int)strtol(token + 6, &end, 10);
+	    if (end != tokenend || end == token + 6 || cacheMsec < 0) {
+		fprintf(stderr,
+		     "pmcd config[line %d]: Error: cache window in milliseconds expected\n",
+		     nLines);
+		return -1;
+	    }
 	}
     } while (i);
 
@@ -799,6 +811,7 @@ ParsePipe(char *pmDomainLabel, int pmDomainId)
     newAgent->outFd = -1;
     newAgent->pmDomainLabel = strdup(pmDomainLabel);
     newAgent->status.startNotReady = notReady;
+    newAgent->cacheMsec = cacheMsec;
     newAgent->ipc.pipe.argv = BuildArgv();
 
     if (newAgent->ipc.pipe.argv == NULL) {
@@ -1915,6 +1928,8 @@ PrintAgentInfo(FILE *stream)
 	    fprintf(stream, " %3d %5" FMT_PID " %3d %3d %3d ",
 		aPtr->pmDomainId, aPtr->ipc.pipe.agentPid, aPtr->inFd, aPtr->outFd, version);
 	    fputs("bin ", stream);
+	    if (aPtr->cacheMsec > 0)
+		fprintf(stream, "cache=%d ", aPtr->cacheMsec);
 	    if (aPtr->ipc.pipe.commandLine) {
 		fputs("pipe cmd=", stream);
 		fputs(aPtr->ipc.pipe.commandLine, stream);
@@ -2316,6 +2331,7 @@ DupAgent(AgentInfo *dest, AgentInfo *src)
     dest->profIndex = src->profIndex;
     /* IMPORTANT: copy the status, connections stay connected */
     memcpy(&dest->status, &src->status, sizeof(dest->status));
+    memcpy(&dest->fetchStats, &src->fetchStats, sizeof(dest->fetchStats));
     if (src->ipcType == AGENT_DSO) {
 	dest->ipc.dso.dlHandle = src->ipc.dso.dlHandle;
 	/*
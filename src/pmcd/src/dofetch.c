@@ -350,232 +350,589 @@ ExtractState(pmResult *result)
     return (int)byte;
 }
 
-int
-DoFetch(ClientInfo *cip, __pmPDU* pb)
+/*
+ * Optional per-agent cache of recent fetch results, enabled with the
+ * cache=MSEC keyword in pmcd.conf.  When many clients fetch the same
+ * metrics on aligned intervals, those arriving within MSEC of an agent
+ * response for the same pmID list and instance profile are given that
+ * response again, without the agent being asked.
+ * Cached pmResults are those decoded from the agent's PDU, so each copy
+ * handed out shares the pinned PDU buffer holding the values.
+ */
+
+#define FETCH_CACHE_SIZE	8	/* entries per agent, at most */
+
+typedef struct fetchcache {
+    struct fetchcache	*next;		/* most recently used first */
+    int			nPmids;
+    pmID		*pmids;
+    pmProfile		*profile;	/* copy of profile used, or NULL */
+    pmResult		*result;	/* agent response, PDU buffer pinned */
+    struct timeval	when;		/* time response arrived */
+} FetchCache;
+
+/*
+ * Return a new pmResult sharing the value sets of a decoded pmResult.
+ */
+static pmResult *
+ShareResult(pmResult *rp)
 {
-    int			i, j;
-    int 		sts;
-    int			ctxnum;
-    unsigned int	changes = 0;
-    pmTimeval		when;
+    pmResult		*result;
+    int			need;
+
+    need = (int)sizeof(pmResult) + (rp->numpmid - 1) * (int)sizeof(pmValueSet *);
+    if ((result = (pmResult *)malloc(need)) == NULL) {
+	pmNoMem("ShareResult", need, PM_FATAL_ERR);
+    }
+    memcpy(result, rp, need);
+    if (rp->numpmid > 0)
+	__pmPinPDUBuf(rp->vset[0]);
+    return result;
+}
+
+static int
+SameProfile(const pmProfile *p1, const pmProfile *p2)
+{
+    const pmInDomProfile	*ip1, *ip2;
+    int				i;
+
+    if (p1 == NULL || p2 == NULL)
+	return p1 == p2;
+    if (p1->state != p2->state || p1->profile_len != p2->profile_len)
+	return 0;
+    for (i = 0; i < p1->profile_len; i++) {
+	ip1 = &p1->profile[i];
+	ip2 = &p2->profile[i];
+	if (ip1->indom != ip2->indom || ip1->state != ip2->state ||
+	    ip1->instances_len != ip2->instances_len)
+	    return 0;
+	if (ip1->instances_len > 0 &&
+	    memcmp(ip1->instances, ip2->instances,
+		   ip1->instances_len * sizeof(int)) != 0)
+	    return 0;
+    }
+    return 1;
+}
+
+static pmProfile *
+CopyProfile(const pmProfile *profile)
+{
+    pmProfile		*copy;
+    pmInDomProfile	*ip;
+    size_t		need;
+    int			i;
+
+    if (profile == NULL)
+	return NULL;
+    if ((copy = (pmProfile *)malloc(sizeof(pmProfile))) == NULL) {
+	pmNoMem("CopyProfile", sizeof(pmProfile), PM_FATAL_ERR);
+    }
+    *copy = *profile;
+    copy->profile = NULL;
+    if (profile->profile_len == 0)
+	return copy;
+    need = profile->profile_len * sizeof(pmInDomProfile);
+    if ((copy->profile = (pmInDomProfile *)malloc(need)) == NULL) {
+	pmNoMem("CopyProfile.profile", need, PM_FATAL_ERR);
+    }
+    for (i = 0; i < profile->profile_len; i++) {
+	ip = &copy->profile[i];
+	*ip = profile->profile[i];
+	ip->instances = NULL;
+	if (ip->instances_len == 0)
+	    continue;
+	need = ip->instances_len * sizeof(int);
+	if ((ip->instances = (int *)malloc(need)) == NULL) {
+	    pmNoMem("CopyProfile.instances", need, PM_FATAL_ERR);
+	}
+	memcpy(ip->instances, profile->profile[i].instances, need);
+    }
+    return copy;
+}
+
+static void
+FreeFetchCache(FetchCache *cp)
+{
+    pmFreeResult(cp->result);
+    __pmFreeProfile(cp->profile);
+    free(cp);
+}
+
+/*
+ * Discard all cached results for an agent, e.g. when it is cleaned up.
+ */
+void
+FlushFetchCache(AgentInfo *ap)
+{
+    FetchCache		*cp;
+
+    while ((cp = ap->cache) != NULL) {
+	ap->cache = cp->next;
+	FreeFetchCache(cp);
+    }
+}
+
+/*
+ * Return a copy of a sufficiently recent agent response for this pmID
+ * list and profile, or NULL if there is none.  Stale entries are
+ * discarded along the way.
+ */
+static pmResult *
+CacheLookup(AgentInfo *ap, DomPmidList *dp, pmProfile *profile)
+{
+    FetchCache		*cp, **cpp;
+    struct timeval	now;
+
+    if (ap->cacheMsec <= 0)
+	return NULL;
+
+    pmtimevalNow(&now);
+    for (cpp = &ap->cache; (cp = *cpp) != NULL; ) {
+	if (pmtimevalSub(&now, &cp->when) * 1000 > ap->cacheMsec) {
+	    *cpp = cp->next;
+	    FreeFetchCache(cp);
+	    continue;
+	}
+	if (cp->nPmids == dp->listSize &&
+	    memcmp(cp->pmids, dp->list, dp->listSize * sizeof(pmID)) == 0 &&
+	    SameProfile(cp->profile, profile)) {
+	    /* move to the front of the list */
+	    *cpp = cp->next;
+	    cp->next = ap->cache;
+	    ap->cache = cp;
+	    ap->fetchStats.cacheHits++;
+	    return ShareResult(cp->result);
+	}
+	cpp = &cp->next;
+    }
+    ap->fetchStats.cacheMisses++;
+    return NULL;
+}
+
+/*
+ * Remember an agent's response, replacing any older response for the
+ * same pmID list and profile, and evicting the least recently used
+ * entry if the cache is full.
+ */
+static void
+CacheInsert(AgentInfo *ap, DomPmidList *dp, pmProfile *profile,
+	    pmResult *result)
+{
+    FetchCache		*cp, **cpp;
+    size_t		need;
+    int			n;
+
+    for (cpp = &ap->cache, n = 0; (cp = *cpp) != NULL; n++) {
+	if ((cp->nPmids == dp->listSize &&
+	     memcmp(cp->pmids, dp->list, dp->listSize * sizeof(pmID)) == 0 &&
+	     SameProfile(cp->profile, profile)) ||
+	    n >= FETCH_CACHE_SIZE - 1) {
+	    *cpp = cp->next;
+	    FreeFetchCache(cp);
+	    continue;
+	}
+	cpp = &cp->next;
+    }
+
+    need = sizeof(FetchCache) + dp->listSize * sizeof(pmID);
+    if ((cp = (FetchCache *)malloc(need)) == NULL) {
+	pmNoMem("CacheInsert", need, PM_FATAL_ERR);
+    }
+    cp->nPmids = dp->listSize;
+    cp->pmids = (pmID *)&cp[1];
+    memcpy(cp->pmids, dp->list, dp->listSize * sizeof(pmID));
+    cp->profile = CopyProfile(profile);
+    cp->result = ShareResult(result);
+    pmtimevalNow(&cp->when);
+    cp->next = ap->cache;
+    ap->cache = cp;
+}
+
+/*
+ * Fetches that involve daemon PMDAs complete asynchronously, so that a
+ * client waiting on a slow agent does not hold up clients fetching from
+ * other agents.  Each daemon agent has a FIFO queue of fetch requests;
+ * only the request at the head of the queue is ever in flight because
+ * agents service PDUs strictly in order.  The client whose fetch is in
+ * progress is removed from clientFds until its pmResult has been sent.
+ * DSO agents are called when the last daemon agent reply has arrived,
+ * immediately before the pmResult is assembled, as DSOs own (and reuse)
+ * the pmResult skeletons they return.
+ */
+
+typedef struct fetchctl {
+    struct fetchctl	*next;		/* fetches awaiting agent replies */
+    int			client;		/* index into client[] */
+    int			ctxnum;		/* client context slot number */
+    int			cancelled;	/* client has gone away */
+    int			nWait;		/* agent replies still outstanding */
+    unsigned int	changes;	/* PMCD_* state changes from agents */
     int			nPmids;
-    pmID		*pmidList;
-    static pmResult	*endResult = NULL;
-    static int		maxnpmids = 0;	/* sizes endResult */
-    DomPmidList		*dList;		/* NOTE: NOT indexed by agent index */
-    static int		nDoms = 0;
-    static pmResult	**results = NULL;
-    static int		*resIndex = NULL;
-    __pmFdSet		waitFds;
-    __pmFdSet		readyFds;
-    int			nWait;
-    int			maxFd;
-    struct timeval	timeout;
-    __pmHashCtl		*hcp;
-    __pmHashNode	*hp;
-    pmProfile		*profile;
+    pmID		*pmidList;	/* pinned in client's FETCH PDU */
+    int			*slot;		/* pmidList[i] is in dList[slot[i]] */
+    int			nDoms;		/* dList[nDoms] is the no-agent list */
+    DomPmidList		*dList;
+    int			*aIndex;	/* agent[] index for each dList[] */
+    pmResult		**results;	/* per-dList[] result from agent */
+} FetchCtl;
 
-    if (nAgents > nDoms) {
-	if (results != NULL)
-	    free(results);
-	if (resIndex != NULL)
-	    free(resIndex);
-	results = (pmResult **)malloc((nAgents + 1) * sizeof (pmResult *));
-	resIndex = (int *)malloc((nAgents + 1) * sizeof(int));
-	if (results == NULL || resIndex == NULL) {
-	    pmNoMem("DoFetch.results", (nAgents + 1) * sizeof (pmResult *) + (nAgents + 1) * sizeof(int), PM_FATAL_ERR);
+typedef struct fetchreq {
+    struct fetchreq	*next;
+    FetchCtl		*fetch;
+    int			dom;		/* index into fetch->dList */
+    struct timeval	sent;		/* time request was sent to agent */
+} FetchReq;
+
+static FetchCtl		*fetchList;	/* fetches in progress */
+
+static FetchCtl *
+NewFetch(ClientInfo *cip, int ctxnum, int nPmids, pmID *pmidList,
+	 DomPmidList *dList)
+{
+    static int		*domSlot;	/* agent index -> dList index */
+    static int		nSlots;
+    FetchCtl		*fp;
+    pmID		*pmids;
+    size_t		need;
+    int			i, j, nDoms;
+
+    if (nAgents + 1 > nSlots) {
+	free(domSlot);
+	if ((domSlot = (int *)malloc((nAgents + 1) * sizeof(int))) == NULL) {
+	    pmNoMem("NewFetch.domSlot", (nAgents + 1) * sizeof(int), PM_FATAL_ERR);
 	}
-	nDoms = nAgents;
+	nSlots = nAgents + 1;
     }
-    memset(results, 0, (nAgents + 1) * sizeof(results[0]));
 
-    sts = __pmDecodeFetch(pb, &ctxnum, &when, &nPmids, &pmidList);
-    if (sts < 0)
-	return sts;
+    for (nDoms = 0; dList[nDoms].domain != -1; nDoms++)
+	;
 
-    /* Check that a profile has been received from the specified context */
-    profile = NULL;
-    if (ctxnum >= 0) {
-	hcp = &cip->profile;
-	hp = __pmHashSearch(ctxnum, hcp);
-	if (hp != NULL)
-	    profile = (pmProfile *)hp->data;
+    need = sizeof(FetchCtl);
+    need += (nDoms + 1) * (sizeof(DomPmidList) + sizeof(int) + sizeof(pmResult *));
+    need += nPmids * (sizeof(pmID) + sizeof(int));
+    if ((fp = (FetchCtl *)calloc(1, need)) == NULL) {
+	pmNoMem("NewFetch", need, PM_FATAL_ERR);
     }
-    if (ctxnum < 0 || profile == NULL) {
-	__pmUnpinPDUBuf(pb);
-	if (ctxnum < 0)
-	    pmNotifyErr(LOG_ERR, "DoFetch: bad ctxnum=%d\n", ctxnum);
+    fp->dList = (DomPmidList *)&fp[1];
+    fp->results = (pmResult **)&fp->dList[nDoms + 1];
+    fp->aIndex = (int *)&fp->results[nDoms + 1];
+    fp->slot = &fp->aIndex[nDoms + 1];
+    pmids = (pmID *)&fp->slot[nPmids];
+
+    fp->client = cip - client;
+    fp->ctxnum = ctxnum;
+    fp->nPmids = nPmids;
+    fp->pmidList = pmidList;
+    fp->nDoms = nDoms;
+
+    for (i = 0; i <= nDoms; i++) {
+	fp->dList[i].domain = dList[i].domain;
+	fp->dList[i].listSize = dList[i].listSize;
+	fp->dList[i].list = pmids;
+	memcpy(pmids, dList[i].list, dList[i].listSize * sizeof(pmID));
+	pmids += dList[i].listSize;
+	fp->aIndex[i] = (i < nDoms) ? mapdom[dList[i].domain] : nAgents;
+	domSlot[fp->aIndex[i]] = i;
+    }
+    domSlot[nAgents] = nDoms;
+    for (i = 0; i < nPmids; i++) {
+	j = mapdom[((__pmID_int *)&pmidList[i])->domain];
+	fp->slot[i] = domSlot[j];
+    }
+    return fp;
+}
+
+/*
+ * Account for the latency of one fetch from an agent.
+ */
+static void
+FetchLatency(AgentInfo *ap, struct timeval *start)
+{
+    struct timeval	now;
+    FetchStats		*sp = &ap->fetchStats;
+    double		usec;
+    int			i;
+
+    pmtimevalNow(&now);
+    if ((usec = pmtimevalSub(&now, start) * 1000000) < 0)
+	usec = 0;		/* clock stepped backwards */
+    sp->count++;
+    sp->time += (__uint64_t)usec;
+    if (usec > sp->max)
+	sp->max = (__uint64_t)usec;
+    for (i = 0; i < FETCH_NBUCKETS - 1; i++) {
+	if (usec <= 1000)
+	    break;
+	usec /= 10;
+    }
+    sp->bucket[i]++;
+}
+
+/*
+ * Record the pmResult from one agent for a fetch in progress.
+ */
+static void
+FetchResult(FetchCtl *fp, int dom, pmResult *result)
+{
+    fp->results[dom] = result;
+    fp->nWait--;
+}
+
+/*
+ * Send queued requests to an agent, until one is in flight or the
+ * queue has been emptied.
+ */
+static void
+DispatchFetch(AgentInfo *ap)
+{
+    FetchReq		*rp;
+    FetchCtl		*fp;
+    DomPmidList		*dp;
+    pmResult		*result;
+
+    while (!ap->status.busy && (rp = ap->fetchHead) != NULL) {
+	/*
+	 * Unlink first - if SendFetch() fails it calls CleanupAgent(),
+	 * which fails every request remaining on this agent's queue.
+	 */
+	if ((ap->fetchHead = rp->next) == NULL)
+	    ap->fetchTail = NULL;
+	fp = rp->fetch;
+	dp = &fp->dList[rp->dom];
+	if (fp->cancelled)
+	    result = MakeBadResult(dp->listSize, dp->list, PM_ERR_NOAGENT);
 	else
-	    pmNotifyErr(LOG_ERR, "DoFetch: no profile for ctxnum=%d\n", ctxnum);
-	return PM_ERR_NOPROFILE;
+	    result = SendFetch(dp, ap, &client[fp->client], fp->ctxnum);
+	if (result == NULL) {
+	    /* request is in flight, wait for the agent's response */
+	    pmtimevalNow(&rp->sent);
+	    rp->next = ap->fetchHead;
+	    ap->fetchHead = rp;
+	    if (ap->fetchTail == NULL)
+		ap->fetchTail = rp;
+	    ap->status.busy = 1;
+	    break;
+	}
+	FetchResult(fp, rp->dom, result);
+	free(rp);
+    }
+}
+
+static void
+QueueFetch(AgentInfo *ap, FetchCtl *fp, int dom)
+{
+    FetchReq		*rp;
+
+    if ((rp = (FetchReq *)malloc(sizeof(FetchReq))) == NULL) {
+	pmNoMem("QueueFetch", sizeof(FetchReq), PM_FATAL_ERR);
+    }
+    rp->next = NULL;
+    rp->fetch = fp;
+    rp->dom = dom;
+    if (ap->fetchTail != NULL)
+	ap->fetchTail->next = rp;
+    else
+	ap->fetchHead = rp;
+    ap->fetchTail = rp;
+    fp->nWait++;
+
+    DispatchFetch(ap);
+}
+
+/*
+ * Agent is being cleaned up - fail any requests it has queued,
+ * including one in flight.
+ */
+void
+AbortAgentFetches(AgentInfo *ap)
+{
+    FetchReq		*rp;
+    DomPmidList		*dp;
+
+    while ((rp = ap->fetchHead) != NULL) {
+	ap->fetchHead = rp->next;
+	dp = &rp->fetch->dList[rp->dom];
+	FetchResult(rp->fetch, rp->dom,
+		    MakeBadResult(dp->listSize, dp->list, PM_ERR_NOAGENT));
+	free(rp);
+    }
+    ap->fetchTail = NULL;
+    ap->status.busy = 0;
+}
+
+/*
+ * Client is being cleaned up - any fetch of theirs still in progress
+ * is completed silently, once the agents involved have responded.
+ */
+void
+CancelClientFetch(ClientInfo *cip)
+{
+    FetchCtl		*fp;
+
+    for (fp = fetchList; fp != NULL; fp = fp->next) {
+	if (fp->client == cip - client)
+	    fp->cancelled = 1;
+    }
+}
+
+/*
+ * Read the response to the in-flight request from an agent.
+ */
+static void
+FetchReply(AgentInfo *ap)
+{
+    FetchReq		*rp = ap->fetchHead;
+    FetchCtl		*fp = rp->fetch;
+    DomPmidList		*dp = &fp->dList[rp->dom];
+    pmResult		*result = NULL;
+    __pmPDU		*pb;
+    int			pinpdu;
+    int			sts, k;
+
+    if ((ap->fetchHead = rp->next) == NULL)
+	ap->fetchTail = NULL;
+    ap->status.busy = 0;
+
+    pinpdu = sts = __pmGetPDU(ap->outFd, ANY_SIZE, pmcd_timeout, &pb);
+    if (sts > 0)
+	pmcd_trace(TR_RECV_PDU, ap->outFd, sts, (int)((__psint_t)pb & 0xffffffff));
+    FetchLatency(ap, &rp->sent);
+    if (sts == PDU_RESULT) {
+	if ((sts = __pmDecodeResult(pb, &result)) >= 0) {
+	    if (result->numpmid == dp->listSize) {
+		fp->changes |= ExtractState(result);
+	    } else {
+		if (pmDebugOptions.appl0)
+		    pmNotifyErr(LOG_ERR, "DoFetch: \"%s\" agent given %d pmIDs, returned %d\n",
+				 ap->pmDomainLabel, dp->listSize, result->numpmid);
+		pmFreeResult(result);
+		sts = PM_ERR_IPC;
+	    }
+	}
     }
+    else {
+	if (sts == PDU_ERROR) {
+	    int s;
+	    if ((s = __pmDecodeError(pb, &sts)) < 0)
+		sts = s;
+	    else if (sts >= 0)
+		sts = PM_ERR_GENERIC;
+	    pmcd_trace(TR_RECV_ERR, ap->outFd, PDU_RESULT, sts);
+	}
+	else if (sts >= 0) {
+	    pmcd_trace(TR_WRONG_PDU, ap->outFd, PDU_RESULT, sts);
+	    sts = PM_ERR_IPC;
+	}
+    }
+    if (pinpdu > 0)
+	__pmUnpinPDUBuf(pb);
+
+    if (sts < 0) {
+	result = MakeBadResult(dp->listSize, dp->list, sts);
+
+	if (sts == PM_ERR_PMDANOTREADY) {
+	    /* the agent is indicating it can't handle PDUs for now */
+	    extern int CheckError(AgentInfo *ap, int sts);
+
+	    for (k = 0; k < dp->listSize; k++)
+		result->vset[k]->numval = PM_ERR_AGAIN;
+	    sts = CheckError(ap, sts);
+	}
+
+	if (pmDebugOptions.appl0) {
+	    fprintf(stderr, "RESULT error from \"%s\" agent : %s\n",
+		    ap->pmDomainLabel, pmErrStr(sts));
+	}
+    }
+    else if (ap->cacheMsec > 0 && !fp->cancelled &&
+	     ExtractState(result) == 0) {
+	ClientInfo	*cip = &client[fp->client];
+	__pmHashNode	*hp = __pmHashSearch(fp->ctxnum, &cip->profile);
+
+	CacheInsert(ap, dp, hp ? (pmProfile *)hp->data : NULL, result);
+    }
+    FetchResult(fp, rp->dom, result);
+    free(rp);
+
+    if (sts == PM_ERR_IPC || sts == PM_ERR_TIMEOUT)
+	CleanupAgent(ap, AT_COMM, ap->outFd);
+    else
+	DispatchFetch(ap);
+}
 
-    if (nPmids > maxnpmids) {
+/*
+ * Merge the per-agent results and send the pmResult to the client,
+ * then release everything associated with the fetch.
+ */
+static void
+FinishFetch(FetchCtl *fp)
+{
+    static pmResult	*endResult = NULL;
+    static int		maxnpmids = 0;	/* sizes endResult */
+    static int		*resIndex = NULL;
+    static int		maxdoms = 0;	/* sizes resIndex */
+    ClientInfo		*cip = &client[fp->client];
+    AgentInfo		*ap;
+    struct timeval	start;
+    int			save_client_id;
+    int			i, j;
+    int			sts;
+
+    if (fp->cancelled)
+	goto done;
+
+    if (fp->nPmids > maxnpmids) {
 	int		need;
 	if (endResult != NULL)
 	    free(endResult);
-	need = (int)sizeof(pmResult) + (nPmids - 1) * (int)sizeof(pmValueSet *);
+	need = (int)sizeof(pmResult) + (fp->nPmids - 1) * (int)sizeof(pmValueSet *);
 	if ((endResult = (pmResult *)malloc(need)) == NULL) {
 	    pmNoMem("DoFetch.endResult", need, PM_FATAL_ERR);
 	}
-	maxnpmids = nPmids;
+	maxnpmids = fp->nPmids;
     }
-
-    dList = SplitPmidList(nPmids, pmidList);
-
-    /* For each domain in the split pmidList, dispatch the per-domain subset
-     * of pmIDs to the appropriate agent.  For DSO agents, the pmResult will
-     * come back immediately.  If a request cannot be sent to an agent, a
-     * suitable pmResult (containing metric not available values) will be
-     * returned.
-     */
-    __pmFD_ZERO(&waitFds);
-    nWait = 0;
-    maxFd = -1;
-    for (i = 0; dList[i].domain != -1; i++) {
-	j = mapdom[dList[i].domain];
-	results[j] = SendFetch(&dList[i], &agent[j], cip, ctxnum);
-	if (results[j] == NULL) { /* Wait for agent's response */
-	    int fd = agent[j].outFd;
-	    agent[j].status.busy = 1;
-	    __pmFD_SET(fd, &waitFds);
-	    if (fd > maxFd)
-		maxFd = fd;
-	    nWait++;
-	} else {
-	    changes |= ExtractState(results[j]);
+    if (fp->nDoms + 1 > maxdoms) {
+	if (resIndex != NULL)
+	    free(resIndex);
+	if ((resIndex = (int *)malloc((fp->nDoms + 1) * sizeof(int))) == NULL) {
+	    pmNoMem("DoFetch.resIndex", (fp->nDoms + 1) * sizeof(int), PM_FATAL_ERR);
 	}
+	maxdoms = fp->nDoms + 1;
     }
-    /* Construct pmResult for bad-pmID list */
-    if (dList[i].listSize != 0)
-	results[nAgents] = MakeBadResult(dList[i].listSize, dList[i].list, PM_ERR_NOAGENT);
-
-    /* Wait for results to roll in from agents */
-    while (nWait > 0) {
-        __pmFD_COPY(&readyFds, &waitFds);
-	if (nWait > 1) {
-	    timeout.tv_sec = pmcd_timeout;
-	    timeout.tv_usec = 0;
-
-            retry:
-	    setoserror(0);
-	    sts = __pmSelectRead(maxFd+1, &readyFds, &timeout);
-
-	    if (sts == 0) {
-		pmNotifyErr(LOG_INFO, "DoFetch: select timeout");
-
-		/* Timeout, terminate agents with undelivered results */
-		for (i = 0; i < nAgents; i++) {
-		    if (agent[i].status.busy) {
-			/* Find entry in dList for this agent */
-			for (j = 0; dList[j].domain != -1; j++)
-			    if (dList[j].domain == agent[i].pmDomainId)
-				break;
-			results[i] = MakeBadResult(dList[j].listSize,
-						   dList[j].list,
-						   PM_ERR_NOAGENT);
-			pmcd_trace(TR_RECV_TIMEOUT, agent[i].outFd, PDU_RESULT, 0);
-			CleanupAgent(&agent[i], AT_COMM, agent[i].inFd);
-		    }
-		}
-		break;
-	    }
-	    else if (sts < 0) {
-		if (neterror() == EINTR)
-		    goto retry;
-		/* this is not expected to happen! */
-		pmNotifyErr(LOG_ERR, "DoFetch: fatal select failure: %s\n",
-			netstrerror());
-		Shutdown();
-		exit(1);
-	    }
-	}
-
-	/* Read results from agents that have them ready */
-	for (i = 0; i < nAgents; i++) {
-	    AgentInfo	*ap = &agent[i];
-	    int		pinpdu;
-	    if (!ap->status.busy || !__pmFD_ISSET(ap->outFd, &readyFds))
-		continue;
-	    ap->status.busy = 0;
-	    __pmFD_CLR(ap->outFd, &waitFds);
-	    nWait--;
-	    pinpdu = sts = __pmGetPDU(ap->outFd, ANY_SIZE, pmcd_timeout, &pb);
-	    if (sts > 0)
-		pmcd_trace(TR_RECV_PDU, ap->outFd, sts, (int)((__psint_t)pb & 0xffffffff));
-	    if (sts == PDU_RESULT) {
-		if ((sts = __pmDecodeResult(pb, &results[i])) >= 0) {
-		    if (results[i]->numpmid == aFreq[i]) {
-			changes |= ExtractState(results[i]);
-		    } else {
-			if (pmDebugOptions.appl0)
-			    pmNotifyErr(LOG_ERR, "DoFetch: \"%s\" agent given %d pmIDs, returned %d\n",
-					 ap->pmDomainLabel, aFreq[i], results[i]->numpmid);
-			pmFreeResult(results[i]);
-			sts = PM_ERR_IPC;
-		    }
-		}
-	    }
-	    else {
-		if (sts == PDU_ERROR) {
-		    int s;
-		    if ((s = __pmDecodeError(pb, &sts)) < 0)
-			sts = s;
-		    else if (sts >= 0)
-			sts = PM_ERR_GENERIC;
-		    pmcd_trace(TR_RECV_ERR, ap->outFd, PDU_RESULT, sts);
-		}
-		else if (sts >= 0) {
-		    pmcd_trace(TR_WRONG_PDU, ap->outFd, PDU_RESULT, sts);
-		    sts = PM_ERR_IPC;
-		}
-	    }
-	    if (pinpdu > 0)
-		__pmUnpinPDUBuf(pb);
-
-	    if (sts < 0) {
-		/* Find entry in dList for this agent */
-		for (j = 0; dList[j].domain != -1; j++)
-		    if (dList[j].domain == agent[i].pmDomainId)
-			break;
-		results[i] = MakeBadResult(dList[j].listSize,
-					   dList[j].list, sts);
-
-		if (sts == PM_ERR_PMDANOTREADY) {
-		    /* the agent is indicating it can't handle PDUs for now */
-		    int k;
-		    extern int CheckError(AgentInfo *ap, int sts);
-
-		    for (k = 0; k < dList[j].listSize; k++)
-			results[i]->vset[k]->numval = PM_ERR_AGAIN;
-		    sts = CheckError(&agent[i], sts);
-		}
 
-		if (pmDebugOptions.appl0) {
-		    fprintf(stderr, "RESULT error from \"%s\" agent : %s\n",
-			    ap->pmDomainLabel, pmErrStr(sts));
-		}
-		if (sts == PM_ERR_IPC || sts == PM_ERR_TIMEOUT)
-		    CleanupAgent(ap, AT_COMM, ap->outFd);
-	    }
-	}
+    /*
+     * Daemon agents have all responded, now call the DSO agents.  This
+     * may happen while another client's request is being handled (from
+     * WaitFetches), so the DSOs see this client only for these calls.
+     */
+    save_client_id = this_client_id;
+    this_client_id = fp->client;
+    for (i = 0; i < fp->nDoms; i++) {
+	ap = &agent[fp->aIndex[i]];
+	if (ap->ipcType != AGENT_DSO)
+	    continue;
+	pmtimevalNow(&start);
+	fp->results[i] = SendFetch(&fp->dList[i], ap, cip, fp->ctxnum);
+	FetchLatency(ap, &start);
+	fp->changes |= ExtractState(fp->results[i]);
     }
+    this_client_id = save_client_id;
 
-    if (changes)
-	MarkStateChanges(changes);
+    if (fp->changes)
+	MarkStateChanges(fp->changes);
 
-    endResult->numpmid = nPmids;
+    endResult->numpmid = fp->nPmids;
     pmtimevalNow(&endResult->timestamp);
     /* The order of the pmIDs in the per-domain results is the same as in the
      * original request, but on a per-domain basis.  resIndex is an array of
-     * indices (one per agent) of the next metric to be retrieved from each
+     * indices (one per domain) of the next metric to be retrieved from each
      * per-domain result's vset.
      */
-    memset(resIndex, 0, (nAgents + 1) * sizeof(resIndex[0]));
+    memset(resIndex, 0, (fp->nDoms + 1) * sizeof(resIndex[0]));
 
-    for (i = 0; i < nPmids; i++) {
-	j = mapdom[((__pmID_int *)&pmidList[i])->domain];
-	endResult->vset[i] = results[j]->vset[resIndex[j]++];
+    for (i = 0; i < fp->nPmids; i++) {
+	j = fp->slot[i];
+	endResult->vset[i] = fp->results[j]->vset[resIndex[j]++];
     }
     pmcd_trace(TR_XMIT_PDU, cip->fd, PDU_RESULT, endResult->numpmid);
 
@@ -594,27 +951,258 @@ DoFetch(ClientInfo *cip, __pmPDU* pb)
 	pmcd_trace(TR_XMIT_ERR, cip->fd, PDU_RESULT, sts);
 	CleanupClient(cip, sts);
     }
+    else {
+	/* ready for the next request from this client */
+	__pmFD_SET(cip->fd, &clientFds);
+    }
 
+done:
     /*
      * pmFreeResult() all the accumulated results.
      */
-    for (i = 0; dList[i].domain != -1; i++) {
-	j = mapdom[dList[i].domain];
-	if (agent[j].ipcType == AGENT_DSO && agent[j].status.connected &&
-	    !agent[j].status.madeDsoResult)
+    for (i = 0; i <= fp->nDoms; i++) {
+	if (fp->results[i] == NULL)
+	    continue;
+	ap = (i < fp->nDoms) ? &agent[fp->aIndex[i]] : NULL;
+	if (ap != NULL && ap->ipcType == AGENT_DSO && ap->status.connected &&
+	    !ap->status.madeDsoResult)
 	    /* Living DSO's manage their own pmResult skeleton unless
 	     * MakeBadResult was called to create the result.  The value sets
 	     * within the skeleton need to be freed though!
 	     */
-	    __pmFreeResultValues(results[j]);
+	    __pmFreeResultValues(fp->results[i]);
 	else
 	    /* For others it is dynamically allocated in __pmDecodeResult or
 	     * MakeBadResult
 	     */
-	    pmFreeResult(results[j]);
+	    pmFreeResult(fp->results[i]);
+    }
+    __pmUnpinPDUBuf(fp->pmidList);
+    free(fp);
+}
+
+/*
+ * Complete any fetches for which all daemon agents have now responded.
+ */
+static void
+FinishFetches(void)
+{
+    FetchCtl		*fp, **fpp;
+
+    fpp = &fetchList;
+    while ((fp = *fpp) != NULL) {
+	if (fp->nWait > 0) {
+	    fpp = &fp->next;
+	    continue;
+	}
+	*fpp = fp->next;
+	FinishFetch(fp);
+	/* list may have changed beneath us, so start again */
+	fpp = &fetchList;
+    }
+}
+
+/*
+ * Add the output descriptors of agents with a fetch in flight to the
+ * given set; returns the updated select() nfds value.
+ */
+int
+FetchAgentFds(__pmFdSet *fds, int nfds)
+{
+    int			i;
+
+    for (i = 0; i < nAgents; i++) {
+	if (!agent[i].status.busy || agent[i].fetchHead == NULL)
+	    continue;
+	__pmFD_SET(agent[i].outFd, fds);
+	if (agent[i].outFd >= nfds)
+	    nfds = agent[i].outFd + 1;
     }
-    if (results[nAgents] != NULL)
-	pmFreeResult(results[nAgents]);
-    __pmUnpinPDUBuf(pmidList);
+    return nfds;
+}
+
+/*
+ * Time until the earliest in-flight fetch times out, or NULL if there
+ * is nothing to wait for (or timeouts are disabled).
+ */
+struct timeval *
+FetchTimeout(struct timeval *timeout)
+{
+    struct timeval	now;
+    double		wait, least = -1;
+    int			i;
+
+    if (pmcd_timeout <= 0)
+	return NULL;
+    pmtimevalNow(&now);
+    for (i = 0; i < nAgents; i++) {
+	if (!agent[i].status.busy || agent[i].fetchHead == NULL)
+	    continue;
+	wait = pmcd_timeout - pmtimevalSub(&now, &agent[i].fetchHead->sent);
+	if (least < 0 || wait < least)
+	    least = wait;
+    }
+    if (least < 0)
+	return NULL;
+    if (least < 0.001)
+	least = 0.001;
+    pmtimevalFromReal(least, timeout);
+    return timeout;
+}
+
+/*
+ * Process agent responses to in-flight fetches, time out agents that
+ * have not responded within pmcd_timeout, and send pmResults for any
+ * fetches that are now complete.
+ */
+void
+HandleFetchReplies(__pmFdSet *readyFds)
+{
+    struct timeval	now;
+    AgentInfo		*ap;
+    FetchReq		*rp;
+    DomPmidList		*dp;
+    int			i;
+
+    for (i = 0; i < nAgents; i++) {
+	ap = &agent[i];
+	if (!ap->status.busy || (rp = ap->fetchHead) == NULL)
+	    continue;
+	if (readyFds != NULL && __pmFD_ISSET(ap->outFd, readyFds)) {
+	    FetchReply(ap);
+	    continue;
+	}
+	if (pmcd_timeout <= 0)
+	    continue;
+	pmtimevalNow(&now);
+	if (pmtimevalSub(&now, &rp->sent) < pmcd_timeout)
+	    continue;
+
+	/* Timeout, terminate agent with undelivered result */
+	pmNotifyErr(LOG_INFO, "DoFetch: \"%s\" agent timeout",
+			ap->pmDomainLabel);
+	if ((ap->fetchHead = rp->next) == NULL)
+	    ap->fetchTail = NULL;
+	ap->status.busy = 0;
+	ap->fetchStats.timeouts++;
+	dp = &rp->fetch->dList[rp->dom];
+	FetchResult(rp->fetch, rp->dom,
+		    MakeBadResult(dp->listSize, dp->list, PM_ERR_NOAGENT));
+	free(rp);
+	pmcd_trace(TR_RECV_TIMEOUT, ap->outFd, PDU_RESULT, 0);
+	CleanupAgent(ap, AT_COMM, ap->inFd);
+    }
+
+    FinishFetches();
+}
+
+/*
+ * Block until every fetch in progress for the given agent has completed,
+ * or for all agents if ap is NULL.  Agents service PDUs strictly in
+ * order, so this must be done before any synchronous PDU exchange with
+ * an agent, and before agents are restarted.
+ */
+int
+WaitFetches(AgentInfo *ap)
+{
+    __pmFdSet		readyFds;
+    struct timeval	timeout;
+    int			nfds;
+    int			sts;
+
+    while (ap ? ap->fetchHead != NULL : fetchList != NULL) {
+	__pmFD_ZERO(&readyFds);
+	sts = 0;
+	if (ap != NULL) {
+	    __pmFD_SET(ap->outFd, &readyFds);
+	    nfds = ap->outFd + 1;
+	}
+	else
+	    nfds = FetchAgentFds(&readyFds, 0);
+	if (nfds > 0) {
+	    sts = __pmSelectRead(nfds, &readyFds, FetchTimeout(&timeout));
+	    if (sts < 0 && neterror() != EINTR) {
+		/* this is not expected to happen! */
+		pmNotifyErr(LOG_ERR, "WaitFetches: fatal select failure: %s\n",
+			    netstrerror());
+		Shutdown();
+		exit(1);
+	    }
+	}
+	HandleFetchReplies(sts > 0 ? &readyFds : NULL);
+    }
+    if (ap != NULL && !ap->status.connected)
+	return PM_ERR_NOAGENT;
+    return 0;
+}
+
+int
+DoFetch(ClientInfo *cip, __pmPDU* pb)
+{
+    int 		sts;
+    int			i;
+    int			ctxnum;
+    pmTimeval		when;
+    int			nPmids;
+    pmID		*pmidList;
+    DomPmidList		*dList;		/* NOTE: NOT indexed by agent index */
+    FetchCtl		*fp;
+    AgentInfo		*ap;
+    __pmHashCtl		*hcp;
+    __pmHashNode	*hp;
+    pmProfile		*profile;
+
+    sts = __pmDecodeFetch(pb, &ctxnum, &when, &nPmids, &pmidList);
+    if (sts < 0)
+	return sts;
+
+    /* Check that a profile has been received from the specified context */
+    profile = NULL;
+    if (ctxnum >= 0) {
+	hcp = &cip->profile;
+	hp = __pmHashSearch(ctxnum, hcp);
+	if (hp != NULL)
+	    profile = (pmProfile *)hp->data;
+    }
+    if (ctxnum < 0 || profile == NULL) {
+	__pmUnpinPDUBuf(pb);
+	if (ctxnum < 0)
+	    pmNotifyErr(LOG_ERR, "DoFetch: bad ctxnum=%d\n", ctxnum);
+	else
+	    pmNotifyErr(LOG_ERR, "DoFetch: no profile for ctxnum=%d\n", ctxnum);
+	return PM_ERR_NOPROFILE;
+    }
+
+    dList = SplitPmidList(nPmids, pmidList);
+    fp = NewFetch(cip, ctxnum, nPmids, pmidList, dList);
+
+    /* For each domain in the split pmidList served by a daemon agent,
+     * queue the per-domain subset of pmIDs for the appropriate agent,
+     * unless a recent enough response is in the agent's cache.
+     * If a request cannot be sent to an agent, a suitable pmResult
+     * (containing metric not available values) is filled in directly.
+     */
+    for (i = 0; i < fp->nDoms; i++) {
+	ap = &agent[fp->aIndex[i]];
+	if (ap->ipcType == AGENT_DSO)
+	    continue;
+	if ((fp->results[i] = CacheLookup(ap, &fp->dList[i], profile)) == NULL)
+	    QueueFetch(ap, fp, i);
+    }
+    /* Construct pmResult for bad-pmID list */
+    if (fp->dList[i].listSize != 0)
+	fp->results[i] = MakeBadResult(fp->dList[i].listSize,
+				       fp->dList[i].list, PM_ERR_NOAGENT);
+
+    if (fp->nWait == 0) {
+	/* DSOs only, or no daemon agent could be sent a request */
+	FinishFetch(fp);
+	return 0;
+    }
+
+    /* Stop listening to this client until their pmResult has been sent */
+    __pmFD_CLR(cip->fd, &clientFds);
+    fp->next = fetchList;
+    fetchList = fp;
     return 0;
 }
@@ -77,6 +77,8 @@ DoText(ClientInfo *cp, __pmPDU* pb)
 					  ap->ipc.dso.dispatch.version.any.ext);
     }
     else {
+	if ((sts = WaitFetches(ap)) < 0)
+	    return sts;
 	if (ap->status.notReady)
 	    return PM_ERR_AGAIN;
 	pmcd_trace(TR_XMIT_PDU, ap->inFd, PDU_TEXT_REQ, ident);
@@ -189,6 +191,8 @@ DoDesc(ClientInfo *cp, __pmPDU *pb)
 					ap->ipc.dso.dispatch.version.any.ext);
     }
     else {
+	if ((sts = WaitFetches(ap)) < 0)
+	    return sts;
 	if (ap->status.notReady)
 	    return PM_ERR_AGAIN;
 	pmcd_trace(TR_XMIT_PDU, ap->inFd, PDU_DESC_REQ, (int)pmid);
@@ -275,6 +279,10 @@ DoInstance(ClientInfo *cp, __pmPDU *pb)
 					ap->ipc.dso.dispatch.version.any.ext);
     }
     else {
+	if ((sts = WaitFetches(ap)) < 0) {
+	    if (name != NULL) free(name);
+	    return sts;
+	}
 	if (ap->status.notReady) {
 	    if (name != NULL) free(name);
 	    return PM_ERR_AGAIN;
@@ -496,6 +504,8 @@ DoLabel(ClientInfo *cp, __pmPDU *pb)
 	    nsets = sts;
     }
     else {
+	if ((sts = WaitFetches(ap)) < 0)
+	    return sts;
 	if (ap->status.notReady)
 	    return PM_ERR_AGAIN;
 
@@ -599,6 +609,8 @@ DoPMNSIDs(ClientInfo *cp, __pmPDU *pb)
 	}
 	else {
 	    /* daemon PMDA ... ship request on */
+	    if ((sts = WaitFetches(ap)) < 0)
+		goto fail;
 	    if (ap->status.notReady)
 		return PM_ERR_AGAIN;
 	    pmcd_trace(TR_XMIT_PDU, ap->inFd, PDU_PMNS_IDS, 1);
@@ -714,7 +726,9 @@ DoPMNSNames(ClientInfo *cp, __pmPDU *pb)
 	    else {
 		/* daemon PMDA ... ship request on */
 		int		fdfail = -1;
-		if (ap->status.notReady)
+		if (WaitFetches(ap) < 0)
+		    lsts = PM_ERR_NOAGENT;
+		else if (ap->status.notReady)
 		    lsts = PM_ERR_AGAIN;
 		else {
 		    pmcd_trace(TR_XMIT_PDU, ap->inFd, PDU_PMNS_NAMES, 1);
@@ -843,7 +857,9 @@ DoPMNSChild(ClientInfo *cp, __pmPDU *pb)
 	else {
 	    /* daemon PMDA ... ship request on */
 	    int		fdfail = -1;
-	    if (ap->status.notReady)
+	    if (WaitFetches(ap) < 0)
+		sts = PM_ERR_NOAGENT;
+	    else if (ap->status.notReady)
 		sts = PM_ERR_AGAIN;
 	    else {
 		pmcd_trace(TR_XMIT_PDU, ap->inFd, PDU_PMNS_CHILD, 1);
@@ -1024,7 +1040,7 @@ traverse_dynamic(ClientInfo *cp, char *start, int *num_names, char ***names)
 	    else {
 		/* daemon PMDA ... ship request on */
 		int		fdfail = -1;
-		if (ap->status.notReady)
+		if (WaitFetches(ap) < 0 || ap->status.notReady)
 		    continue;
 		pmcd_trace(TR_XMIT_PDU, ap->inFd, PDU_PMNS_TRAVERSE, 1);
 		sts = __pmSendTraversePMNSReq(ap->inFd, cp - client, namelist[0]);
@@ -163,6 +163,10 @@ DoStore(ClientInfo *cp, __pmPDU* pb)
 	    s = ap->ipc.dso.dispatch.version.any.store(dResult[i],
 				       ap->ipc.dso.dispatch.version.any.ext);
 	}
+	else if (WaitFetches(ap) < 0) {
+	    /* agent died while completing earlier fetches */
+	    s = PM_ERR_NOAGENT;
+	}
 	else {
 	    if (ap->status.notReady == 0) {
 		/* agent is ready for PDUs */
@@ -214,7 +218,8 @@ DoStore(ClientInfo *cp, __pmPDU* pb)
 
 		/* Timeout, terminate agents that haven't responded */
 		for (i = 0; i < nAgents; i++) {
-		    if (agent[i].status.busy) {
+		    if (agent[i].status.busy &&
+			__pmFD_ISSET(agent[i].outFd, &waitFds)) {
 			pmcd_trace(TR_RECV_TIMEOUT, agent[i].outFd, PDU_ERROR, 0);
 			CleanupAgent(&agent[i], AT_COMM, agent[i].inFd);
 		    }
@@ -749,11 +749,13 @@ ClientLoop(void)
     int		reload_namespace = 0;
     int		restartAgents = -1;	/* initial state unknown */
     __pmFdSet	readableFds;
+    struct timeval timeout;
 
     for (;;) {
 
 	/* Figure out which file descriptors to wait for input on.  Keep
 	 * track of the highest numbered descriptor for the select call.
+	 * Clients with a fetch in progress are not in clientFds.
 	 */
 	readableFds = clientFds;
 	maxFd = maxClientFd + 1;
@@ -768,7 +770,7 @@ ClientLoop(void)
 	    if (ap->status.notReady) {
 		fd = ap->outFd;
 		__pmFD_SET(fd, &readableFds);
-		if (fd > maxFd)
+		if (fd >= maxFd)
 		    maxFd = fd + 1;
 		checkAgents = 1;
 		if (pmDebugOptions.appl0)
@@ -778,7 +780,11 @@ ClientLoop(void)
 	    }
 	}
 
-	sts = __pmSelectRead(maxFd, &readableFds, NULL);
+	/* Agents with a fetch in flight will respond in their own time */
+	maxFd = FetchAgentFds(&readableFds, maxFd);
+
+	sts = __pmSelectRead(maxFd, &readableFds, FetchTimeout(&timeout));
+	HandleFetchReplies(sts > 0 ? &readableFds : NULL);
 	if (sts > 0) {
 	    if (pmDebugOptions.appl0)
 		for (i = 0; i <= maxClientFd; i++)
@@ -821,6 +827,7 @@ ClientLoop(void)
 	if (restart) {
 	    restart = 0;
 	    reload_namespace = 1;
+	    WaitFetches(NULL);
 	    SignalRestart();
 	}
 	if (reload_namespace) {
@@ -1111,6 +1118,8 @@ CleanupClient(ClientInfo *cp, int sts)
 
     force = pmDebugOptions.appl0;
 
+    CancelClientFetch(cp);
+
     if (sts != 0 || force) {
 	/* for access violations, only print the message if this host hasn't
 	 * been dinged for an access violation since startup or reconfiguration
@@ -71,6 +71,24 @@ typedef struct {
     pid_t agentPid;			/* Process ID of the agent */
 } PipeInfo;
 
+/*
+ * Per-agent fetch statistics, exported as the pmcd.agent.fetch and
+ * pmcd.agent.cache metrics.  Latency is measured from when the request
+ * is sent to the agent until its response arrives, and binned in
+ * power-of-ten buckets from 1msec.
+ */
+#define FETCH_NBUCKETS	6		/* <=1ms, 10ms, 100ms, 1s, 10s, >10s */
+
+typedef struct {
+    __uint64_t	count;			/* Fetches completed by the agent */
+    __uint64_t	time;			/* Total fetch latency (usec) */
+    __uint64_t	max;			/* Worst fetch latency (usec) */
+    __uint32_t	timeouts;		/* Fetches abandoned at pmcd_timeout */
+    __uint64_t	bucket[FETCH_NBUCKETS];	/* Fetch latency histogram */
+    __uint64_t	cacheHits;		/* Fetches served from cache */
+    __uint64_t	cacheMisses;		/* Fetches sent on, despite cache */
+} FetchStats;
+
 /* The agent table and its size. */
 
 typedef struct {
@@ -96,6 +114,11 @@ typedef struct {
 	    flags : 16;			/* Agent-supplied connection flags */
     } status;
     int		reason;			/* if ! connected */
+    struct fetchreq *fetchHead;		/* Queued fetches, head is in flight */
+    struct fetchreq *fetchTail;		/* Last fetch queued for this agent */
+    FetchStats	fetchStats;		/* Fetch latency and cache counters */
+    int		cacheMsec;		/* Fetch cache window, 0 if disabled */
+    struct fetchcache *cache;		/* Recent fetch results, MRU first */
     union {				/* per-ipcType info */
 	DsoInfo    dso;
 	SocketInfo socket;
@@ -215,6 +238,17 @@ extern int DoPMNSNames(ClientInfo *, __pmPDU *);
 extern int DoPMNSChild(ClientInfo *, __pmPDU *);
 extern int DoPMNSTraverse(ClientInfo *, __pmPDU *);
 
+/*
+ * Asynchronous fetch completion (daemon agents)
+ */
+extern int FetchAgentFds(__pmFdSet *, int);
+extern struct timeval *FetchTimeout(struct timeval *);
+extern void HandleFetchReplies(__pmFdSet *);
+extern int WaitFetches(AgentInfo *);
+extern void AbortAgentFetches(AgentInfo *);
+extern void CancelClientFetch(ClientInfo *);
+extern void FlushFetchCache(AgentInfo *);
+
 /*
  * General purpose routines
  */
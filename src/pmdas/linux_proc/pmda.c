@@ -41,6 +41,8 @@
 #include "getinfo.h"
 #include "proc_pid.h"
 #include "proc_runq.h"
+#include "proc_taskstats.h"
+#include "proc_scan.h"
 #include "proc_dynamic.h"
 #include "ksym.h"
 #include "cgroups.h"
@@ -57,6 +59,11 @@ static int			have_access;	/* =1 recvd uid/gid */
 static size_t			_pm_system_pagesize;
 static unsigned int		threads;	/* control.all.threads */
 static char *			cgroups;	/* control.all.cgroups */
+static int			taskstats;	/* =1 use netlink taskstats */
+static unsigned int		workers;	/* proc_scan.c pool size */
+static __uint64_t		refresh_count;	/* control.refresh.count */
+static __uint64_t		refresh_time;	/* control.refresh.time */
+static unsigned int		refresh_last;	/* control.refresh.last */
 int				conf_gen;	/* hotproc config version, if zero hotproc not configured yet */
 long				hz;
 
@@ -1544,6 +1551,26 @@ static pmdaMetric metrictab[] = {
     { PMDA_PMID(CLUSTER_CONTROL, 3), PM_TYPE_STRING,
     PM_INDOM_NULL, PM_SEM_INSTANT, PMDA_PMUNITS(0,0,0,0,0,0) } },
 
+/* proc.control.refresh.workers */
+  { &workers,
+    { PMDA_PMID(CLUSTER_CONTROL, 4), PM_TYPE_U32,
+    PM_INDOM_NULL, PM_SEM_DISCRETE, PMDA_PMUNITS(0,0,0,0,0,0) } },
+
+/* proc.control.refresh.count */
+  { &refresh_count,
+    { PMDA_PMID(CLUSTER_CONTROL, 5), PM_TYPE_U64,
+    PM_INDOM_NULL, PM_SEM_COUNTER, PMDA_PMUNITS(0,0,1,0,0,PM_COUNT_ONE) } },
+
+/* proc.control.refresh.time */
+  { &refresh_time,
+    { PMDA_PMID(CLUSTER_CONTROL, 6), PM_TYPE_U64,
+    PM_INDOM_NULL, PM_SEM_COUNTER, PMDA_PMUNITS(0,1,0,0,PM_TIME_USEC,0) } },
+
+/* proc.control.refresh.last */
+  { &refresh_last,
+    { PMDA_PMID(CLUSTER_CONTROL, 7), PM_TYPE_U32,
+    PM_INDOM_NULL, PM_SEM_INSTANT, PMDA_PMUNITS(0,1,0,0,PM_TIME_USEC,0) } },
+
 /*
  * hotproc specific clusters
  */
@@ -1625,11 +1652,40 @@ proc_statsfile(const char *path, char *buffer, int size)
     return fopen(buffer, "r");
 }
 
+/*
+ * The proc/<pid> files to be read by the worker threads (if any) for
+ * the metric clusters of a fetch.  Only the cheap, commonly used files
+ * are read up-front - the others are read on demand as before.
+ */
+static int
+proc_prefetch(int *need_refresh)
+{
+    int prefetch = 0;
+
+    if (need_refresh[CLUSTER_PID_STAT])
+	prefetch |= PROC_PID_FLAG_STAT_FETCHED;
+    if (need_refresh[CLUSTER_PID_STATM])
+	prefetch |= PROC_PID_FLAG_STATM_FETCHED;
+    if (need_refresh[CLUSTER_PID_STATUS])
+	prefetch |= PROC_PID_FLAG_STATUS_FETCHED;
+    if (need_refresh[CLUSTER_PID_SCHEDSTAT])
+	prefetch |= PROC_PID_FLAG_SCHEDSTAT_FETCHED;
+    if (need_refresh[CLUSTER_PID_IO])
+	prefetch |= PROC_PID_FLAG_IO_FETCHED;
+    if (need_refresh[CLUSTER_PID_FD])
+	prefetch |= PROC_PID_FLAG_FD_FETCHED;
+    if (need_refresh[CLUSTER_PID_OOM_SCORE])
+	prefetch |= PROC_PID_FLAG_OOM_SCORE_FETCHED;
+    return prefetch;
+}
+
 static int
-proc_refresh(pmdaExt *pmda, int *need_refresh)
+proc_refresh(pmdaExt *pmda, int *need_refresh, int prefetch)
 {
     char cgroup[MAXPATHLEN];
     proc_container_t *container;
+    struct timeval start, end;
+    double elapsed;
     int sts, cgrouplen = 0;
 
     if ((container = proc_ctx_container(pmda->e_context)) != NULL) {
@@ -1683,12 +1739,17 @@ proc_refresh(pmdaExt *pmda, int *need_refresh)
 	need_refresh[CLUSTER_PID_OOM_SCORE] ||
 	need_refresh[CLUSTER_PID_FD] ||
 	need_refresh[CLUSTER_PROC_RUNQ]) {
+	pmtimevalNow(&start);
 	refresh_proc_pid(&proc_pid,
 		need_refresh[CLUSTER_PROC_RUNQ]? &proc_runq : NULL,
 		proc_ctx_threads(pmda->e_context, threads),
 		proc_ctx_cgroups(pmda->e_context, cgroups),
-		container ? cgroup : NULL, cgrouplen);
-
+		container ? cgroup : NULL, cgrouplen, prefetch);
+	pmtimevalNow(&end);
+	elapsed = pmtimevalSub(&end, &start) * 1000000.0;
+	refresh_last = (unsigned int)elapsed;
+	refresh_time += refresh_last;
+	refresh_count++;
     }
     if (need_refresh[CLUSTER_HOTPROC_PID_STAT] ||
         need_refresh[CLUSTER_HOTPROC_PID_STATM] ||
@@ -1802,7 +1863,7 @@ proc_instance(pmInDom indom, int inst, char *name, pmInResult **result, pmdaExt
 
     if (have_access ||
 	((serial != PROC_INDOM) && (serial != HOTPROC_INDOM))) {
-	if ((sts = proc_refresh(pmda, need_refresh)) == 0)
+	if ((sts = proc_refresh(pmda, need_refresh, 0)) == 0)
 	    sts = pmdaInstance(indom, inst, name, result, pmda);
     }
 
@@ -2065,10 +2126,14 @@ proc_fetchCallBack(pmdaMetric *mdesc, unsigned int inst, pmAtomValue *atom)
 		break;
  
 	    case PROC_PID_STAT_ENVIRON: /* proc.psinfo.environ */
+		if (fetch_proc_pid_environ(inst, active_proc_pid, &sts) == NULL)
+		    return sts;
 		atom->cp = entry->environ_buf ? entry->environ_buf : "";
 		break;
 
 	    case PROC_PID_STAT_WCHAN_SYMBOL: /* proc.psinfo.wchan_s */
+		if (fetch_proc_pid_wchan(inst, active_proc_pid, &sts) == NULL)
+		    return sts;
 		if (entry->wchan_buf)	/* 2.6 kernel, /proc/<pid>/wchan */
 		    atom->cp = entry->wchan_buf;
 		else {		/* old school (2.4 kernels, at least) */
@@ -3141,6 +3206,7 @@ proc_fetchCallBack(pmdaMetric *mdesc, unsigned int inst, pmAtomValue *atom)
     case CLUSTER_CONTROL:
 	switch (item) {
 	/* case 1: not reached -- proc.control.all.threads is direct */
+	/* case 4-7: not reached -- proc.control.refresh.* are direct */
 	case 2:	/* proc.control.perclient.threads */
 	    atom->ul = proc_ctx_threads(pmdaGetContext(), threads);
 	    break;
@@ -3176,7 +3242,7 @@ proc_fetch(int numpmid, pmID pmidlist[], pmResult **resp, pmdaExt *pmda)
     if (pmDebugOptions.auth)
 	fprintf(stderr, "proc_fetch: initial access have=%d all=%d proc_ctx_access=%d\n", have_access, all_access, proc_ctx_access(pmda->e_context));
 
-    if ((sts = proc_refresh(pmda, need_refresh)) == 0)
+    if ((sts = proc_refresh(pmda, need_refresh, proc_prefetch(need_refresh))) == 0)
 	sts = pmdaFetch(numpmid, pmidlist, resp, pmda);
 
     have_access = all_access || proc_ctx_revert(pmda->e_context);
@@ -3483,6 +3549,10 @@ proc_init(pmdaInterface *dp)
 	threads = atoi(envpath);
     if ((envpath = getenv("PROC_ACCESS")) != NULL)
 	all_access = atoi(envpath);
+    if ((envpath = getenv("PROC_TASKSTATS")) != NULL)
+	taskstats = atoi(envpath);
+    if ((envpath = getenv("PROC_WORKERS")) != NULL)
+	workers = atoi(envpath);
 
     if (_isDSO) {
 	char helppath[MAXPATHLEN];
@@ -3542,6 +3612,30 @@ proc_init(pmdaInterface *dp)
      */
     read_ksym_sources(kernel_uname.release);
 
+    /*
+     * taskstats describes the running kernel, so it cannot be used
+     * with an alternate (testing) proc_statspath
+     */
+    if (taskstats && proc_statspath[0] == '\0') {
+	int	sts;
+
+	if ((sts = proc_taskstats_init()) < 0)
+	    pmNotifyErr(LOG_WARNING, "netlink taskstats unavailable, "
+			"using procfs: %s\n", pmErrStr(sts));
+    }
+
+    if (workers > 0) {
+	int	sts;
+
+	if ((sts = proc_scan_init(workers)) < 0) {
+	    pmNotifyErr(LOG_WARNING, "cannot start %u worker threads, "
+			"reading on demand: %s\n", workers, pmErrStr(sts));
+	    workers = 0;
+	}
+	else
+	    workers = sts;
+    }
+
     proc_ctx_init();
     proc_dynamic_init(metrictab, nmetrics);
 
@@ -3573,13 +3667,15 @@ pmLongOptions	longopts[] = {
     PMDAOPT_LOGFILE,
     { "with-threads", 0, 'L', 0, "include threads in the all-processes instance domain" },
     { "from-cgroup", 1, 'r', "NAME", "restrict monitoring to processes in the named cgroup" },
+    { "taskstats", 0, 't', 0, "use netlink taskstats for per-task scheduler metrics" },
+    { "workers", 1, 'w', "N", "read per-process files using N worker threads" },
     PMDAOPT_USERNAME,
     PMOPT_HELP,
     PMDA_OPTIONS_END
 };
 
 pmdaOptions	opts = {
-    .short_options = "AD:d:l:Lr:U:?",
+    .short_options = "AD:d:l:Lr:tU:w:?",
     .long_options = longopts,
 };
 
@@ -3590,6 +3686,7 @@ main(int argc, char **argv)
     pmdaInterface	dispatch;
     char		helppath[MAXPATHLEN];
     char		*username = "root";
+    char		*endnum;
 
     _isDSO = 0;
     pmSetProgname(argv[0]);
@@ -3608,6 +3705,16 @@ main(int argc, char **argv)
 	case 'r':
 	    cgroups = opts.optarg;
 	    break;
+	case 't':
+	    taskstats = 1;
+	    break;
+	case 'w':
+	    workers = (unsigned int)strtoul(opts.optarg, &endnum, 10);
+	    if (*endnum != '\0') {
+		pmprintf("%s: -w requires numeric argument\n", pmGetProgname());
+		opts.errors++;
+	    }
+	    break;
 	}
     }
 
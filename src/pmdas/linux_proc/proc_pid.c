@@ -27,6 +27,8 @@
 #include <grp.h>
 #include "proc_pid.h"
 #include "proc_runq.h"
+#include "proc_taskstats.h"
+#include "proc_scan.h"
 #include "indom.h"
 #include "cgroups.h"
 #include "hotproc.h"
@@ -817,13 +819,195 @@ disable_hotproc(void)
     conf_gen = 0;
 }
 
+/*
+ * Create the hash table entry for a new pid, including the external
+ * instance name (built from the command line).  Called from the worker
+ * threads when there are any, so only the new entry is modified here.
+ */
+static proc_pid_entry_t *
+proc_pid_entry_create(int pid)
+{
+    int fd, k = 0;
+    char *p;
+    char buf[MAXPATHLEN];
+    proc_pid_entry_t *ep;
+
+    ep = (proc_pid_entry_t *)malloc(sizeof(proc_pid_entry_t));
+    memset(ep, 0, sizeof(proc_pid_entry_t));
+    ep->id = pid;
+
+    pmsprintf(buf, sizeof(buf), "%s/proc/%d/cmdline", proc_statspath, pid);
+    if ((fd = open(buf, O_RDONLY)) >= 0) {
+	int numlen = pmsprintf(buf, sizeof(buf), "%06d ", pid);
+	if ((k = read(fd, buf+numlen, sizeof(buf)-numlen)) > 0) {
+	    p = buf + k + numlen;
+	    if (p - buf >= sizeof(buf))
+		p--;
+	    *p-- = '\0';
+	    /* Skip trailing nils, i.e. don't replace them */
+	    while (buf+numlen < p) {
+		if (*p-- != '\0') {
+			break;
+		}
+	    }
+	    /* Remove NULL terminators from cmdline string array */
+	    /* Suggested by Mike Mason <mmlnx@us.ibm.com> */
+	    while (buf+numlen < p) {
+		if (*p == '\0') *p = ' ';
+		p--;
+	    }
+	}
+	close(fd);
+    }
+    else {
+	if (pmDebugOptions.libpmda && pmDebugOptions.desperate) {
+	    char ebuf[1024];
+	    fprintf(stderr, "proc_pid_entry_create: open(\"%s\", O_RDONLY) failed: %s\n", buf, pmErrStr_r(-oserror(), ebuf, sizeof(ebuf)));
+	}
+    }
+    if (k == 0) {
+	/*
+	 * If a process is swapped out, /proc/<pid>/cmdline
+	 * returns an empty string so we have to get it
+	 * from /proc/<pid>/status or /proc/<pid>/stat
+	 */
+	pmsprintf(buf, sizeof(buf), "%s/proc/%d/status", proc_statspath, pid);
+	if ((fd = open(buf, O_RDONLY)) >= 0) {
+	    /* We engage in a bit of a hanky-panky here:
+	     * the string should look like "123456 (name)",
+	     * we get it from /proc/XX/status as "Name:   name\n...",
+	     * to fit the 6 digits of PID and opening parenthesis, 
+	     * save 2 bytes at the start of the buffer. 
+	     * And don't forget to leave 2 bytes for the trailing 
+	     * parenthesis and the nil. Here is
+	     * an example of what we're trying to achieve:
+	     * +--+--+--+--+--+--+--+--+--+--+--+--+--+--+
+	     * |  |  | N| a| m| e| :|\t| i| n| i| t|\n| S|...
+	     * +--+--+--+--+--+--+--+--+--+--+--+--+--+--+
+	     * | 0| 0| 0| 0| 0| 1|  | (| i| n| i| t| )|\0|...
+	     * +--+--+--+--+--+--+--+--+--+--+--+--+--+--+ */
+	    if ((k = read(fd, buf+2, sizeof(buf)-4)) > 0) {
+		int bc;
+
+		if ((p = strchr(buf+2, '\n')) == NULL)
+		    p = buf+k;
+		p[0] = ')'; 
+		p[1] = '\0';
+		bc = pmsprintf(buf, sizeof(buf), "%06d ", pid); 
+		buf[bc] = '(';
+	    }
+	    close(fd);
+	}
+	else {
+	    if (pmDebugOptions.libpmda && pmDebugOptions.desperate) {
+		char ebuf[1024];
+		fprintf(stderr, "proc_pid_entry_create: open(\"%s\", O_RDONLY) failed: %s\n", buf, pmErrStr_r(-oserror(), ebuf, sizeof(ebuf)));
+	    }
+	}
+    }
+
+    if (k <= 0) {
+	/* hmm .. must be exiting */
+	pmsprintf(buf, sizeof(buf), "%06d <exiting>", pid);
+    }
+
+    ep->name = strdup(buf);
+    return ep;
+}
+
+static void
+proc_pid_entry_free(proc_pid_entry_t *ep)
+{
+    if (ep->name != NULL)
+	free(ep->name);
+    if (ep->stat_buf != NULL)
+	free(ep->stat_buf);
+    if (ep->status_buf != NULL)
+	free(ep->status_buf);
+    if (ep->statm_buf != NULL)
+	free(ep->statm_buf);
+    if (ep->maps_buf != NULL)
+	free(ep->maps_buf);
+    if (ep->schedstat_buf != NULL)
+	free(ep->schedstat_buf);
+    if (ep->io_buf != NULL)
+	free(ep->io_buf);
+    if (ep->wchan_buf != NULL)
+	free(ep->wchan_buf);
+    if (ep->environ_buf != NULL)
+	free(ep->environ_buf);
+    free(ep);
+}
+
+typedef struct {
+    proc_pid_t		*proc_pid;
+    proc_pid_list_t	*pids;
+    proc_pid_entry_t	**entries;	/* new entries, one per pid */
+    int			flags;		/* PROC_PID_FLAG_*_FETCHED to read */
+} proc_scan_job_t;
+
+static void
+create_entries(void *arg, int first, int last)
+{
+    proc_scan_job_t	*job = (proc_scan_job_t *)arg;
+    int			i;
+
+    for (i = first; i < last; i++)
+	job->entries[i] = proc_pid_entry_create(job->pids->pids[i]);
+}
+
+/*
+ * The proc/<pid> readers that are safe to run in the worker threads,
+ * i.e. that only modify the entry for the pid.
+ */
+static const struct {
+    int			flag;
+    proc_pid_entry_t	*(*fetch)(int, proc_pid_t *, int *);
+} prefetchers[] = {
+    { PROC_PID_FLAG_STAT_FETCHED,	fetch_proc_pid_stat },
+    { PROC_PID_FLAG_STATM_FETCHED,	fetch_proc_pid_statm },
+    { PROC_PID_FLAG_STATUS_FETCHED,	fetch_proc_pid_status },
+    { PROC_PID_FLAG_SCHEDSTAT_FETCHED,	fetch_proc_pid_schedstat },
+    { PROC_PID_FLAG_IO_FETCHED,		fetch_proc_pid_io },
+    { PROC_PID_FLAG_FD_FETCHED,		fetch_proc_pid_fd },
+    { PROC_PID_FLAG_OOM_SCORE_FETCHED,	fetch_proc_pid_oom_score },
+};
+
+static void
+prefetch_entries(void *arg, int first, int last)
+{
+    proc_scan_job_t	*job = (proc_scan_job_t *)arg;
+    proc_pid_entry_t	*ep;
+    __pmHashNode	*node;
+    int			i, j, id, sts;
+
+    for (i = first; i < last; i++) {
+	id = job->pids->pids[i];
+	if ((node = __pmHashSearch(id, &job->proc_pid->pidhash)) == NULL)
+	    continue;
+	ep = (proc_pid_entry_t *)node->data;
+	for (j = 0; j < sizeof(prefetchers)/sizeof(prefetchers[0]); j++) {
+	    if (!(job->flags & prefetchers[j].flag))
+		continue;
+	    /*
+	     * On failure the file is read again at fetch time, so that
+	     * the error is reported for the metric just as it would be
+	     * without the worker threads.
+	     */
+	    if (prefetchers[j].fetch(id, job->proc_pid, &sts) == NULL)
+		ep->flags &= ~prefetchers[j].flag;
+	}
+    }
+}
+
 static void
 refresh_proc_pidlist(proc_pid_t *proc_pid, proc_pid_list_t *pids)
 {
-    int i;
-    int fd;
+    proc_pid_list_t newpids = { 0 };
+    proc_pid_entry_t **entries = NULL;
+    proc_scan_job_t job;
+    int i, k;
     char *p;
-    char buf[MAXPATHLEN];
     __pmHashNode *node, *next, *prev;
     proc_pid_entry_t *ep;
     pmdaIndom *indomp = proc_pid->indom;
@@ -846,99 +1030,42 @@ refresh_proc_pidlist(proc_pid_t *proc_pid, proc_pid_list_t *pids)
 	}
     }
 
+    /* may now be running with different client credentials */
+    proc_taskstats_reset();
+
+    /*
+     * find the new pids and create their entries, in parallel if
+     * there are worker threads - these are only added to the hash
+     * table below, once all of them have been read
+     */
+    for (i=0; i < pids->count; i++) {
+	if (i > 0 && pids->pids[i] == pids->pids[i-1])
+	    continue;
+	if (__pmHashSearch(pids->pids[i], &proc_pid->pidhash) == NULL)
+	    pidlist_append_pid(pids->pids[i], &newpids);
+    }
+    if (newpids.count > 0 &&
+	(entries = (proc_pid_entry_t **)malloc(newpids.count *
+				sizeof(proc_pid_entry_t *))) == NULL)
+	newpids.count = 0;	/* create them one at a time, below */
+    memset(&job, 0, sizeof(job));
+    job.pids = &newpids;
+    job.entries = entries;
+    proc_scan_run(create_entries, &job, newpids.count);
+
     /*
      * walk pid list and add new pids to the hash table,
      * marking entries valid as we go ...
      */
-    for (i=0; i < pids->count; i++) {
+    for (i=0, k=0; i < pids->count; i++) {
 	node = __pmHashSearch(pids->pids[i], &proc_pid->pidhash);
 	if (node == NULL) {
-	    int k = 0;
-
-	    ep = (proc_pid_entry_t *)malloc(sizeof(proc_pid_entry_t));
-	    memset(ep, 0, sizeof(proc_pid_entry_t));
-
-	    ep->id = pids->pids[i];
-
-	    pmsprintf(buf, sizeof(buf), "%s/proc/%d/cmdline", proc_statspath, pids->pids[i]);
-	    if ((fd = open(buf, O_RDONLY)) >= 0) {
-		int numlen = pmsprintf(buf, sizeof(buf), "%06d ", pids->pids[i]);
-		if ((k = read(fd, buf+numlen, sizeof(buf)-numlen)) > 0) {
-		    p = buf + k + numlen;
-		    if (p - buf >= sizeof(buf))
-			p--;
-		    *p-- = '\0';
-		    /* Skip trailing nils, i.e. don't replace them */
-		    while (buf+numlen < p) {
-			if (*p-- != '\0') {
-				break;
-			}
-		    }
-		    /* Remove NULL terminators from cmdline string array */
-		    /* Suggested by Mike Mason <mmlnx@us.ibm.com> */
-		    while (buf+numlen < p) {
-			if (*p == '\0') *p = ' ';
-			p--;
-		    }
-		}
-		close(fd);
-	    }
-	    else {
-		if (pmDebugOptions.libpmda && pmDebugOptions.desperate) {
-		    char ebuf[1024];
-		    fprintf(stderr, "refresh_proc_pidlist: open(\"%s\", O_RDONLY) failed: %s\n", buf, pmErrStr_r(-oserror(), ebuf, sizeof(ebuf)));
-		}
-	    }
-	    if (k == 0) {
-		/*
-		 * If a process is swapped out, /proc/<pid>/cmdline
-		 * returns an empty string so we have to get it
-		 * from /proc/<pid>/status or /proc/<pid>/stat
-		 */
-		pmsprintf(buf, sizeof(buf), "%s/proc/%d/status", proc_statspath, pids->pids[i]);
-		if ((fd = open(buf, O_RDONLY)) >= 0) {
-		    /* We engage in a bit of a hanky-panky here:
-		     * the string should look like "123456 (name)",
-		     * we get it from /proc/XX/status as "Name:   name\n...",
-		     * to fit the 6 digits of PID and opening parenthesis, 
-	             * save 2 bytes at the start of the buffer. 
-                     * And don't forget to leave 2 bytes for the trailing 
-		     * parenthesis and the nil. Here is
-		     * an example of what we're trying to achieve:
-		     * +--+--+--+--+--+--+--+--+--+--+--+--+--+--+
-		     * |  |  | N| a| m| e| :|\t| i| n| i| t|\n| S|...
-		     * +--+--+--+--+--+--+--+--+--+--+--+--+--+--+
-		     * | 0| 0| 0| 0| 0| 1|  | (| i| n| i| t| )|\0|...
-		     * +--+--+--+--+--+--+--+--+--+--+--+--+--+--+ */
-		    if ((k = read(fd, buf+2, sizeof(buf)-4)) > 0) {
-			int bc;
-
-			if ((p = strchr(buf+2, '\n')) == NULL)
-			    p = buf+k;
-			p[0] = ')'; 
-			p[1] = '\0';
-			bc = pmsprintf(buf, sizeof(buf), "%06d ", pids->pids[i]); 
-			buf[bc] = '(';
-		    }
-		    close(fd);
-		}
-		else {
-		    if (pmDebugOptions.libpmda && pmDebugOptions.desperate) {
-			char ebuf[1024];
-			fprintf(stderr, "refresh_proc_pidlist: open(\"%s\", O_RDONLY) failed: %s\n", buf, pmErrStr_r(-oserror(), ebuf, sizeof(ebuf)));
-		    }
-		}
-	    }
-
-	    if (k <= 0) {
-		/* hmm .. must be exiting */
-	    	pmsprintf(buf, sizeof(buf), "%06d <exiting>", pids->pids[i]);
-	    }
-
-	    ep->name = strdup(buf);
-
+	    if (k < newpids.count && newpids.pids[k] == pids->pids[i])
+		ep = entries[k++];
+	    else
+		ep = proc_pid_entry_create(pids->pids[i]);
 	    __pmHashAdd(pids->pids[i], (void *)ep, &proc_pid->pidhash);
-	    //fprintf(stderr, "key %d : ADDED \"%s\" to hash table\n", pids->pids[i], buf);
+	    //fprintf(stderr, "key %d : ADDED \"%s\" to hash table\n", pids->pids[i], ep->name);
 	}
 	else
 	    ep = (proc_pid_entry_t *)node->data;
@@ -980,6 +1107,14 @@ refresh_proc_pidlist(proc_pid_t *proc_pid, proc_pid_list_t *pids)
 	}
     }
 
+    /* entries not added above (duplicate pids in the list) */
+    while (k < newpids.count)
+	proc_pid_entry_free(entries[k++]);
+    if (entries)
+	free(entries);
+    if (newpids.pids)
+	free(newpids.pids);
+
     /* 
      * harvest exited pids from the pid hash table
      */
@@ -991,30 +1126,11 @@ refresh_proc_pidlist(proc_pid_t *proc_pid, proc_pid_list_t *pids)
 	    	// ep->id, node, prev, node->next, ep, ep->valid);
 	    if (!(ep->flags & PROC_PID_FLAG_VALID)) {
 	        //fprintf(stderr, "DELETED key=%d name=\"%s\"\n", ep->id, ep->name);
-		if (ep->name != NULL)
-		    free(ep->name);
-		if (ep->stat_buf != NULL)
-		    free(ep->stat_buf);
-		if (ep->status_buf != NULL)
-		    free(ep->status_buf);
-		if (ep->statm_buf != NULL)
-		    free(ep->statm_buf);
-		if (ep->maps_buf != NULL)
-		    free(ep->maps_buf);
-		if (ep->schedstat_buf != NULL)
-		    free(ep->schedstat_buf);
-		if (ep->io_buf != NULL)
-		    free(ep->io_buf);
-		if (ep->wchan_buf != NULL)
-		    free(ep->wchan_buf);
-		if (ep->environ_buf != NULL)
-		    free(ep->environ_buf);
-
 	    	if (prev == NULL)
 		    proc_pid->pidhash.hash[i] = node->next;
 		else
 		    prev->next = node->next;
-		free(ep);
+		proc_pid_entry_free(ep);
 		free(node);
 	    }
 	    else {
@@ -1029,8 +1145,9 @@ refresh_proc_pidlist(proc_pid_t *proc_pid, proc_pid_list_t *pids)
 int
 refresh_proc_pid(proc_pid_t *proc_pid, proc_runq_t *proc_runq,
 		 int want_threads, const char *cgroups,
-		 const char *container, int namelen)
+		 const char *container, int namelen, int prefetch)
 {
+    proc_scan_job_t job;
     char path[MAXPATHLEN];
     int sts, length, want_cgroups;
     const char *filter = cgroups;
@@ -1068,6 +1185,18 @@ refresh_proc_pid(proc_pid_t *proc_pid, proc_runq_t *proc_runq,
 		container ? "container" : "cgroups", filter ? filter : "");
 
     refresh_proc_pidlist(proc_pid, &procpids);
+
+    /*
+     * With worker threads, read the files for all processes now (in
+     * parallel) rather than one at a time from the fetch callbacks.
+     */
+    if (prefetch && proc_scan_workers() > 0) {
+	memset(&job, 0, sizeof(job));
+	job.proc_pid = proc_pid;
+	job.pids = &procpids;
+	job.flags = prefetch;
+	proc_scan_run(prefetch_entries, &job, procpids.count);
+    }
     return 0;
 }
 
@@ -1221,13 +1350,15 @@ read_proc_entry(int fd, int *lenp, char **bufp)
 
 /*
  * fetch a proc/<pid>/stat entry for pid
+ *
+ * Failures are not reported here, the stat fields are then simply
+ * empty (backwards compat, this used to be hidden by the environ read).
  */
 proc_pid_entry_t *
 fetch_proc_pid_stat(int id, proc_pid_t *proc_pid, int *sts)
 {
     __pmHashNode	*node = __pmHashSearch(id, &proc_pid->pidhash);
     proc_pid_entry_t	*ep = node ? (proc_pid_entry_t *)node->data : NULL;
-    char		*p;
     int			fd;
 
     *sts = 0;
@@ -1237,27 +1368,63 @@ fetch_proc_pid_stat(int id, proc_pid_t *proc_pid, int *sts)
     if (!(ep->flags & PROC_PID_FLAG_STAT_FETCHED)) {
 	if (ep->stat_buflen > 0)
 	    ep->stat_buf[0] = '\0';
-	if ((fd = proc_open("stat", ep)) < 0)
-	    *sts = maperr();
-	else {
-	    *sts = read_proc_entry(fd, &ep->stat_buflen, &ep->stat_buf);
+	if ((fd = proc_open("stat", ep)) >= 0) {
+	    read_proc_entry(fd, &ep->stat_buflen, &ep->stat_buf);
 	    close(fd);
 	}
 	ep->flags |= PROC_PID_FLAG_STAT_FETCHED;
     }
 
+    return ep;
+}
+
+/*
+ * fetch a proc/<pid>/wchan entry for pid
+ *
+ * Only proc.psinfo.wchan_s needs this, so it is not read along with
+ * every proc/<pid>/stat (likewise environ, below).
+ */
+proc_pid_entry_t *
+fetch_proc_pid_wchan(int id, proc_pid_t *proc_pid, int *sts)
+{
+    __pmHashNode	*node = __pmHashSearch(id, &proc_pid->pidhash);
+    proc_pid_entry_t	*ep = node ? (proc_pid_entry_t *)node->data : NULL;
+    int			fd;
+
+    *sts = 0;
+    if (!ep)
+	return NULL;
+
     if (!(ep->flags & PROC_PID_FLAG_WCHAN_FETCHED)) {
 	if (ep->wchan_buflen > 0)
 	    ep->wchan_buf[0] = '\0';
 	if ((fd = proc_open("wchan", ep)) < 0)
 	    ; /* ignore failure here, backwards compat */
 	else {
-	    *sts = read_proc_entry(fd, &ep->wchan_buflen, &ep->wchan_buf);
+	    read_proc_entry(fd, &ep->wchan_buflen, &ep->wchan_buf);
 	    close(fd);
 	}
 	ep->flags |= PROC_PID_FLAG_WCHAN_FETCHED;
     }
 
+    return ep;
+}
+
+/*
+ * fetch a proc/<pid>/environ entry for pid
+ */
+proc_pid_entry_t *
+fetch_proc_pid_environ(int id, proc_pid_t *proc_pid, int *sts)
+{
+    __pmHashNode	*node = __pmHashSearch(id, &proc_pid->pidhash);
+    proc_pid_entry_t	*ep = node ? (proc_pid_entry_t *)node->data : NULL;
+    char		*p;
+    int			fd;
+
+    *sts = 0;
+    if (!ep)
+	return NULL;
+
     if (!(ep->flags & PROC_PID_FLAG_ENVIRON_FETCHED)) {
 	if (ep->environ_buflen > 0)
 	    ep->environ_buf[0] = '\0';
@@ -1294,8 +1461,6 @@ fetch_proc_pid_stat(int id, proc_pid_t *proc_pid, int *sts)
 	ep->flags |= PROC_PID_FLAG_ENVIRON_FETCHED;
     }
 
-    if (*sts < 0)
-    	return NULL;
     return ep;
 }
 
@@ -1593,6 +1758,38 @@ fetch_proc_pid_maps(int id, proc_pid_t *proc_pid, int *sts)
     return (*sts < 0) ? NULL : ep;
 }
 
+/*
+ * Fill the proc/<pid>/schedstat buffer, in procfs format, from a netlink
+ * taskstats request (see proc_taskstats.c).  Returns zero on success, or
+ * a negative value if the caller should read procfs instead.
+ */
+static int
+fetch_proc_pid_taskstats(proc_pid_entry_t *ep)
+{
+    proc_taskstats_t	ts;
+    char		buf[80];
+    int			len, sts;
+
+    if (!proc_taskstats_enabled())
+	return -ENOTCONN;
+    if ((sts = proc_taskstats_fetch(ep->id, &ts)) < 0)
+	return sts;
+    len = pmsprintf(buf, sizeof(buf), "%llu %llu %llu\n",
+		(unsigned long long)ts.cpu_time,
+		(unsigned long long)ts.run_delay,
+		(unsigned long long)ts.pcount);
+    if (ep->schedstat_buflen < len) {
+	char	*p = (char *)realloc(ep->schedstat_buf, len+1);
+
+	if (p == NULL)
+	    return -ENOMEM;
+	ep->schedstat_buflen = len;
+	ep->schedstat_buf = p;
+    }
+    memcpy(ep->schedstat_buf, buf, len+1);
+    return 0;
+}
+
 /*
  * fetch a proc/<pid>/schedstat entry for pid
  */
@@ -1611,7 +1808,9 @@ fetch_proc_pid_schedstat(int id, proc_pid_t *proc_pid, int *sts)
 
 	if (ep->schedstat_buflen > 0)
 	    ep->schedstat_buf[0] = '\0';
-	if ((fd = proc_open("schedstat", ep)) < 0)
+	if (fetch_proc_pid_taskstats(ep) == 0)
+	    ; /* schedstat_buf filled from netlink */
+	else if ((fd = proc_open("schedstat", ep)) < 0)
 	    *sts = maperr();
 	else {
 	    *sts = read_proc_entry(fd, &ep->schedstat_buflen, &ep->schedstat_buf);
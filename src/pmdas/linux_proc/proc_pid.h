@@ -314,8 +314,11 @@ typedef struct {
     int			threads;	/* /proc/PID/{xxx,task/PID/xxx} flag */
 } proc_pid_list_t;
 
-/* refresh the proc indom, reset all "fetched" flags */
-extern int refresh_proc_pid(proc_pid_t *, proc_runq_t *, int, const char *, const char *, int);
+/*
+ * refresh the proc indom, reset all "fetched" flags, then read the files
+ * for the PROC_PID_FLAG_*_FETCHED flags given (if there are worker threads)
+ */
+extern int refresh_proc_pid(proc_pid_t *, proc_runq_t *, int, const char *, const char *, int, int);
 
 /* refresh the hotproc indom, checking against the current configuration */
 extern int refresh_hotproc_pid(proc_pid_t *, int, const char *);
@@ -338,6 +341,12 @@ extern void init_hotproc_pid(proc_pid_t *);
 /* fetch a proc/<pid>/stat entry for pid */
 extern proc_pid_entry_t *fetch_proc_pid_stat(int, proc_pid_t *, int *);
 
+/* fetch a proc/<pid>/wchan entry for pid */
+extern proc_pid_entry_t *fetch_proc_pid_wchan(int, proc_pid_t *, int *);
+
+/* fetch a proc/<pid>/environ entry for pid */
+extern proc_pid_entry_t *fetch_proc_pid_environ(int, proc_pid_t *, int *);
+
 /* fetch a proc/<pid>/statm entry for pid */
 extern proc_pid_entry_t *fetch_proc_pid_statm(int, proc_pid_t *, int *);
 
@@ -0,0 +1,156 @@
+/*
+ * Worker threads for the per-process /proc scan
+ *
+ * Copyright (c) 2026 Red Hat.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+/*
+ * With thousands of processes a refresh is dominated by the open, read
+ * and close of a few small proc/<pid> files per process, each of which
+ * is cheap but not free (procfs path lookup, task locking, formatting).
+ * A fixed pool of threads shares these out: the items of a scan are
+ * handed out in small chunks from a shared index, so threads that hit
+ * slow processes (e.g. contended mm locks for statm) do not hold up
+ * the others, and the calling thread works on the scan as well.
+ *
+ * The callbacks must only touch per-item state; the caller publishes
+ * the results (into the pid hash table, the instance domain) once
+ * proc_scan_run returns.
+ *
+ * Credential changes made for the PMDA clients (setresuid) apply to
+ * all threads of the process, so the workers are subject to the same
+ * procfs access checks as the main thread.
+ */
+#include "pmapi.h"
+#include "libpcp.h"
+#include "pmda.h"
+#include <pthread.h>
+#include <signal.h>
+#include "proc_scan.h"
+
+#define SCAN_CHUNK	16	/* items claimed by a thread at a time */
+
+static pthread_mutex_t	scan_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	scan_start = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t	scan_done = PTHREAD_COND_INITIALIZER;
+static int		nworkers;	/* size of the pool */
+
+static struct {
+    proc_scan_func_t	func;
+    void		*arg;
+    int			count;		/* items in this scan */
+    int			next;		/* next unclaimed item */
+    int			busy;		/* workers yet to finish */
+    unsigned int	generation;	/* incremented for each scan */
+} scan;
+
+/*
+ * Claim and process chunks of the current scan until none remain.
+ * Called, and returns, with scan_lock held.
+ */
+static void
+scan_items(void)
+{
+    int		first, last;
+
+    while (scan.next < scan.count) {
+	first = scan.next;
+	last = first + SCAN_CHUNK;
+	if (last > scan.count)
+	    last = scan.count;
+	scan.next = last;
+	pthread_mutex_unlock(&scan_lock);
+	scan.func(scan.arg, first, last);
+	pthread_mutex_lock(&scan_lock);
+    }
+}
+
+static void *
+scan_worker(void *arg)
+{
+    unsigned int	seen = 0;
+
+    pthread_mutex_lock(&scan_lock);
+    for (;;) {
+	while (scan.generation == seen)
+	    pthread_cond_wait(&scan_start, &scan_lock);
+	seen = scan.generation;
+	scan_items();
+	if (--scan.busy == 0)
+	    pthread_cond_signal(&scan_done);
+    }
+    /* NOTREACHED */
+    return NULL;
+}
+
+void
+proc_scan_run(proc_scan_func_t func, void *arg, int count)
+{
+    if (nworkers == 0 || count <= SCAN_CHUNK) {
+	func(arg, 0, count);
+	return;
+    }
+
+    /*
+     * The hotproc timer (SIGALRM) refreshes the hotproc pid list, so
+     * hold it off rather than have it start a scan within this one.
+     */
+    __pmAFblock();
+    pthread_mutex_lock(&scan_lock);
+    scan.func = func;
+    scan.arg = arg;
+    scan.count = count;
+    scan.next = 0;
+    scan.busy = nworkers;
+    scan.generation++;
+    pthread_cond_broadcast(&scan_start);
+
+    scan_items();
+    while (scan.busy > 0)
+	pthread_cond_wait(&scan_done, &scan_lock);
+    pthread_mutex_unlock(&scan_lock);
+    __pmAFunblock();
+}
+
+int
+proc_scan_workers(void)
+{
+    return nworkers;
+}
+
+int
+proc_scan_init(int count)
+{
+    pthread_t	tid;
+    sigset_t	all, saved;
+    int		sts = 0;
+
+    if (nworkers > 0 || count <= 0)
+	return nworkers;
+
+    /* signals (e.g. the hotproc timer) are handled by the main thread */
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &saved);
+    while (nworkers < count) {
+	if ((sts = pthread_create(&tid, NULL, scan_worker, NULL)) != 0)
+	    break;
+	pthread_detach(tid);
+	nworkers++;
+    }
+    pthread_sigmask(SIG_SETMASK, &saved, NULL);
+
+    if (pmDebugOptions.libpmda)
+	fprintf(stderr, "proc_scan_init: %d of %d worker threads\n",
+			nworkers, count);
+    return nworkers > 0 ? nworkers : -sts;
+}
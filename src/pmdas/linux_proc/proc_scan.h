@@ -0,0 +1,31 @@
+/*
+ * Worker threads for the per-process /proc scan
+ *
+ * Copyright (c) 2026 Red Hat.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+#ifndef _PROC_SCAN_H
+#define _PROC_SCAN_H
+
+/* process items [first, last) of a scan, may run in any worker thread */
+typedef void (*proc_scan_func_t)(void *, int, int);
+
+/* start the worker threads, returns the pool size or negative errno */
+extern int proc_scan_init(int);
+
+/* number of worker threads, zero if there is no pool */
+extern int proc_scan_workers(void);
+
+/* call func for all of count items, in parallel, returning when done */
+extern void proc_scan_run(proc_scan_func_t, void *, int);
+
+#endif /* _PROC_SCAN_H */
@@ -0,0 +1,245 @@
+/*
+ * Linux netlink taskstats interface
+ *
+ * Copyright (c) 2026 Red Hat.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+/*
+ * A single TASKSTATS_CMD_GET request on a generic netlink socket returns
+ * the scheduler accounting of a task, replacing the open, reads and close
+ * of /proc/<pid>/schedstat (and the path lookup in procfs).
+ *
+ * The I/O accounting in struct taskstats is deliberately not used: the
+ * kernel truncates those counters to multiples of 1024 (even the syscall
+ * counts), and for a process /proc/<pid>/io also includes the I/O of all
+ * its threads and waited-for children, so proc.io stays with procfs.
+ *
+ * The kernel only answers these requests for callers with CAP_NET_ADMIN,
+ * so once the PMDA has switched to the credentials of an unprivileged
+ * client they fail with EPERM and the caller falls back to procfs, with
+ * the usual procfs access checks.
+ */
+#include "pmapi.h"
+#include "libpcp.h"
+#include "pmda.h"
+#include <pthread.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/genetlink.h>
+#include <linux/taskstats.h>
+#include "proc_taskstats.h"
+
+#define GENLMSG_DATA(g)		((char *)(g) + GENL_HDRLEN)
+#define NLA_DATA(na)		((char *)(na) + NLA_HDRLEN)
+#define NLA_NEXT(na)		((struct nlattr *)((char *)(na) + NLA_ALIGN((na)->nla_len)))
+#define NLA_OK(na, len)		((len) >= (int)sizeof(struct nlattr) && \
+				 (na)->nla_len >= sizeof(struct nlattr) && \
+				 (na)->nla_len <= (len))
+
+static int		tsfd = -1;	/* netlink socket, -1 if not in use */
+static __u16		tsfamily;	/* TASKSTATS generic netlink family */
+static __u32		tsseq;
+static int		tsdenied;	/* EPERM since the last reset */
+static pthread_mutex_t	tslock = PTHREAD_MUTEX_INITIALIZER; /* socket, tsseq */
+
+/*
+ * Send one generic netlink request carrying a single attribute and
+ * read the matching reply into buf.  Returns the reply length or a
+ * negative errno.
+ */
+static int
+taskstats_request(__u16 family, __u8 cmd, __u16 type,
+		const void *data, int datalen, char *buf, int buflen)
+{
+    struct {
+	struct nlmsghdr		n;
+	struct genlmsghdr	g;
+	char			attrs[64];
+    } req;
+    struct nlattr		*na;
+    struct nlmsghdr		*nlh;
+    struct nlmsgerr		*err;
+    struct sockaddr_nl		addr;
+    int				len;
+
+    if (NLA_HDRLEN + datalen > (int)sizeof(req.attrs))
+	return -EINVAL;
+    memset(&req, 0, sizeof(req));
+    req.n.nlmsg_len = NLMSG_LENGTH(GENL_HDRLEN);
+    req.n.nlmsg_type = family;
+    req.n.nlmsg_flags = NLM_F_REQUEST;
+    req.n.nlmsg_seq = ++tsseq;
+    req.n.nlmsg_pid = 0;
+    req.g.cmd = cmd;
+    req.g.version = 1;
+    na = (struct nlattr *)GENLMSG_DATA(&req.g);
+    na->nla_type = type;
+    na->nla_len = NLA_HDRLEN + datalen;
+    memcpy(NLA_DATA(na), data, datalen);
+    req.n.nlmsg_len += NLA_ALIGN(na->nla_len);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    if (sendto(tsfd, &req, req.n.nlmsg_len, 0,
+		(struct sockaddr *)&addr, sizeof(addr)) < 0)
+	return -oserror();
+
+    /*
+     * The reply is queued before sendto returns, so never block here;
+     * skip any stale replies to earlier (abandoned) requests.
+     */
+    for (;;) {
+	if ((len = recv(tsfd, buf, buflen, MSG_DONTWAIT)) < 0)
+	    return -oserror();
+	nlh = (struct nlmsghdr *)buf;
+	if (!NLMSG_OK(nlh, len))
+	    return -EIO;
+	if (nlh->nlmsg_seq != req.n.nlmsg_seq)
+	    continue;
+	if (nlh->nlmsg_type == NLMSG_ERROR) {
+	    err = (struct nlmsgerr *)NLMSG_DATA(nlh);
+	    return err->error ? err->error : -EIO;
+	}
+	return nlh->nlmsg_len;
+    }
+}
+
+/*
+ * Find attribute type in the len bytes of attributes at na.
+ */
+static struct nlattr *
+taskstats_attr(struct nlattr *na, int len, __u16 type)
+{
+    for (; NLA_OK(na, len); len -= NLA_ALIGN(na->nla_len), na = NLA_NEXT(na)) {
+	if ((na->nla_type & NLA_TYPE_MASK) == type)
+	    return na;
+    }
+    return NULL;
+}
+
+static struct nlattr *
+taskstats_reply(char *buf, int len)
+{
+    struct nlmsghdr	*nlh = (struct nlmsghdr *)buf;
+
+    len -= NLMSG_HDRLEN + GENL_HDRLEN;
+    return len > 0 ? (struct nlattr *)GENLMSG_DATA(NLMSG_DATA(nlh)) : NULL;
+}
+
+int
+proc_taskstats_fetch(int pid, proc_taskstats_t *tp)
+{
+    struct taskstats	ts;
+    struct nlattr	*na;
+    __u32		id = pid;
+    char		buf[2048];
+    int			len, sts;
+
+    if (tsfd < 0)
+	return -ENOTCONN;
+    /* requests may come from the proc_scan.c worker threads */
+    pthread_mutex_lock(&tslock);
+    sts = taskstats_request(tsfamily, TASKSTATS_CMD_GET,
+		TASKSTATS_CMD_ATTR_PID, &id, sizeof(id), buf, sizeof(buf));
+    pthread_mutex_unlock(&tslock);
+    if (sts < 0) {
+	if (pmDebugOptions.libpmda && pmDebugOptions.desperate) {
+	    char	ebuf[1024];
+	    fprintf(stderr, "proc_taskstats_fetch: pid %d: %s\n",
+			pid, pmErrStr_r(sts, ebuf, sizeof(ebuf)));
+	}
+	/* no privilege for this client, do not ask again for every task */
+	if (sts == -EPERM || sts == -EACCES)
+	    tsdenied = 1;
+	return sts;
+    }
+    len = sts - NLMSG_HDRLEN - GENL_HDRLEN;
+    if ((na = taskstats_reply(buf, sts)) == NULL ||
+	(na = taskstats_attr(na, len, TASKSTATS_TYPE_AGGR_PID)) == NULL ||
+	(na = taskstats_attr((struct nlattr *)NLA_DATA(na),
+			na->nla_len - NLA_HDRLEN, TASKSTATS_TYPE_STATS)) == NULL)
+	return -EPROTO;
+
+    /* older kernels have a shorter struct, newer kernels a longer one */
+    memset(&ts, 0, sizeof(ts));
+    len = na->nla_len - NLA_HDRLEN;
+    memcpy(&ts, NLA_DATA(na), len < (int)sizeof(ts) ? len : sizeof(ts));
+
+    tp->cpu_time = ts.cpu_run_virtual_total;
+    tp->run_delay = ts.cpu_delay_total;
+    tp->pcount = ts.cpu_count;
+    return 0;
+}
+
+int
+proc_taskstats_enabled(void)
+{
+    return tsfd >= 0 && !tsdenied;
+}
+
+void
+proc_taskstats_reset(void)
+{
+    tsdenied = 0;
+}
+
+int
+proc_taskstats_init(void)
+{
+    static const char	name[] = TASKSTATS_GENL_NAME;
+    struct sockaddr_nl	addr;
+    struct nlattr	*na;
+    proc_taskstats_t	probe;
+    char		buf[4096];
+    int			len, sts;
+
+    if (tsfd >= 0)
+	return 0;
+    if ((tsfd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_GENERIC)) < 0) {
+	sts = -oserror();
+	goto fail;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.nl_family = AF_NETLINK;
+    if (bind(tsfd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+	sts = -oserror();
+	goto fail;
+    }
+
+    /* resolve the TASKSTATS family identifier */
+    if ((sts = taskstats_request(GENL_ID_CTRL, CTRL_CMD_GETFAMILY,
+		CTRL_ATTR_FAMILY_NAME, name, sizeof(name), buf, sizeof(buf))) < 0)
+	goto fail;
+    len = sts - NLMSG_HDRLEN - GENL_HDRLEN;
+    if ((na = taskstats_reply(buf, sts)) == NULL ||
+	(na = taskstats_attr(na, len, CTRL_ATTR_FAMILY_ID)) == NULL) {
+	sts = -EPROTO;
+	goto fail;
+    }
+    tsfamily = *(__u16 *)NLA_DATA(na);
+
+    /* check the kernel will answer us at all (privileges, namespaces) */
+    if ((sts = proc_taskstats_fetch(getpid(), &probe)) < 0)
+	goto fail;
+
+    if (pmDebugOptions.libpmda)
+	fprintf(stderr, "proc_taskstats_init: family %u, fd %d\n",
+			tsfamily, tsfd);
+    return 0;
+
+fail:
+    if (tsfd >= 0)
+	close(tsfd);
+    tsfd = -1;
+    return sts;
+}
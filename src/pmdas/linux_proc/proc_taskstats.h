@@ -0,0 +1,41 @@
+/*
+ * Linux netlink taskstats interface
+ *
+ * Copyright (c) 2026 Red Hat.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+#ifndef _PROC_TASKSTATS_H
+#define _PROC_TASKSTATS_H
+
+/*
+ * Per-task accounting fields returned by TASKSTATS_CMD_GET, the subset
+ * of struct taskstats with the /proc/<pid>/schedstat values
+ */
+typedef struct {
+    __uint64_t	cpu_time;		/* se.sum_exec_runtime (nsec) */
+    __uint64_t	run_delay;		/* sched_info.run_delay (nsec) */
+    __uint64_t	pcount;			/* sched_info.pcount */
+} proc_taskstats_t;
+
+/* open the netlink socket, returns 0 or negative errno */
+extern int proc_taskstats_init(void);
+
+/* non-zero if the taskstats backend is in use (and permitted) */
+extern int proc_taskstats_enabled(void);
+
+/* forget any permission failure, credentials may have changed */
+extern void proc_taskstats_reset(void);
+
+/* query the kernel for the per-task accounting of one task */
+extern int proc_taskstats_fetch(int, proc_taskstats_t *);
+
+#endif /* _PROC_TASKSTATS_H */
@@ -77,17 +77,28 @@ typedef struct {
     mmv_disk_metric_t * metrics1;	/* v1 metric descs in mmap */
     mmv_disk_metric2_t * metrics2;	/* v2 metric descs in mmap */
     mmv_disk_label_t * labels; 		/* labels desc in mmap */
+    mmv_disk_stripe_t * stripes;	/* counter stripes in mmap */
     int		vcnt;			/* number of values */
     int		mcnt1;			/* number of metrics */
     int		mcnt2;			/* number of v2 metrics */
     int		lcnt;			/* number of labels */
+    int		stcnt;			/* number of striped values */
     int		version;		/* v1/v2/v3 version number */
     int		cluster;		/* cluster identifier */
     pid_t	pid;			/* process identifier */
     __int64_t	len;			/* mmap region len */
     __uint64_t	gen;			/* generation number on open */
+    __pmHashCtl	items;			/* item -> slot_t index of values */
+    int		indexed;		/* items built, else linear scan */
 } stats_t;
 
+typedef struct slot {
+    int		mindex;			/* metric index in metrics1/metrics2 */
+    mmv_disk_value_t * first;		/* first value slot for this metric */
+    __pmHashCtl	insts;			/* internal inst -> value slot */
+    struct slot * next;			/* later metric with the same item */
+} slot_t;
+
 static stats_t * slist;
 static int scnt;
 
@@ -494,6 +505,135 @@ create_indom(pmdaExt *pmda, stats_t *s, __uint64_t offset, __uint32_t count,
     return 0;
 }
 
+static __pmHashWalkState
+free_inst_slot(const __pmHashNode *tp, void *cp)
+{
+    (void)tp;
+    (void)cp;
+    return PM_HASH_WALK_DELETE_NEXT;
+}
+
+static __pmHashWalkState
+free_item_slot(const __pmHashNode *tp, void *cp)
+{
+    slot_t *sp = (slot_t *)tp->data;
+    slot_t *next;
+
+    (void)cp;
+    for (; sp != NULL; sp = next) {
+	next = sp->next;
+	__pmHashWalkCB(free_inst_slot, NULL, &sp->insts);
+	__pmHashClear(&sp->insts);
+	free(sp);
+    }
+    return PM_HASH_WALK_DELETE_NEXT;
+}
+
+static void
+free_stats_index(stats_t *s)
+{
+    __pmHashWalkCB(free_item_slot, NULL, &s->items);
+    __pmHashClear(&s->items);
+    s->indexed = 0;
+}
+
+/*
+ * Build the (item, inst) -> value slot index for one mapping, so that
+ * fetch need not scan every metric and every value for each request.
+ * Metrics with the same item are chained in order and the first value
+ * found in the first of these wins, as for the linear scan - which is
+ * still used if the index cannot be built.
+ */
+static void
+index_stats(stats_t *s)
+{
+    mmv_disk_value_t *v = s->values;
+    __pmHashNode *hp;
+    slot_t *sp, *last;
+    __uint64_t moffset, msize, ioffset, isize;
+    __uint32_t item, indom, internal;
+    int mi, vi, mcnt;
+    char *mbase;
+
+    if (s->version == MMV_VERSION1) {
+	mbase = (char *)s->metrics1;
+	mcnt = s->mcnt1;
+	msize = sizeof(mmv_disk_metric_t);
+	isize = sizeof(mmv_disk_instance_t);
+    } else {
+	mbase = (char *)s->metrics2;
+	mcnt = s->mcnt2;
+	msize = sizeof(mmv_disk_metric2_t);
+	isize = sizeof(mmv_disk_instance2_t);
+    }
+    if (mbase == NULL)
+	return;
+    moffset = mbase - (char *)s->addr;
+
+    for (mi = 0; mi < mcnt; mi++) {
+	item = (s->version == MMV_VERSION1) ?
+		s->metrics1[mi].item : s->metrics2[mi].item;
+	if ((sp = (slot_t *)calloc(1, sizeof(slot_t))) == NULL)
+	    goto fail;
+	sp->mindex = mi;
+	if ((hp = __pmHashSearch(item, &s->items)) != NULL) {
+	    for (last = (slot_t *)hp->data; last->next; last = last->next)
+		;
+	    last->next = sp;	/* duplicate item */
+	}
+	else if (__pmHashAdd(item, sp, &s->items) < 0) {
+	    free(sp);
+	    goto fail;
+	}
+    }
+
+    for (vi = 0; vi < s->vcnt; vi++) {
+	if (v[vi].metric < moffset ||
+	    (v[vi].metric - moffset) % msize != 0 ||
+	    (mi = (v[vi].metric - moffset) / msize) >= mcnt)
+	    continue;
+
+	if (s->version == MMV_VERSION1) {
+	    item = s->metrics1[mi].item;
+	    indom = s->metrics1[mi].indom;
+	} else {
+	    item = s->metrics2[mi].item;
+	    indom = s->metrics2[mi].indom;
+	}
+	if ((hp = __pmHashSearch(item, &s->items)) == NULL)
+	    continue;
+	for (sp = (slot_t *)hp->data; sp != NULL; sp = sp->next) {
+	    if (sp->mindex == mi)
+		break;
+	}
+	if (sp == NULL)
+	    continue;
+	if (sp->first == NULL)
+	    sp->first = &v[vi];
+
+	if (indom == PM_INDOM_NULL || indom == 0)
+	    continue;
+	ioffset = v[vi].instance;
+	if (s->len < ioffset + isize)
+	    continue;
+	if (s->version == MMV_VERSION1)
+	    internal = ((mmv_disk_instance_t *)((char *)s->addr + ioffset))->internal;
+	else
+	    internal = ((mmv_disk_instance2_t *)((char *)s->addr + ioffset))->internal;
+	if (__pmHashSearch(internal, &sp->insts) != NULL)
+	    continue;
+	if (__pmHashAdd(internal, &v[vi], &sp->insts) < 0)
+	    goto fail;
+    }
+    s->indexed = 1;
+    return;
+
+fail:
+    pmNotifyErr(LOG_WARNING, "MMV: %s - cannot index values, using linear "
+		"search: %s", s->name, osstrerror());
+    free_stats_index(s);
+}
+
 static void
 map_stats(pmdaExt *pmda)
 {
@@ -534,6 +674,7 @@ map_stats(pmdaExt *pmda)
 
     if (slist != NULL) {
 	for (i = 0; i < scnt; i++) {
+	    free_stats_index(&slist[i]);
 	    free(slist[i].name);
 	    __pmMemoryUnmap(slist[i].addr, slist[i].len);
 	}
@@ -806,6 +947,30 @@ map_stats(pmdaExt *pmda)
 		s->lcnt = count;
 	    	break;
 
+	    case MMV_TOC_STRIPES:
+		if (count > MAX_MMV_COUNT) {
+		    if (pmDebugOptions.appl0) {
+			pmNotifyErr(LOG_ERR, "MMV: %s - "
+					"stripes count: %d > %d",
+					s->name, count, MAX_MMV_COUNT);
+		    }
+		    continue;
+		}
+		offset += (count * sizeof(mmv_disk_stripe_t));
+		if (s->len < offset) {
+		    if (pmDebugOptions.appl0) {
+			pmNotifyErr(LOG_ERR, "MMV: %s - "
+					"stripes offset: %"PRIu64" < %"PRIu64,
+					s->name, s->len, offset);
+		    }
+		    continue;
+		}
+		offset -= (count * sizeof(mmv_disk_stripe_t));
+
+		s->stcnt = count;
+		s->stripes = (mmv_disk_stripe_t *)((char *)s->addr + offset);
+		break;
+
 	    default:
 		if (pmDebugOptions.appl0) {
 		    pmNotifyErr(LOG_DEBUG, "MMV: %s - bad TOC type (%x)",
@@ -814,14 +979,33 @@ map_stats(pmdaExt *pmda)
 		break;
 	    }
 	}
+
+	index_stats(s);
     }
 
     pmdaTreeRebuildHash(pmns, mtot);	/* for reverse (pmid->name) lookups */
     reload = need_reload;
 }
 
+static mmv_disk_value_t *
+mmv_lookup_slot(slot_t *sp, unsigned int inst, __uint32_t indom)
+{
+    __pmHashNode *hp;
+
+    if (sp->first == NULL)
+	return NULL;
+    if (indom == PM_INDOM_NULL || indom == 0 || inst == PM_IN_NULL)
+	return sp->first;
+    if ((hp = __pmHashSearch(inst, &sp->insts)) == NULL)
+	return NULL;
+    return (mmv_disk_value_t *)hp->data;
+}
+
+/*
+ * Linear search of the metrics and values, when there is no index.
+ */
 static int
-mmv_lookup_item1(int item, unsigned int inst,
+mmv_scan_item1(int item, unsigned int inst,
 	stats_t *s, mmv_disk_value_t **value,
 	__uint64_t *shorttext, __uint64_t *helptext)
 {
@@ -856,7 +1040,7 @@ mmv_lookup_item1(int item, unsigned int inst,
 }
 
 static int
-mmv_lookup_item2(int item, unsigned int inst,
+mmv_scan_item2(int item, unsigned int inst,
 	stats_t *s, mmv_disk_value_t **value,
 	__uint64_t *shorttext, __uint64_t *helptext)
 {
@@ -890,6 +1074,62 @@ mmv_lookup_item2(int item, unsigned int inst,
     return sts;
 }
 
+static int
+mmv_lookup_item1(int item, unsigned int inst,
+	stats_t *s, mmv_disk_value_t **value,
+	__uint64_t *shorttext, __uint64_t *helptext)
+{
+    mmv_disk_metric_t *m1;
+    mmv_disk_value_t *v;
+    __pmHashNode *hp;
+    slot_t *sp;
+
+    if (!s->indexed)
+	return mmv_scan_item1(item, inst, s, value, shorttext, helptext);
+    if ((hp = __pmHashSearch(item, &s->items)) == NULL)
+	return PM_ERR_PMID;
+    for (sp = (slot_t *)hp->data; sp != NULL; sp = sp->next) {
+	m1 = &s->metrics1[sp->mindex];
+	if ((v = mmv_lookup_slot(sp, inst, m1->indom)) == NULL)
+	    continue;
+	if (shorttext)
+	    *shorttext = m1->shorttext;
+	if (helptext)
+	    *helptext = m1->helptext;
+	*value = v;
+	return m1->type;
+    }
+    return PM_ERR_INST;
+}
+
+static int
+mmv_lookup_item2(int item, unsigned int inst,
+	stats_t *s, mmv_disk_value_t **value,
+	__uint64_t *shorttext, __uint64_t *helptext)
+{
+    mmv_disk_metric2_t *m2;
+    mmv_disk_value_t *v;
+    __pmHashNode *hp;
+    slot_t *sp;
+
+    if (!s->indexed)
+	return mmv_scan_item2(item, inst, s, value, shorttext, helptext);
+    if ((hp = __pmHashSearch(item, &s->items)) == NULL)
+	return PM_ERR_PMID;
+    for (sp = (slot_t *)hp->data; sp != NULL; sp = sp->next) {
+	m2 = &s->metrics2[sp->mindex];
+	if ((v = mmv_lookup_slot(sp, inst, m2->indom)) == NULL)
+	    continue;
+	if (shorttext)
+	    *shorttext = m2->shorttext;
+	if (helptext)
+	    *helptext = m2->helptext;
+	*value = v;
+	return m2->type;
+    }
+    return PM_ERR_INST;
+}
+
 static int
 mmv_lookup_stat_metric(pmID pmid, unsigned int inst,
 	stats_t **stats, mmv_disk_value_t **value,
@@ -914,6 +1154,60 @@ mmv_lookup_stat_metric(pmID pmid, unsigned int inst,
     return sts;
 }
 
+/*
+ * Add the per-thread stripe slots of a striped counter into its value.
+ */
+static void
+mmv_stripe_sum(stats_t *s, mmv_disk_value_t *v, int type, pmAtomValue *atom)
+{
+    mmv_disk_stripe_t *sp;
+    pmAtomValue *slot;
+    __uint64_t base, offset = v->extra;
+    int i;
+
+    if (s->stripes == NULL || offset == 0)
+	return;
+    base = (char *)s->stripes - (char *)s->addr;
+    if (offset < base ||
+	(offset - base) % sizeof(mmv_disk_stripe_t) != 0 ||
+	(offset - base) / sizeof(mmv_disk_stripe_t) >= s->stcnt)
+	return;
+    sp = (mmv_disk_stripe_t *)((char *)s->addr + offset);
+    if (sp->value != (char *)v - (char *)s->addr ||
+	sp->count > MMV_STRIPE_MAX ||
+	s->len < sp->offset + (__uint64_t)sp->count * MMV_STRIPE_SIZE) {
+	if (pmDebugOptions.appl0)
+	    pmNotifyErr(LOG_ERR, "MMV: %s - bad stripe at offset %"PRIu64,
+				s->name, offset);
+	return;
+    }
+
+    for (i = 0; i < sp->count; i++) {
+	slot = (pmAtomValue *)((char *)s->addr + sp->offset +
+				(__uint64_t)i * MMV_STRIPE_SIZE);
+	switch (type) {
+	case MMV_TYPE_I32:
+	    atom->l += slot->l;
+	    break;
+	case MMV_TYPE_U32:
+	    atom->ul += slot->ul;
+	    break;
+	case MMV_TYPE_I64:
+	    atom->ll += slot->ll;
+	    break;
+	case MMV_TYPE_U64:
+	    atom->ull += slot->ull;
+	    break;
+	case MMV_TYPE_FLOAT:
+	    atom->f += slot->f;
+	    break;
+	case MMV_TYPE_DOUBLE:
+	    atom->d += slot->d;
+	    break;
+	}
+    }
+}
+
 static int
 mmv_lookup_stat_metric_value(pmID pmid, unsigned int inst,
 	stats_t **stats, mmv_disk_value_t **value)
@@ -967,16 +1261,19 @@ mmv_fetchCallBack(pmdaMetric *mdesc, unsigned int inst, pmAtomValue *atom)
 		if ((fl & MMV_FLAG_SENTINEL) &&
 		    (memcmp(atom, &aNaN, sizeof(*atom)) == 0))
 		    return PMDA_FETCH_NOVALUES;
+		mmv_stripe_sum(s, v, rv, atom);
 		break;
 	    case MMV_TYPE_FLOAT:
 		memcpy(atom, &v->value, sizeof(pmAtomValue));
 		if ((fl & MMV_FLAG_SENTINEL) && atom->f == fNaN)
 		    return PMDA_FETCH_NOVALUES;
+		mmv_stripe_sum(s, v, rv, atom);
 		break;
 	    case MMV_TYPE_DOUBLE:
 		memcpy(atom, &v->value, sizeof(pmAtomValue));
 		if ((fl & MMV_FLAG_SENTINEL) && atom->d == dNaN)
 		    return PMDA_FETCH_NOVALUES;
+		mmv_stripe_sum(s, v, rv, atom);
 		break;
 	    case MMV_TYPE_ELAPSED: {
 		atom->ll = v->value.ll;
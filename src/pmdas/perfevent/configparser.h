@@ -1,5 +1,6 @@
 /*
  * Copyright (C) 2013  Joe White
+ * Copyright (c) 2026 Red Hat.
  *
  * This program is free software; you can redistribute it and/or
  * modify it under the terms of the GNU General Public License
@@ -61,17 +62,25 @@ typedef struct pmcdynamic {
     pmcsetting_t *dynamicSettingList;
 } pmcdynamic_t;
 
+typedef struct pmcgroup {
+    char *name;
+    pmcsetting_t *groupSettingList;   /* leader first, then the members */
+} pmcgroup_t;
+
 typedef struct configuration {
     pmcconfiguration_t *configArr;
     size_t nConfigEntries;
     pmcderived_t *derivedArr;
     size_t nDerivedEntries;
     pmcdynamic_t *dynamicpmc;
+    pmcgroup_t *groupArr;
+    size_t nGroupEntries;
 } configuration_t;
 
 int context_newpmc;
 int context_derived;        /* A flag to check the current pmc */
 int context_dynamic;        /* check the current dynamic pmc */
+int context_group;          /* check the current event group */
 
 /* \brief parse the perf event configuration file
  * This function allocates memory. The returned object should be passed to
@@ -1,6 +1,7 @@
 /* perf interface implementation
  *
  * Copyright (C) 2013  Joe White
+ * Copyright (c) 2026 Red Hat.
  *
  * This program is free software; you can redistribute it and/or
  * modify it under the terms of the GNU General Public License
@@ -23,6 +24,7 @@
 #include "pmapi.h"
 #include <limits.h>
 #include <dirent.h>
+#include <time.h>
 
 #define SYSFS_DEVICES "/sys/bus/event_source/devices"
 #define BUF_SIZE 1024
@@ -95,6 +97,13 @@ static void free_perfdata(perfdata_t *del)
         free_event(&del->events[i]);
     }
     free(del->events);
+    for ( i = 0; i < del->ngroups; ++i )
+    {
+        free(del->groups[i].name);
+        free(del->groups[i].buf);
+        free(del->groups[i].valid);
+    }
+    free(del->groups);
     free_architecture(del->archinfo);
     free(del->archinfo);
     free(del);
@@ -521,46 +530,33 @@ static int perf_setup_derived_event(perfdata_t *inst, pmcderived_t *derived_pmc)
 }
 
 
-/* Setup an event
+/*
+ * Choose the cpus for an event (or group of events) from the CPU option
+ * in the configuration file
  */
-static int perf_setup_event(perfdata_t *inst, const char *eventname, const int cpuSetting)
+static int *event_cpus(perfdata_t *inst, const int cpuSetting, int *ncpus)
 {
-    int i;
-    int ncpus, ret;
     int *cpuarr;
-
-    event_t *events;
-    int nevents = inst->nevents;
     archinfo_t *archinfo = inst->archinfo;
 
-    /* Increase size of event array */
-    events = realloc(inst->events, (nevents + 1) * sizeof(*events));
-    if (NULL == events)
-    {
-        free(inst->events);
-        inst->nevents = 0;
-        inst->events = NULL;
-        return -E_PERFEVENT_REALLOC;
-    }
-
     switch(cpuSetting)
     {
         case CPUCONFIG_ROUNDROBIN_CPU:
             cpuarr = &archinfo->cpus.index[inst->roundrobin_cpu_idx];
-            ncpus = 1;
+            *ncpus = 1;
             inst->roundrobin_cpu_idx = (inst->roundrobin_cpu_idx + 1) % archinfo->cpus.count;
             break;
         case CPUCONFIG_EACH_CPU:
             cpuarr = archinfo->cpus.index;
-            ncpus = archinfo->cpus.count;
+            *ncpus = archinfo->cpus.count;
             break;
         case CPUCONFIG_EACH_NUMANODE:
             cpuarr = archinfo->cpunodes[0].index;
-            ncpus = archinfo->cpunodes[0].count;
+            *ncpus = archinfo->cpunodes[0].count;
             break;
         case CPUCONFIG_ROUNDROBIN_NUMANODE:
             cpuarr = archinfo->cpunodes[inst->roundrobin_nodecpu_idx].index;
-            ncpus = archinfo->cpunodes[inst->roundrobin_nodecpu_idx].count;
+            *ncpus = archinfo->cpunodes[inst->roundrobin_nodecpu_idx].count;
             inst->roundrobin_nodecpu_idx = (inst->roundrobin_nodecpu_idx + 1) % archinfo->ncpus_per_node;
             break;
         default:
@@ -569,14 +565,50 @@ static int perf_setup_event(perfdata_t *inst, const char *eventname, const int c
             } else {
                 cpuarr = &archinfo->cpus.index[0];
             }
-            ncpus = 1;
+            *ncpus = 1;
             break;
     }
 
+    return cpuarr;
+}
+
+/* Setup an event
+ */
+static int perf_setup_event(perfdata_t *inst, const char *eventname, const int cpuSetting)
+{
+    int i;
+    int ncpus, ret;
+    int *cpuarr;
+
+    event_t *events;
+    int nevents = inst->nevents;
+
+    /* Events in a group are already counted (and read) with the group */
+    events = search_event(inst, eventname);
+    if (events != NULL && events->group >= 0)
+    {
+        fprintf(stderr, "Event \"%s\" is already configured in group %s\n",
+                eventname, inst->groups[events->group].name);
+        return 0;
+    }
+
+    /* Increase size of event array */
+    events = realloc(inst->events, (nevents + 1) * sizeof(*events));
+    if (NULL == events)
+    {
+        free(inst->events);
+        inst->nevents = 0;
+        inst->events = NULL;
+        return -E_PERFEVENT_REALLOC;
+    }
+
+    cpuarr = event_cpus(inst, cpuSetting, &ncpus);
+
     event_t *curr = events + nevents;
     curr->name = strdup(eventname);
     curr->info = malloc( (sizeof *(curr->info)) * ncpus );
     curr->ncpus = 0;
+    curr->group = -1;
 
     eventcpuinfo_t *info = &curr->info[0];
 
@@ -664,6 +696,163 @@ static int perf_setup_event(perfdata_t *inst, const char *eventname, const int c
     return ret;
 }
 
+/*
+ * Setup an event group.  The first event is the group leader, and the
+ * members are opened with the leader's file descriptor as group_fd on
+ * each cpu, so one PERF_FORMAT_GROUP read of the leader returns them
+ * all.  If any member cannot be opened on a cpu, the group is not used
+ * on that cpu at all, so the cpus of every event in the group match.
+ */
+static int perf_setup_group(perfdata_t *inst, pmcgroup_t *group_pmc)
+{
+    pmcsetting_t *setting, *prev;
+    event_group_t *groups, *group;
+    event_t *events, *curr;
+    eventcpuinfo_t *info;
+    pfm_perf_encode_arg_t arg;
+    int first = inst->nevents;
+    int nevents = 0;
+    int ncpus, leader_fd, ret;
+    int *cpuarr;
+    int i, j, k;
+
+    setting = group_pmc->groupSettingList;
+    if (NULL == setting) {
+        fprintf(stderr, "No events in group %s\n", group_pmc->name);
+        return -E_PERFEVENT_LOGIC;
+    }
+
+    for (; setting; setting = setting->next) {
+        if (0 == strncmp(setting->name, "RAPL:", 5)) {
+            fprintf(stderr, "RAPL event %s cannot be in group %s\n",
+                    setting->name, group_pmc->name);
+            return -E_PERFEVENT_LOGIC;
+        }
+        if (setting->cpuConfig != group_pmc->groupSettingList->cpuConfig) {
+            fprintf(stderr, "Mismatch in cpu configuration for group %s\n",
+                    group_pmc->name);
+            return -E_PERFEVENT_LOGIC;
+        }
+        for (prev = group_pmc->groupSettingList; prev != setting; prev = prev->next) {
+            if (!strcmp(prev->name, setting->name))
+                break;
+        }
+        if (prev != setting || search_event(inst, setting->name) != NULL) {
+            fprintf(stderr, "Event %s in group %s is already configured\n",
+                    setting->name, group_pmc->name);
+            return -E_PERFEVENT_LOGIC;
+        }
+        nevents++;
+    }
+
+    groups = realloc(inst->groups, (inst->ngroups + 1) * sizeof(*groups));
+    if (NULL == groups)
+        return -E_PERFEVENT_REALLOC;
+    inst->groups = groups;
+
+    events = realloc(inst->events, (first + nevents) * sizeof(*events));
+    if (NULL == events)
+        return -E_PERFEVENT_REALLOC;
+    inst->events = events;
+
+    cpuarr = event_cpus(inst, group_pmc->groupSettingList->cpuConfig, &ncpus);
+
+    setting = group_pmc->groupSettingList;
+    for (k = 0; k < nevents; k++, setting = setting->next) {
+        curr = &events[first + k];
+        memset(curr, 0, sizeof(*curr));
+        curr->name = strdup(setting->name);
+        curr->info = calloc(ncpus, sizeof(*curr->info));
+        curr->group = inst->ngroups;
+        if (NULL == curr->name || NULL == curr->info) {
+            nevents = k + 1;
+            ret = -E_PERFEVENT_REALLOC;
+            goto fail;
+        }
+    }
+
+    for (i = 0; i < ncpus; ++i) {
+        leader_fd = -1;
+        for (k = 0; k < nevents; k++) {
+            curr = &events[first + k];
+            info = &curr->info[curr->ncpus];
+            memset(info, 0, sizeof(*info));
+            info->fd = -1;
+            info->cpu = cpuarr[i];
+            info->type = EVENT_TYPE_PERF;
+
+            /* ABI compatibility, set before calling libpfm */
+            info->hw.size = sizeof(info->hw);
+
+            memset(&arg, 0, sizeof(arg));
+            arg.attr = &(info->hw);
+            arg.fstr = &(info->fstr); /* info->fstr is NULL */
+
+            ret = pfm_get_os_event_encoding(curr->name, PFM_PLM0|PFM_PLM3, PFM_OS_PERF_EVENT_EXT, &arg);
+            if (ret != PFM_SUCCESS) {
+                fprintf(stderr, "pfm_get_os_event_encoding failed on cpu%d for \"%s\": %s\n",
+                        info->cpu, curr->name, pfm_strerror(ret));
+                for (j = 0; j <= k; j++)
+                    free_eventcpuinfo(&events[first + j].info[events[first + j].ncpus]);
+                ret = -E_PERFEVENT_RUNTIME;
+                goto fail;
+            }
+
+            info->idx = arg.idx;
+            info->hw.disabled = 1;
+            info->hw.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            info->fd = perf_event_open(&info->hw, -1, info->cpu, leader_fd, 0);
+            if (info->fd == -1) {
+                fprintf(stderr, "perf_event_open failed on cpu%d for \"%s\" in group %s: %s\n",
+                        info->cpu, curr->name, group_pmc->name, strerror(errno));
+                break;
+            }
+            if (k == 0)
+                leader_fd = info->fd;
+        }
+
+        if (k < nevents) {
+            /* drop this cpu for the whole group */
+            for (j = 0; j <= k; j++)
+                free_eventcpuinfo(&events[first + j].info[events[first + j].ncpus]);
+            continue;
+        }
+
+        /* The group was configured sucessfully on this cpu */
+        for (k = 0; k < nevents; k++)
+            ++(events[first + k].ncpus);
+    }
+
+    if (0 == events[first].ncpus) {
+        ret = -E_PERFEVENT_RUNTIME;
+        goto fail;
+    }
+
+    group = &groups[inst->ngroups];
+    group->name = strdup(group_pmc->name);
+    group->first = first;
+    group->nevents = nevents;
+    group->ncpus = events[first].ncpus;
+    group->buf = calloc(3 + nevents, sizeof(*group->buf));
+    group->valid = calloc(group->ncpus, sizeof(*group->valid));
+    if (NULL == group->name || NULL == group->buf || NULL == group->valid) {
+        free(group->name);
+        free(group->buf);
+        free(group->valid);
+        ret = -E_PERFEVENT_REALLOC;
+        goto fail;
+    }
+
+    ++(inst->ngroups);
+    inst->nevents += nevents;
+    return 0;
+
+ fail:
+    for (k = 0; k < nevents; k++)
+        free_event(&events[first + k]);
+    return ret;
+}
+
 /*
  * Setup the dynamic events
  */
@@ -718,6 +907,7 @@ static int perf_setup_dynamic_events(perfdata_t *inst,
             curr->name = strdup(eventname);
 
             curr->disable_event = disable_event;
+            curr->group = -1;
             if (disable_event) {
                 ++nevents;
                 ret = 0;
@@ -1084,10 +1274,54 @@ static int perf_derived_get(perf_derived_counter **derived_counters,
     return 0;
 }
 
+/*
+ * Read all of the events in a group on one cpu with a single read of the
+ * leader, and save the values for each event as if it had been read on
+ * its own.  The time enabled and running are those of the whole group.
+ */
+static void perf_group_read(perfdata_t *pdata, event_group_t *group, int cpuidx)
+{
+    eventcpuinfo_t *info;
+    size_t size = (3 + group->nevents) * sizeof(*group->buf);
+    ssize_t ret;
+    int k;
+
+    info = &pdata->events[group->first].info[cpuidx];
+    ret = read(info->fd, group->buf, size);
+    ++pdata->stats.reads;
+    if (ret != (ssize_t)size) {
+        if (ret == -1)
+            fprintf(stderr, "cannot read group %s on cpu %d:%d\n", group->name, info->cpu, (int)ret);
+        else
+            fprintf(stderr, "could not read group %s on cpu %d\n", group->name, info->cpu);
+        group->valid[cpuidx] = 0;
+        return;
+    }
+
+    for (k = 0; k < group->nevents; k++) {
+        info = &pdata->events[group->first + k].info[cpuidx];
+        info->values[RAW_VALUE] = group->buf[3 + k];
+        info->values[TIME_ENABLED] = group->buf[1];
+        info->values[TIME_RUNNING] = group->buf[2];
+    }
+    group->valid[cpuidx] = 1;
+}
+
+void perf_get_stats(perfhandle_t *inst, perf_read_stats *stats)
+{
+    perfdata_t *pdata = (perfdata_t *)inst;
+
+    if (NULL == pdata)
+        memset(stats, 0, sizeof(*stats));
+    else
+        *stats = pdata->stats;
+}
+
 int perf_get(perfhandle_t *inst, perf_counter **counters, int *size,
              perf_derived_counter **derived_counters, int *derived_size)
 {
     int cpuidx, idx, events_read;
+    struct timespec start, end;
 
     if(NULL == inst)
     {
@@ -1110,6 +1344,9 @@ int perf_get(perfhandle_t *inst, perf_counter **counters, int *size,
         ncounters = pdata->nevents;
     }
 
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pdata->stats.reads = 0;
+
     events_read = 0;
     for(idx = 0; idx < pdata->nevents; ++idx)
     {
@@ -1135,18 +1372,26 @@ int perf_get(perfhandle_t *inst, perf_counter **counters, int *size,
             int ret;
 
             if( info->type == EVENT_TYPE_PERF ) {
-                ret = read(info->fd, info->values, sizeof(info->values));
-                if (ret != sizeof(info->values)) {
-                    if (ret == -1)
-                        fprintf(stderr, "cannot read event %s on cpu %d:%d\n", event->name, info->cpu, ret);
-                    else
-                        fprintf(stderr, "could not read event %s on cpu %d\n", event->name, info->cpu);
-                    continue;
-                }
-                else
-                {
-                    ++events_read;
+                if (event->group >= 0) {
+                    event_group_t *group = &pdata->groups[event->group];
+
+                    /* the read for the leader fetches the whole group */
+                    if (idx == group->first)
+                        perf_group_read(pdata, group, cpuidx);
+                    if (!group->valid[cpuidx])
+                        continue;
+                } else {
+                    ret = read(info->fd, info->values, sizeof(info->values));
+                    ++pdata->stats.reads;
+                    if (ret != sizeof(info->values)) {
+                        if (ret == -1)
+                            fprintf(stderr, "cannot read event %s on cpu %d:%d\n", event->name, info->cpu, ret);
+                        else
+                            fprintf(stderr, "could not read event %s on cpu %d\n", event->name, info->cpu);
+                        continue;
+                    }
                 }
+                ++events_read;
 
                 pcounter[idx].data[cpuidx].value += scaled_value_delta(info);
                 pcounter[idx].data[cpuidx].time_enabled = info->values[TIME_ENABLED];
@@ -1168,6 +1413,10 @@ int perf_get(perfhandle_t *inst, perf_counter **counters, int *size,
         }
     }
 
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    pdata->stats.read_time = (end.tv_sec - start.tv_sec) * 1000000000LL +
+                             (end.tv_nsec - start.tv_nsec);
+
     *counters = pcounter;
     *size = ncounters;
 
@@ -1211,6 +1460,14 @@ perfhandle_t *perf_event_create(const char *config_file)
         goto out;
     }
 
+    /* Setup the event groups, before the events are setup individually */
+    for (i = 0; i < perfconfig->nGroupEntries; i++)
+    {
+        ret = perf_setup_group(inst, &perfconfig->groupArr[i]);
+        if (ret < 0)
+            fprintf(stderr, "Unable to setup event group : %s\n", perfconfig->groupArr[i].name);
+    }
+
     pmcsetting = find_perf_settings(perfconfig);
     if(NULL == pmcsetting)
     {
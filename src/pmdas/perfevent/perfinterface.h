@@ -2,6 +2,7 @@
  * perfevent interface
  *
  * Copyright (c) 2013 Joe White
+ * Copyright (c) 2026 Red Hat.
  *
  * This program is free software; you can redistribute it and/or modify it
  * under the terms of the GNU General Public License as published by the
@@ -74,8 +75,24 @@ typedef struct event_t_ {
     int disable_event;
     eventcpuinfo_t *info;
     int ncpus;
+    int group; /* index into perfdata_t groups or -1 if not in a group */
 } event_t;
 
+/*
+ * The events in a group are counted together (the kernel schedules the
+ * whole group onto the PMU or none of it) and read with a single
+ * PERF_FORMAT_GROUP read of the leader per cpu, so all of the values
+ * for the members come from the same time slice.
+ */
+typedef struct event_group_t_ {
+    char *name;
+    int first;     /* index of the leader in perfdata_t events */
+    int nevents;   /* leader and members, at first .. first + nevents - 1 */
+    int ncpus;
+    uint64_t *buf; /* nr, time_enabled, time_running, values[nevents] */
+    int *valid;    /* per cpu, was the last group read successful */
+} event_group_t;
+
 typedef struct event_list_t_ {
     event_t *event;
     double scale;
@@ -93,11 +110,22 @@ typedef struct dynamic_event_t_ {
     struct dynamic_event_t_ *next;
 } dynamic_event_t;
 
+typedef struct perf_read_stats_t_
+{
+    uint32_t reads;     /* read(2) calls made by the last perf_get() */
+    uint64_t read_time; /* nanoseconds taken to read the counters */
+} perf_read_stats;
+
 typedef struct perfdata_t_
 {
     int nevents;
     event_t *events;
 
+    int ngroups;
+    event_group_t *groups;
+
+    perf_read_stats stats;
+
     int nderivedevents;
     derived_event_t *derived_events;
 
@@ -124,6 +152,8 @@ int perf_counter_enable(perfhandle_t *inst, int enable);
 
 int perf_get(perfhandle_t *inst, perf_counter **data, int *size, perf_derived_counter **derived_counter, int *derived_size);
 
+void perf_get_stats(perfhandle_t *inst, perf_read_stats *stats);
+
 #define E_PERFEVENT_LOGIC 1
 #define E_PERFEVENT_REALLOC 2
 #define E_PERFEVENT_RUNTIME 3
@@ -1,5 +1,6 @@
 /*
  * Copyright (C) 2013  Joe White
+ * Copyright (c) 2026 Red Hat.
  *
  * This program is free software; you can redistribute it and/or
  * modify it under the terms of the GNU General Public License
@@ -154,6 +155,15 @@ int perf_get_r(perfmanagerhandle_t *inst, perf_counter **data, int *size, perf_d
     return res;
 }
 
+void perf_get_stats_r(perfmanagerhandle_t *inst, perf_read_stats *stats)
+{
+    monitor_t *m = ((manager_t *)inst)->monitor;
+
+    pthread_mutex_lock( &m->counter_mutex );
+    perf_get_stats(m->perf, stats);
+    pthread_mutex_unlock( &m->counter_mutex );
+}
+
 int perf_enabled(perfmanagerhandle_t *inst)
 {
     manager_t *mgr = (manager_t *)inst;
@@ -2,6 +2,7 @@
  * perfmanager interface
  *
  * Copyright (c) 2013 Joe White
+ * Copyright (c) 2026 Red Hat.
  *
  * This program is free software; you can redistribute it and/or modify it
  * under the terms of the GNU General Public License as published by the
@@ -28,6 +29,8 @@ void manager_destroy(perfmanagerhandle_t *mgr);
 
 int perf_get_r(perfmanagerhandle_t *inst, perf_counter **data, int *size, perf_derived_counter **derived_counter, int *derived_size);
 
+void perf_get_stats_r(perfmanagerhandle_t *inst, perf_read_stats *stats);
+
 int perf_enabled(perfmanagerhandle_t *inst);
 
 #endif // PERFMANAGER_H_
@@ -2,7 +2,7 @@
  * perfevent PMDA
  *
  * Copyright (c) 2013 Joe White
- * Copyright (c) 2012,2016,2018 Red Hat.
+ * Copyright (c) 2012,2016,2018,2026 Red Hat.
  * Copyright (c) 1995,2004 Silicon Graphics, Inc.  All Rights Reserved.
  *
  * This program is free software; you can redistribute it and/or modify it
@@ -34,6 +34,14 @@
  *	perfevent.active
  *	        number of active hardware counters
  *
+ *	perfevent.reads.syscalls
+ *	        number of read(2) calls made to read the counters on the
+ *	        last fetch, one per event per CPU, or one per event group
+ *	        per CPU for events in a group
+ *
+ *	perfevent.reads.latency
+ *	        time taken to read the counters on the last fetch
+ *
  *	perfevent.hwcounters.{HWCOUNTER}.value
  *	        the value of the counter. Per-cpu counters have mulitple instances,
  *	        one for each CPU. Uncore/Northbridge counters only have one
@@ -69,6 +77,7 @@ static int nhwcounters;
 static perf_derived_counter *derived_counters;
 static int nderivedcounters;
 static int activecounters;
+static perf_read_stats readstats;
 
 /*
  * metrics information
@@ -105,7 +114,11 @@ static pmdaMetric static_metrictab[] =
     /* perfevent.version */
     { NULL, { PMDA_PMID(0,0), PM_TYPE_STRING, PM_INDOM_NULL, PM_SEM_DISCRETE, PMDA_PMUNITS(0,0,0,0,0,0) } },
     /* perfevent.active */
-    { NULL, { PMDA_PMID(0,1), PM_TYPE_32, PM_INDOM_NULL, PM_SEM_DISCRETE, PMDA_PMUNITS(0,0,0,0,0,0) } }
+    { NULL, { PMDA_PMID(0,1), PM_TYPE_32, PM_INDOM_NULL, PM_SEM_DISCRETE, PMDA_PMUNITS(0,0,0,0,0,0) } },
+    /* perfevent.reads.syscalls */
+    { NULL, { PMDA_PMID(0,2), PM_TYPE_U32, PM_INDOM_NULL, PM_SEM_INSTANT, PMDA_PMUNITS(0,0,1,0,0,PM_COUNT_ONE) } },
+    /* perfevent.reads.latency */
+    { NULL, { PMDA_PMID(0,3), PM_TYPE_U64, PM_INDOM_NULL, PM_SEM_INSTANT, PMDA_PMUNITS(0,1,0,0,PM_TIME_NSEC,0) } }
 };
 
 #define NUM_STATIC_METRICS (sizeof(static_metrictab)/sizeof(static_metrictab[0]))
@@ -209,6 +222,16 @@ static int perfevent_fetchCallBack(pmdaMetric *mdesc, unsigned int inst, pmAtomV
             atom->l = activecounters;
             return 1;
         }
+        else if( item == 2)
+        {
+            atom->ul = readstats.reads;
+            return 1;
+        }
+        else if( item == 3)
+        {
+            atom->ull = readstats.read_time;
+            return 1;
+        }
         else
         {
             return PM_ERR_PMID;
@@ -285,6 +308,7 @@ static int perfevent_profile(pmProfile *prof, pmdaExt *pmda)
 static int perfevent_fetch(int numpmid, pmID pmidlist[], pmResult **resp, pmdaExt *pmda)
 {
     activecounters = perf_get_r(perfif, &hwcounters, &nhwcounters, &derived_counters, &nderivedcounters);
+    perf_get_stats_r(perfif, &readstats);
 
     pmdaEventNewClient(pmda->e_context);
     return pmdaFetch(numpmid, pmidlist, resp, pmda);
@@ -183,6 +183,32 @@ static pmDesc	desctab[] = {
     { PMDA_PMID(4,0), PM_TYPE_U32, PM_INDOM_NULL, PM_SEM_DISCRETE, PMDA_PMUNITS(0,0,0,0,0,0) },
 /* agent.status */
     { PMDA_PMID(4,1), PM_TYPE_32, PM_INDOM_NULL, PM_SEM_DISCRETE, PMDA_PMUNITS(0,0,0,0,0,0) },
+/* agent.fetch.count */
+    { PMDA_PMID(4,2), PM_TYPE_U64, PM_INDOM_NULL, PM_SEM_COUNTER, PMDA_PMUNITS(0,0,1,0,0,PM_COUNT_ONE) },
+/* agent.fetch.time */
+    { PMDA_PMID(4,3), PM_TYPE_U64, PM_INDOM_NULL, PM_SEM_COUNTER, PMDA_PMUNITS(0,1,0,0,PM_TIME_USEC,0) },
+/* agent.fetch.max */
+    { PMDA_PMID(4,4), PM_TYPE_U64, PM_INDOM_NULL, PM_SEM_INSTANT, PMDA_PMUNITS(0,1,0,0,PM_TIME_USEC,0) },
+/* agent.fetch.timeouts */
+    { PMDA_PMID(4,5), PM_TYPE_U32, PM_INDOM_NULL, PM_SEM_COUNTER, PMDA_PMUNITS(0,0,1,0,0,PM_COUNT_ONE) },
+/* agent.fetch.latency.le_1msec */
+    { PMDA_PMID(4,6), PM_TYPE_U64, PM_INDOM_NULL, PM_SEM_COUNTER, PMDA_PMUNITS(0,0,1,0,0,PM_COUNT_ONE) },
+/* agent.fetch.latency.le_10msec */
+    { PMDA_PMID(4,7), PM_TYPE_U64, PM_INDOM_NULL, PM_SEM_COUNTER, PMDA_PMUNITS(0,0,1,0,0,PM_COUNT_ONE) },
+/* agent.fetch.latency.le_100msec */
+    { PMDA_PMID(4,8), PM_TYPE_U64, PM_INDOM_NULL, PM_SEM_COUNTER, PMDA_PMUNITS(0,0,1,0,0,PM_COUNT_ONE) },
+/* agent.fetch.latency.le_1sec */
+    { PMDA_PMID(4,9), PM_TYPE_U64, PM_INDOM_NULL, PM_SEM_COUNTER, PMDA_PMUNITS(0,0,1,0,0,PM_COUNT_ONE) },
+/* agent.fetch.latency.le_10sec */
+    { PMDA_PMID(4,10), PM_TYPE_U64, PM_INDOM_NULL, PM_SEM_COUNTER, PMDA_PMUNITS(0,0,1,0,0,PM_COUNT_ONE) },
+/* agent.fetch.latency.gt_10sec */
+    { PMDA_PMID(4,11), PM_TYPE_U64, PM_INDOM_NULL, PM_SEM_COUNTER, PMDA_PMUNITS(0,0,1,0,0,PM_COUNT_ONE) },
+/* agent.cache.window */
+    { PMDA_PMID(4,12), PM_TYPE_U32, PM_INDOM_NULL, PM_SEM_DISCRETE, PMDA_PMUNITS(0,1,0,0,PM_TIME_MSEC,0) },
+/* agent.cache.hits */
+    { PMDA_PMID(4,13), PM_TYPE_U64, PM_INDOM_NULL, PM_SEM_COUNTER, PMDA_PMUNITS(0,0,1,0,0,PM_COUNT_ONE) },
+/* agent.cache.misses */
+    { PMDA_PMID(4,14), PM_TYPE_U64, PM_INDOM_NULL, PM_SEM_COUNTER, PMDA_PMUNITS(0,0,1,0,0,PM_COUNT_ONE) },
 
 /* pmie.configfile */
     { PMDA_PMID(5,0), PM_TYPE_STRING, PM_INDOM_NULL, PM_SEM_DISCRETE, PMDA_PMUNITS(0,0,0,0,0,0) },
@@ -1641,6 +1667,35 @@ pmcd_fetch(int numpmid, pmID pmidlist[], pmResult **resp, pmdaExt *pmda)
 			    else
 				atom.l = agent[j].reason;
 			    break;
+			case 2:		/* agent.fetch.count */
+			    atom.ull = agent[j].fetchStats.count;
+			    break;
+			case 3:		/* agent.fetch.time */
+			    atom.ull = agent[j].fetchStats.time;
+			    break;
+			case 4:		/* agent.fetch.max */
+			    atom.ull = agent[j].fetchStats.max;
+			    break;
+			case 5:		/* agent.fetch.timeouts */
+			    atom.ul = agent[j].fetchStats.timeouts;
+			    break;
+			case 6:		/* agent.fetch.latency.* */
+			case 7:
+			case 8:
+			case 9:
+			case 10:
+			case 11:
+			    atom.ull = agent[j].fetchStats.bucket[item - 6];
+			    break;
+			case 12:	/* agent.cache.window */
+			    atom.ul = agent[j].cacheMsec;
+			    break;
+			case 13:	/* agent.cache.hits */
+			    atom.ull = agent[j].fetchStats.cacheHits;
+			    break;
+			case 14:	/* agent.cache.misses */
+			    atom.ull = agent[j].fetchStats.cacheMisses;
+			    break;
 			default:
 			    sts = atom.l = PM_ERR_PMID;
 			    break;
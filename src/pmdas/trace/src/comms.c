@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2012-2013 Red Hat.  All Rights Reserved.
+ * Copyright (c) 2012-2013,2026 Red Hat.  All Rights Reserved.
  * Copyright (c) 1997-2001 Silicon Graphics, Inc.  All Rights Reserved.
  * 
  * This program is free software; you can redistribute it and/or modify it
@@ -23,8 +23,10 @@
 #include "comms.h"
 
 extern struct timeval	interval;
+extern struct timeval	shmperiod;
 extern int readData(int, int *);
 extern void timerUpdate(void);
+extern void shmDrain(void);
 
 extern int	maxfd;
 extern int	nclients;
@@ -48,6 +50,10 @@ traceMain(pmdaInterface *dispatch)
 {
     client_t	*cp;
     fd_set	readyfds;
+    struct timeval	now, timeout;
+    struct timeval	*ptimeout = NULL;
+    double	period = pmtimevalToReal(&shmperiod);
+    double	nextdrain = 0, wait;
     int		nready, i, pdutype, sts, protocol;
 
     ctlfd = getcport();
@@ -66,8 +72,22 @@ traceMain(pmdaInterface *dispatch)
     }
 
     for (;;) {
+	/* read shared memory rings every period, whatever the sockets do */
+	if (period > 0) {
+	    pmtimevalNow(&now);
+	    if ((wait = nextdrain - pmtimevalToReal(&now)) <= 0) {
+		__pmAFblock();
+		shmDrain();
+		__pmAFunblock();
+		nextdrain = pmtimevalToReal(&now) + period;
+		wait = period;
+	    }
+	    pmtimevalFromReal(wait, &timeout);
+	    ptimeout = &timeout;
+	}
+
 	memcpy(&readyfds, &fds, sizeof(readyfds));
-	nready = select(maxfd+1, &readyfds, NULL, NULL, NULL);
+	nready = select(maxfd+1, &readyfds, NULL, NULL, ptimeout);
 
 	if (nready == 0)
 	    continue;
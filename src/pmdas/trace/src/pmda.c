@@ -1,7 +1,7 @@
 /*
  * Trace PMDA - process level transaction monitoring for libpcp_trace processes
  *
- * Copyright (c) 2012 Red Hat.
+ * Copyright (c) 2012,2026 Red Hat.
  * Copyright (c) 1997-2000 Silicon Graphics, Inc.  All Rights Reserved.
  * 
  * This program is free software; you can redistribute it and/or modify it
@@ -30,6 +30,7 @@
 
 struct timeval	timespan  = { DEFAULT_TIMESPAN, 0 };
 struct timeval	interval;
+struct timeval	shmperiod = { 0, 100000 };
 unsigned int	rbufsize  = DEFAULT_BUFSIZE;
 int		ctlport	  = -1;
 char		*ctlsock;
@@ -57,6 +58,7 @@ Options:\n\
   -I port     expect programs to connect on given inet port (number/name)\n\
   -M username user account to run under (default \"pcp\")\n\
   -N buckets  number of historical data buffers maintained\n\
+  -S period   shared memory ring read period (default 100 milliseconds)\n\
   -T period   time over which samples are considered (default 60 seconds)\n\
   -U units    export observation values using the given units\n\
   -V units    export counter values using the given units\n",
@@ -162,7 +164,7 @@ main(int argc, char **argv)
 		"trace.log", mypath);
 
     /* need - port, as well as time interval and time span for averaging */
-    while ((c = pmdaGetOpt(argc, argv, "A:D:d:I:l:T:M:N:U:V:?",
+    while ((c = pmdaGetOpt(argc, argv, "A:D:d:I:l:T:M:N:S:U:V:?",
 						&dispatch, &err)) != EOF) {
 	switch(c) {
 	case 'A':
@@ -194,6 +196,14 @@ main(int argc, char **argv)
 		err++;
 	    }
 	    break;
+	case 'S':
+	    if (pmParseInterval(optarg, &shmperiod, &endnum) < 0) {
+		fprintf(stderr, "%s: -S requires a time interval: %s\n",
+			pmGetProgname(), endnum);
+		free(endnum);
+		err++;
+	    }
+	    break;
 	case 'T':
 	    if (pmParseInterval(optarg, &timespan, &endnum) < 0) {
 		fprintf(stderr, "%s: -T requires a time interval: %s\n",
@@ -0,0 +1,397 @@
+/*
+ * Copyright (c) 2026 Red Hat.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+/*
+ * Reader side of the shared memory transport - rings written by
+ * libpcp_trace processes in $PCP_TMP_DIR/trace are mapped read-only
+ * and drained into the same tables as data PDUs from socket clients.
+ * The ring protocol is described in trace_dev.h.
+ *
+ * The directory is writable by everyone, so a ring is only read if it
+ * is a regular file owned by the user running the process it is named
+ * after (or that process has already exited, leaving its ring to be
+ * read one last time), and its size is checked before every pass over
+ * it - reading a mapping beyond the end of a file truncated by its
+ * owner would otherwise be fatal (SIGBUS).
+ */
+
+#include <dirent.h>
+#include "pmapi.h"
+#include "libpcp.h"
+#include "pmda.h"
+#include "trace.h"
+#include "trace_dev.h"
+
+extern int updateData(char *, int, int, double, int);
+
+typedef struct {
+    pid_t		pid;
+    ino_t		ino;		/* detects a new ring for a reused pid */
+    int			fd;		/* for the size checks, -1 if unmapped */
+    size_t		size;
+    __pmTraceShmHdr	*hdr;		/* NULL once the process has exited */
+    __pmTraceShmRecord	*ring;
+    __uint64_t		mask;		/* nrecords - 1 */
+    __uint64_t		tail;		/* next position to be read */
+    int			seen;		/* found in the latest directory scan */
+} shmring_t;
+
+__uint64_t		shmlost;	/* exported as trace.control.lost */
+
+static shmring_t	*rings;
+static int		nrings;
+static char		shmdir[MAXPATHLEN];
+static time_t		dirmtime = -1;
+static time_t		dirscan;
+
+static void
+shmPath(pid_t pid, char *path, size_t pathlen)
+{
+    pmsprintf(path, pathlen, "%s%c%" FMT_PID, shmdir, pmPathSeparator(), pid);
+}
+
+/*
+ * Check that a ring file belongs to the user running process pid,
+ * which (on platforms with a process filesystem) owns /proc/<pid>.
+ * Elsewhere only rings owned by our own user are trusted while their
+ * process is running.
+ */
+static int
+shmOwner(const struct stat *sbuf, pid_t pid)
+{
+#if defined(IS_LINUX) || defined(IS_SOLARIS) || defined(IS_AIX)
+    struct stat		pbuf;
+    char		path[MAXPATHLEN];
+
+    pmsprintf(path, sizeof(path), "/proc/%" FMT_PID, pid);
+    if (stat(path, &pbuf) < 0)
+	return oserror() == ENOENT;
+    return sbuf->st_uid == pbuf.st_uid;
+#else
+    return sbuf->st_uid == geteuid() || !__pmProcessExists(pid);
+#endif
+}
+
+/*
+ * Map a ring read-only and check its header, returns 1 if added,
+ * 0 if the writer has not finished setting it up yet, else -1.
+ */
+static int
+shmAttach(const char *path, pid_t pid, ino_t ino, int startup)
+{
+    struct stat		sbuf;
+    __pmTraceShmHdr	*hdr;
+    shmring_t		*rp;
+    unsigned int	n;
+    size_t		size;
+    int			fd, flags = O_RDONLY | O_NONBLOCK;	/* not for a fifo */
+
+#ifdef O_NOFOLLOW
+    flags |= O_NOFOLLOW;
+#endif
+    if ((fd = open(path, flags)) < 0)
+	return -1;
+    if (fstat(fd, &sbuf) < 0) {
+	close(fd);
+	return -1;
+    }
+    if (!S_ISREG(sbuf.st_mode) || !shmOwner(&sbuf, pid)) {
+	pmNotifyErr(LOG_WARNING, "ignoring trace ring %s: not a file owned "
+		"by the user running process %" FMT_PID, path, pid);
+	close(fd);
+	return -1;
+    }
+    if (sbuf.st_size < (off_t)sizeof(__pmTraceShmHdr)) {
+	close(fd);
+	return 0;
+    }
+    size = sbuf.st_size;
+    if ((hdr = (__pmTraceShmHdr *)__pmMemoryMap(fd, size, 0)) == NULL) {
+	pmNotifyErr(LOG_ERR, "cannot map trace ring %s: %s", path, osstrerror());
+	close(fd);
+	return -1;
+    }
+
+    if (memcmp(hdr->magic, TRACE_SHM_MAGIC, sizeof(hdr->magic)) != 0) {
+	__pmMemoryUnmap(hdr, size);
+	close(fd);
+	return 0;
+    }
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    n = hdr->nrecords;
+    if (hdr->version != TRACE_SHM_VERSION || hdr->pid != pid ||
+	n < TRACE_SHM_MINRECORDS || n > TRACE_SHM_MAXRECORDS || (n & (n - 1)) ||
+	size != sizeof(__pmTraceShmHdr) + n * sizeof(__pmTraceShmRecord)) {
+	pmNotifyErr(LOG_WARNING, "ignoring bad trace ring %s (version %d, "
+		"%u records, %zu bytes)", path, hdr->version, n, size);
+	__pmMemoryUnmap(hdr, size);
+	close(fd);
+	return -1;
+    }
+
+    if ((rp = realloc(rings, (nrings + 1) * sizeof(shmring_t))) == NULL) {
+	pmNotifyErr(LOG_ERR, "dropping trace ring %s: %s", path, osstrerror());
+	__pmMemoryUnmap(hdr, size);
+	close(fd);
+	return -1;
+    }
+    rings = rp;
+    rp = &rings[nrings++];
+    rp->pid = pid;
+    rp->ino = ino;
+    rp->fd = fd;
+    rp->size = size;
+    rp->hdr = hdr;
+    rp->ring = (__pmTraceShmRecord *)(hdr + 1);
+    rp->mask = n - 1;
+    rp->seen = 1;
+    /*
+     * Rings already there when pmdatrace starts are read from the oldest
+     * record they still hold, anything earlier is from before our time.
+     * Records overwritten in later rings before we found them are lost.
+     */
+    if (startup) {
+	rp->tail = __atomic_load_n(&hdr->head, __ATOMIC_ACQUIRE);
+	rp->tail = (rp->tail > n) ? rp->tail - n : 0;
+    }
+    else
+	rp->tail = 0;
+
+    if (pmDebugOptions.appl0)
+	pmNotifyErr(LOG_DEBUG, "attached trace ring %s (%u records)", path, n);
+    return 1;
+}
+
+static void
+shmUnmap(shmring_t *rp)
+{
+    __pmMemoryUnmap(rp->hdr, rp->size);
+    close(rp->fd);
+    rp->fd = -1;
+    rp->hdr = NULL;
+    rp->ring = NULL;
+}
+
+/*
+ * Read every record published since the last call.  A record from a
+ * later lap means the writers overtook us, and one still being written
+ * (or not yet started) ends this pass - it is picked up next time.
+ * Returns -1 if the file has shrunk, and the ring must not be read.
+ */
+static int
+shmRead(shmring_t *rp)
+{
+    __pmTraceShmRecord	rec;
+    __pmTraceShmRecord	*recp;
+    __uint64_t		head, seq;
+    struct stat		sbuf;
+    char		*tag;
+
+    if (fstat(rp->fd, &sbuf) < 0 || sbuf.st_size < (off_t)rp->size) {
+	pmNotifyErr(LOG_WARNING, "trace ring for pid %" FMT_PID
+		" truncated, no longer reading it", rp->pid);
+	return -1;
+    }
+
+    head = __atomic_load_n(&rp->hdr->head, __ATOMIC_ACQUIRE);
+    if (head - rp->tail > rp->mask + 1) {
+	shmlost += head - (rp->mask + 1) - rp->tail;
+	rp->tail = head - (rp->mask + 1);
+    }
+
+    while (rp->tail < head) {
+	recp = &rp->ring[rp->tail & rp->mask];
+	seq = __atomic_load_n(&recp->seq, __ATOMIC_ACQUIRE);
+	if (seq != rp->tail + 1) {
+	    if (seq > rp->tail + 1) {	/* overwritten */
+		shmlost++;
+		rp->tail++;
+		continue;
+	    }
+	    break;
+	}
+	memcpy(&rec, recp, sizeof(rec));
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	if (__atomic_load_n(&recp->seq, __ATOMIC_RELAXED) != seq) {
+	    shmlost++;			/* overwritten while copying */
+	    rp->tail++;
+	    continue;
+	}
+	rp->tail++;
+
+	if (rec.type < TRACE_FIRST_TYPE || rec.type > TRACE_LAST_TYPE ||
+	    rec.taglength < 2 || rec.taglength > MAXTAGNAMELEN ||
+	    rec.tag[rec.taglength - 1] != '\0' ||
+	    strlen(rec.tag) + 1 != rec.taglength) {
+	    pmNotifyErr(LOG_ERR, "bad record in trace ring for pid %" FMT_PID
+		    " (type=%d, taglength=%d)", rp->pid, rec.type, rec.taglength);
+	    continue;
+	}
+	if ((tag = strdup(rec.tag)) == NULL) {
+	    pmNotifyErr(LOG_ERR, "dropping '%s' record: %s", rec.tag,
+			osstrerror());
+	    continue;
+	}
+	updateData(tag, rec.taglength, rec.type, rec.value, -1);
+    }
+    return 0;
+}
+
+/*
+ * Read a ring one last time and unmap it.  Unless it is then removed,
+ * the entry is kept (unmapped) while the file remains, so that it is
+ * not attached and read all over again.
+ */
+static void
+shmDetach(int i, int remove)
+{
+    if (rings[i].hdr != NULL) {
+	if (pmDebugOptions.appl0)
+	    pmNotifyErr(LOG_DEBUG, "detaching trace ring for pid %" FMT_PID,
+			rings[i].pid);
+	shmRead(&rings[i]);
+	shmUnmap(&rings[i]);
+    }
+    if (remove)
+	rings[i] = rings[--nrings];
+}
+
+/*
+ * Find new rings, and those replaced or removed by their writer.  The
+ * directory is only read when it has changed, taking care with changes
+ * made in the same second as the last scan.
+ */
+static void
+shmScan(void)
+{
+    struct dirent	*dp;
+    struct stat		sbuf;
+    char		path[MAXPATHLEN];
+    char		*endnum;
+    pid_t		pid;
+    DIR			*dirp;
+    int			startup = (dirscan == 0);
+    int			i;
+
+    if (stat(shmdir, &sbuf) < 0)
+	return;
+    if (sbuf.st_mtime == dirmtime && dirmtime < dirscan)
+	return;
+    if ((dirp = opendir(shmdir)) == NULL)
+	return;
+    dirmtime = sbuf.st_mtime;
+    dirscan = time(NULL);
+
+    for (i = 0; i < nrings; i++)
+	rings[i].seen = 0;
+    while ((dp = readdir(dirp)) != NULL) {
+	pid = (pid_t)strtol(dp->d_name, &endnum, 10);
+	if (*endnum != '\0' || pid <= 0)
+	    continue;
+	shmPath(pid, path, sizeof(path));
+	if (lstat(path, &sbuf) < 0)
+	    continue;
+	for (i = 0; i < nrings; i++) {
+	    if (rings[i].pid == pid)
+		break;
+	}
+	if (i < nrings) {
+	    if (rings[i].ino == sbuf.st_ino) {
+		rings[i].seen = 1;
+		continue;
+	    }
+	    shmDetach(i, 1);
+	}
+	if (shmAttach(path, pid, sbuf.st_ino, startup) == 0)
+	    dirmtime = -1;	/* not ready, look again next time */
+    }
+    closedir(dirp);
+
+    for (i = 0; i < nrings; ) {
+	if (rings[i].seen)
+	    i++;
+	else
+	    shmDetach(i, 1);
+    }
+}
+
+void
+shmDrain(void)
+{
+    int		i;
+
+    if (shmdir[0] == '\0')
+	return;
+    shmScan();
+    for (i = 0; i < nrings; i++) {
+	/* a truncated ring is kept (unmapped) until the file goes */
+	if (rings[i].hdr != NULL && shmRead(&rings[i]) < 0)
+	    shmUnmap(&rings[i]);
+    }
+}
+
+/* number of rings being read, exported as trace.control.rings */
+unsigned int
+shmRings(void)
+{
+    unsigned int	count = 0;
+    int			i;
+
+    for (i = 0; i < nrings; i++) {
+	if (rings[i].hdr != NULL)
+	    count++;
+    }
+    return count;
+}
+
+/*
+ * Rings are left behind when their process exits, so that nothing
+ * written just before it did is lost - read those one last time and
+ * remove them (along with any no longer read after being truncated).
+ */
+void
+shmReap(void)
+{
+    char	path[MAXPATHLEN];
+    int		i;
+
+    for (i = 0; i < nrings; i++) {
+	if (__pmProcessExists(rings[i].pid))
+	    continue;
+	shmPath(rings[i].pid, path, sizeof(path));
+	if (unlink(path) == 0) {
+	    shmDetach(i, 1);
+	    i--;
+	}
+	else {
+	    if (pmDebugOptions.appl0)
+		pmNotifyErr(LOG_DEBUG, "cannot remove trace ring %s: %s",
+			    path, osstrerror());
+	    shmDetach(i, 0);
+	}
+    }
+}
+
+void
+shmInit(void)
+{
+    int		sep = pmPathSeparator();
+
+    pmsprintf(shmdir, sizeof(shmdir), "%s%c%s",
+		pmGetConfig("PCP_TMP_DIR"), sep, TRACE_SHM_DIR);
+    if (mkdir2(shmdir, 01777) == 0)
+	chmod(shmdir, 01777);	/* not restricted by umask */
+    else if (oserror() != EEXIST)
+	pmNotifyErr(LOG_WARNING, "cannot create %s: %s", shmdir, osstrerror());
+}
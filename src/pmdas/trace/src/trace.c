@@ -1,4 +1,5 @@
 /*
+ * Copyright (c) 2026 Red Hat.
  * Copyright (c) 1997-2000 Silicon Graphics, Inc.  All Rights Reserved.
  * 
  * This program is free software; you can redistribute it and/or modify it
@@ -122,9 +123,24 @@ static pmdaMetric metrictab[] = {
     { NULL,
       { PMDA_PMID(0,19), PM_TYPE_DOUBLE, COUNTER_INDOM, PM_SEM_COUNTER,
 	PMDA_PMUNITS(0,0,0, 0,0,0) }, },	/* this may be modified at startup */
+/* control.rings */
+    { NULL,
+      { PMDA_PMID(0,20), PM_TYPE_U32, PM_INDOM_NULL, PM_SEM_INSTANT,
+	PMDA_PMUNITS(0,0,0, 0,0,0) }, },
+/* control.lost */
+    { NULL,
+      { PMDA_PMID(0,21), PM_TYPE_U64, PM_INDOM_NULL, PM_SEM_COUNTER,
+	PMDA_PMUNITS(0,0,1, 0,0,PM_COUNT_ONE) }, },
 };
 
 extern void __pmdaStartInst(pmInDom indom, pmdaExt *pmda);
+extern void shmInit(void);
+extern void shmDrain(void);
+extern void shmReap(void);
+extern unsigned int shmRings(void);
+extern __uint64_t shmlost;
+
+int updateData(char *, int, int, double, int);
 
 extern int		ctlport;
 extern unsigned int	rbufsize;
@@ -280,12 +296,8 @@ readData(int clientfd, int *protocol)
 {
     __pmTracePDU	*result;
     double	 	data;
-    hashdata_t		newhash;
-    hashdata_t		*hptr;
-    hashdata_t		hash;
     char		*tag;
     int			type, taglen, sts;
-    int			freeflag=0;
 
     if ((sts = __pmtracegetPDU(clientfd, TRACE_TIMEOUT_NEVER, &result)) < 0) {
 	pmNotifyErr(LOG_ERR, "bogus PDU read - %s", pmtraceerrstr(sts));
@@ -300,9 +312,6 @@ readData(int clientfd, int *protocol)
 	    free(tag);
 	    return -1;
 	}
-	newhash.tag = tag;
-	newhash.taglength = taglen;
-	newhash.tracetype = type;
     }
     else if (sts == 0) {	/* client has exited - cleanup in mainloop */
 	return -1;
@@ -313,6 +322,30 @@ readData(int clientfd, int *protocol)
 	return -1;
     }
 
+    return updateData(tag, taglen, type, data, clientfd);
+}
+
+/*
+ * Adds one trace data value to the summary and current ring buffer
+ * tables, for data from both clients' PDUs and shared memory rings
+ * (clientfd is -1 for the latter).  The tag is malloc'd by the caller
+ * and either kept in the tables or freed here.
+ */
+int
+updateData(char *tag, int taglen, int type, double data, int clientfd)
+{
+    hashdata_t		newhash;
+    hashdata_t		*hptr;
+    hashdata_t		hash;
+    int			freeflag=0;
+#ifdef DESPERATE
+    int			sts;
+#endif
+
+    newhash.tag = tag;
+    newhash.taglength = taglen;
+    newhash.tracetype = type;
+
     /*
      * First, update the global summary table with this new data
      */
@@ -488,6 +521,10 @@ clearTable(hashtable_t *t, void *entry)
 void
 timerUpdate(void)
 {
+    /* finish off this interval with everything in the shared memory rings */
+    shmDrain();
+    shmReap();
+
     /* summary table must be reset for next fetch */
     if (dosummary == 0) {
 	__pmhashtraverse(&summary, clearTable);
@@ -757,6 +794,12 @@ auxFetch(int inst, pmID pmid, char *tag, pmAtomValue *atom)
 	case 16:			/* trace.control.debug */
 	    atom->ul = pmDebug;
 	    break;
+	case 20:			/* trace.control.rings */
+	    atom->ul = shmRings();
+	    break;
+	case 21:			/* trace.control.lost */
+	    atom->ull = shmlost;
+	    break;
 	default:
 	    return PM_ERR_PMID;
 	}
@@ -827,6 +870,7 @@ traceFetch(int numpmid, pmID pmidlist[], pmResult **resp, pmdaExt *pmda)
     int			numval;
     int			sts, i, j, need;
 
+    shmDrain();
     indomSortCheck();
     pmda->e_idp = indomtab;
 
@@ -1104,6 +1148,8 @@ traceInit(pmdaInterface *dp)
 						osstrerror());
 	exit(1);
     }
+    shmInit();
+
     /* initialise list of reserved instance domains (for store recovery) */
     if ((sts = __pmhashinit(&history, 0, sizeof(instdata_t),
 						instcmp, instdel)) < 0) {
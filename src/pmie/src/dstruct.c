@@ -2,7 +2,7 @@
  * dstruct.c - central data structures and associated operations
  ***********************************************************************
  *
- * Copyright (c) 2013-2015 Red Hat.
+ * Copyright (c) 2013-2015,2026 Red Hat.
  * Copyright (c) 1995-2003 Silicon Graphics, Inc.  All Rights Reserved.
  * 
  * This program is free software; you can redistribute it and/or modify it
@@ -285,6 +285,8 @@ sleepTight(Task *t)
  * value
  ***********************************************************************/
 
+#define RING_ALIGN	64
+
 void
 newRingBfr(Expr *x)
 {
@@ -309,7 +311,9 @@ newRingBfr(Expr *x)
 
     sz *= x->tspan;
     if (x->ring) free(x->ring);
-    x->ring = zalloc(x->nsmpls * sz);
+    /* cache line aligned, for the block operations in vector.sk */
+    x->ring = aalloc(RING_ALIGN, x->nsmpls * sz);
+    memset(x->ring, 0, x->nsmpls * sz);
     p = (char *)x->ring;
     for (i = 0; i < x->nsmpls; i++) {
 	x->smpls[i].ptr = (void *)p;
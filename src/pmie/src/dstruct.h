@@ -111,6 +111,10 @@ typedef struct expr {
     /* evaluator */
     Eval	    *eval;	/* evaluator function */
     int		    valid;	/* number of valid samples */
+    unsigned int    gen;	/* evaluation cycle of values, 0 if none */
+    int		    changed;	/* values changed in that cycle? */
+    unsigned int    nevals;	/* evaluator function calls */
+    unsigned int    nreused;	/* evaluations where values reused */
 
     /* description of value matrix */
     int		    hdom;	/* cardinality of host dimension */
@@ -3,7 +3,7 @@
  ***********************************************************************
  *
  * Copyright (c) 1995-2002 Silicon Graphics, Inc.  All Rights Reserved.
- * Copyright (c) 2015 Red Hat
+ * Copyright (c) 2015,2026 Red Hat
  * 
  * This program is free software; you can redistribute it and/or modify it
  * under the terms of the GNU General Public License as published by the
@@ -197,6 +197,137 @@ enable(Task *t)
 
 int	showTimeFlag = 0;	/* set when -e used on the command line */
 
+static unsigned int evalgen = 1;	/* current evaluation cycle */
+
+/*
+ * Is the operator a function of the current values of its operands
+ * alone?  If so, and none of the operands changed since it was last
+ * evaluated, its values can be reused.  Fetches, rate conversion and
+ * time domain operators depend on previous samples, and rules and
+ * actions have side effects, so these are always evaluated.
+ */
+static int
+pureOp(int op)
+{
+    switch (op) {
+    case CND_INSTANT:
+    case CND_NEG:
+    case CND_ADD:
+    case CND_SUB:
+    case CND_MUL:
+    case CND_DIV:
+    case CND_SUM_HOST:
+    case CND_SUM_INST:
+    case CND_AVG_HOST:
+    case CND_AVG_INST:
+    case CND_MAX_HOST:
+    case CND_MAX_INST:
+    case CND_MIN_HOST:
+    case CND_MIN_INST:
+    case CND_EQ:
+    case CND_EQ_STR:
+    case CND_NEQ:
+    case CND_NEQ_STR:
+    case CND_LT:
+    case CND_LTE:
+    case CND_GT:
+    case CND_GTE:
+    case CND_NOT:
+    case CND_AND:
+    case CND_OR:
+    case CND_MATCH:
+    case CND_NOMATCH:
+    case CND_ALL_HOST:
+    case CND_ALL_INST:
+    case CND_SOME_HOST:
+    case CND_SOME_INST:
+    case CND_PCNT_HOST:
+    case CND_PCNT_INST:
+    case CND_COUNT_HOST:
+    case CND_COUNT_INST:
+	return 1;
+    }
+    return 0;
+}
+
+/*
+ * did the operand change in this evaluation cycle? ... constants
+ * never do, but variables like $hour are not tracked
+ */
+static int
+argChanged(Expr *x)
+{
+    if (x == NULL || x->op == NOP)
+	return 0;
+    if (x->op == OP_VAR)
+	return 1;
+    return x->changed;
+}
+
+/*
+ * Reuse the values from the previous evaluation, doing only what the
+ * evaluator function would have done to the valid count and timestamp
+ * given the same operand values.
+ */
+static void
+reuse(Expr *x)
+{
+    Expr	*arg1 = x->arg1;
+    Expr	*arg2 = x->arg2;
+    RealTime	stamp = 0;
+
+    if (x->op == CND_MATCH || x->op == CND_NOMATCH) {
+	x->smpls[0].stamp = arg1->smpls[0].stamp;
+	if (x->valid)
+	    x->valid++;
+	return;
+    }
+    if (x->valid == 0)
+	return;
+    if (arg1->valid)
+	stamp = arg1->smpls[0].stamp;
+    if (arg2 && arg2->valid && arg2->smpls[0].stamp > stamp)
+	stamp = arg2->smpls[0].stamp;
+    x->smpls[0].stamp = stamp;
+    x->valid++;
+}
+
+/* evaluate Expr, or reuse its values if no operand changed */
+void
+evalExpr(Expr *x)
+{
+    Expr	*arg1 = x->arg1;
+    Expr	*arg2 = x->arg2;
+
+    /* operands are evaluated here first, and again by x->eval */
+    if (x->gen == evalgen)
+	return;
+
+    if (x->gen != 0 && x->nsmpls == 1 && pureOp(x->op)) {
+	EVALARG(arg1)
+	if (arg2)
+	    EVALARG(arg2)
+	if (!argChanged(arg1) && !argChanged(arg2)) {
+	    reuse(x);
+	    x->gen = evalgen;
+	    x->changed = 0;
+	    x->nreused++;
+	    if (pmDebugOptions.appl2) {
+		fprintf(stderr, "evalExpr(" PRINTF_P_PFX "%p) reused ...\n", x);
+		dumpExpr(x);
+	    }
+	    return;
+	}
+    }
+
+    x->gen = evalgen;
+    (x->eval)(x);
+    x->nevals++;
+    /* fetches work out for themselves if their values changed */
+    if (x->op != CND_FETCH)
+	x->changed = 1;
+}
+
 /* evaluate Task */
 static void
 eval(Task *task)
@@ -213,12 +344,16 @@ eval(Task *task)
     /* fetch metrics */
     taskFetch(task);
 
+    /* new evaluation cycle, 0 is reserved for "never evaluated" */
+    if (++evalgen == 0)
+	evalgen = 1;
+
     /* evaluate rule expressions */
     s = task->rules;
     for (i = 0; i < task->nrules; i++) {
 	curr = symValue(*s);
 	if (curr->op < NOP) {
-	    (curr->eval)(curr);
+	    evalExpr(curr);
 	    perf->eval_actual++;
 	}
 	s++;
@@ -300,6 +435,8 @@ clobber(Expr *x)
 	if (x->arg2)
 	    clobber(x->arg2);
 	x->valid = 0;
+	x->gen = 0;
+	x->changed = 1;
 	/*
 	 * numeric variable or variable?
 	 */
@@ -25,7 +25,10 @@
 #include "andor.h"
 
 #define ROTATE(x)  if ((x)->nsmpls > 1) rotate(x);
-#define EVALARG(x) if ((x)->op < NOP) ((x)->eval)(x);
+#define EVALARG(x) if ((x)->op < NOP) evalExpr(x);
+
+/* evaluate Expr, or reuse its values if no operand changed */
+void evalExpr(Expr *);
 
 /* expression evaluator function prototypes */
 void rule(Expr *);
@@ -2,7 +2,7 @@
  * pmie.c - performance inference engine
  ***********************************************************************
  *
- * Copyright (c) 2013-2015,2017 Red Hat.
+ * Copyright (c) 2013-2015,2017,2026 Red Hat.
  * Copyright (c) 1995-2003 Silicon Graphics, Inc.  All Rights Reserved.
  * 
  * This program is free software; you can redistribute it and/or modify it
@@ -53,6 +53,7 @@ static FILE *logfp;
 static char logfile[MAXPATHLEN];
 static char perffile[MAXPATHLEN];	/* /var/tmp/<pid> file name */
 static char *username;
+static int evalcounts;			/* -E, report counts on exit */
 
 static char menu[] =
 "pmie debugger commands\n\n"
@@ -63,6 +64,8 @@ static char menu[] =
 "  T time-spec        - set default interval for run command\n"
 "  v [expr-name]      - print subexpression used for %h, %i and\n"
 "                       %v bindings\n"
+"  e [expr-name]      - report evaluation counts for named expression\n"
+"                       or all expressions\n"
 "  h or ?             - print this menu of commands\n"
 "  q                  - quit\n\n";
 
@@ -109,6 +112,7 @@ static pmLongOptions longopts[] = {
     { "", 0, 'v', 0, "verbose mode, expression values printed" },
     { "verbose", 0, 'V', 0, "verbose mode, annotated expression values printed" },
     { "", 0, 'W', 0, "verbose mode, satisfying expression values printed" },
+    { "evalcounts", 0, 'E', 0, "report rule evaluation counts on exit" },
     { "secret-applet", 0, 'X', 0, "run in secret applet mode (thin client)" },
     { "secret-agent", 0, 'x', 0, "run in secret agent mode (summary PMDA)" },
     PMAPI_OPTIONS_END
@@ -116,7 +120,7 @@ static pmLongOptions longopts[] = {
 
 static pmOptions opts = {
     .flags = PM_OPTFLAG_STDOUT_TZ,
-    .short_options = "a:A:bc:CdD:efHh:j:l:n:O:PqS:t:T:U:vVWXxzZ:?",
+    .short_options = "a:A:bc:CdD:eEfHh:j:l:n:O:PqS:t:T:U:vVWXxzZ:?",
     .long_options = longopts,
     .short_usage = "[options] [filename ...]",
     .override = override,
@@ -310,6 +314,41 @@ sublist(char *name)
 }
 
 
+/* report evaluation counts for given expression or all expressions */
+static void
+counts(char *name)
+{
+    Task	*t;
+    Symbol	*r;
+    Symbol	s;
+    int		i;
+
+    if (name) {	/* single named rule */
+	if ( (s = symLookup(&rules, name)) )
+	    showCounts(stdout, s);
+	else
+	    printf("%s: error - rule \"%s\" not defined\n", pmGetProgname(), name);
+    }
+    else {	/* all rules */
+	t = taskq;
+	while (t) {
+	    r = t->rules;
+	    for (i = 0; i < t->nrules; i++) {
+		showCounts(stdout, *r);
+		r++;
+	    }
+	    t = t->next;
+	}
+    }
+}
+
+static void
+exitcounts(void)
+{
+    counts(NULL);
+}
+
+
 /***********************************************************************
  * manipulate the performance instrumentation data structure
  ***********************************************************************/
@@ -543,6 +582,10 @@ getargs(int argc, char *argv[])
 	    showTimeFlag = 1;
 	    break;
 
+	case 'E':			/* report evaluation counts */
+	    evalcounts = 1;
+	    break;
+
 	case 'f':			/* in foreground, not as daemon */
 	    foreground = 1;
 	    break;
@@ -909,6 +952,11 @@ interact(void)
 		sublist(token);
 		break;
 
+	    case 'e':
+		token = scanArg(finger);
+		counts(token);
+		break;
+
 	    case '?':
 	    default:
 		printf("%s", menu);
@@ -939,6 +987,9 @@ main(int argc, char **argv)
 
     getargs(argc, argv);
 
+    if (evalcounts)
+	atexit(exitcounts);
+
     if (interactive)
 	interact();
     else
@@ -3,7 +3,7 @@
  ***********************************************************************
  *
  * Copyright (c) 1995-2003 Silicon Graphics, Inc.  All Rights Reserved.
- * Copyright (c) 2015,2017 Red Hat.
+ * Copyright (c) 2015,2017,2026 Red Hat.
  * 
  * This program is free software; you can redistribute it and/or modify it
  * under the terms of the GNU General Public License as published by the
@@ -866,6 +866,32 @@ showSubsyntax(FILE *f, Symbol s)
 }
 
 
+/* sum evaluation counts over the operators in an expression */
+static void
+sumCounts(Expr *x, unsigned int *nevals, unsigned int *nreused)
+{
+    if (x == NULL || x->op >= NOP)
+	return;
+    *nevals += x->nevals;
+    *nreused += x->nreused;
+    sumCounts(x->arg1, nevals, nreused);
+    sumCounts(x->arg2, nevals, nreused);
+}
+
+void
+showCounts(FILE *f, Symbol s)
+{
+    char		*name = symName(s);
+    Expr		*x = symValue(s);
+    unsigned int	nevals = 0;
+    unsigned int	nreused = 0;
+
+    sumCounts(x, &nevals, &nreused);
+    fprintf(f, "%s: %u evaluations, %u operators evaluated, %u reused\n",
+	   name, x->nevals + x->nreused, nevals, nreused);
+}
+
+
 /* Print value of expression */
 void
 showValue(FILE *f, Expr *x)
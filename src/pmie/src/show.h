@@ -24,6 +24,7 @@ char *opStrings(int);
 
 void showSyntax(FILE *,Symbol);
 void showSubsyntax(FILE *, Symbol);
+void showCounts(FILE *, Symbol);
 void showValue(FILE *, Expr *);
 void showAnnotatedValue(FILE *, Expr *);
 void showSatisfyingValue(FILE *, Expr *);
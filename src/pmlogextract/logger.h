@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2018 Red Hat.
+ * Copyright (c) 2018,2026 Red Hat.
  * Copyright (c) 2004 Silicon Graphics, Inc.  All Rights Reserved.
  * 
  * This program is free software; you can redistribute it and/or modify it
@@ -37,6 +37,22 @@ typedef struct _reclist_t {
     struct _reclist_t	*next;		/* ptr to next reclist_t record */
 } reclist_t;
 
+/*
+ *  a log record from an input archive, as read by its reader
+ */
+typedef struct {
+    int		sts;		/* < 0 for end of log or error */
+    pmResult	*result;	/* decoded record */
+    pmResult	*Nresult;	/* wanted metrics, may be result or NULL */
+    __pmPDU	*pdu;		/* record as read, if no rewriting needed */
+    int		pid_sts;	/* pmcd.pid: > 0 found, < 0 error */
+    int		seqnum_sts;	/* pmcd.seqnum: > 0 found, < 0 error */
+    int64_t	pmcd_pid;
+    int32_t	pmcd_seqnum;
+} logrec_t;
+
+struct _reader_t;
+
 /*
  *  Input archive control
  */
@@ -47,6 +63,8 @@ typedef struct {
     __pmPDU	*pb[2];
     pmResult	*_result;
     pmResult	*_Nresult;
+    __pmPDU	*_pdu;		/* _result as read, for pass through */
+    struct _reader_t *reader;	/* see reader.c */
     int		eof[2];
     int		mark;		/* need EOL marker */
     int		recnum;
@@ -89,6 +107,10 @@ extern rlist_t	*rl;			/* list of pmResults */
 
 extern int	ilog;
 
+/* from the prologue/epilogue records */
+extern pmID	pmid_pid;
+extern pmID	pmid_seqnum;
+
 
 /* config file parser states */
 #define GLOBAL	0
@@ -116,6 +138,11 @@ extern pmUnits ntoh_pmUnits(pmUnits);
 #define ntoh_pmLabelType(ltype) ntohl(ltype)
 #define ntoh_pmTextType(ltype) ntohl(ltype)
 
+/* per-input archive readers */
+extern void reader_start(inarch_t *);
+extern void reader_next(inarch_t *, logrec_t *);
+extern void freelogrec(logrec_t *);
+
 /* internal routines */
 extern void insertresult(rlist_t **, pmResult *);
 extern pmResult *searchmlist(pmResult *);
@@ -1,7 +1,7 @@
 /*
  * pmlogextract - extract desired metrics from PCP archive logs
  *
- * Copyright (c) 2014-2018 Red Hat.
+ * Copyright (c) 2014-2018,2026 Red Hat.
  * Copyright (c) 1997-2002 Silicon Graphics, Inc.  All Rights Reserved.
  * 
  * This program is free software; you can redistribute it and/or modify it
@@ -19,6 +19,7 @@
 #include <ctype.h>
 #include <sys/stat.h>
 #include <assert.h>
+#include <pthread.h>
 #include "pmapi.h"
 #include "libpcp.h"
 #include "logger.h"
@@ -301,6 +302,7 @@ int			ilog;		/* index of earliest log */
 
 static reclist_t	*rlog;		/* log records to be written */
 static reclist_t	*rdesc;		/* meta desc records to be written */
+static __pmHashCtl	rdesc_hash;	/* rdesc records by pmid */
 static reclist_t	*rindom;	/* meta indom records to be written */
 static reclist_t	*rtext;		/* meta text records to be written */
 static __pmHashCtl	rlabelset;	/* label sets to be written */
@@ -787,6 +789,11 @@ update_descreclist(int indx)
 	curr->desc.units = ntoh_pmUnits(*pmup);
 	curr->ptr = findnadd_indomreclist(curr->desc.indom);
 	iap->pb[META] = NULL;
+	if (__pmHashAdd((int)curr->desc.pmid, (void *)curr, &rdesc_hash) < 0) {
+	    fprintf(stderr, "%s: Error: cannot malloc space for desc hash.\n",
+		    pmGetProgname());
+	    abandon_extract();
+	}
     }
 }
 
@@ -1296,6 +1303,7 @@ write_metareclist(pmResult *result, int *needti)
     reclist_t		*curr_desc;	/* current desc record */
     reclist_t		*curr_indom;	/* current indom record */
     reclist_t   	*othr_indom;	/* other indom record */
+    __pmHashNode	*hp;
     pmID		pmid;
     pmInDom		indom;
     struct timeval	*this;		/* ptr to timestamp in result */
@@ -1308,9 +1316,8 @@ write_metareclist(pmResult *result, int *needti)
 	indom = PM_IN_NULL;
 	curr_indom = NULL;
 
-	curr_desc = rdesc;
-	while (curr_desc != NULL && curr_desc->desc.pmid != pmid)
-	    curr_desc = curr_desc->next;
+	hp = __pmHashSearch((int)pmid, &rdesc_hash);
+	curr_desc = hp == NULL ? NULL : (reclist_t *)hp->data;
 
 	if (curr_desc == NULL) {
 	    /* descriptor has not been found - this is bad */
@@ -1467,18 +1474,6 @@ _createmark(void)
     return((__pmPDU *)markp);
 }
 
-void
-checklogtime(pmTimeval *this, int indx)
-{
-    if ((curlog.tv_sec == 0 && curlog.tv_usec == 0) ||
-	(curlog.tv_sec > this->tv_sec ||
-	(curlog.tv_sec == this->tv_sec && curlog.tv_usec > this->tv_usec))) {
-	    ilog = indx;
-	    curlog.tv_sec = this->tv_sec;
-	    curlog.tv_usec = this->tv_usec;
-    }
-}
-
 
 /*
  * pick next meta record - if all meta is at EOF return -1
@@ -1771,34 +1766,520 @@ againmeta:
 
 
 /*
- * read in next log record for every archive
+ * Output records are encoded and written out, after the metadata they
+ * need, and the temporal index is maintained, by a writer thread, so
+ * this overlaps the reading and merging of the input archives.  Records
+ * are queued in output order, and the writer owns (and frees) what it
+ * is handed.  If the thread cannot be created, records are written as
+ * they are queued.
+ */
+#define W_RESULT		0
+#define W_MARK			1
+#define W_END			2
+
+#define WQ_SIZE			64	/* records queued for the writer */
+
+typedef struct {
+    int			type;		/* W_RESULT, W_MARK or W_END */
+    pmResult		*_result;	/* as read, freed once written */
+    pmResult		*_Nresult;	/* to be written */
+    __pmPDU		*pdu;		/* record as read, or mark, or NULL */
+    pmTimeval		stamp;		/* now in main() */
+} wrec_t;
+
+static struct {
+    pthread_mutex_t	lock;
+    pthread_cond_t	avail;		/* queue not empty */
+    pthread_cond_t	space;		/* queue below half full */
+    pthread_t		tid;
+    int			threaded;	/* else write as queued */
+    int			head;		/* next record to write */
+    int			count;		/* records queued */
+    int			wwait;		/* writer blocked on avail */
+    int			pwait;		/* main() blocked on space */
+    wrec_t		q[WQ_SIZE];
+} wq = {
+    PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER
+};
+
+static int	wwritten = 0;		/* num log writes so far, by writer */
+static int	wfirst_datarec = 1;	/* first record flag, for writer */
+
+/*
+ * write out a log record, after the metadata it needs, and update
+ * the temporal index if necessary
+ */
+static void
+writerecord(wrec_t *wp)
+{
+    int		i;
+    int		j;
+    int		sts;
+    int		needti = 0;	/* need to flush/update */
+    pmTimeval	titime  = {0,0};/* time of last temporal index write */
+    pmTimeval	restime;	/* time of result */
+    struct timeval tstamp;	/* temporary time stamp */
+    pmResult	*res = wp->_Nresult;
+    pmValueSet	*vsetp;
+    __pmPDU	*pb;		/* pdu buffer */
+    unsigned long	peek_offset;
+
+    restime.tv_sec = res->timestamp.tv_sec;
+    restime.tv_usec = res->timestamp.tv_usec;
+
+    /*
+     * if this is the first record (for output archive) then do some
+     * admin stuff
+     */
+    if (wfirst_datarec) {
+	wfirst_datarec = 0;
+	logctl.l_label.ill_start.tv_sec = res->timestamp.tv_sec;
+	logctl.l_label.ill_start.tv_usec = res->timestamp.tv_usec;
+	logctl.l_state = PM_LOG_STATE_INIT;
+	writelabel_data();
+    }
+
+    /* We need to write out the relevant context labelsm if any. */
+    tstamp.tv_sec = wp->stamp.tv_sec;
+    tstamp.tv_usec = wp->stamp.tv_usec;
+    write_priorlabelset(PM_LABEL_CONTEXT, PM_IN_NULL, &tstamp);
+
+    /*
+     * convert log record to a pdu, unless the record as read from
+     * the input archive can be passed through unchanged
+     */
+    if (wp->pdu != NULL)
+	pb = wp->pdu;
+    else if ((sts = __pmEncodeResult(PDU_OVERRIDE2, res, &pb)) < 0) {
+	fprintf(stderr, "%s: Error: __pmEncodeResult: %s\n",
+		pmGetProgname(), pmErrStr(sts));
+	abandon_extract();
+    }
+
+    /* switch volumes if required */
+    if (varg > 0) {
+	if (wwritten > 0 && (wwritten % varg) == 0) {
+	    newvolume(outarchname, (pmTimeval *)&pb[3]);
+	}
+    }
+    /*
+     * Even without a -v option, we may need to switch volumes
+     * if the data file exceeds 2^31-1 bytes
+     */
+    peek_offset = __pmFtell(archctl.ac_mfp);
+    peek_offset += ((__pmPDUHdr *)pb)->len - sizeof(__pmPDUHdr) + 2*sizeof(int);
+    if (peek_offset > 0x7fffffff) {
+	newvolume(outarchname, (pmTimeval *)&pb[3]);
+    }
+
+    /* write out the descriptor and instance domain pdu's first */
+    write_metareclist(res, &needti);
+
+    /* write out log record */
+    old_log_offset = __pmFtell(archctl.ac_mfp);
+    assert(old_log_offset >= 0);
+    if ((sts = __pmLogPutResult2(&archctl, pb)) < 0) {
+	fprintf(stderr, "%s: Error: __pmLogPutResult2: log data: %s\n",
+		pmGetProgname(), pmErrStr(sts));
+	abandon_extract();
+    }
+    wwritten++;
+
+
+    /* check whether we need to write TI (temporal index) */
+    if (old_log_offset == 0 ||
+	old_log_offset == sizeof(__pmLogLabel)+2*sizeof(int) ||
+	__pmFtell(archctl.ac_mfp) > flushsize)
+	    needti = 1;
+
+    /*
+     * make sure that we do not write out the temporal index more
+     * than once for the same timestamp
+     */
+    if (needti && tvcmp(titime, restime) >= 0)
+	needti = 0;
+
+    /* flush/update */
+    if (needti) {
+	titime = restime;
+
+	__pmFflush(archctl.ac_mfp);
+	__pmFflush(logctl.l_mdfp);
+
+	if (old_log_offset == 0)
+	    old_log_offset = sizeof(__pmLogLabel)+2*sizeof(int);
+
+	new_log_offset = __pmFtell(archctl.ac_mfp);
+	assert(new_log_offset >= 0);
+	new_meta_offset = __pmFtell(logctl.l_mdfp);
+	assert(new_meta_offset >= 0);
+
+	__pmFseek(archctl.ac_mfp, (long)old_log_offset, SEEK_SET);
+	__pmFseek(logctl.l_mdfp, (long)old_meta_offset, SEEK_SET);
+
+	__pmLogPutIndex(&archctl, &restime);
+
+	__pmFseek(archctl.ac_mfp, (long)new_log_offset, SEEK_SET);
+	__pmFseek(logctl.l_mdfp, (long)new_meta_offset, SEEK_SET);
+
+	old_log_offset = __pmFtell(archctl.ac_mfp);
+	assert(old_log_offset >= 0);
+	old_meta_offset = __pmFtell(logctl.l_mdfp);
+	assert(old_meta_offset >= 0);
+
+	flushsize = __pmFtell(archctl.ac_mfp) + 100000;
+    }
+
+    /* free PDU buffer */
+    __pmUnpinPDUBuf(pb);
+    pb = NULL;
+
+    /*
+     * free _result & _Nresult
+     *	_Nresult may contain space that was allocated
+     *	in __pmStuffValue this space has PM_VAL_SPTR format,
+     *	and has to be freed first
+     *	(in order to avoid memory leaks)
+     */
+    if (wp->_result != res) {
+	for (i=0; i<res->numpmid; i++) {
+	    vsetp = res->vset[i];
+	    if (vsetp->valfmt == PM_VAL_SPTR) {
+		for (j=0; j<vsetp->numval; j++) {
+		    free(vsetp->vlist[j].value.pval);
+		}
+	    }
+	}
+	free(res);
+    }
+    if (wp->_result != NULL)
+	pmFreeResult(wp->_result);
+}
+
+static void
+writeout(wrec_t *wp)
+{
+    int		sts;
+
+    old_meta_offset = __pmFtell(logctl.l_mdfp);
+    assert(old_meta_offset >= 0);
+
+    if (wp->type == W_RESULT) {
+	writerecord(wp);
+	return;
+    }
+
+    /* W_MARK */
+    if ((sts = __pmLogPutResult2(&archctl, wp->pdu)) < 0) {
+	fprintf(stderr, "%s: Error: __pmLogPutResult2: log data: %s\n",
+		pmGetProgname(), pmErrStr(sts));
+	abandon_extract();
+    }
+    wwritten++;
+    free(wp->pdu);
+}
+
+static void *
+writer(void *arg)
+{
+    wrec_t	rec;
+
+    (void)arg;
+    for (;;) {
+	pthread_mutex_lock(&wq.lock);
+	while (wq.count == 0) {
+	    wq.wwait = 1;
+	    pthread_cond_wait(&wq.avail, &wq.lock);
+	}
+	rec = wq.q[wq.head];
+	wq.head = (wq.head + 1) % WQ_SIZE;
+	wq.count--;
+	if (wq.pwait && wq.count <= WQ_SIZE / 2) {
+	    wq.pwait = 0;
+	    pthread_cond_signal(&wq.space);
+	}
+	pthread_mutex_unlock(&wq.lock);
+
+	if (rec.type == W_END)
+	    break;
+	writeout(&rec);
+    }
+    return NULL;
+}
+
+static void
+putrec(wrec_t *wp)
+{
+    if (!wq.threaded) {
+	if (wp->type != W_END)
+	    writeout(wp);
+	return;
+    }
+
+    pthread_mutex_lock(&wq.lock);
+    while (wq.count == WQ_SIZE) {
+	wq.pwait = 1;
+	pthread_cond_wait(&wq.space, &wq.lock);
+    }
+    wq.q[(wq.head + wq.count) % WQ_SIZE] = *wp;
+    wq.count++;
+    if (wq.wwait) {
+	wq.wwait = 0;
+	pthread_cond_signal(&wq.avail);
+    }
+    pthread_mutex_unlock(&wq.lock);
+}
+
+static void
+writer_start(void)
+{
+    if (pthread_create(&wq.tid, NULL, writer, NULL) == 0)
+	wq.threaded = 1;
+    else if (pmDebugOptions.appl1)
+	fprintf(stderr, "writer_start: no thread, write as queued\n");
+}
+
+/*
+ * wait for everything queued to be written out
+ */
+static void
+writer_finish(void)
+{
+    wrec_t	rec;
+
+    if (!wq.threaded)
+	return;
+    memset(&rec, 0, sizeof(rec));
+    rec.type = W_END;
+    putrec(&rec);
+    pthread_join(wq.tid, NULL);
+    wq.threaded = 0;
+}
+
+/*
+ * wait for everything queued so far to be written out, so that
+ * messages from main() and the writer appear in order
+ */
+static void
+writer_sync(void)
+{
+    if (wq.threaded) {
+	writer_finish();
+	writer_start();
+    }
+}
+
+/*
+ * queue the log record from this archive to be written out
+ */
+static void
+putresult(inarch_t *iap, pmTimeval now)
+{
+    wrec_t	rec;
+
+    rec.type = W_RESULT;
+    rec._result = iap->_result;
+    rec._Nresult = iap->_Nresult;
+    rec.pdu = iap->_pdu;
+    rec.stamp = now;
+    putrec(&rec);
+    written++;
+
+    /*
+     * if we are in a pre_startwin state, and we are writing
+     * something out, then we are not in a pre_startwin state any more
+     * (it also means that there may be some discrete metrics to be
+     * written out)
+     */
+    first_datarec = 0;
+    if (pre_startwin)
+	pre_startwin = 0;
+
+    iap->_result = NULL;
+    iap->_Nresult = NULL;
+    iap->_pdu = NULL;
+}
+
+/*
+ * queue a mark record to be written out
+ */
+static void
+putmark(__pmPDU *markpdu)
+{
+    wrec_t	rec;
+
+    memset(&rec, 0, sizeof(rec));
+    rec.type = W_MARK;
+    rec.pdu = markpdu;
+    putrec(&rec);
+    written++;
+}
+
+/*
+ *  mark record has been created and assigned to iap->pb[LOG]
+ *  write it out
+ */
+void
+writemark(inarch_t *iap)
+{
+    mark_t      *p = (mark_t *)iap->pb[LOG];
+
+    if (!iap->mark) {
+	fprintf(stderr, "%s: Fatal Error!\n", pmGetProgname());
+	fprintf(stderr, "    writemark called, but mark not set\n");
+	abandon_extract();
+    }
+
+    if (p == NULL) {
+	fprintf(stderr, "%s: Fatal Error!\n", pmGetProgname());
+	fprintf(stderr, "    writemark called, but no pdu\n");
+	abandon_extract();
+    }
+
+    p->timestamp.tv_sec = htonl(p->timestamp.tv_sec);
+    p->timestamp.tv_usec = htonl(p->timestamp.tv_usec);
+
+    putmark(iap->pb[LOG]);
+    iap->pb[LOG] = NULL;
+}
+
+/*
+ * Input archives are merged in timestamp order with a binary heap of
+ * the archives that have a record (or mark) ready, ordered by the
+ * timestamp of that record and then by archive index, so the earliest
+ * record is always at heap[0] and ties go to the first archive on the
+ * command line.  Archives that have no record ready and are not at EOF
+ * are on the pending list, to be read by the next nextlog().
+ */
+static int	*heap;		/* inarch[] indices, earliest record first */
+static int	nheap;
+static int	*pending;	/* inarch[] indices, need a record */
+static int	npending;
+static int	eoflog;		/* number of log files at eof */
+
+static pmTimeval
+headtime(int indx)
+{
+    inarch_t	*iap = &inarch[indx];
+    pmTimeval	tv;
+
+    if (iap->_Nresult != NULL) {
+	tv.tv_sec = iap->_Nresult->timestamp.tv_sec;
+	tv.tv_usec = iap->_Nresult->timestamp.tv_usec;
+    }
+    else {
+	tv.tv_sec = iap->pb[LOG][3]; /* no swab needed */
+	tv.tv_usec = iap->pb[LOG][4]; /* no swab needed */
+    }
+    return tv;
+}
+
+static int
+heapless(int a, int b)
+{
+    int		sts = tvcmp(headtime(a), headtime(b));
+
+    return sts < 0 || (sts == 0 && a < b);
+}
+
+static void
+heapdown(int i)
+{
+    int		child;
+    int		tmp;
+
+    for (;;) {
+	child = 2 * i + 1;
+	if (child >= nheap)
+	    break;
+	if (child + 1 < nheap && heapless(heap[child+1], heap[child]))
+	    child++;
+	if (!heapless(heap[child], heap[i]))
+	    break;
+	tmp = heap[i];
+	heap[i] = heap[child];
+	heap[child] = tmp;
+	i = child;
+    }
+}
+
+static void
+heappush(int indx)
+{
+    int		i = nheap++;
+    int		parent;
+
+    heap[i] = indx;
+    while (i > 0) {
+	parent = (i - 1) / 2;
+	if (!heapless(heap[i], heap[parent]))
+	    break;
+	heap[i] = heap[parent];
+	heap[parent] = indx;
+	i = parent;
+    }
+}
+
+static void
+heappop(void)
+{
+    if (--nheap > 0) {
+	heap[0] = heap[nheap];
+	heapdown(0);
+    }
+}
+
+/*
+ * after records have been discarded (checkwinend), start again
+ * from the archives that still have a record or mark
+ */
+static void
+heaprebuild(void)
+{
+    int		indx;
+
+    nheap = 0;
+    npending = 0;
+    for (indx=0; indx<inarchnum; indx++) {
+	if (inarch[indx]._Nresult != NULL || inarch[indx].pb[LOG] != NULL)
+	    heap[nheap++] = indx;
+	if (inarch[indx]._Nresult == NULL && !inarch[indx].eof[LOG])
+	    pending[npending++] = indx;
+    }
+    for (indx=nheap/2-1; indx>=0; indx--)
+	heapdown(indx);
+}
+
+static int
+indxcmp(const void *a, const void *b)
+{
+    return *(const int *)a - *(const int *)b;
+}
+
+/*
+ * read in next log record for every archive that needs one
  */
 static int
 nextlog(void)
 {
+    int		i;
+    int		n;
     int		indx;
-    int		eoflog = 0;	/* number of log files at eof */
-    int		sts;
     pmTimeval	curtime;
-    __pmArchCtl	*acp;
+    logrec_t	rec;
     __pmContext	*ctxp;
     inarch_t	*iap;
 
+    /* archives are read in order, as errors and warnings are reported */
+    n = npending;
+    if (n > 1)
+	qsort(pending, n, sizeof(pending[0]), indxcmp);
+    npending = 0;
 
-    for (indx=0; indx<inarchnum; indx++) {
+    for (i=0; i<n; i++) {
+	indx = pending[i];
 	iap = &inarch[indx];
 
-	/* if at the end of log file then skip this archive */
-	if (iap->eof[LOG]) {
-	    ++eoflog;
-	    continue;
-	}
-
-	/* if we already have a log record then skip this archive */
-	if (iap->_Nresult != NULL) {
-	    continue;
-	}
-
 	/* if mark has been written out, then log is at EOF */
 	if (iap->mark) {
 	    iap->eof[LOG] = 1;
@@ -1806,20 +2287,19 @@ nextlog(void)
 	    continue;
 	}
 
-	if ((ctxp = __pmHandleToPtr(iap->ctx)) == NULL) {
-	    fprintf(stderr, "%s: botch: __pmHandleToPtr(%d) returns NULL!\n", pmGetProgname(), iap->ctx);
-	    abandon_extract();
-	}
-	/* Need to hold c_lock for __pmLogRead_ctx() */
-	acp = ctxp->c_archctl;
-
 againlog:
-	if ((sts=__pmLogRead_ctx(ctxp, PM_MODE_FORW, NULL, &iap->_result, PMLOGREAD_NEXT)) < 0) {
-	    if (sts != PM_ERR_EOL) {
+	reader_next(iap, &rec);
+	if (rec.sts < 0) {
+	    if (rec.sts != PM_ERR_EOL) {
+		writer_sync();
 		fprintf(stderr, "%s: Error: __pmLogRead[log %s]: %s\n",
-			pmGetProgname(), iap->name, pmErrStr(sts));
-		_report(acp->ac_mfp);
-		if (sts != PM_ERR_LOGREC)
+			pmGetProgname(), iap->name, pmErrStr(rec.sts));
+		/* the reader is done with the context now */
+		if ((ctxp = __pmHandleToPtr(iap->ctx)) != NULL) {
+		    _report(ctxp->c_archctl->ac_mfp);
+		    PM_UNLOCK(ctxp->c_lock);
+		}
+		if (rec.sts != PM_ERR_LOGREC)
 		    abandon_extract();
 	    }
 	    /*
@@ -1835,67 +2315,52 @@ againlog:
 	    else {
 		iap->mark = 1;
 		iap->pb[LOG] = _createmark();
+		heappush(indx);
+		/* at EOF next time around */
+		pending[npending++] = indx;
 	    }
-	    PM_UNLOCK(ctxp->c_lock);
 	    continue;
 	}
 	iap->recnum++;
-	assert(iap->_result != NULL);
+	assert(rec.result != NULL);
 
 	/*
 	 * set current log time - this is only done so that we can
 	 * determine whether to keep or discard the log
 	 */
-	curtime.tv_sec = iap->_result->timestamp.tv_sec;
-	curtime.tv_usec = iap->_result->timestamp.tv_usec;
+	curtime.tv_sec = rec.result->timestamp.tv_sec;
+	curtime.tv_usec = rec.result->timestamp.tv_usec;
 
 	/*
 	 * check for prologue/epilogue records ... 
 	 *
 	 * Warning: If pmlogger changes the contents of the prologue
-	 *          and/or epilogue records, then the 5 below will need
-	 *          to be adjusted.
+	 *          and/or epilogue records, then the 5 below (and in
+	 *          readrec()) will need to be adjusted.
 	 *          If the type of pmcd.pid changes from U64 or the type
 	 *          of pmcd.seqnum changes from U32, the extraction will
 	 *          have to change as well.
 	 */
-	if (iap->_result->numpmid == 5) {
-	    int		i;
-	    pmAtomValue	av;
-	    int		lsts;
-	    for (i=0; i<iap->_result->numpmid; i++) {
-		if (iap->_result->vset[i]->pmid == pmid_pid) {
-		    lsts = pmExtractValue(iap->_result->vset[i]->valfmt, &iap->_result->vset[i]->vlist[0], PM_TYPE_U64, &av, PM_TYPE_64);
-		    if (lsts != 0) {
-			fprintf(stderr,
-			    "%s: Warning: failed to get pmcd.pid from %s at record %d: %s\n",
-				pmGetProgname(), iap->name, iap->recnum, pmErrStr(lsts));
-			if (pmDebugOptions.desperate) {
-			    PM_UNLOCK(ctxp->c_lock);
-			    __pmDumpResult(stderr, iap->_result);
-			    PM_LOCK(ctxp->c_lock);
-			}
-		    }
-		    else
-			iap->pmcd_pid = av.ll;
-		}
-		else if (iap->_result->vset[i]->pmid == pmid_seqnum) {
-		    lsts = pmExtractValue(iap->_result->vset[i]->valfmt, &iap->_result->vset[i]->vlist[0], PM_TYPE_U32, &av, PM_TYPE_32);
-		    if (lsts != 0) {
-			fprintf(stderr,
-			    "%s: Warning: failed to get pmcd.seqnum from %s at record %d: %s\n",
-				pmGetProgname(), iap->name, iap->recnum, pmErrStr(lsts));
-			if (pmDebugOptions.desperate) {
-			    PM_UNLOCK(ctxp->c_lock);
-			    __pmDumpResult(stderr, iap->_result);
-			    PM_LOCK(ctxp->c_lock);
-			}
-		    }
-		    else
-			iap->pmcd_seqnum = av.l;
-		}
-	    }
+	if (rec.pid_sts < 0) {
+	    writer_sync();
+	    fprintf(stderr,
+		"%s: Warning: failed to get pmcd.pid from %s at record %d: %s\n",
+		    pmGetProgname(), iap->name, iap->recnum, pmErrStr(rec.pid_sts));
+	    if (pmDebugOptions.desperate)
+		__pmDumpResult(stderr, rec.result);
+	}
+	else if (rec.pid_sts > 0)
+	    iap->pmcd_pid = rec.pmcd_pid;
+	if (rec.seqnum_sts < 0) {
+	    writer_sync();
+	    fprintf(stderr,
+		"%s: Warning: failed to get pmcd.seqnum from %s at record %d: %s\n",
+		    pmGetProgname(), iap->name, iap->recnum, pmErrStr(rec.seqnum_sts));
+	    if (pmDebugOptions.desperate)
+		__pmDumpResult(stderr, rec.result);
 	}
+	else if (rec.seqnum_sts > 0)
+	    iap->pmcd_seqnum = rec.pmcd_seqnum;
 
 	/*
 	 * if log time is greater than (or equal to) the current window
@@ -1906,40 +2371,25 @@ againlog:
 	    /*
 	     * log is not in time window - discard result and get next record
 	     */
-	    pmFreeResult(iap->_result);
-	    iap->_result = NULL;
+	    freelogrec(&rec);
 	    goto againlog;
 	}
-        else {
-            /*
-	     * log is within time window - check whether we want this record
-             */
-            if (iap->_result->numpmid == 0) {
-		/* mark record, process this one as is */
-                iap->_Nresult = iap->_result;
-	    }
-            else if (ml == NULL) {
-                /* ml is NOT defined, we want everything */
-                iap->_Nresult = iap->_result;
-            }
-            else {
-                /*
-		 * ml is defined, need to search metric list for wanted pmid's
-                 *   (searchmlist may return a NULL pointer - this is fine)
-                 */
-                iap->_Nresult = searchmlist(iap->_result);
-            }
-
-            if (iap->_Nresult == NULL) {
-                /* dont want any of the metrics in _result, try again */
-		pmFreeResult(iap->_result);
-		iap->_result = NULL;
-                goto againlog;
-            }
+
+	/*
+	 * log is within time window - check whether we want this record
+	 *   (the reader has searched the metric list for wanted pmid's)
+	 */
+	if (rec.Nresult == NULL) {
+	    /* dont want any of the metrics in _result, try again */
+	    freelogrec(&rec);
+	    goto againlog;
 	}
-	PM_UNLOCK(ctxp->c_lock);
+	iap->_result = rec.result;
+	iap->_Nresult = rec.Nresult;
+	iap->_pdu = rec.pdu;
+	heappush(indx);
 
-    } /*for(indx)*/
+    } /*for(i)*/
 
     /*
      * if we are here, then each archive control struct should either
@@ -2092,7 +2542,6 @@ static int
 checkwinend(pmTimeval now)
 {
     int		indx;
-    int		sts;
     pmTimeval	tmptime;
     inarch_t	*iap;
     __pmPDU	*markpdu;	/* mark b/n time windows */
@@ -2128,7 +2577,7 @@ checkwinend(pmTimeval now)
 	    tmptime.tv_sec = iap->_Nresult->timestamp.tv_sec;
 	    tmptime.tv_usec = iap->_Nresult->timestamp.tv_usec;
 	    if (tvcmp(tmptime, winstart) < 0) {
-		/* free _result and _Nresult */
+		/* free _result, _Nresult and _pdu */
 		if (iap->_result != iap->_Nresult) {
 		    free(iap->_Nresult);
 		}
@@ -2136,6 +2585,10 @@ checkwinend(pmTimeval now)
 		    pmFreeResult(iap->_result);
 		    iap->_result = NULL;
 		}
+		if (iap->_pdu != NULL) {
+		    __pmUnpinPDUBuf(iap->_pdu);
+		    iap->_pdu = NULL;
+		}
 		iap->_Nresult = NULL;
 		iap->pb[LOG] = NULL;
 	    }
@@ -2153,204 +2606,16 @@ checkwinend(pmTimeval now)
 	    }
 	}
     } /*for(indx)*/
+    heaprebuild();
 
     /* must create "mark" record and write it out */
     /* (need only one mark record) */
     markpdu = _createmark();
-    if ((sts = __pmLogPutResult2(&archctl, markpdu)) < 0) {
-	fprintf(stderr, "%s: Error: __pmLogPutResult2: log data: %s\n",
-		pmGetProgname(), pmErrStr(sts));
-	abandon_extract();
-    }
-    written++;
-    free(markpdu);
+    putmark(markpdu);
     return(1);
 }
 
 
-void
-writerlist(rlist_t **rlready, pmTimeval mintime)
-{
-    int		sts;
-    int		needti = 0;	/* need to flush/update */
-    pmTimeval	titime  = {0,0};/* time of last temporal index write */
-    pmTimeval	restime;	/* time of result */
-    struct timeval tstamp;	/* temporary time stamp */
-    rlist_t	*elm;		/* element of rlready to be written out */
-    __pmPDU	*pb;		/* pdu buffer */
-    unsigned long	peek_offset;
-
-    while (*rlready != NULL) {
-	restime.tv_sec = (*rlready)->res->timestamp.tv_sec;
-	restime.tv_usec = (*rlready)->res->timestamp.tv_usec;
-
-        if (tvcmp(restime, mintime) > 0) {
-#if 0
-fprintf(stderr, "writelist: restime %d.%06d mintime %d.%06d ", restime.tv_sec, restime.tv_usec, mintime.tv_sec, mintime.tv_usec);
-fprintf(stderr, " break!\n");
-#endif
-	    break;
-	}
-
-	/* get the first element from the list */
-	elm = *rlready;
-	*rlready = elm->next;
-
-	/*
-	 * if this is the first record (for output archive) then do some
-	 * admin stuff
-	 */
-	if (first_datarec) {
-	    first_datarec = 0;
-	    logctl.l_label.ill_start.tv_sec = elm->res->timestamp.tv_sec;
-	    logctl.l_label.ill_start.tv_usec = elm->res->timestamp.tv_usec;
-            logctl.l_state = PM_LOG_STATE_INIT;
-            writelabel_data();
-        }
-
-	/*
-	 * if we are in a pre_startwin state, and we are writing
-	 * something out, then we are not in a pre_startwin state any more
-	 * (it also means that there may be some discrete metrics to be
-	 * written out)
-	 */
-	if (pre_startwin)
-	    pre_startwin = 0;
-
-	/* We need to write out the relevant context labelsm if any. */
-	tstamp.tv_sec = mintime.tv_sec;
-	tstamp.tv_usec = mintime.tv_usec;
-	write_priorlabelset(PM_LABEL_CONTEXT, PM_IN_NULL, &tstamp);
-
-	/* convert log record to a pdu */
-	sts = __pmEncodeResult(PDU_OVERRIDE2, elm->res, &pb);
-	if (sts < 0) {
-	    fprintf(stderr, "%s: Error: __pmEncodeResult: %s\n",
-		    pmGetProgname(), pmErrStr(sts));
-	    abandon_extract();
-	}
-
-        /* switch volumes if required */
-        if (varg > 0) {
-            if (written > 0 && (written % varg) == 0) {
-                newvolume(outarchname, (pmTimeval *)&pb[3]);
-	    }
-        }
-	/*
-	 * Even without a -v option, we may need to switch volumes
-	 * if the data file exceeds 2^31-1 bytes
-	 */
-	peek_offset = __pmFtell(archctl.ac_mfp);
-	peek_offset += ((__pmPDUHdr *)pb)->len - sizeof(__pmPDUHdr) + 2*sizeof(int);
-	if (peek_offset > 0x7fffffff) {
-	    newvolume(outarchname, (pmTimeval *)&pb[3]);
-	}
-
-	/* write out the descriptor and instance domain pdu's first */
-	write_metareclist(elm->res, &needti);
-
-	/* write out log record */
-	old_log_offset = __pmFtell(archctl.ac_mfp);
-	assert(old_log_offset >= 0);
-	if ((sts = __pmLogPutResult2(&archctl, pb)) < 0) {
-	    fprintf(stderr, "%s: Error: __pmLogPutResult2: log data: %s\n",
-		    pmGetProgname(), pmErrStr(sts));
-	    abandon_extract();
-	}
-	written++;
-
-
-	/* check whether we need to write TI (temporal index) */
-	if (old_log_offset == 0 ||
-	    old_log_offset == sizeof(__pmLogLabel)+2*sizeof(int) ||
-	    __pmFtell(archctl.ac_mfp) > flushsize)
-		needti = 1;
-
-	/*
-	 * make sure that we do not write out the temporal index more
-	 * than once for the same timestamp
-	 */
-	if (needti && tvcmp(titime, restime) >= 0)
-	    needti = 0;
-
-	/* flush/update */
-	if (needti) {
-	    titime = restime;
-
-	    __pmFflush(archctl.ac_mfp);
-	    __pmFflush(logctl.l_mdfp);
-
-	    if (old_log_offset == 0)
-		old_log_offset = sizeof(__pmLogLabel)+2*sizeof(int);
-
-            new_log_offset = __pmFtell(archctl.ac_mfp);
-	    assert(new_log_offset >= 0);
-            new_meta_offset = __pmFtell(logctl.l_mdfp);
-	    assert(new_meta_offset >= 0);
-
-            __pmFseek(archctl.ac_mfp, (long)old_log_offset, SEEK_SET);
-            __pmFseek(logctl.l_mdfp, (long)old_meta_offset, SEEK_SET);
-
-            __pmLogPutIndex(&archctl, &restime);
-
-            __pmFseek(archctl.ac_mfp, (long)new_log_offset, SEEK_SET);
-            __pmFseek(logctl.l_mdfp, (long)new_meta_offset, SEEK_SET);
-
-            old_log_offset = __pmFtell(archctl.ac_mfp);
-	    assert(old_log_offset >= 0);
-            old_meta_offset = __pmFtell(logctl.l_mdfp);
-	    assert(old_meta_offset >= 0);
-
-            flushsize = __pmFtell(archctl.ac_mfp) + 100000;
-        }
-
-	/* free PDU buffer */
-	__pmUnpinPDUBuf(pb);
-	pb = NULL;
-
-	elm->res = NULL;
-	elm->next = NULL;
-	free(elm);
-
-    } /*while(*rlready)*/
-}
-
-
-/*
- *  mark record has been created and assigned to iap->pb[LOG]
- *  write it out
- */
-void
-writemark(inarch_t *iap)
-{
-    int		sts;
-    mark_t      *p = (mark_t *)iap->pb[LOG];
-
-    if (!iap->mark) {
-	fprintf(stderr, "%s: Fatal Error!\n", pmGetProgname());
-	fprintf(stderr, "    writemark called, but mark not set\n");
-	abandon_extract();
-    }
-
-    if (p == NULL) {
-	fprintf(stderr, "%s: Fatal Error!\n", pmGetProgname());
-	fprintf(stderr, "    writemark called, but no pdu\n");
-	abandon_extract();
-    }
-
-    p->timestamp.tv_sec = htonl(p->timestamp.tv_sec);
-    p->timestamp.tv_usec = htonl(p->timestamp.tv_usec);
-
-    if ((sts = __pmLogPutResult2(&archctl, iap->pb[LOG])) < 0) {
-	fprintf(stderr, "%s: Error: __pmLogPutResult2: log data: %s\n",
-		pmGetProgname(), pmErrStr(sts));
-	abandon_extract();
-    }
-    written++;
-    free(iap->pb[LOG]);
-    iap->pb[LOG] = NULL;
-}
-
 static int
 do_not_need_mark(inarch_t *iap)
 {
@@ -2397,7 +2662,6 @@ int
 main(int argc, char **argv)
 {
     int		indx;
-    int		j;
     int		sts;
     int		stslog;			/* sts from nextlog() */
     int		stsmeta;		/* sts from nextmeta() */
@@ -2405,20 +2669,16 @@ main(int argc, char **argv)
     char	*msg;
 
     pmTimeval 	now = {0,0};	/* the current time */
-    pmTimeval 	mintime = {0,0};
-    pmTimeval 	tmptime = {0,0};
 
-    pmTimeval		tstamp;		/* temporary timestamp */
     inarch_t		*iap;		/* ptr to archive control */
-    rlist_t		*rlready;	/* list of results ready for writing */
     struct timeval	unused;
 
 
     rlog = NULL;	/* list of log records to write */
     rdesc = NULL;	/* list of meta desc records to write */
+    __pmHashInit(&rdesc_hash);
     rindom = NULL;	/* list of meta indom records to write */
     rtext = NULL;	/* list of meta text records to write */
-    rlready = NULL;
     __pmHashInit(&rlabelset);	/* list of meta label set records to write */
 
     /*
@@ -2472,6 +2732,8 @@ main(int argc, char **argv)
 	iap->recnum = 0;
 	iap->_result = NULL;
 	iap->_Nresult = NULL;
+	iap->_pdu = NULL;
+	iap->reader = NULL;
 
 	if ((iap->ctx = pmNewContext(PM_CONTEXT_ARCHIVE, iap->name)) < 0) {
 	    fprintf(stderr, "%s: Error: cannot open archive \"%s\": %s\n",
@@ -2631,6 +2893,25 @@ main(int argc, char **argv)
 	stsmeta = nextmeta();
     } while (stsmeta >= 0);
 
+    /*
+     * now the log records ... a reader for each input archive, and
+     * all archives need a record to start with
+     */
+    heap = (int *)malloc(inarchnum * sizeof(int));
+    pending = (int *)malloc(inarchnum * sizeof(int));
+    if (heap == NULL || pending == NULL) {
+	fprintf(stderr, "%s: Error: malloc heap: %s\n",
+		pmGetProgname(), osstrerror());
+	abandon_extract();
+    }
+    for (indx=0; indx<inarchnum; indx++) {
+	reader_start(&inarch[indx]);
+	pending[indx] = indx;
+    }
+    npending = inarchnum;
+    nheap = 0;
+    eoflog = 0;
+    writer_start();
 
     /*
      * get log record - choose one with earliest timestamp
@@ -2639,54 +2920,29 @@ main(int argc, char **argv)
      * do ti update if necessary
      */
     while (sarg == -1 || written < sarg) {
-	ilog = -1;
-	curlog.tv_sec = 0;
-	curlog.tv_usec = 0;
-	old_meta_offset = __pmFtell(logctl.l_mdfp);
-	assert(old_meta_offset >= 0);
-
-	/* nextlog() resets ilog, and curlog (to the smallest timestamp) */
+	/* nextlog() reads a record for the archives that need one */
 	stslog = nextlog();
 
 	if (stslog < 0)
 	    break;
 
 	/*
-	 * find the _Nresult (or mark pdu) with the earliest timestamp;
-	 * set ilog
-	 * (this is a bit more complex when tflag is specified)
+	 * the _Nresult (or mark pdu) with the earliest timestamp is
+	 * at the top of the heap; set ilog
 	 */
-	mintime.tv_sec = mintime.tv_usec = 0;
-	for (indx=0; indx<inarchnum; indx++) {
-	    if (inarch[indx]._Nresult != NULL) {
-		tstamp.tv_sec = inarch[indx]._Nresult->timestamp.tv_sec;
-		tstamp.tv_usec = inarch[indx]._Nresult->timestamp.tv_usec;
-		checklogtime(&tstamp, indx);
-
-		if (ilog == indx) {
-		    tmptime = curlog;
-		    if (mintime.tv_sec <= 0 || tvcmp(mintime, tmptime) > 0)
-		        mintime = tmptime;
-		}
-	    }
-	    else if (inarch[indx].pb[LOG] != NULL) {
-		tstamp.tv_sec = inarch[indx].pb[LOG][3]; /* no swab needed */
-		tstamp.tv_usec = inarch[indx].pb[LOG][4]; /* no swab needed */
-		checklogtime(&tstamp, indx);
-
-		if (ilog == indx) {
-		    tmptime = curlog;
-		    if (mintime.tv_sec <= 0 || tvcmp(mintime, tmptime) > 0)
-		        mintime = tmptime;
-		}
-	    }
+	if (nheap > 0) {
+	    ilog = heap[0];
+	    curlog = headtime(ilog);
+	}
+	else {
+	    ilog = -1;
+	    curlog.tv_sec = 0;
+	    curlog.tv_usec = 0;
 	}
 
 	/*
 	 * now     == the earliest timestamp of the archive(s)
 	 *		and/or mark records
-	 * mintime == now or timestamp of the earliest mark
-	 *		(whichever is smaller)
 	 */
 	now = curlog;
 
@@ -2714,6 +2970,7 @@ main(int argc, char **argv)
 
 
 	iap = &inarch[ilog];
+	heappop();
 	if (iap->mark) {
 	    if (do_not_need_mark(iap)) {
 		free(iap->pb[LOG]);
@@ -2729,53 +2986,19 @@ main(int argc, char **argv)
 		fprintf(stderr, "    pick == LOG and _Nresult = NULL\n");
 		abandon_extract();
 	    }
-	    insertresult(&rlready, iap->_Nresult);
-#if 0
-{
-    rlist_t	*rp;
-    int		i;
-
-    fprintf(stderr, "rlready");
-    for (i = 0, rp = rlready; rp != NULL; i++, rp = rp->next) {
-	fprintf(stderr, " [%d] t=%d.%06d numpmid=%d", i, (int)rp->res->timestamp.tv_sec, (int)rp->res->timestamp.tv_usec, rp->res->numpmid);
-    }
-    fprintf(stderr, " now=%d.%06d\n", now.tv_sec, now.tv_usec);
-}
-#endif
-
-	    writerlist(&rlready, curlog);
 
 	    /*
-	     * writerlist frees elm (elements of rlready) but does not
-	     * free _result & _Nresult
-	     *
-	     * free _result & _Nresult
-	     *	_Nresult may contain space that was allocated
-	     *	in __pmStuffValue this space has PM_VAL_SPTR format,
-	     *	and has to be freed first
-	     *	(in order to avoid memory leaks)
+	     * the writer frees _result & _Nresult once written, and this
+	     * archive needs its next record
 	     */
-	    if (iap->_result != iap->_Nresult && iap->_Nresult != NULL) {
-		int		i;
-		pmValueSet	*vsetp;
-		for (i=0; i<iap->_Nresult->numpmid; i++) {
-		    vsetp = iap->_Nresult->vset[i];
-		    if (vsetp->valfmt == PM_VAL_SPTR) {
-			for (j=0; j<vsetp->numval; j++) {
-			    free(vsetp->vlist[j].value.pval);
-			}
-		    }
-		}
-		free(iap->_Nresult);
-	    }
-	    if (iap->_result != NULL) {
-		pmFreeResult(iap->_result);
-		iap->_result = NULL;
-	    }
-	    iap->_Nresult = NULL;
+	    putresult(iap, curlog);
+	    pending[npending++] = ilog;
 	}
     } /*while()*/
 
+    /* everything queued has to be written before the end */
+    writer_finish();
+
     if (first_datarec) {
         fprintf(stderr, "%s: Warning: no qualifying records found.\n",
                 pmGetProgname());
@@ -2796,8 +3019,8 @@ cleanup:
 	assert(new_meta_offset >= 0);
 
 #if 0
-	fprintf(stderr, "*** last tstamp: \n\tmintime=%d.%06d \n\ttmptime=%d.%06d \n\tlogend=%d.%06d \n\twinend=%d.%06d \n\tcurrent=%d.%06d\n",
-	    mintime.tv_sec, mintime.tv_usec, tmptime.tv_sec, tmptime.tv_usec, logend.tv_sec, logend.tv_usec, winend.tv_sec, winend.tv_usec, current.tv_sec, current.tv_usec);
+	fprintf(stderr, "*** last tstamp: \n\tlogend=%d.%06d \n\twinend=%d.%06d \n\tcurrent=%d.%06d\n",
+	    logend.tv_sec, logend.tv_usec, winend.tv_sec, winend.tv_usec, current.tv_sec, current.tv_usec);
 #endif
 
 	__pmFseek(archctl.ac_mfp, old_log_offset, SEEK_SET);
@@ -0,0 +1,252 @@
+/*
+ * Input archive readers for pmlogextract
+ *
+ * Copyright (c) 2026 Red Hat.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY
+ * or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License
+ * for more details.
+ */
+
+/*
+ * Each input archive has a reader thread that reads and decodes its
+ * log records, and picks out the wanted metrics, ahead of the merge
+ * in main().  With many input archives this spreads the decoding over
+ * several threads, and it overlaps the encoding and writing of the
+ * output (see the writer in pmlogextract.c).  Records are handed over
+ * in order through a small bounded queue; at end of log (or an error)
+ * the reader queues that status and exits.
+ *
+ * When all the metrics in a record are wanted, the record needs no
+ * rewriting, so the reader keeps a copy of the record as it is in the
+ * archive and the writer passes that through, rather than encoding
+ * the pmResult again.
+ *
+ * If a thread cannot be created, records are read on demand instead.
+ */
+#include <pthread.h>
+#include "pmapi.h"
+#include "libpcp.h"
+#include "logger.h"
+
+#define RQ_SIZE		8	/* records queued ahead for each archive */
+
+typedef struct _reader_t {
+    pthread_mutex_t	lock;
+    pthread_cond_t	avail;		/* queue not empty */
+    pthread_cond_t	space;		/* queue below half full */
+    int			threaded;	/* else read on demand */
+    int			head;		/* next record to hand over */
+    int			count;		/* records queued */
+    int			cwait;		/* consumer blocked on avail */
+    int			rwait;		/* reader blocked on space */
+    logrec_t		q[RQ_SIZE];
+} reader_t;
+
+/*
+ * The record just read, from offset to the current position in f,
+ * in a PDU buffer with room for the trailer, as __pmLogPutResult2()
+ * expects.
+ */
+static __pmPDU *
+rawrec(__pmFILE *f, off_t offset)
+{
+    off_t	end = __pmFtell(f);
+    int		rlen = (int)(end - offset) - 2 * (int)sizeof(int);
+    __pmPDU	*pb;
+    __pmPDUHdr	*php;
+
+    if (rlen <= 0)
+	return NULL;
+    pb = __pmFindPDUBuf(rlen + (int)sizeof(__pmPDUHdr) + (int)sizeof(int));
+    if (pb == NULL)
+	return NULL;
+    __pmFseek(f, offset + sizeof(int), SEEK_SET);
+    if (__pmFread((char *)pb + sizeof(__pmPDUHdr), 1, rlen, f) != rlen) {
+	__pmClearerr(f);
+	__pmUnpinPDUBuf(pb);
+	pb = NULL;
+    }
+    else {
+	php = (__pmPDUHdr *)pb;
+	php->len = rlen + (int)sizeof(__pmPDUHdr);
+	php->type = PDU_RESULT;
+	php->from = 0;
+    }
+    __pmFseek(f, end, SEEK_SET);
+    return pb;
+}
+
+/*
+ * read and decode the next log record, and pick out the wanted metrics
+ */
+static void
+readrec(inarch_t *iap, logrec_t *lrp)
+{
+    int		i;
+    int		vol;
+    off_t	offset;
+    pmAtomValue	av;
+    pmValueSet	*vsp;
+    pmResult	*result;
+    __pmArchCtl	*acp;
+    __pmContext	*ctxp;
+
+    memset(lrp, 0, sizeof(*lrp));
+    if ((ctxp = __pmHandleToPtr(iap->ctx)) == NULL) {
+	fprintf(stderr, "%s: botch: __pmHandleToPtr(%d) returns NULL!\n", pmGetProgname(), iap->ctx);
+	abandon_extract();
+    }
+    /* Need to hold c_lock for __pmLogRead_ctx() */
+    acp = ctxp->c_archctl;
+    vol = acp->ac_curvol;
+    offset = __pmFtell(acp->ac_mfp);
+
+    lrp->sts = __pmLogRead_ctx(ctxp, PM_MODE_FORW, NULL, &lrp->result, PMLOGREAD_NEXT);
+    if (lrp->sts < 0) {
+	lrp->result = NULL;
+	PM_UNLOCK(ctxp->c_lock);
+	return;
+    }
+    result = lrp->result;
+
+    /*
+     * prologue/epilogue records, see nextlog() ... this is done here,
+     * before searchmlist() may cherry-pick instances from the result
+     */
+    if (result->numpmid == 5) {
+	for (i=0; i<result->numpmid; i++) {
+	    vsp = result->vset[i];
+	    if (vsp->pmid == pmid_pid) {
+		lrp->pid_sts = pmExtractValue(vsp->valfmt, &vsp->vlist[0], PM_TYPE_U64, &av, PM_TYPE_64);
+		if (lrp->pid_sts == 0) {
+		    lrp->pid_sts = 1;
+		    lrp->pmcd_pid = av.ll;
+		}
+	    }
+	    else if (vsp->pmid == pmid_seqnum) {
+		lrp->seqnum_sts = pmExtractValue(vsp->valfmt, &vsp->vlist[0], PM_TYPE_U32, &av, PM_TYPE_32);
+		if (lrp->seqnum_sts == 0) {
+		    lrp->seqnum_sts = 1;
+		    lrp->pmcd_seqnum = av.l;
+		}
+	    }
+	}
+    }
+
+    if (result->numpmid == 0 || ml == NULL) {
+	/* mark record, or ml is NOT defined, we want everything */
+	lrp->Nresult = result;
+    }
+    else {
+	/* searchmlist may return a NULL pointer - this is fine */
+	lrp->Nresult = searchmlist(result);
+    }
+
+    /* unchanged, and not split across a volume switch */
+    if (lrp->Nresult == result && acp->ac_curvol == vol)
+	lrp->pdu = rawrec(acp->ac_mfp, offset);
+
+    PM_UNLOCK(ctxp->c_lock);
+}
+
+static void *
+reader(void *arg)
+{
+    inarch_t	*iap = (inarch_t *)arg;
+    reader_t	*rp = iap->reader;
+    logrec_t	rec;
+
+    do {
+	readrec(iap, &rec);
+	pthread_mutex_lock(&rp->lock);
+	while (rp->count == RQ_SIZE) {
+	    rp->rwait = 1;
+	    pthread_cond_wait(&rp->space, &rp->lock);
+	}
+	rp->q[(rp->head + rp->count) % RQ_SIZE] = rec;
+	rp->count++;
+	if (rp->cwait) {
+	    rp->cwait = 0;
+	    pthread_cond_signal(&rp->avail);
+	}
+	pthread_mutex_unlock(&rp->lock);
+    } while (rec.sts >= 0);
+
+    return NULL;
+}
+
+void
+reader_start(inarch_t *iap)
+{
+    reader_t	*rp;
+    pthread_t	tid;
+
+    if ((rp = (reader_t *)calloc(1, sizeof(reader_t))) == NULL) {
+	fprintf(stderr, "%s: Error: reader malloc: %s\n",
+		pmGetProgname(), osstrerror());
+	abandon_extract();
+    }
+    pthread_mutex_init(&rp->lock, NULL);
+    pthread_cond_init(&rp->avail, NULL);
+    pthread_cond_init(&rp->space, NULL);
+    iap->reader = rp;
+
+    if (pthread_create(&tid, NULL, reader, iap) == 0) {
+	pthread_detach(tid);
+	rp->threaded = 1;
+    }
+    else if (pmDebugOptions.appl1)
+	fprintf(stderr, "reader_start: %s: no thread, read on demand\n", iap->name);
+}
+
+/*
+ * next log record for this archive ... once a record with sts < 0
+ * has been returned, there are no more
+ */
+void
+reader_next(inarch_t *iap, logrec_t *lrp)
+{
+    reader_t	*rp = iap->reader;
+
+    if (!rp->threaded) {
+	readrec(iap, lrp);
+	return;
+    }
+
+    pthread_mutex_lock(&rp->lock);
+    while (rp->count == 0) {
+	rp->cwait = 1;
+	pthread_cond_wait(&rp->avail, &rp->lock);
+    }
+    *lrp = rp->q[rp->head];
+    rp->head = (rp->head + 1) % RQ_SIZE;
+    rp->count--;
+    /* let the queue drain a bit before waking the reader again */
+    if (rp->rwait && rp->count <= RQ_SIZE / 2) {
+	rp->rwait = 0;
+	pthread_cond_signal(&rp->space);
+    }
+    pthread_mutex_unlock(&rp->lock);
+}
+
+/*
+ * discard a log record that is not wanted
+ */
+void
+freelogrec(logrec_t *lrp)
+{
+    if (lrp->Nresult != NULL && lrp->Nresult != lrp->result)
+	free(lrp->Nresult);
+    if (lrp->pdu != NULL)
+	__pmUnpinPDUBuf(lrp->pdu);
+    if (lrp->result != NULL)
+	pmFreeResult(lrp->result);
+    memset(lrp, 0, sizeof(*lrp));
+}
@@ -535,12 +535,13 @@ static pmLongOptions longopts[] = {
     { "version", 1, 'V', "NUM", "version for archive (default and only version is 2)" },
     { "", 1, 'x', "FD", "control file descriptor for running from pmRecordControl(3)" },
     { "", 0, 'y', 0, "set timezone for times to local time rather than from PMCD host" },
+    { "compress", 1, 'z', "SUFFIX", "compress data volumes as they are written (xz)" },
     PMOPT_HELP,
     PMAPI_OPTIONS_END
 };
 
 static pmOptions opts = {
-    .short_options = "c:CD:h:H:l:K:Lm:n:op:Prs:T:t:uU:v:V:x:y?",
+    .short_options = "c:CD:h:H:l:K:Lm:n:op:Prs:T:t:uU:v:V:x:yz:?",
     .long_options = longopts,
     .short_usage = "[options] archive",
 };
@@ -807,6 +808,14 @@ main(int argc, char **argv)
 	    use_localtime = 1;
 	    break;
 
+	case 'z':		/* compressed data volumes */
+	    if ((sts = __pmLogSetCompress(opts.optarg)) < 0) {
+		pmprintf("%s: cannot compress data volumes with '%s': %s\n",
+			pmGetProgname(), opts.optarg, pmErrStr(sts));
+		opts.errors++;
+	    }
+	    break;
+
 	case '?':
 	default:
 	    opts.errors++;
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2014,2016 Red Hat.
+ * Copyright (c) 2014,2016,2026 Red Hat.
  * Copyright (c) 1995-2001,2003 Silicon Graphics, Inc.  All Rights Reserved.
  * 
  * This program is free software; you can redistribute it and/or modify it
@@ -16,6 +16,7 @@
 #include <math.h>
 #include <stdarg.h>
 #include <limits.h>
+#include <pthread.h>
 #include "pmapi.h"
 #include "libpcp.h"
 
@@ -39,6 +40,7 @@ static pmLongOptions longopts[] = {
     PMOPT_START,
     PMOPT_FINISH,
     { "verbose", 0, 'v', 0, "verbose, enable warnings from individual archive fetches" },
+    { "workers", 1, 'w', "N", "summarize the archive in parts using N worker threads" },
     { "", 0, 'x', 0, "print only stochastic averages for counter metrics" },
     { "samples", 0, 'y', "print sample count for each metric" },
     PMOPT_TIMEZONE,
@@ -51,7 +53,7 @@ static pmLongOptions longopts[] = {
 static int override(int, pmOptions *);
 static pmOptions opts = {
     .flags = PM_OPTFLAG_DONE | PM_OPTFLAG_BOUNDARIES | PM_OPTFLAG_STDOUT_TZ,
-    .short_options = "abB:D:fFHiIlmMNn:p:rsS:T:vVxyzZ:?",
+    .short_options = "abB:D:fFHiIlmMNn:p:rsS:T:vVw:xyzZ:?",
     .long_options = longopts,
     .short_usage = "[options] archive [metricname ...]",
     .override = override,
@@ -74,6 +76,11 @@ typedef struct {
     int			marked;		/* seen since last "mark" record? */
     unsigned int	bintotal;	/* copy of count for 2nd pass */
     unsigned int	*bin;		/* bins for value distribution */
+    double		headval;	/* first value in this part (part > 0) */
+    struct timeval	headtime;	/* time of first value in this part */
+    int			headmarks;	/* mark records in this part before it */
+    struct timeval	ratetime;	/* time of first counter rate in this part */
+    int			merged;		/* seen in the part being merged */
 } instData;
 
 typedef struct {
@@ -83,11 +90,36 @@ typedef struct {
     unsigned int	listsize;
 } aveData;
 
+/*
+ * With -w the time window is split into parts that are summarized
+ * concurrently, each from its own context into its own hash table,
+ * then merged in time order (see mergepart()).  The first part is
+ * summarized as before, directly into hashlist.  In the other parts
+ * each instance starts out empty, and its first value (the "head") is
+ * kept aside, so that the merge can apply it to the previous state of
+ * the instance just as a serial pass would have done.
+ */
+typedef struct {
+    int			part;		/* 0 for the first (or only) part */
+    int			last;		/* the last part, finish is inclusive */
+    struct timeval	start;		/* time window for this part */
+    struct timeval	finish;
+    __pmHashCtl		*hashlist;	/* aveData for each metric */
+    int			nmarks;		/* mark records seen (part > 0) */
+    struct timeval	*marks;
+    int			sts;		/* fetch status at the end */
+} partData;
+
 /*
  * Hash control for statistics & errors related to each metric
  */
 static __pmHashCtl	hashlist;
 static __pmHashCtl	errlist;
+static pthread_mutex_t	errlock = PTHREAD_MUTEX_INITIALIZER;
+
+static partData		*parts;		/* parts[0] is summarized into hashlist */
+static int		nparts = 1;
+static char		*archive;
 
 /* output format flags */
 static unsigned int	stocaveflag;	/* no stochastic counter ave */
@@ -102,6 +134,7 @@ static unsigned int	warnflag;	/* warnings are off by default */
 static unsigned int	delimiter = ' ';/* output field separator */
 static unsigned int	nbins;		/* number of distribution bins */
 static unsigned int	precision = 3;	/* number of digits after "." */
+static int		dowrap;		/* PCP_COUNTER_WRAP is set */
 
 /* time window stuff */
 static int		dayflag;
@@ -137,10 +170,28 @@ tadd(struct timeval *a, struct timeval *b)
     return 0;
 }
 
+static int
+fpbad(double d)
+{
+    int		fp_bad = 0;
+
+#ifdef HAVE_FPCLASSIFY
+    fp_bad = fpclassify(d) == FP_NAN;
+#else
+#ifdef HAVE_ISNAN
+    fp_bad = isnan(d);
+#endif
+#endif
+    return fp_bad;
+}
+
 static void
 pmiderr(pmID pmid, const char *msg, ...)
 {
-    if (warnflag && __pmHashSearch(pmid, &errlist) == NULL) {
+    if (!warnflag)
+	return;
+    pthread_mutex_lock(&errlock);
+    if (__pmHashSearch(pmid, &errlist) == NULL) {
 	va_list	arg;
 	int	numnames;
 	char	**names;
@@ -155,6 +206,7 @@ pmiderr(pmID pmid, const char *msg, ...)
 	__pmHashAdd(pmid, NULL, &errlist);
 	if (numnames > 0) free(names);
     }
+    pthread_mutex_unlock(&errlock);
 }
 
 static void
@@ -378,16 +430,8 @@ static double
 unwrap(double current, double previous, int pmtype)
 {
     double	outval = current;
-    static int	dowrap = -1;
 
     if ((current - previous) < 0.0) {
-	if (dowrap == -1) {
-	    /* PCP_COUNTER_WRAP in environment enables "counter wrap" logic */
-	    if (getenv("PCP_COUNTER_WRAP") == NULL)
-		dowrap = 0;
-	    else
-		dowrap = 1;
-	}
 	if (dowrap) {
 	    switch (pmtype) {
 		case PM_TYPE_32:
@@ -405,23 +449,17 @@ unwrap(double current, double previous, int pmtype)
     return outval;
 }
 
-static void
-newHashInst(pmValue *vp,
+static instData *
+newInst(partData *pp,
 	aveData *avedata,		/* updated by this function */
-	int valfmt,
-	struct timeval *timestamp,	/* timestamp for this sample */
-	int pos)			/* position of this inst in instlist */
+	int inst,
+	double value,			/* first value for this inst */
+	struct timeval *timestamp)	/* timestamp for this sample */
 {
-    int		sts;
+    int		pos = avedata->listsize;
     size_t	size;
     instData	*instdata;
-    pmAtomValue av;
 
-    if ((sts = pmExtractValue(valfmt, vp, avedata->desc.type, &av, PM_TYPE_DOUBLE)) < 0) {
-	pmiderr(avedata->desc.pmid, "failed to extract value: %s\n", pmErrStr(sts));
-	fprintf(stderr, "%s: possibly corrupt archive?\n", pmGetProgname());
-	exit(1);
-    }
     size = (pos+1) * sizeof(instData *);
     avedata->instlist = (instData **) realloc(avedata->instlist, size);
     if (avedata->instlist == NULL)
@@ -439,8 +477,18 @@ newHashInst(pmValue *vp,
 	    pmNoMem("newHashInst.instlist[inst].bin", size, PM_FATAL_ERR);
 	memset(instdata->bin, 0, size);
     }
-    instdata->inst = vp->inst;
-    if (avedata->desc.sem == PM_SEM_COUNTER) {
+    instdata->inst = inst;
+    if (pp->part > 0) {	/* empty, first value is merged later */
+	instdata->min = HUGE_VAL;
+	instdata->max = -HUGE_VAL;
+	instdata->sum = 0.0;
+	instdata->mintime = *timestamp;
+	instdata->maxtime = *timestamp;
+	instdata->stocave = 0.0;
+	instdata->timeave = 0.0;
+	instdata->count = 0;
+    }
+    else if (avedata->desc.sem == PM_SEM_COUNTER) {
 	instdata->min = 0.0;
 	instdata->max = 0.0;
 	instdata->sum = 0.0;
@@ -451,21 +499,26 @@ newHashInst(pmValue *vp,
 	instdata->count = 0;
     }
     else {	/* for the other semantics */
-	instdata->min = av.d;
-	instdata->max = av.d;
-	instdata->sum = av.d;
+	instdata->min = value;
+	instdata->max = value;
+	instdata->sum = value;
 	instdata->mintime = *timestamp;
 	instdata->maxtime = *timestamp;
-	instdata->stocave = av.d;
+	instdata->stocave = value;
 	instdata->timeave = 0.0;
 	instdata->count = 1;
     }
     instdata->marked = 0;
     instdata->bintotal = 0;
     instdata->markcount = 0;
-    instdata->lastval = av.d;
+    instdata->lastval = value;
     instdata->firsttime = *timestamp;
     instdata->lasttime = *timestamp;
+    instdata->headval = value;
+    instdata->headtime = *timestamp;
+    instdata->headmarks = pp->nmarks;
+    instdata->ratetime = *timestamp;
+    instdata->merged = 0;
     avedata->listsize++;
     if (pmDebugOptions.appl0) {
 	int	numnames;
@@ -476,10 +529,30 @@ newHashInst(pmValue *vp,
 		instdata->min, instdata->max);
 	if (numnames > 0) free(names);
     }
+    return instdata;
 }
 
 static void
-newHashItem(pmValueSet *vsp,
+newHashInst(partData *pp,
+	pmValue *vp,
+	aveData *avedata,		/* updated by this function */
+	int valfmt,
+	struct timeval *timestamp)	/* timestamp for this sample */
+{
+    int		sts;
+    pmAtomValue av;
+
+    if ((sts = pmExtractValue(valfmt, vp, avedata->desc.type, &av, PM_TYPE_DOUBLE)) < 0) {
+	pmiderr(avedata->desc.pmid, "failed to extract value: %s\n", pmErrStr(sts));
+	fprintf(stderr, "%s: possibly corrupt archive?\n", pmGetProgname());
+	exit(1);
+    }
+    newInst(pp, avedata, vp->inst, av.d, timestamp);
+}
+
+static void
+newHashItem(partData *pp,
+	pmValueSet *vsp,
 	pmDesc *desc,
 	aveData *avedata,		/* output from this function */
 	struct timeval *timestamp)	/* timestamp for this sample */
@@ -509,7 +582,7 @@ newHashItem(pmValueSet *vsp,
     avedata->listsize = 0;
     avedata->instlist = NULL;
     for (j = 0; j < vsp->numval; j++)
-	newHashInst(&vsp->vlist[j], avedata, vsp->valfmt, timestamp, j);
+	newHashInst(pp, &vsp->vlist[j], avedata, vsp->valfmt, timestamp);
 }
 
 /*
@@ -545,42 +618,54 @@ findbin(pmID pmid, double val, double min, double max)
     return index;
 }
 
+static void
+markinst(aveData *avedata, instData *instdata, struct timeval *timestamp)
+{
+    double		val;
+    struct timeval	timediff;
+
+    if (avedata->desc.sem == PM_SEM_DISCRETE) {
+	/* extend discrete metrics to the mark point */
+	timediff = *timestamp;
+	tsub(&timediff, &instdata->lasttime);
+	val = instdata->lastval;
+	instdata->stocave += val;
+	instdata->timeave += val*pmtimevalToReal(&timediff);
+	instdata->lasttime = *timestamp;
+	instdata->count++;
+    }
+    instdata->marked = 1;
+    instdata->markcount++;
+}
+
 /*
  * must keep a note for every instance of every metric whenever a mark
  * record has been seen between now & the last fetch for that instance
  */
 static void
-markrecord(pmResult *result)
+markrecord(partData *pp, pmResult *result)
 {
     int			i, j;
+    size_t		size;
     __pmHashNode	*hptr;
     aveData		*avedata;
-    instData		*instdata;
-    double		val;
-    struct timeval	timediff;
 
     if (pmDebugOptions.appl0) {
 	printstamp(&result->timestamp, '\n');
 	printf(" - mark record\n\n");
     }
-    for (i = 0; i < hashlist.hsize; i++) {
-	for (hptr = hashlist.hash[i]; hptr != NULL; hptr = hptr->next) {
+    if (pp->part > 0) {
+	/* instances not yet seen in this part are marked in mergepart() */
+	size = (pp->nmarks + 1) * sizeof(struct timeval);
+	if ((pp->marks = (struct timeval *)realloc(pp->marks, size)) == NULL)
+	    pmNoMem("markrecord.marks", size, PM_FATAL_ERR);
+	pp->marks[pp->nmarks++] = result->timestamp;
+    }
+    for (i = 0; i < pp->hashlist->hsize; i++) {
+	for (hptr = pp->hashlist->hash[i]; hptr != NULL; hptr = hptr->next) {
 	    avedata = (aveData *)hptr->data;
-	    for (j = 0; j < avedata->listsize; j++) {
-		instdata = avedata->instlist[j];
-		if (avedata->desc.sem == PM_SEM_DISCRETE) {
-		    /* extend discrete metrics to the mark point */
-		    timediff = result->timestamp;
-		    tsub(&timediff, &instdata->lasttime);
-		    val = instdata->lastval;
-		    instdata->stocave += val;
-		    instdata->timeave += val*pmtimevalToReal(&timediff);
-		    instdata->lasttime = result->timestamp;
-		    instdata->count++;
-		}
-		instdata->marked = 1;
-		instdata->markcount++;
-	    }
+	    for (j = 0; j < avedata->listsize; j++)
+		markinst(avedata, avedata->instlist[j], &result->timestamp);
 	}
     }
 }
@@ -602,7 +687,7 @@ calcbinning(pmResult *result)
     struct timeval	timediff;
 
     if (result->numpmid == 0)	/* mark record */
-	markrecord(result);
+	markrecord(&parts[0], result);
 
     for (i = 0; i < result->numpmid; i++) {
 	vsp = result->vset[i];
@@ -616,7 +701,6 @@ calcbinning(pmResult *result)
 	if ((hptr = __pmHashSearch(vsp->pmid, &hashlist)) != NULL) {
 	    avedata = (aveData *)hptr->data;
 	    for (j = 0; j < vsp->numval; j++) {	/* iterate thro result values */
-		int	fp_bad;
 		vp = &vsp->vlist[j];
 		k = j;	/* index into stored inst list, result may differ */
 		if ((vsp->numval > 1) || (avedata->desc.indom != PM_INDOM_NULL)) {
@@ -642,15 +726,7 @@ calcbinning(pmResult *result)
 		    pmiderr(avedata->desc.pmid, "failed to extract value: %s\n", pmErrStr(sts));
 		    continue;
 		}
-		fp_bad = 0;
-#ifdef HAVE_FPCLASSIFY
-		fp_bad = fpclassify(av.d) == FP_NAN;
-#else
-#ifdef HAVE_ISNAN
-		fp_bad = isnan(av.d);
-#endif
-#endif
-		if (fp_bad)
+		if (fpbad(av.d))
 		    continue;
 
 		/* reset values from first pass needed in this second pass */
@@ -711,26 +787,194 @@ calcbinning(pmResult *result)
     }
 }
 
+/*
+ * update statistics for one instance with a new value
+ */
 static void
-calcaverage(pmResult *result)
+calcinst(partData *pp,
+	aveData *avedata,
+	instData *instdata,
+	double value,
+	struct timeval *timestamp)
 {
-    int			i, j, k;
-    int			sts;
     int			wrap;
     double		val;
+    double		diff;
+    double		rate = 0;
+    struct timeval	timediff;
+
+    timediff = *timestamp;
+    tsub(&timediff, &instdata->lasttime);
+    diff = pmtimevalToReal(&timediff);
+    wrap = 0;
+    if (avedata->desc.sem == PM_SEM_COUNTER) {
+	diff *= avedata->scale;
+	if (diff == 0.0) return;
+	if (instdata->marked)
+	    val = value;
+	else
+	    val = unwrap(value, instdata->lastval, avedata->desc.type);
+	if (pmDebugOptions.appl0) {
+	    int	numnames;
+	    char	**names;
+	    numnames = pmNameAll(avedata->desc.pmid, &names);
+	    __pmPrintMetricNames(stderr, numnames, names, " or ");
+	    fprintf(stderr, " base value is %f, count %d\n",
+		    val, instdata->count+1);
+	    if (numnames > 0) free(names);
+	}
+	if (instdata->marked || val < instdata->lastval) {
+	    /* either previous record was a "mark", or this is not */
+	    /* the first one, and counter not monotonic increasing */
+	    if (pmDebugOptions.appl1) {
+		int	numnames;
+		char	**names;
+		numnames = pmNameAll(avedata->desc.pmid, &names);
+		__pmPrintMetricNames(stderr, numnames, names, " or ");
+		fprintf(stderr, " counter wrapped or <mark>\n");
+		if (numnames > 0) free(names);
+	    }
+	    wrap = 1;
+	    instdata->marked = 0;
+	    tadd(&instdata->firsttime, timestamp);
+	    tsub(&instdata->firsttime, &instdata->lasttime);
+	}
+	else {
+	    rate = (val - instdata->lastval) / diff;
+	    instdata->stocave += rate;
+	    if (!instdata->marked)
+		instdata->timeave += (val - instdata->lastval);
+	    else {
+		instdata->marked = 0;
+		/* remove the timeslice in question from time-based calc */
+		tadd(&instdata->firsttime, timestamp);
+		tsub(&instdata->firsttime, &instdata->lasttime);
+	    }
+	    if (instdata->count == 0 && pp->part == 0) {	/* 1st time */
+		instdata->min = instdata->max = rate;
+		instdata->sum = (val - instdata->lastval);
+	    }
+	    else {
+		if (instdata->count == 0)	/* 1st rate in this part */
+		    instdata->ratetime = *timestamp;
+		if (pmDebugOptions.appl2) {
+		    int	numnames;
+		    char	**names;
+		    char	*istr = NULL;
+
+		    numnames = pmNameAll(avedata->desc.pmid, &names);
+		    if (pmNameInDom(avedata->desc.indom,
+			instdata->inst, &istr) < 0)
+			istr = NULL;
+		    if (rate < instdata->min) {
+			fprintf(stderr, "new min value for ");
+			__pmPrintMetricNames(stderr, numnames, names, " or ");
+			fprintf(stderr, " (inst[%s]: %f) at ",
+			    (istr == NULL ? "":istr), rate);
+			pmPrintStamp(stderr, timestamp);
+			fprintf(stderr, "\n");
+		    }
+		    if (rate > instdata->max) {
+			fprintf(stderr, "new max value for ");
+			__pmPrintMetricNames(stderr, numnames, names, " or ");
+			fprintf(stderr, " (inst[%s]: %f) at ",
+			    (istr == NULL ? "":istr), rate);
+			pmPrintStamp(stderr, timestamp);
+			fprintf(stderr, "\n");
+		    }
+		    if (numnames > 0) free(names);
+		    if (istr) free(istr);
+		}
+		if (rate < instdata->min) {
+		    instdata->min = rate;
+		    instdata->mintime = *timestamp;
+		}
+		if (rate > instdata->max) {
+		    instdata->max = rate;
+		    instdata->maxtime = *timestamp;
+		}
+		instdata->sum += (val - instdata->lastval);
+	    }
+	}
+    }
+    else {	/* for the other semantics - discrete & instantaneous */
+	val = value;
+	instdata->sum += val;
+	instdata->stocave += val;
+	if (val < instdata->min) {
+	    instdata->min = val;
+	    instdata->mintime = *timestamp;
+	}
+	if (val > instdata->max) {
+	    instdata->max = val;
+	    instdata->maxtime = *timestamp;
+	}
+	if (!instdata->marked)
+	    instdata->timeave += instdata->lastval*diff;
+	else {
+	    instdata->marked = 0;
+	    /* remove the timeslice in question from time-based calc */
+	    tadd(&instdata->firsttime, timestamp);
+	    tsub(&instdata->firsttime, &instdata->lasttime);
+	}
+    }
+    if (!wrap) {
+	instdata->count++;
+	if (pmDebugOptions.appl1 &&
+	    (avedata->desc.sem != PM_SEM_COUNTER || instdata->count > 0)) {
+	    int	numnames;
+	    char	**names;
+	    double	metricspan = 0.0;
+	    struct timeval	metrictimespan;
+
+	    metrictimespan = *timestamp;
+	    tsub(&metrictimespan, &instdata->firsttime);
+	    metricspan = pmtimevalToReal(&metrictimespan);
+	    numnames = pmNameAll(avedata->desc.pmid, &names);
+	    fprintf(stderr, "++ ");
+	    __pmPrintMetricNames(stderr, numnames, names, " or ");
+
+	    if (avedata->desc.sem == PM_SEM_COUNTER) {
+		fprintf(stderr, " timedelta=%f count=%d\n"
+				"sum=%f min=%f max=%f stocsum=%f\n"
+				"rate=%f timesum=%f (+%f) timespan=%f\n",
+			diff, instdata->count, instdata->sum,
+			instdata->min, instdata->max,
+			instdata->stocave, rate, instdata->timeave,
+			diff * (val - instdata->lastval) / 2,
+			metricspan);
+	    }
+	    else {	/* non-counters */
+		fprintf(stderr, " timedelta=%f count=%d\n"
+				"sum=%f min=%f max=%f stocsum=%f\n"
+				"lastval=%f timesum=%f (+%f) timespan=%f\n",
+			diff, instdata->count, instdata->sum,
+			instdata->min, instdata->max,
+			instdata->stocave, instdata->lastval,
+			instdata->timeave, instdata->lastval*diff,
+			metricspan);
+	    }
+	    if (numnames > 0) free(names);
+	}
+    }
+    instdata->lastval = value;
+    instdata->lasttime = *timestamp;
+}
+
+static void
+calcaverage(partData *pp, pmResult *result)
+{
+    int			i, j, k;
+    int			sts;
     pmDesc		desc;
     pmAtomValue 	av;
     pmValue		*vp;
     pmValueSet		*vsp;
     __pmHashNode	*hptr = NULL;
     aveData		*avedata = NULL;
-    instData		*instdata;
-    double		diff;
-    double		rate = 0;
-    struct timeval	timediff;
 
     if (result->numpmid == 0)	/* mark record */
-	markrecord(result);
+	markrecord(pp, result);
 
     for (i = 0; i < result->numpmid; i++) {
 	vsp = result->vset[i];
@@ -742,7 +986,7 @@ calcaverage(pmResult *result)
 	}
 
 	/* check if pmid already in hash list */
-	if ((hptr = __pmHashSearch(vsp->pmid, &hashlist)) == NULL) {
+	if ((hptr = __pmHashSearch(vsp->pmid, pp->hashlist)) == NULL) {
 	    if ((sts = pmLookupDesc(vsp->pmid, &desc)) < 0) {
 		pmiderr(vsp->pmid, "cannot find descriptor: %s\n", pmErrStr(sts));
 		continue;
@@ -756,8 +1000,8 @@ calcaverage(pmResult *result)
 
 	    /* create a new one & add to list */
 	    avedata = (aveData*) malloc(sizeof(aveData));
-	    newHashItem(vsp, &desc, avedata, &result->timestamp);
-	    if (__pmHashAdd(avedata->desc.pmid, (void*)avedata, &hashlist) < 0) {
+	    newHashItem(pp, vsp, &desc, avedata, &result->timestamp);
+	    if (__pmHashAdd(avedata->desc.pmid, (void*)avedata, pp->hashlist) < 0) {
 		pmiderr(avedata->desc.pmid, "failed %s hash table insertion\n", pmGetProgname());
 		/* free memory allocated above on insert failure */
 		for (j = 0; j < vsp->numval; j++)
@@ -769,7 +1013,6 @@ calcaverage(pmResult *result)
 	else {	/* pmid exists - update statistics */
 	    avedata = (aveData*)hptr->data;
 	    for (j = 0; j < vsp->numval; j++) {	/* iterate thro result values */
-		int	fp_bad;
 		vp = &vsp->vlist[j];
 		k = j;	/* index into stored inst list, result may differ */
 		if ((vsp->numval > 1) || (avedata->desc.indom != PM_INDOM_NULL)) {
@@ -781,189 +1024,328 @@ calcaverage(pmResult *result)
 			    }
 			}
 			if (k == avedata->listsize) {	/* no matching inst was found */
-			    newHashInst(vp, avedata, vsp->valfmt, &result->timestamp, k);
+			    newHashInst(pp, vp, avedata, vsp->valfmt, &result->timestamp);
 			    continue;
 			}
 		    }
 		    else if (k >= avedata->listsize) {
 			k = avedata->listsize;
-			newHashInst(vp, avedata, vsp->valfmt, &result->timestamp, k);
+			newHashInst(pp, vp, avedata, vsp->valfmt, &result->timestamp);
 			continue;
 		    }
 		}
-		instdata = avedata->instlist[k];
 
 		if ((sts = pmExtractValue(vsp->valfmt, vp, avedata->desc.type, &av, PM_TYPE_DOUBLE)) < 0) {
 		    pmiderr(avedata->desc.pmid, "failed to extract value: %s\n", pmErrStr(sts));
 		    continue;
 		}
-		fp_bad = 0;
-#ifdef HAVE_FPCLASSIFY
-		fp_bad = fpclassify(av.d) == FP_NAN;
-#else
-#ifdef HAVE_ISNAN
-		fp_bad = isnan(av.d);
-#endif
-#endif
-		if (fp_bad)
+		if (fpbad(av.d))
 		    continue;
-		timediff = result->timestamp;
-		tsub(&timediff, &instdata->lasttime);
-		diff = pmtimevalToReal(&timediff);
-		wrap = 0;
-		if (avedata->desc.sem == PM_SEM_COUNTER) {
-		    diff *= avedata->scale;
-		    if (diff == 0.0) continue;
-		    if (instdata->marked)
-			val = av.d;
-		    else
-			val = unwrap(av.d, instdata->lastval, avedata->desc.type);
-		    if (pmDebugOptions.appl0) {
-			int	numnames;
-			char	**names;
-			numnames = pmNameAll(avedata->desc.pmid, &names);
-			__pmPrintMetricNames(stderr, numnames, names, " or ");
-			fprintf(stderr, " base value is %f, count %d\n",
-				val, instdata->count+1);
-			if (numnames > 0) free(names);
-		    }
-		    if (instdata->marked || val < instdata->lastval) {
-			/* either previous record was a "mark", or this is not */
-			/* the first one, and counter not monotonic increasing */
-			if (pmDebugOptions.appl1) {
-			    int	numnames;
-			    char	**names;
-			    numnames = pmNameAll(avedata->desc.pmid, &names);
-			    __pmPrintMetricNames(stderr, numnames, names, " or ");
-			    fprintf(stderr, " counter wrapped or <mark>\n");
-			    if (numnames > 0) free(names);
-			}
-			wrap = 1;
-			instdata->marked = 0;
-			tadd(&instdata->firsttime, &result->timestamp);
-			tsub(&instdata->firsttime, &instdata->lasttime);
-		    }
-		    else {
-			rate = (val - instdata->lastval) / diff;
-			instdata->stocave += rate;
-			if (!instdata->marked)
-			    instdata->timeave += (val - instdata->lastval);
-			else {
-			    instdata->marked = 0;
-			    /* remove the timeslice in question from time-based calc */
-			    tadd(&instdata->firsttime, &result->timestamp);
-			    tsub(&instdata->firsttime, &instdata->lasttime);
-			}
-			if (instdata->count == 0) {		/* 1st time */
-			    instdata->min = instdata->max = rate;
-			    instdata->sum = (val - instdata->lastval);
-			}
-			else {
-			    if (pmDebugOptions.appl2) {
-				int	numnames;
-				char	**names;
-				char	*istr = NULL;
-
-				numnames = pmNameAll(avedata->desc.pmid, &names);
-				if (pmNameInDom(avedata->desc.indom,
-				    instdata->inst, &istr) < 0)
-				    istr = NULL;
-				if (rate < instdata->min) {
-				    fprintf(stderr, "new min value for ");
-				    __pmPrintMetricNames(stderr, numnames, names, " or ");
-				    fprintf(stderr, " (inst[%s]: %f) at ",
-					(istr == NULL ? "":istr), rate);
-				    pmPrintStamp(stderr, &result->timestamp);
-				    fprintf(stderr, "\n");
-				}
-				if (rate > instdata->max) {
-				    fprintf(stderr, "new max value for ");
-				    __pmPrintMetricNames(stderr, numnames, names, " or ");
-				    fprintf(stderr, " (inst[%s]: %f) at ",
-					(istr == NULL ? "":istr), rate);
-				    pmPrintStamp(stderr, &result->timestamp);
-				    fprintf(stderr, "\n");
-				}
-				if (numnames > 0) free(names);
-				if (istr) free(istr);
-			    }
-			    if (rate < instdata->min) {
-				instdata->min = rate;
-				instdata->mintime = result->timestamp;
-			    }
-			    if (rate > instdata->max) {
-				instdata->max = rate;
-				instdata->maxtime = result->timestamp;
-			    }
-			    instdata->sum += (val - instdata->lastval);
-			}
+		calcinst(pp, avedata, avedata->instlist[k], av.d, &result->timestamp);
+	    }
+	}
+    }
+}
+
+/*
+ * add statistics for one instance from a later part into those for
+ * the archive so far (after its head value has been applied)
+ */
+static void
+mergeinst(aveData *avedata, instData *instdata, instData *pinst)
+{
+    if (pinst->count > 0) {
+	if (avedata->desc.sem == PM_SEM_COUNTER && instdata->count == 0) {
+	    /* as for the 1st rate in calcinst(), times from that unchanged */
+	    instdata->min = pinst->min;
+	    if (pmtimevalSub(&pinst->mintime, &pinst->ratetime) != 0)
+		instdata->mintime = pinst->mintime;
+	    instdata->max = pinst->max;
+	    if (pmtimevalSub(&pinst->maxtime, &pinst->ratetime) != 0)
+		instdata->maxtime = pinst->maxtime;
+	}
+	else {
+	    if (pinst->min < instdata->min) {
+		instdata->min = pinst->min;
+		instdata->mintime = pinst->mintime;
+	    }
+	    if (pinst->max > instdata->max) {
+		instdata->max = pinst->max;
+		instdata->maxtime = pinst->maxtime;
+	    }
+	}
+    }
+    instdata->count += pinst->count;
+    instdata->stocave += pinst->stocave;
+    instdata->timeave += pinst->timeave;
+    instdata->sum += pinst->sum;
+    instdata->markcount += pinst->markcount;
+    /* time slices removed from the time-based calculation in this part */
+    tadd(&instdata->firsttime, &pinst->firsttime);
+    tsub(&instdata->firsttime, &pinst->headtime);
+    instdata->lastval = pinst->lastval;
+    instdata->lasttime = pinst->lasttime;
+    instdata->marked = pinst->marked;
+}
+
+/*
+ * merge the statistics from a later part into hashlist, in the order
+ * a single pass would have seen the values, then free them
+ */
+static void
+mergepart(partData *pp)
+{
+    int			i, j, k, m;
+    __pmHashNode	*hptr;
+    __pmHashNode	*node;
+    aveData		*avedata;
+    aveData		*pavedata;
+    instData		*instdata;
+    instData		*pinst;
+
+    for (i = 0; i < pp->hashlist->hsize; i++) {
+	for (hptr = pp->hashlist->hash[i]; hptr != NULL; hptr = hptr->next) {
+	    pavedata = (aveData *)hptr->data;
+	    if ((node = __pmHashSearch(pavedata->desc.pmid, &hashlist)) != NULL)
+		avedata = (aveData *)node->data;
+	    else {
+		/* first seen in this part */
+		if ((avedata = (aveData *)malloc(sizeof(aveData))) == NULL)
+		    pmNoMem("mergepart.avedata", sizeof(aveData), PM_FATAL_ERR);
+		*avedata = *pavedata;
+		avedata->listsize = 0;
+		avedata->instlist = NULL;
+		if (__pmHashAdd(avedata->desc.pmid, (void *)avedata, &hashlist) < 0)
+		    pmNoMem("mergepart.hashlist", sizeof(__pmHashNode), PM_FATAL_ERR);
+	    }
+	    for (j = 0; j < pavedata->listsize; j++) {
+		pinst = pavedata->instlist[j];
+		k = j;	/* probably in the same order already */
+		if (k >= avedata->listsize || avedata->instlist[k]->inst != pinst->inst) {
+		    for (k = 0; k < avedata->listsize; k++) {
+			if (avedata->instlist[k]->inst == pinst->inst)
+			    break;
 		    }
 		}
-		else {	/* for the other semantics - discrete & instantaneous */
-		    val = av.d;
-		    instdata->sum += val;
-		    instdata->stocave += val;
-		    if (val < instdata->min) {
-			instdata->min = val;
-			instdata->mintime = result->timestamp;
-		    }
-		    if (val > instdata->max) {
-			instdata->max = val;
-			instdata->maxtime = result->timestamp;
-		    }
-		    if (!instdata->marked)
-			instdata->timeave += instdata->lastval*diff;
-		    else {
-			instdata->marked = 0;
-			/* remove the timeslice in question from time-based calc */
-			tadd(&instdata->firsttime, &result->timestamp);
-			tsub(&instdata->firsttime, &instdata->lasttime);
-		    }
+		if (k == avedata->listsize) {
+		    instdata = newInst(&parts[0], avedata, pinst->inst,
+				pinst->headval, &pinst->headtime);
 		}
-		if (!wrap) {
-		    instdata->count++;
-		    if (pmDebugOptions.appl1 &&
-			(avedata->desc.sem != PM_SEM_COUNTER || instdata->count > 0)) {
-			int	numnames;
-			char	**names;
-			double	metricspan = 0.0;
-			struct timeval	metrictimespan;
-
-			metrictimespan = result->timestamp;
-			tsub(&metrictimespan, &instdata->firsttime);
-			metricspan = pmtimevalToReal(&metrictimespan);
-			numnames = pmNameAll(avedata->desc.pmid, &names);
-			fprintf(stderr, "++ ");
-			__pmPrintMetricNames(stderr, numnames, names, " or ");
+		else {
+		    instdata = avedata->instlist[k];
+		    for (m = 0; m < pinst->headmarks; m++)
+			markinst(avedata, instdata, &pp->marks[m]);
+		    if (!fpbad(pinst->headval))
+			calcinst(&parts[0], avedata, instdata,
+				pinst->headval, &pinst->headtime);
+		}
+		mergeinst(avedata, instdata, pinst);
+		instdata->merged = 1;
+		if (pinst->bin)
+		    free(pinst->bin);
+		free(pinst);
+	    }
+	    if (pavedata->instlist)
+		free(pavedata->instlist);
+	    free(pavedata);
+	}
+    }
+    __pmHashClear(pp->hashlist);
 
-			if (avedata->desc.sem == PM_SEM_COUNTER) {
-			    fprintf(stderr, " timedelta=%f count=%d\n"
-					    "sum=%f min=%f max=%f stocsum=%f\n"
-					    "rate=%f timesum=%f (+%f) timespan=%f\n",
-				    diff, instdata->count, instdata->sum,
-				    instdata->min, instdata->max,
-				    instdata->stocave, rate, instdata->timeave,
-				    diff * (val - instdata->lastval) / 2,
-				    metricspan);
-			}
-			else {	/* non-counters */
-			    fprintf(stderr, " timedelta=%f count=%d\n"
-					    "sum=%f min=%f max=%f stocsum=%f\n"
-					    "lastval=%f timesum=%f (+%f) timespan=%f\n",
-				    diff, instdata->count, instdata->sum,
-				    instdata->min, instdata->max,
-				    instdata->stocave, instdata->lastval,
-				    instdata->timeave, instdata->lastval*diff,
-				    metricspan);
-			}
-			if (numnames > 0) free(names);
-		    }
+    /* instances with no values in this part still see its mark records */
+    for (i = 0; i < hashlist.hsize; i++) {
+	for (hptr = hashlist.hash[i]; hptr != NULL; hptr = hptr->next) {
+	    avedata = (aveData *)hptr->data;
+	    for (j = 0; j < avedata->listsize; j++) {
+		instdata = avedata->instlist[j];
+		if (instdata->merged)
+		    instdata->merged = 0;
+		else {
+		    for (m = 0; m < pp->nmarks; m++)
+			markinst(avedata, instdata, &pp->marks[m]);
 		}
-		instdata->lastval = av.d;
-		instdata->lasttime = result->timestamp;
 	    }
 	}
     }
+    if (pp->marks)
+	free(pp->marks);
+    pp->marks = NULL;
+    pp->nmarks = 0;
+}
+
+/*
+ * summarize one part of the time window, the last part from the
+ * current context (so it is left where a single pass would leave it,
+ * for pmNameInDom() in printsummary()), the others each from a new
+ * context
+ */
+static void *
+sumpart(void *arg)
+{
+    partData		*pp = (partData *)arg;
+    pmResult		*result;
+    int			ctx = -1;
+    int			sts;
+
+    if (!pp->last &&
+	(sts = ctx = pmNewContext(PM_CONTEXT_ARCHIVE, archive)) < 0)
+	goto done;
+    if ((sts = pmSetMode(PM_MODE_FORW, &pp->start, 0)) < 0)
+	goto done;
+
+    for ( ; ; ) {
+	if ((sts = pmFetchArchive(&result)) < 0)
+	    break;
+
+	if (pp->part > 0 &&
+	    pmtimevalSub(&result->timestamp, &pp->start) < 0) {
+	    /* before this part */
+	    pmFreeResult(result);
+	    continue;
+	}
+	if (pp->finish.tv_sec > result->timestamp.tv_sec ||
+	    (pp->finish.tv_sec == result->timestamp.tv_sec &&
+	     (pp->finish.tv_usec > result->timestamp.tv_usec ||
+	      (pp->last && pp->finish.tv_usec == result->timestamp.tv_usec)))) {
+	    calcaverage(pp, result);
+	    pmFreeResult(result);
+	}
+	else {
+	    pmFreeResult(result);
+	    sts = PM_ERR_EOL;
+	    break;
+	}
+    }
+
+done:
+    pp->sts = sts;
+    if (ctx >= 0)
+	pmDestroyContext(ctx);
+    return NULL;
+}
+
+/*
+ * a part can start at a temporal index entry only if pmSetMode() then
+ * positions the context at a record with that time, otherwise records
+ * would be missed or read twice
+ */
+static int
+checksplit(struct timeval *tv)
+{
+    pmResult		*result;
+    int			sts;
+
+    if (pmSetMode(PM_MODE_FORW, tv, 0) < 0)
+	return 0;
+    if (pmFetchArchive(&result) < 0)
+	return 0;
+    sts = pmtimevalSub(&result->timestamp, tv) == 0;
+    pmFreeResult(result);
+    return sts;
+}
+
+/*
+ * split the time window into at most n parts, at temporal index entries
+ * of the archive (or at the start of each archive, for a set of them)
+ * spread evenly across the window
+ */
+static void
+splitparts(int n)
+{
+    int			i, j;
+    int			ncand = 0;
+    int			maxcand;
+    struct timeval	*cand = NULL;
+    struct timeval	tv;
+    __pmContext		*ctxp;
+    __pmArchCtl		*acp;
+    __pmLogCtl		*lcp;
+
+    if ((ctxp = __pmHandleToPtr(pmWhichContext())) == NULL)
+	n = 1;
+    else {
+	acp = ctxp->c_archctl;
+	lcp = acp->ac_log;
+	maxcand = acp->ac_num_logs > 1 ? acp->ac_num_logs : lcp->l_numti;
+	if ((cand = (struct timeval *)malloc((maxcand + 1) * sizeof(*cand))) == NULL)
+	    pmNoMem("splitparts", (maxcand + 1) * sizeof(*cand), PM_FATAL_ERR);
+	for (i = 0; i < maxcand; i++) {
+	    if (acp->ac_num_logs > 1) {
+		tv.tv_sec = acp->ac_log_list[i]->ml_starttime.tv_sec;
+		tv.tv_usec = acp->ac_log_list[i]->ml_starttime.tv_usec;
+	    }
+	    else {
+		/*
+		 * pmSetMode() seeks straight to an index entry with the
+		 * same time, so skip entries at the end of a volume
+		 */
+		if (i == maxcand - 1 ||
+		    lcp->l_ti[i+1].ti_vol != lcp->l_ti[i].ti_vol ||
+		    lcp->l_ti[i+1].ti_log <= lcp->l_ti[i].ti_log)
+		    continue;
+		tv.tv_sec = lcp->l_ti[i].ti_stamp.tv_sec;
+		tv.tv_usec = lcp->l_ti[i].ti_stamp.tv_usec;
+	    }
+	    /* strictly increasing, and inside the time window */
+	    if (pmtimevalSub(&tv, &opts.start) <= 0 ||
+		pmtimevalSub(&tv, &opts.finish) >= 0)
+		continue;
+	    if (ncand > 0 && pmtimevalSub(&tv, &cand[ncand-1]) <= 0)
+		continue;
+	    cand[ncand++] = tv;
+	}
+	PM_UNLOCK(ctxp->c_lock);
+	if (n > ncand + 1)
+	    n = ncand + 1;
+	for (i = 1; i < n; i++) {
+	    j = (i * ncand) / n;
+	    if (!checksplit(&cand[j])) {
+		/* drop it and start again */
+		if (pmDebugOptions.appl0) {
+		    fprintf(stderr, "splitparts: cannot split at ");
+		    pmPrintStamp(stderr, &cand[j]);
+		    fputc('\n', stderr);
+		}
+		memmove(&cand[j], &cand[j+1], (ncand - j - 1) * sizeof(*cand));
+		ncand--;
+		if (n > ncand + 1)
+		    n = ncand + 1;
+		i = 0;
+	    }
+	}
+    }
+
+    if ((parts = (partData *)calloc(n, sizeof(partData))) == NULL)
+	pmNoMem("splitparts", n * sizeof(partData), PM_FATAL_ERR);
+    for (i = 0; i < n; i++) {
+	parts[i].part = i;
+	parts[i].start = i == 0 ? opts.start : cand[(i * ncand) / n];
+	if (i == n - 1) {
+	    parts[i].last = 1;
+	    parts[i].finish = opts.finish;
+	}
+	else
+	    parts[i].finish = cand[((i + 1) * ncand) / n];
+	if (i == 0)
+	    parts[i].hashlist = &hashlist;
+	else {
+	    if ((parts[i].hashlist = (__pmHashCtl *)malloc(sizeof(__pmHashCtl))) == NULL)
+		pmNoMem("splitparts.hashlist", sizeof(__pmHashCtl), PM_FATAL_ERR);
+	    __pmHashInit(parts[i].hashlist);
+	}
+    }
+    if (cand != NULL)
+	free(cand);
+    if (pmDebugOptions.appl0 && n > 1) {
+	for (i = 0; i < n; i++) {
+	    fprintf(stderr, "part %d: ", i);
+	    pmPrintStamp(stderr, &parts[i].start);
+	    fprintf(stderr, " - ");
+	    pmPrintStamp(stderr, &parts[i].finish);
+	    fputc('\n', stderr);
+	}
+    }
+    nparts = n;
 }
 
 static int
@@ -977,13 +1359,15 @@ override(int opt, pmOptions *opts)
 int
 main(int argc, char *argv[])
 {
-    int			c, i, sts, trip, exitstatus = 0;
+    int			c, i, sts, exitstatus = 0;
     int			lflag = 0;		/* no label by default */
     int			Hflag = 0;		/* no header by default */
+    int			nworkers = 1;		/* summarize in one pass */
+    pthread_t		*tids = NULL;
+    int			*started = NULL;
     pmResult		*result;
     struct timeval 	timespan = {0, 0};
     char		*endnum;
-    char		*archive;
 
     while ((c = pmGetOptions(argc, argv, &opts)) != EOF) {
 	switch (c) {
@@ -1063,6 +1447,15 @@ main(int argc, char *argv[])
 	    warnflag = 1;
 	    break;
 
+	case 'w':	/* summarize in parts, in parallel */
+	    nworkers = (int)strtol(opts.optarg, &endnum, 10);
+	    if (*endnum != '\0' || nworkers < 1) {
+		pmprintf("%s: -w requires positive numeric argument\n",
+			pmGetProgname());
+		opts.errors++;
+	    }
+	    break;
+
 	case 'x':	/* use only stochastic counter averages */
 	    stocaveflag = 1;
 	    timeaveflag = 0;
@@ -1123,7 +1516,48 @@ main(int argc, char *argv[])
     if (timespan.tv_sec > 86400) /* seconds per day: 60*60*24 */
 	dayflag = 1;
 
-    for (trip = 0; trip < 2; trip++) {	/* two passes if binning */
+    /* PCP_COUNTER_WRAP in environment enables "counter wrap" logic */
+    dowrap = getenv("PCP_COUNTER_WRAP") != NULL;
+
+    splitparts(nworkers);
+    if (nparts > 1) {
+	tids = (pthread_t *)calloc(nparts, sizeof(pthread_t));
+	started = (int *)calloc(nparts, sizeof(int));
+	if (tids == NULL || started == NULL)
+	    pmNoMem("workers", nparts * sizeof(pthread_t), PM_FATAL_ERR);
+	for (i = 0; i < nparts - 1; i++)
+	    started[i] = (pthread_create(&tids[i], NULL, sumpart, &parts[i]) == 0);
+	for (i = 0; i < nparts - 1; i++) {
+	    if (!started[i]) {
+		sumpart(&parts[i]);	/* no thread, do it here */
+		pmUseContext(c);
+	    }
+	}
+    }
+    sumpart(&parts[nparts - 1]);
+    for (i = 0; i < nparts - 1; i++) {
+	if (started[i])
+	    pthread_join(tids[i], NULL);
+    }
+    sts = parts[0].sts;
+    for (i = 1; i < nparts; i++) {
+	if (sts == PM_ERR_EOL)
+	    sts = parts[i].sts;
+	mergepart(&parts[i]);
+    }
+    if (nparts > 1) {
+	free(tids);
+	free(started);
+    }
+
+    if (nbins > 0) {	/* second pass, distribute values into bins */
+	if (pmDebugOptions.appl0)
+	    fprintf(stderr, "resetting for second iteration\n");
+	if ((sts = pmSetMode(PM_MODE_FORW, &opts.start, 0)) < 0) {
+	    fprintf(stderr, "%s: pmSetMode reset failed: %s\n",
+		pmGetProgname(), pmErrStr(sts));
+	    exit(1);
+	}
 	for ( ; ; ) {
 	    if ((sts = pmFetchArchive(&result)) < 0)
 		break;
@@ -1131,10 +1565,7 @@ main(int argc, char *argv[])
 	    if (opts.finish.tv_sec > result->timestamp.tv_sec ||
 		(opts.finish.tv_sec == result->timestamp.tv_sec &&
 		 opts.finish.tv_usec >= result->timestamp.tv_usec)) {
-		if (trip == 0)
-		    calcaverage(result);
-		else
-		    calcbinning(result);
+		calcbinning(result);
 		pmFreeResult(result);
 	    }
 	    else {
@@ -1143,18 +1574,6 @@ main(int argc, char *argv[])
 		break;
 	    }
 	}
-
-	if (trip == 0 && nbins > 0) {	/* distribute values into bins */
-	    if (pmDebugOptions.appl0)
-		fprintf(stderr, "resetting for second iteration\n");
-	    if ((sts = pmSetMode(PM_MODE_FORW, &opts.start, 0)) < 0) {
-		fprintf(stderr, "%s: pmSetMode reset failed: %s\n",
-		    pmGetProgname(), pmErrStr(sts));
-		exit(1);
-	    }
-	}
-	else
-	    break;	/* two passes only when doing binning */
     }
 
     if (sts != PM_ERR_EOL) {
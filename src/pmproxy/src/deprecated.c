@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2012-2018 Red Hat.
+ * Copyright (c) 2012-2018,2026 Red Hat.
  * Copyright (c) 1995-2002 Silicon Graphics, Inc.  All Rights Reserved.
  * 
  * This program is free software; you can redistribute it and/or modify it
@@ -575,12 +575,15 @@ ShutdownPorts(void *arg)
 }
 
 void *
-OpenRequestPorts(const char *path, int maxpending)
+OpenRequestPorts(const char *path, int maxpending, int nworkers)
 {
     ServerInfo	*sp;
     int		sts;
 
     (void)path;
+    if (nworkers > 1)
+	pmNotifyErr(LOG_WARNING, "%d worker loops requested, but this pmproxy "
+			"only supports one - continuing\n", nworkers);
 
     if ((sp = calloc(1, sizeof(ServerInfo))) == NULL)
 	return NULL;
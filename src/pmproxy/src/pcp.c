@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2018 Red Hat.
+ * Copyright (c) 2018,2026 Red Hat.
  * 
  * This library is free software; you can redistribute it and/or modify it
  * under the terms of the GNU Lesser General Public License as published
@@ -21,22 +21,25 @@
 static void
 on_server_close(uv_handle_t *handle)
 {
-    struct client	*client = (struct client *)handle;
+    struct client	*client = (struct client *)handle->data;
 
     if (pmDebugOptions.pdu)
 	fprintf(stderr, "client %p pmcd connection closed\n", client);
+
+    /* the socket handle is finished with only now that it is closed */
+    memset(&client->u.pcp, 0, sizeof(client->u.pcp));
 }
 
 static void
 on_server_write(uv_write_t *writer, int status)
 {
-    struct client	*client = (struct client *)writer->handle;
+    struct client	*client = (struct client *)writer->handle->data;
     stream_write_baton	*request = (stream_write_baton *)writer;
 
     sdsfree(request->buffer[0].base);
     free(request);
 
-    if (status != 0)
+    if (status != 0 && !uv_is_closing((uv_handle_t *)&client->stream))
 	uv_close((uv_handle_t *)&client->stream, on_client_close);
 }
 
@@ -76,11 +79,13 @@ on_server_read(uv_stream_t *stream, ssize_t nread, const uv_buf_t *buf)
 void
 on_pcp_client_close(struct client *client)
 {
-    if (client->u.pcp.connected)
-	uv_close((uv_handle_t *)&client->u.pcp.socket, on_server_close);
     if (client->buffer)
 	sdsfree(client->buffer);
-    memset(&client->u.pcp, 0, sizeof(client->u.pcp));
+    client->buffer = NULL;
+    if (client->u.pcp.connected)
+	uv_close((uv_handle_t *)&client->u.pcp.socket, on_server_close);
+    else
+	memset(&client->u.pcp, 0, sizeof(client->u.pcp));
 }
 
 static void
@@ -95,7 +100,9 @@ on_pcp_client_connect(uv_connect_t *connected, int status)
 			"on_pcp_client_connect", client, status);
 
     if (status != 0) {
-	uv_close((uv_handle_t *)&client->stream, on_client_close);
+	/* the client may have gone already, cancelling the connect */
+	if (!uv_is_closing((uv_handle_t *)&client->stream))
+	    uv_close((uv_handle_t *)&client->stream, on_client_close);
 	return;
     }
 
@@ -113,7 +120,7 @@ on_pcp_client_connect(uv_connect_t *connected, int status)
     if (status != 0) {
 	fprintf(stderr, "%s: server read start failed: %s\n",
 			"on_pcp_client_connect", uv_strerror(status));
-	uv_close((uv_handle_t *)&client->u.pcp.socket, on_client_close);
+	uv_close((uv_handle_t *)&client->stream, on_client_close);
     }
 }
 
@@ -135,6 +142,7 @@ pcp_client_connect_pmcd(struct client *client)
     handle->data = (void *)client;
 
     uv_tcp_init(proxy->events, &client->u.pcp.socket);
+    client->u.pcp.connected = 1;	/* socket handle must now be closed */
     uv_ip4_addr(client->u.pcp.hostname, client->u.pcp.port, &pmcd);
     uv_tcp_connect(&client->u.pcp.pmcd, &client->u.pcp.socket,
 		    (struct sockaddr *)&pmcd, on_pcp_client_connect);
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2012-2018 Red Hat.
+ * Copyright (c) 2012-2018,2026 Red Hat.
  * Copyright (c) 2002 Silicon Graphics, Inc.  All Rights Reserved.
  * 
  * This program is free software; you can redistribute it and/or modify it
@@ -31,6 +31,7 @@ static char	*certdb;		/* certificate DB path (NSS) */
 static char	*dbpassfile;		/* certificate DB password file */
 static char     *cert_nickname;         /* Alternate nickname for server certificate */
 static char	sockpath[MAXPATHLEN];	/* local unix domain socket path */
+static int	nworkers = 1;		/* client event loops (threads), see -w */
 
 #ifdef HAVE_SA_SIGINFO
 static pid_t    killer_pid;
@@ -75,6 +76,7 @@ static pmLongOptions longopts[] = {
     { "certdb", 1, 'C', "PATH", "path to NSS certificate database" },
     { "passfile", 1, 'P', "PATH", "password file for certificate database access" },
     { "", 1, 'L', "BYTES", "maximum size for PDUs from clients [default 65536]" },
+    { "workers", 1, 'w', "N", "number of event loops serving clients [default 1]" },
     PMAPI_OPTIONS_HEADER("Connection options"),
     { "interface", 1, 'i', "ADDR", "accept connections on this IP address" },
     { "port", 1, 'p', "N", "accept connections on this port" },
@@ -86,7 +88,7 @@ static pmLongOptions longopts[] = {
 };
 
 static pmOptions opts = {
-    .short_options = "A:C:D:fi:l:L:M:p:P:s:U:x:?",
+    .short_options = "A:C:D:fi:l:L:M:p:P:s:U:w:x:?",
     .long_options = longopts,
 };
 
@@ -96,6 +98,7 @@ ParseOptions(int argc, char *argv[], int *nports)
     int		c;
     int		sts;
     int		usage = 0;
+    char	*endnum;
 
     while ((c = pmgetopt_r(argc, argv, &opts)) != EOF) {
 	switch (c) {
@@ -174,6 +177,15 @@ ParseOptions(int argc, char *argv[], int *nports)
 	    username = opts.optarg;
 	    break;
 
+	case 'w':	/* number of client event loops */
+	    nworkers = (int)strtol(opts.optarg, &endnum, 10);
+	    if (*endnum != '\0' || nworkers <= 0) {
+		pmprintf("%s: -w requires a positive numeric argument (%s)\n",
+			pmGetProgname(), opts.optarg);
+		opts.errors++;
+	    }
+	    break;
+
 	case 'x':
 	    fatalfile = opts.optarg;
 	    break;
@@ -382,7 +394,7 @@ main(int argc, char *argv[])
     __pmSetSignalHandler(SIGSEGV, SigBad);
 
     /* Open non-blocking request ports for client connections */
-    if ((server = OpenRequestPorts(sockpath, maxpending)) == NULL)
+    if ((server = OpenRequestPorts(sockpath, maxpending, nworkers)) == NULL)
 	DontStart();
 
     if (env_warn & ENV_WARN_PORT)
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2012-2013,2018 Red Hat.
+ * Copyright (c) 2012-2013,2018,2026 Red Hat.
  * Copyright (c) 2002 Silicon Graphics, Inc.  All Rights Reserved.
  * 
  * This program is free software; you can redistribute it and/or modify it
@@ -15,7 +15,7 @@
 #ifndef PMPROXY_H
 #define PMPROXY_H
 
-extern void *OpenRequestPorts(const char *, int);
+extern void *OpenRequestPorts(const char *, int, int);
 extern void DumpRequestPorts(FILE *, void *);
 extern void *GetServerInfo(void);
 extern void MainLoop(void *);
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2018 Red Hat.
+ * Copyright (c) 2018,2026 Red Hat.
  * Copyright (c) 2018 Challa Venkata Naga Prajwal <cvnprajwal at gmail dot com>
  *
  * This library is free software; you can redistribute it and/or modify it
@@ -95,6 +95,10 @@ on_redis_connected(void *arg)
     struct proxy	*proxy = (struct proxy *)arg;
     sds			message;
 
+    /* every worker has its own connections, report the first only */
+    if (proxy->id != 0)
+	return;
+
     message = sdsnew("slots");
     if (redis_protocol)
 	message = sdscat(message, ", command keys");
@@ -121,6 +125,10 @@ setup_redis_modules(struct proxy *proxy)
 			flags, proxylog, on_redis_connected,
 			proxy, proxy->events, proxy);
     }
+
+    /* archive discovery is not per-client work, the first worker does it */
+    if (proxy->id != 0)
+	return;
     redis_discover.module.events = proxy->events;
     redis_discover.module.metrics = proxy->metrics;
     //TODO: pmDiscoverSetup(&redis_discover, proxy);
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2018 Red Hat.
+ * Copyright (c) 2018,2026 Red Hat.
  *
  * This library is free software; you can redistribute it and/or modify it
  * under the terms of the GNU Lesser General Public License as published
@@ -13,6 +13,45 @@
  */
 #include "server.h"
 
+#define PROXY_CLUSTER	4	/* MMV cluster for pmproxy metrics */
+#define WORKER_INDOM	1	/* MMV instance domain of worker loops */
+
+#if defined(UV_VERSION_HEX) && UV_VERSION_HEX >= 0x012700
+#define HAVE_UV_METRICS_IDLE_TIME 1	/* libuv 1.39 onward */
+#endif
+
+static struct {
+    const char		*name;
+    mmv_metric_type_t	type;
+    mmv_metric_sem_t	semantics;
+    pmUnits		units;
+    const char		*shorthelp;
+    const char		*longhelp;
+} metrictab[NUM_METRICS] = {
+    [METRIC_CLIENTS] = { "worker.clients", MMV_TYPE_U32, MMV_SEM_INSTANT,
+	MMV_UNITS(0,0,1,0,0,PM_COUNT_ONE),
+	"clients currently connected to each worker",
+	"Number of client connections currently served by each pmproxy\n"
+	"worker event loop." },
+    [METRIC_ACCEPTS] = { "worker.accepts", MMV_TYPE_U64, MMV_SEM_COUNTER,
+	MMV_UNITS(0,0,1,0,0,PM_COUNT_ONE),
+	"client connections accepted by each worker",
+	"Cumulative count of client connections accepted by each pmproxy\n"
+	"worker event loop." },
+    [METRIC_BYTES_IN] = { "worker.bytes_in", MMV_TYPE_U64, MMV_SEM_COUNTER,
+	MMV_UNITS(1,0,0,PM_SPACE_BYTE,0,0),
+	"bytes received from clients by each worker", NULL },
+    [METRIC_BYTES_OUT] = { "worker.bytes_out", MMV_TYPE_U64, MMV_SEM_COUNTER,
+	MMV_UNITS(1,0,0,PM_SPACE_BYTE,0,0),
+	"bytes sent to clients by each worker", NULL },
+    [METRIC_BUSY] = { "worker.busy", MMV_TYPE_U64, MMV_SEM_COUNTER,
+	MMV_UNITS(0,1,0,0,PM_TIME_USEC,0),
+	"time each worker spent processing events",
+	"Time each pmproxy worker event loop has spent other than waiting\n"
+	"for events, so the rate is the fraction of a CPU used by the worker\n"
+	"(saturated as this nears one).  Zero before libuv 1.39." },
+};
+
 void
 proxylog(pmLogLevel level, sds message, void *arg)
 {
@@ -41,40 +80,123 @@ proxylog(pmLogLevel level, sds message, void *arg)
     pmNotifyErr(priority, "%s%s", state, message);
 }
 
+static void
+server_metrics_init(struct proxy *workers)
+{
+    mmv_registry_t	*registry;
+    int			i, m;
+
+    registry = mmv_stats_registry("pmproxy", PROXY_CLUSTER, MMV_FLAG_PROCESS);
+    if (registry == NULL) {
+	pmNotifyErr(LOG_WARNING, "%s: cannot setup metrics: %s\n",
+			pmGetProgname(), osstrerror());
+	return;
+    }
+    mmv_stats_add_indom(registry, WORKER_INDOM,
+			"pmproxy worker event loops",
+			"Instance domain of pmproxy event loops, one for each thread\n"
+			"serving clients (see the pmproxy -w option).");
+    for (i = 0; i < workers->nworkers; i++)
+	mmv_stats_add_instance(registry, WORKER_INDOM, i, workers[i].name);
+    for (m = 0; m < NUM_METRICS; m++)
+	mmv_stats_add_metric(registry, metrictab[m].name, m,
+			metrictab[m].type, metrictab[m].semantics,
+			metrictab[m].units, WORKER_INDOM,
+			metrictab[m].shorthelp, metrictab[m].longhelp);
+    workers->metrics = registry;
+}
+
+/*
+ * Map the metric values once running as the final user, and find
+ * each worker's values - workers only update their own instance,
+ * so these updates need not be atomic.
+ */
+static void
+server_metrics_start(struct proxy *workers)
+{
+    struct proxy	*proxy;
+    void		*map;
+    int			i, m;
+
+    if (workers->metrics == NULL)
+	return;
+    if ((map = mmv_stats_start(workers->metrics)) == NULL) {
+	pmNotifyErr(LOG_WARNING, "%s: cannot export metrics: %s\n",
+			pmGetProgname(), osstrerror());
+	return;
+    }
+    for (i = 0; i < workers->nworkers; i++) {
+	proxy = &workers[i];
+	proxy->map = map;
+	for (m = 0; m < NUM_METRICS; m++)
+	    proxy->values[m] = mmv_lookup_value_desc(map,
+				metrictab[m].name, proxy->name);
+    }
+}
+
 static struct proxy *
-server_init(int portcount, const char *localpath)
+server_init(int portcount, const char *localpath, int nworkers)
 {
     struct server	*servers;
-    struct proxy	*proxy;
-    int			count;
+    struct proxy	*workers, *proxy;
+    int			count, i;
 
-    if ((proxy = calloc(1, sizeof(struct proxy))) == NULL) {
+    count = portcount + (*localpath ? 1 : 0);
+    if (count == 0) {
+	fprintf(stderr, "%s: no ports or local paths specified\n",
+			pmGetProgname());
+	return NULL;
+    }
+
+    if ((workers = calloc(nworkers, sizeof(struct proxy))) == NULL) {
 	fprintf(stderr, "%s: out-of-memory in proxy server setup\n",
 			pmGetProgname());
 	return NULL;
     }
 
-    count = portcount + (*localpath ? 1 : 0);
-    if (count) {
+    for (i = 0; i < nworkers; i++) {
+	proxy = &workers[i];
+	proxy->id = i;
+	proxy->nworkers = nworkers;
+	pmsprintf(proxy->name, sizeof(proxy->name), "worker%d", i);
+
 	/* allocate space for maximum listen port data structures */
 	if ((servers = calloc(count, sizeof(struct server))) == NULL) {
 	    fprintf(stderr, "%s: out-of-memory allocating for %d ports\n",
 			    pmGetProgname(), count);
-	    free(proxy);
-	    return NULL;
+	    goto fail;
 	}
 	proxy->servers = servers;
-    } else {
-	fprintf(stderr, "%s: no ports or local paths specified\n",
-			pmGetProgname());
-	free(proxy);
-	return NULL;
+
+	proxy->redishost = sdsnew("localhost:6379");	/* TODO: config file */
+	if (i == 0)
+	    proxy->events = uv_default_loop();
+	else if ((proxy->events = malloc(sizeof(uv_loop_t))) == NULL) {
+	    fprintf(stderr, "%s: out-of-memory allocating worker %d\n",
+			    pmGetProgname(), i);
+	    goto fail;
+	}
+	uv_loop_init(proxy->events);
+#ifdef HAVE_UV_METRICS_IDLE_TIME
+	uv_loop_configure(proxy->events, UV_METRICS_IDLE_TIME);
+#endif
     }
 
-    proxy->redishost = sdsnew("localhost:6379");	/* TODO: config file */
-    proxy->events = uv_default_loop();
-    uv_loop_init(proxy->events);
-    return proxy;
+    server_metrics_init(workers);
+    return workers;
+
+fail:
+    for (i = 0; i < nworkers; i++) {
+	proxy = &workers[i];
+	if (proxy->events && i > 0)
+	    free(proxy->events);
+	if (proxy->redishost)
+	    sdsfree(proxy->redishost);
+	if (proxy->servers)
+	    free(proxy->servers);
+    }
+    free(workers);
+    return NULL;
 }
 
 void
@@ -94,10 +216,16 @@ void
 on_client_close(uv_handle_t *handle)
 {
     struct client	*client = (struct client *)handle;
+    struct proxy	*proxy;
 
     if (pmDebugOptions.desperate)
 	fprintf(stderr, "client %p connection closed\n", client);
 
+    if ((proxy = client->proxy) != NULL) {
+	proxy->nclients--;
+	mmv_set_value(proxy->map, proxy->values[METRIC_CLIENTS], proxy->nclients);
+    }
+
     switch (client->protocol) {
     case STREAM_PCP:
 	on_pcp_client_close(client);
@@ -110,7 +238,6 @@ on_client_close(uv_handle_t *handle)
     }
 
 #if 0
-    struct proxy	*proxy = (struct proxy *)handle->data;
     struct client	*tmp;
     /* remove client from the doubly-linked list */
     tmp = client->prev;
@@ -152,6 +279,10 @@ client_write(struct client *client, sds buffer, sds suffix)
 	request->buffer[nbuffers++] = uv_buf_init(buffer, sdslen(buffer));
 	if (suffix != NULL)
 	    request->buffer[nbuffers++] = uv_buf_init(suffix, sdslen(suffix));
+	if (client->proxy)
+	    mmv_inc_value(client->proxy->map,
+			client->proxy->values[METRIC_BYTES_OUT],
+			sdslen(buffer) + (suffix ? sdslen(suffix) : 0));
 	uv_write(&request->writer, (uv_stream_t *)&client->stream,
 		 request->buffer, nbuffers, on_client_write);
     } else {
@@ -190,6 +321,7 @@ on_client_read(uv_stream_t *stream, ssize_t nread, const uv_buf_t *buf)
     struct client	*client = (struct client *)stream;
 
     if (nread > 0) {
+	mmv_inc_value(proxy->map, proxy->values[METRIC_BYTES_IN], nread);
 	if (client->protocol == STREAM_UNKNOWN)
 	    client->protocol = client_protocol(*buf->base);
 	switch (client->protocol) {
@@ -268,14 +400,46 @@ on_client_connection(uv_stream_t *stream, int status)
 	proxy->head = proxy->tail = client;
     }
     client->proxy = proxy;
+    proxy->nclients++;
+    mmv_set_value(proxy->map, proxy->values[METRIC_CLIENTS], proxy->nclients);
+    mmv_inc_value(proxy->map, proxy->values[METRIC_ACCEPTS], 1);
 
     status = uv_read_start((uv_stream_t *)&client->stream.u.tcp,
 			    on_buffer_alloc, on_client_read);
     if (status != 0) {
 	fprintf(stderr, "%s: client read start failed: %s\n",
 			pmGetProgname(), uv_strerror(status));
-	uv_close((uv_handle_t *)stream, on_client_close);
+	uv_close(handle, on_client_close);
+    }
+}
+
+/*
+ * With several workers, each listens on a socket of its own bound to
+ * the same address (SO_REUSEPORT) and the kernel spreads new client
+ * connections across them.
+ */
+static int
+InitRequestPort(struct proxy *proxy, struct stream *stream,
+		const struct sockaddr *addr)
+{
+#ifdef SO_REUSEPORT
+    int			fd, sts, on = 1;
+
+    if (proxy->nworkers > 1) {
+	if ((fd = socket(addr->sa_family, SOCK_STREAM, 0)) < 0)
+	    return -oserror();
+	if (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) < 0) {
+	    sts = -oserror();
+	    close(fd);
+	    return sts;
+	}
+	uv_tcp_init(proxy->events, &stream->u.tcp);
+	if ((sts = uv_tcp_open(&stream->u.tcp, fd)) != 0)
+	    close(fd);
+	return sts;
     }
+#endif
+    return uv_tcp_init(proxy->events, &stream->u.tcp);
 }
 
 static int
@@ -291,11 +455,19 @@ OpenRequestPort(struct proxy *proxy, struct server *server, stream_family family
 	flags = UV_TCP_IPV6ONLY;
     stream->port = port;
 
-    uv_tcp_init(proxy->events, &stream->u.tcp);
+    if ((sts = InitRequestPort(proxy, stream, addr)) != 0) {
+	fprintf(stderr, "%s: socket setup error %s\n",
+			pmGetProgname(), uv_strerror(sts));
+	return -ENOTCONN;
+    }
     handle = (uv_handle_t *)&stream->u.tcp;
     handle->data = (void *)proxy;
 
-    uv_tcp_bind(&stream->u.tcp, addr, flags);
+    if ((sts = uv_tcp_bind(&stream->u.tcp, addr, flags)) != 0) {
+	fprintf(stderr, "%s: socket bind error %s\n",
+			pmGetProgname(), uv_strerror(sts));
+	return -ENOTCONN;
+    }
     uv_tcp_nodelay(&stream->u.tcp, 1);
     uv_tcp_keepalive(&stream->u.tcp, 1, 50);	/* TODO: config file */
 
@@ -306,7 +478,7 @@ OpenRequestPort(struct proxy *proxy, struct server *server, stream_family family
 	return -ENOTCONN;
     }
     stream->active = 1;
-    if (__pmServerHasFeature(PM_SERVER_FEATURE_DISCOVERY))
+    if (proxy->id == 0 && __pmServerHasFeature(PM_SERVER_FEATURE_DISCOVERY))
 	server->presence = __pmServerAdvertisePresence(PM_SERVER_PROXY_SPEC, port);
     return 0;
 }
@@ -339,6 +511,61 @@ OpenRequestLocal(struct proxy *proxy, struct server *server,
     return 0;
 }
 
+/*
+ * Listen on a duplicate of the first worker's socket for this port.
+ * This is used for the local socket, and for all sockets without
+ * SO_REUSEPORT - each worker polls the one socket, and whichever
+ * wakes first accepts the connection (libuv ignores the EAGAIN that
+ * the others then see).
+ */
+static int
+ShareRequestPort(struct proxy *proxy, struct server *server,
+		struct server *first, int maxpending)
+{
+    struct stream	*stream = &server->stream;
+    uv_handle_t		*handle;
+    uv_os_fd_t		uv_fd;
+    int			sts, fd;
+
+    stream->family = first->stream.family;
+    stream->port = first->stream.port;
+    stream->address = first->stream.address;
+    if (first->stream.active == 0)
+	return -ENOTCONN;
+
+    if ((sts = uv_fileno((uv_handle_t *)&first->stream, &uv_fd)) < 0)
+	fd = sts;
+    else if ((fd = dup((int)uv_fd)) < 0)
+	fd = -oserror();
+    if (fd < 0) {
+	fprintf(stderr, "%s: shared socket error %s\n",
+			pmGetProgname(), uv_strerror(fd));
+	return -ENOTCONN;
+    }
+
+    if (stream->family == STREAM_LOCAL) {
+	uv_pipe_init(proxy->events, &stream->u.local, 0);
+	sts = uv_pipe_open(&stream->u.local, fd);
+    } else {
+	uv_tcp_init(proxy->events, &stream->u.tcp);
+	sts = uv_tcp_open(&stream->u.tcp, fd);
+    }
+    if (sts != 0)
+	close(fd);
+    handle = (uv_handle_t *)&stream->u;
+    handle->data = (void *)proxy;
+
+    if (sts == 0)
+	sts = uv_listen((uv_stream_t *)&stream->u, maxpending, on_client_connection);
+    if (sts != 0) {
+	fprintf(stderr, "%s: shared socket listen error %s\n",
+			pmGetProgname(), uv_strerror(sts));
+	return -ENOTCONN;
+    }
+    stream->active = 1;
+    return 0;
+}
+
 typedef struct proxyaddr {
     __pmSockAddr	*addr;
     const char		*address;
@@ -346,9 +573,9 @@ typedef struct proxyaddr {
 } proxyaddr;
 
 void *
-OpenRequestPorts(const char *localpath, int maxpending)
+OpenRequestPorts(const char *localpath, int maxpending, int nworkers)
 {
-    int			inaddr, total, count, port, sts, i, n;
+    int			inaddr, total, count, port, sts, i, n, w;
     int			with_ipv6 = strcmp(pmGetAPIConfig("ipv6"), "true") == 0;
     const char		*address;
     __pmSockAddr	*addr;
@@ -356,7 +583,7 @@ OpenRequestPorts(const char *localpath, int maxpending)
     const struct sockaddr *sockaddr;
     stream_family	family;
     struct server	*server;
-    struct proxy	*proxy;
+    struct proxy	*workers, *proxy;
 
     if ((sts = total = __pmServerSetupRequestPorts()) < 0)
 	return NULL;
@@ -405,71 +632,150 @@ OpenRequestPorts(const char *localpath, int maxpending)
     }
     total = n;
 
-    if ((proxy = server_init(total, localpath)) == NULL)
+    if ((workers = server_init(total, localpath, nworkers)) == NULL)
 	goto fail;
 
-    count = n = 0;
-    if (*localpath) {
-	server = &proxy->servers[n++];
-	server->stream.address = localpath;
-	if (OpenRequestLocal(proxy, server, localpath, maxpending) == 0)
-	    count++;
-    }
+    /* every worker listens on each port, servers[] indices match */
+    for (w = 0; w < nworkers; w++) {
+	proxy = &workers[w];
+	count = n = 0;
+	if (*localpath) {
+	    server = &proxy->servers[n];
+	    server->stream.address = localpath;
+	    if (w == 0)
+		sts = OpenRequestLocal(proxy, server, localpath, maxpending);
+	    else
+		sts = ShareRequestPort(proxy, server, &workers->servers[n], maxpending);
+	    if (sts == 0)
+		count++;
+	    n++;
+	}
 
-    for (i = 0; i < total; i++) {
-	sockaddr = (const struct sockaddr *)addrlist[i].addr;
-	family = __pmSockAddrGetFamily(addrlist[i].addr) == AF_INET ?
+	for (i = 0; i < total; i++) {
+	    sockaddr = (const struct sockaddr *)addrlist[i].addr;
+	    family = __pmSockAddrGetFamily(addrlist[i].addr) == AF_INET ?
 					STREAM_TCP4 : STREAM_TCP6;
-	server = &proxy->servers[n++];
-	server->stream.address = addrlist[i].address;
-	if (OpenRequestPort(proxy, server, family, sockaddr, port, maxpending) == 0)
-	    count++;
-	__pmSockAddrFree(addrlist[i].addr);
-    }
-    free(addrlist);
+	    server = &proxy->servers[n];
+	    server->stream.address = addrlist[i].address;
+#ifdef SO_REUSEPORT
+	    sts = OpenRequestPort(proxy, server, family, sockaddr,
+				port, maxpending);
+#else
+	    if (w == 0)
+		sts = OpenRequestPort(proxy, server, family, sockaddr,
+				port, maxpending);
+	    else
+		sts = ShareRequestPort(proxy, server, &workers->servers[n],
+				maxpending);
+#endif
+	    if (sts == 0)
+		count++;
+	    n++;
+	}
 
-    if (count == 0) {
-	pmNotifyErr(LOG_ERR, "%s: can't open any request ports, exiting\n",
-		pmGetProgname());
-	free(proxy);
-	return NULL;
+	if (count == 0) {
+	    pmNotifyErr(LOG_ERR, "%s: can't open any request ports, exiting\n",
+		    pmGetProgname());
+	    goto fail;
+	}
+	proxy->nservers = n;
     }
-    proxy->nservers = count;
-    return proxy;
+
+    for (i = 0; i < total; i++)
+	__pmSockAddrFree(addrlist[i].addr);
+    free(addrlist);
+    return workers;
 
 fail:
-    for (i = 0; i < n; i++)
+    for (i = 0; i < total; i++)
 	__pmSockAddrFree(addrlist[i].addr);
     free(addrlist);
     return NULL;
 }
 
-extern void
-ShutdownPorts(void *arg)
+/*
+ * Close all of a worker's handles - its listening sockets, clients,
+ * Redis connections and timers - so that its loop can finish and be
+ * closed.  This is called on the thread running the worker loop, or
+ * if that loop is not running, from the thread shutting down.
+ */
+static void
+worker_close(struct proxy *proxy)
 {
-    struct proxy	*proxy = (struct proxy *)arg;
     struct server	*server;
     struct stream	*stream;
+    struct client	*client;
     int			i;
 
     for (i = 0; i < proxy->nservers; i++) {
-	server = &proxy->servers[i++];
+	server = &proxy->servers[i];
 	stream = &server->stream;
 	if (stream->active == 0)
 	    continue;
-	uv_close((uv_handle_t *)&stream, NULL);
-	if (server->presence)
+	uv_close((uv_handle_t *)stream, NULL);
+	stream->active = 0;
+	if (server->presence) {
 	    __pmServerUnadvertisePresence(server->presence);
+	    server->presence = NULL;
+	}
+    }
+
+    for (client = proxy->head; client != NULL; client = client->next) {
+	if (!uv_is_closing((uv_handle_t *)&client->stream))
+	    uv_close((uv_handle_t *)&client->stream, on_client_close);
     }
-    proxy->nservers = 0;
-    free(proxy->servers);
-    proxy->servers = NULL;
 
     if (proxy->slots) {
 	redisSlotsFree(proxy->slots);
 	proxy->slots = NULL;
     }
-    sdsfree(proxy->redishost);
+
+    if (proxy->start == 0)	/* no handles setup by MainLoop */
+	return;
+    if (!uv_is_closing((uv_handle_t *)&proxy->attempt))
+	uv_close((uv_handle_t *)&proxy->attempt, NULL);
+#ifdef HAVE_UV_METRICS_IDLE_TIME
+    uv_close((uv_handle_t *)&proxy->prepare, NULL);
+#endif
+    if (proxy->id != 0)
+	uv_close((uv_handle_t *)&proxy->stop, NULL);
+}
+
+extern void
+ShutdownPorts(void *arg)
+{
+    struct proxy	*workers = (struct proxy *)arg;
+    struct proxy	*proxy;
+    int			w;
+
+    for (w = 0; w < workers->nworkers; w++) {
+	proxy = &workers[w];
+	if (proxy->id != 0 && proxy->running) {
+	    /* the worker closes its own handles then its loop finishes */
+	    uv_async_send(&proxy->stop);
+	    uv_thread_join(&proxy->thread);
+	    proxy->running = 0;
+	} else {
+	    /* loop is not running, close handles and run their callbacks */
+	    worker_close(proxy);
+	    uv_run(proxy->events, UV_RUN_NOWAIT);
+	}
+	if (uv_loop_close(proxy->events) == 0 && proxy->id != 0)
+	    free(proxy->events);
+	proxy->events = NULL;
+
+	proxy->nservers = 0;
+	free(proxy->servers);
+	proxy->servers = NULL;
+	sdsfree(proxy->redishost);
+	proxy->redishost = NULL;
+	proxy->map = NULL;
+    }
+
+    if (workers->metrics) {
+	mmv_stats_free(workers->metrics);
+	workers->metrics = NULL;
+    }
 }
 
 void
@@ -497,8 +803,13 @@ DumpRequestPorts(FILE *output, void *arg)
 		    stream->family == STREAM_TCP4 ? "inet" : "ipv6",
 		    stream->address ? stream->address : "INADDR_ANY");
     }
+    if (proxy->nworkers > 1)
+	fprintf(output, "%s: %d worker event loops share these ports\n",
+		pmGetProgname(), proxy->nworkers);
 }
 
+static void start_workers(struct proxy *);
+
 /*
  * Attempt to establish a Redis connection straight away;
  * this is achieved via a timer that expires immediately.
@@ -513,19 +824,103 @@ setup_proxy(uv_timer_t *arg)
 
     setup_redis_modules(proxy);
     setup_pcp_modules(proxy);
+
+    /*
+     * Any one-time library setup (e.g. the libpcp_web string maps) has
+     * now been done by the first worker, in this thread - only now are
+     * the other worker threads started.
+     */
+    if (proxy->id == 0)
+	start_workers(proxy);
+}
+
+#ifdef HAVE_UV_METRICS_IDLE_TIME
+/*
+ * Runs just before each wait for new events, and updates the time
+ * the loop has spent busy (running, and not waiting in the kernel).
+ */
+static void
+on_worker_prepare(uv_prepare_t *arg)
+{
+    uv_handle_t		*handle = (uv_handle_t *)arg;
+    struct proxy	*proxy = (struct proxy *)handle->data;
+    __uint64_t		busy;
+
+    busy = uv_hrtime() - proxy->start - uv_metrics_idle_time(proxy->events);
+    mmv_set_value(proxy->map, proxy->values[METRIC_BUSY], busy / 1000);
+}
+#endif
+
+static void
+on_worker_stop(uv_async_t *arg)
+{
+    uv_handle_t		*handle = (uv_handle_t *)arg;
+
+    worker_close((struct proxy *)handle->data);
+}
+
+static void
+worker_loop(void *arg)
+{
+    struct proxy	*proxy = (struct proxy *)arg;
+
+    /* runs until on_worker_stop has closed every handle */
+    uv_run(proxy->events, UV_RUN_DEFAULT);
+}
+
+static void
+start_workers(struct proxy *workers)
+{
+    struct proxy	*proxy;
+    int			i, sts;
+
+    for (i = 1; i < workers->nworkers; i++) {
+	proxy = &workers[i];
+	if ((sts = uv_thread_create(&proxy->thread, worker_loop, proxy)) != 0) {
+	    pmNotifyErr(LOG_ERR, "%s: cannot start worker %d: %s\n",
+			pmGetProgname(), i, uv_strerror(sts));
+	    /* unserved sockets would leave new clients hanging */
+	    exit(1);
+	}
+	proxy->running = 1;
+    }
 }
 
 void
 MainLoop(void *arg)
 {
-    struct proxy	*proxy = (struct proxy *)arg;
-    uv_timer_t		attempt;
+    struct proxy	*workers = (struct proxy *)arg;
+    struct proxy	*proxy;
     uv_handle_t		*handle;
+    int			i;
 
-    uv_timer_init(proxy->events, &attempt);
-    handle = (uv_handle_t *)&attempt;
-    handle->data = (void *)proxy;
-    uv_timer_start(&attempt, setup_proxy, 0, 0);
+    server_metrics_start(workers);
 
-    uv_run(proxy->events, UV_RUN_DEFAULT);
+    for (i = 0; i < workers->nworkers; i++) {
+	proxy = &workers[i];
+	proxy->start = uv_hrtime();
+
+	uv_timer_init(proxy->events, &proxy->attempt);
+	handle = (uv_handle_t *)&proxy->attempt;
+	handle->data = (void *)proxy;
+	uv_timer_start(&proxy->attempt, setup_proxy, 0, 0);
+
+#ifdef HAVE_UV_METRICS_IDLE_TIME
+	uv_prepare_init(proxy->events, &proxy->prepare);
+	handle = (uv_handle_t *)&proxy->prepare;
+	handle->data = (void *)proxy;
+	uv_prepare_start(&proxy->prepare, on_worker_prepare);
+	uv_unref(handle);
+#endif
+
+	if (i == 0)	/* the first worker runs below, in this thread */
+	    continue;
+
+	uv_async_init(proxy->events, &proxy->stop, on_worker_stop);
+	handle = (uv_handle_t *)&proxy->stop;
+	handle->data = (void *)proxy;
+    }
+
+    /* worker threads are started once this loop has run setup_proxy */
+    uv_run(workers->events, UV_RUN_DEFAULT);
 }
@@ -1,5 +1,5 @@
 /*
- * Copyright (c) 2018 Red Hat.
+ * Copyright (c) 2018,2026 Red Hat.
  *
  * This library is free software; you can redistribute it and/or modify it
  * under the terms of the GNU Lesser General Public License as published
@@ -87,6 +87,21 @@ typedef struct server {
     __pmServerPresence	*presence;
 } server;
 
+typedef enum proxy_metric {
+    METRIC_CLIENTS	= 0,
+    METRIC_ACCEPTS,
+    METRIC_BYTES_IN,
+    METRIC_BYTES_OUT,
+    METRIC_BUSY,
+    NUM_METRICS
+} proxy_metric;
+
+/*
+ * One of these for each worker event loop - each worker listens on
+ * all request ports, and owns the client connections it accepts and
+ * the pmcd and Redis connections made on behalf of those clients.
+ * Worker zero runs in the main thread on the default loop.
+ */
 typedef struct proxy {
     struct client	*head;		/* doubly linked list of clients */
     struct client	*tail;
@@ -97,6 +112,18 @@ typedef struct proxy {
     mmv_registry_t	*metrics;
     uv_loop_t		*events;
     redisSlots		*slots;
+    int			id;		/* worker number, zero is the main loop */
+    int			nworkers;	/* count of entries in workers array */
+    char		name[16];	/* worker instance name for metrics */
+    uv_thread_t		thread;		/* thread running a non-zero worker */
+    int			running;	/* thread started, not yet joined */
+    uv_async_t		stop;		/* request a worker loop to finish */
+    uv_prepare_t	prepare;	/* worker busy time accounting */
+    uv_timer_t		attempt;	/* initial Redis connection attempt */
+    __uint64_t		start;		/* loop start time (uv_hrtime) */
+    unsigned int	nclients;	/* currently connected clients */
+    void		*map;		/* memory mapped metric values */
+    pmAtomValue		*values[NUM_METRICS];	/* this worker's values */
 } proxy;
 
 extern void on_client_close(uv_handle_t *);
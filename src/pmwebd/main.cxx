@@ -1,7 +1,7 @@
 /*
  * JSON web bridge for PMAPI.
  *
- * Copyright (c) 2011-2017 Red Hat.
+ * Copyright (c) 2011-2017,2026 Red Hat.
  *
  * This program is free software; you can redistribute it and/or modify it
  * under the terms of the GNU General Public License as published by the
@@ -41,6 +41,8 @@ static __pmServerPresence *presence;
 unsigned multithread = 0;       /* set by -M option */
 unsigned graphite_timestep = 60;  /* set by -i option */
 unsigned graphite_hostcache = 0; /* set by -J option */
+unsigned graphite_contexts = 64; /* set by -F option */
+string graphite_rollupdir;	/* set by -r option */
 string logfile = "";		/* set by -l option */
 string fatalfile = "/dev/tty";	/* fatal messages at startup go here */
 
@@ -390,6 +392,11 @@ server_dump_configuration ()
     clog << "\tGraphite API " << (graphite_p ? "enabled" : "disabled") << endl;
     clog << "\tGraphite API name encoding " << (graphite_encode ? "long" : "short") << endl;
     clog << "\tGraphite API metric naming " << (graphite_hostcache ? "hostname-based" : "file-based") << endl;
+    clog << "\tGraphite API archive context pool size " << graphite_contexts << endl;
+    if (graphite_rollupdir != "")
+        clog << "\tGraphite API rollups under " << graphite_rollupdir << endl;
+    else
+        clog << "\tGraphite API rollups disabled" << endl;
     clog << "\tGraphite API Cairo graphics rendering "
 #ifdef HAVE_CAIRO
          << "compiled-in"
@@ -489,6 +496,8 @@ longopts[] = {
     {"graphite-timestamp", 1, 'i', "SEC", "minimum graphite timestep (s) [default 60]"},
     {"graphite-archivedir", 0, 'I', 0, "prefer archive directories [default OFF]"},
     {"graphite-host", 0, 'J', 0, "prefer hostname as metric component [default OFF]"},
+    {"graphite-contexts", 1, 'F', "NUM", "archive contexts kept open between requests [default 64]"},
+    {"graphite-rollups", 1, 'r', "DIR", "keep archive rollups for long time ranges in dir [default OFF]"},
     PMAPI_OPTIONS_HEADER ("Context options"),
     {"timeout", 1, 't', "SEC", "max time (seconds) for PMAPI polling [default 300]"},
     {"context", 1, 'c', "NUM", "set next permanent-binding context number"},
@@ -543,7 +552,7 @@ main (int argc, char *argv[])
     pmGetUsername (&username_str);
     __pmServerSetFeature (PM_SERVER_FEATURE_DISCOVERY);
 
-    opts.short_options = "A:a:c:CD:h:Ll:NM:Pp:R:GJi:It:U:vx:d:SX46?";
+    opts.short_options = "A:a:c:CD:F:h:Ll:NM:Pp:R:r:GJi:It:U:vx:d:SX46?";
     opts.long_options = longopts;
     opts.override = option_overrides;
 
@@ -598,6 +607,18 @@ main (int argc, char *argv[])
             graphite_hostcache = 1;
             break;
 
+        case 'F':
+            graphite_contexts = strtoul (opts.optarg, &endptr, 0);
+            if (*endptr != '\0') {
+                pmprintf ("%s: invalid context pool size %s\n", pmGetProgname(), opts.optarg);
+                opts.errors++;
+            }
+            break;
+
+        case 'r':
+            graphite_rollupdir = opts.optarg;
+            break;
+
         case 'A':
             archivesdir = opts.optarg;
             break;
@@ -1,7 +1,7 @@
 /*
  * PMWEBD graphite-api emulation
  *
- * Copyright (c) 2014-2018 Red Hat Inc.
+ * Copyright (c) 2014-2018,2026 Red Hat Inc.
  *
  * This program is free software; you can redistribute it and/or modify it
  * under the terms of the GNU General Public License as published by the
@@ -349,6 +349,279 @@ typedef multimap<string,archivecache_entry*> ac_by_ap_t;
 ac_by_ap_t archivecache_by_archivepart;
 
 
+// A render request over many archives would otherwise pmNewContext
+// each one (rereading its whole .index and .meta) and look up all the
+// metric and instance names again, once per request.  So we keep a
+// bounded pool of open archive contexts, keyed by the same filename as
+// the archivecache, along with what was resolved from each.  A context
+// is used by one fetch thread at a time; it is checked out of the pool
+// for the duration of a pmgraphite_fetch_series job, then checked back
+// in.  The archivecache refresh drops a pooled context whenever it sees
+// its archive change or disappear, so the next request reopens it.
+
+struct archivepool_metric {
+    int sts; // pmLookupName result, 1 if found
+    pmID pmid;
+    int desc_sts; // pmLookupDesc result
+    pmDesc desc;
+};
+
+struct archivepool_entry {
+    string filename;
+    int ctx;
+    pmLogLabel label;
+    bool busy; // checked out by a fetch thread
+    bool stale; // invalidated while busy; destroy at checkin
+    unsigned long last_use; // for LRU eviction
+    unsigned long name_hits, name_misses; // since checkout
+    map<string,archivepool_metric> metrics; // metric name -> pmid/desc
+    map<pair<pmInDom,string>,int> instances; // (indom,instance name) -> inst
+};
+
+typedef map<string,archivepool_entry*> ap_by_fn_t;
+static ap_by_fn_t archivepool;
+static unsigned long archivepool_clock;
+#ifdef HAVE_PTHREAD_H
+static pthread_mutex_t archivepool_lock = PTHREAD_MUTEX_INITIALIZER; // protects all the above
+#endif
+
+// statistics, also protected by archivepool_lock
+static unsigned long archivepool_hits;
+static unsigned long archivepool_misses;
+static unsigned long archivepool_busy; // misses because another thread had it
+static unsigned long archivepool_evictions;
+static unsigned long archivepool_invalidations;
+static unsigned long archivepool_name_hits;
+static unsigned long archivepool_name_misses;
+
+
+static void
+ap_destroy (archivepool_entry *p)
+{
+    if (p->ctx >= 0)
+        pmDestroyContext (p->ctx);
+    delete p;
+}
+
+
+// Return an open archive context for the given archive file, made
+// current for this thread, or 0 on error.  A context that is not in
+// the pool (pool disabled, or the pooled one is busy) is private to
+// the caller, and is destroyed at ap_checkin.
+static archivepool_entry *
+ap_checkout (const string& filename, int& sts)
+{
+    archivepool_entry *p = 0;
+
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_lock (& archivepool_lock);
+#endif
+    ap_by_fn_t::iterator it = archivepool.find (filename);
+    if (it != archivepool.end () && ! it->second->busy) {
+        p = it->second;
+        p->busy = true;
+        archivepool_hits ++;
+    } else {
+        archivepool_misses ++;
+        if (it != archivepool.end ())
+            archivepool_busy ++;
+    }
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_unlock (& archivepool_lock);
+#endif
+
+    if (p) {
+        sts = pmUseContext (p->ctx);
+        if (sts >= 0)
+            return p;
+        // should not happen; forget it and open another
+#ifdef HAVE_PTHREAD_H
+        pthread_mutex_lock (& archivepool_lock);
+#endif
+        archivepool.erase (filename);
+#ifdef HAVE_PTHREAD_H
+        pthread_mutex_unlock (& archivepool_lock);
+#endif
+        ap_destroy (p);
+    }
+
+    // Open the bad boy, outside the lock.
+    p = new archivepool_entry;
+    p->filename = filename;
+    p->busy = true;
+    p->stale = false;
+    p->last_use = 0;
+    p->name_hits = p->name_misses = 0;
+    p->ctx = sts = pmNewContext (PM_CONTEXT_ARCHIVE, filename.c_str ());
+    if (sts < 0) {
+        delete p;
+        return 0;
+    }
+    sts = pmGetArchiveLabel (& p->label);
+    if (sts < 0) {
+        ap_destroy (p);
+        return 0;
+    }
+
+    if (graphite_contexts > 0) {
+#ifdef HAVE_PTHREAD_H
+        pthread_mutex_lock (& archivepool_lock);
+#endif
+        // a pooled context stays pooled; ours is then private to this job
+        if (archivepool.find (filename) == archivepool.end ())
+            archivepool[filename] = p;
+#ifdef HAVE_PTHREAD_H
+        pthread_mutex_unlock (& archivepool_lock);
+#endif
+    }
+    return p;
+}
+
+
+// Return the context to the pool (or destroy it, if private or stale),
+// then trim the pool to size by evicting least recently used contexts.
+static void
+ap_checkin (archivepool_entry *p)
+{
+    vector<archivepool_entry*> doomed;
+
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_lock (& archivepool_lock);
+#endif
+    archivepool_name_hits += p->name_hits;
+    archivepool_name_misses += p->name_misses;
+    p->name_hits = p->name_misses = 0;
+
+    ap_by_fn_t::iterator it = archivepool.find (p->filename);
+    if (it == archivepool.end () || it->second != p) {
+        doomed.push_back (p); // private, or already invalidated
+    } else if (p->stale) {
+        archivepool.erase (it);
+        doomed.push_back (p);
+    } else {
+        p->busy = false;
+        p->last_use = ++archivepool_clock;
+    }
+
+    while (archivepool.size () > graphite_contexts) {
+        ap_by_fn_t::iterator victim = archivepool.end ();
+        for (it = archivepool.begin (); it != archivepool.end (); it++) {
+            if (it->second->busy)
+                continue;
+            if (victim == archivepool.end () || it->second->last_use < victim->second->last_use)
+                victim = it;
+        }
+        if (victim == archivepool.end ())
+            break; // all busy; trim at a later checkin
+        doomed.push_back (victim->second);
+        archivepool.erase (victim);
+        archivepool_evictions ++;
+    }
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_unlock (& archivepool_lock);
+#endif
+
+    for (unsigned i = 0; i < doomed.size (); i++)
+        ap_destroy (doomed[i]);
+}
+
+
+// Drop any pooled context for the given archive file, because the
+// archivecache has found it changed (or gone, or we are exiting).
+static void
+ap_invalidate (const string& filename)
+{
+    archivepool_entry *p = 0;
+
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_lock (& archivepool_lock);
+#endif
+    ap_by_fn_t::iterator it = archivepool.find (filename);
+    if (it != archivepool.end ()) {
+        archivepool_invalidations ++;
+        if (it->second->busy) {
+            it->second->stale = true; // its fetch thread destroys it
+        } else {
+            p = it->second;
+            archivepool.erase (it);
+        }
+    }
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_unlock (& archivepool_lock);
+#endif
+
+    if (p)
+        ap_destroy (p);
+}
+
+
+// pmLookupName + pmLookupDesc for one metric name, through the cache
+// of the (checked out, hence ours alone) pool entry.
+static int
+ap_lookup_metric (archivepool_entry *p, const string& name, pmID& pmid, pmDesc& desc, int& desc_sts)
+{
+    map<string,archivepool_metric>::iterator it = p->metrics.find (name);
+    if (it == p->metrics.end ()) {
+        archivepool_metric m;
+        char *namelist[1];
+        namelist[0] = (char *) name.c_str ();
+        m.sts = pmLookupName (1, namelist, & m.pmid);
+        m.desc_sts = (m.sts == 1) ? pmLookupDesc (m.pmid, & m.desc) : m.sts;
+        it = p->metrics.insert (make_pair (name, m)).first;
+        p->name_misses ++;
+    } else {
+        p->name_hits ++;
+    }
+    pmid = it->second.pmid;
+    desc = it->second.desc;
+    desc_sts = it->second.desc_sts;
+    return it->second.sts;
+}
+
+
+// pmLookupInDomArchive for one instance name, likewise cached.
+static int
+ap_lookup_instance (archivepool_entry *p, pmInDom indom, const string& name)
+{
+    pair<pmInDom,string> key (indom, name);
+    map<pair<pmInDom,string>,int>::iterator it = p->instances.find (key);
+    if (it != p->instances.end ()) {
+        p->name_hits ++;
+        return it->second;
+    }
+    int inst = pmLookupInDomArchive (indom, (char *) name.c_str ());
+    p->instances[key] = inst;
+    p->name_misses ++;
+    return inst;
+}
+
+
+// Print a dumpstats-periodic report of the pool.
+static void
+ap_dumpstats ()
+{
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_lock (& archivepool_lock);
+#endif
+    unsigned long lookups = archivepool_hits + archivepool_misses;
+    unsigned long names = archivepool_name_hits + archivepool_name_misses;
+    timestamp (clog) << "Archive context pool: "
+                     << archivepool.size() << "/" << graphite_contexts << " open, "
+                     << archivepool_hits << "/" << lookups << " hits ("
+                     << (lookups ? (100 * archivepool_hits / lookups) : 0) << "%), "
+                     << archivepool_busy << " busy, "
+                     << archivepool_evictions << " evictions, "
+                     << archivepool_invalidations << " invalidations, "
+                     << archivepool_name_hits << "/" << names << " name hits" << endl;
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_unlock (& archivepool_lock);
+#endif
+}
+
+
+static void rollup_remove (const string& filename); // see below
+
+
 // Compute an "archivepart" for the given archive file name (.meta or
 // dir/), already opened with given pcp archive context.  This can be
 // an encoded version of the file name, or the pcp hostname found
@@ -410,6 +683,7 @@ ac_refresh(struct MHD_Connection * connection, const string& filename)
 
     // clean up
     if (e && exit_p) {
+        ap_invalidate (filename);
         archivecache_by_filename.erase(filename);
         // the multimaps are harder
         pair<ac_by_ap_t::iterator,ac_by_ap_t::iterator> its =
@@ -497,6 +771,8 @@ ac_refresh(struct MHD_Connection * connection, const string& filename)
     rc = __pmStat(filename.c_str(), &st);
     if (rc < 0) {
         // the .meta file has disappeared - retire this archivecache_entry!
+        ap_invalidate (filename);
+        rollup_remove (filename);
         // the map is easy
         archivecache_by_filename.erase(filename);
         // the multimaps are harder
@@ -516,6 +792,7 @@ ac_refresh(struct MHD_Connection * connection, const string& filename)
 	; // metrics cache still good
     } else { // need to (re)load the metrics
         e->metadata_mtime = st.st_mtime;
+        ap_invalidate (filename); // new metrics, indoms or instances
 
         // open a context if not already open from the new-archive case above
         if (ctx < 0) {
@@ -570,6 +847,9 @@ ac_refresh(struct MHD_Connection * connection, const string& filename)
 	       __pmAccess(nextvol_name, R_OK) != 0) { // no next volume
 	// nothing to do
     } else {
+	// a pooled context has a stale temporal index and volume list
+	ap_invalidate (filename);
+
 	// open a context if not already open from the new-archive or metrics case above
 	if (ctx < 0) {
 	    ctx = pmNewContext (PM_CONTEXT_ARCHIVE, filename.c_str ());
@@ -647,7 +927,8 @@ ac_refresh_all(struct MHD_Connection* connection /* may be null */)
     static time_t last_refresh = 0;
     // Don't scan more than once per this long; so we may miss the
     // creation of new archives for that long.
-    if (last_refresh > 0 && (last_refresh + min_refresh_interval) >= last_report)
+    // But at exit, always go through to clean up.
+    if (! exit_p && last_refresh > 0 && (last_refresh + min_refresh_interval) >= last_report)
         return;
     last_refresh = last_report;
 
@@ -784,6 +1065,7 @@ ac_refresh_all(struct MHD_Connection* connection /* may be null */)
         timestamp (clog) << "Archive cache: "
                          << archivecache_by_filename.size() << " files, "
                          << archivecache_by_archivepart.size() << " names" << endl;
+        ap_dumpstats ();
         last_dumpstats = time(NULL);
     }
     
@@ -1217,7 +1499,10 @@ struct fetch_series_jobspec {
 
     vector<metric_string> targets;
     string filename; // archive filename
+    time_t archive_end; // as known to the archivecache
     time_t t_start, t_end, t_step;
+    time_t rollup_tier; // resolution of the rollups used, 0 if none
+    unsigned rollup_values; // values taken from them
     string message; // may have error or verbose message
 };
 
@@ -1320,6 +1605,590 @@ void fetch_series_jobqueue<Spec>::run ()
 
 
 
+// Rollup store.  Rendering a long time range at a coarse step would
+// interpolate every step from the raw archive data, reading the whole
+// archive between them.  So when a rollup directory is configured (-r),
+// each archive gets a rollup file there, holding the min/max/avg/count
+// of every numeric metric-instance over fixed-size buckets, at each of
+// a few resolutions (tiers).  A render request whose step spans at
+// least two buckets of the finest tier is served from the coarsest tier
+// that still has two buckets per step, each value being the average of
+// the buckets centred within that step; the buckets are aligned to the
+// epoch, not to the request, so finer is more faithful.  A counter is
+// instead interpolated between the minima (barring wraps, the first
+// values) of the buckets around each point, so its rates come out as
+// they would from the raw data.  Steps that run past the rolled up data
+// come from the raw archive as before.
+//
+// A rollup file is built, or extended, by a fetch job the first time
+// it is needed after the archivecache scan has seen the archive grow,
+// by reading just the archive records it does not yet cover.  It is
+// rewritten in full (via a temporary file and rename), and it is
+// removed when the archivecache retires its archive.
+//
+// The file is a private cache, in native byte order:
+//   header: magic, byte order, tier resolutions, archive label start
+//           time, time of the last record included, number of series
+//   per series: pmDesc, metric names, instance number and name, and
+//           per tier: first bucket number (time / resolution), number
+//           of buckets, offset of the buckets into the data part
+//   data:   the buckets, series by series and tier by tier.
+// A file that does not match (say, a different archive now lives at
+// that path) is rebuilt from scratch.
+
+static const time_t rollup_tiers[] = { 600, 3600, 86400 };
+#define ROLLUP_NTIERS (sizeof(rollup_tiers) / sizeof(rollup_tiers[0]))
+static const char rollup_magic[8] = { 'P', 'C', 'P', 'R', 'O', 'L', 'L', '1' };
+static const __uint32_t rollup_byteorder = 0x01020304;
+
+struct rollup_bucket {
+    float min, max, avg;
+    __uint32_t count; // 0 if no values in this bucket
+};
+
+struct rollup_series {
+    pmDesc desc;
+    vector<string> names; // all PMNS names of the metric
+    int inst; // PM_IN_NULL for PM_INDOM_NULL
+    string instname;
+    __int64_t first[ROLLUP_NTIERS];
+    __uint32_t nbuckets[ROLLUP_NTIERS];
+    __uint64_t offset[ROLLUP_NTIERS];
+    vector<rollup_bucket> data[ROLLUP_NTIERS]; // loaded only for extending
+
+    rollup_series (): inst (PM_IN_NULL)
+    {
+        for (unsigned t = 0; t < ROLLUP_NTIERS; t++) {
+            first[t] = 0;
+            nbuckets[t] = 0;
+            offset[t] = 0;
+        }
+    }
+};
+
+struct rollup_index {
+    struct timeval label; // archive label start time
+    struct timeval covered; // time of last archive record included, 0 if none
+    vector<rollup_series> series;
+    map<pair<string,string>,unsigned> by_name; // (metric,instance) -> series[]
+    long data_base; // file offset of the data part
+
+    rollup_index (): data_base (0)
+    {
+        label.tv_sec = label.tv_usec = 0;
+        covered.tv_sec = covered.tv_usec = 0;
+    }
+};
+
+#ifdef HAVE_PTHREAD_H
+static pthread_mutex_t rollup_lock = PTHREAD_MUTEX_INITIALIZER; // protects the following
+#endif
+static set<string> rollup_busy; // rollup files in use by a fetch job
+
+
+// The rollup file name for an archive: its .meta file name, made flat.
+static string
+rollup_path (const string& filename)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    string path = graphite_rollupdir + "/";
+
+    for (unsigned i = 0; i < filename.size (); i++) {
+        char c = filename[i];
+        if (isalnum (c) || c == '_' || c == '.')
+            path += c;
+        else {
+            path += '-';
+            path += hex[(c >> 4) & 15];
+            path += hex[(c >> 0) & 15];
+        }
+    }
+    return path + ".rollup";
+}
+
+
+// Forget the rollups of an archive that the archivecache has retired.
+static void
+rollup_remove (const string& filename)
+{
+    if (graphite_rollupdir != "")
+        (void) unlink (rollup_path (filename).c_str ());
+}
+
+
+template <class T> static bool
+rollup_get (FILE *f, T& v)
+{
+    return fread (&v, sizeof (v), 1, f) == 1;
+}
+
+template <class T> static bool
+rollup_put (FILE *f, const T& v)
+{
+    return fwrite (&v, sizeof (v), 1, f) == 1;
+}
+
+static bool
+rollup_get_string (FILE *f, string& s)
+{
+    __uint32_t len;
+    if (! rollup_get (f, len) || len > MAXPATHLEN)
+        return false;
+    s.resize (len);
+    return len == 0 || fread (&s[0], len, 1, f) == 1;
+}
+
+static bool
+rollup_put_string (FILE *f, const string& s)
+{
+    __uint32_t len = s.size ();
+    return rollup_put (f, len) && (len == 0 || fwrite (s.data (), len, 1, f) == 1);
+}
+
+
+static void
+rollup_index_series (rollup_index& ri, unsigned i)
+{
+    const rollup_series& rs = ri.series[i];
+    for (unsigned k = 0; k < rs.names.size (); k++)
+        ri.by_name[make_pair (rs.names[k], rs.instname)] = i;
+}
+
+
+// Read the header and series table of a rollup file into ri, and with
+// data_p the buckets too.  Returns the open file (positioned anywhere),
+// or 0 if there is no usable rollup file, in which case ri is empty.
+static FILE *
+rollup_load (const string& path, rollup_index& ri, bool data_p)
+{
+    char magic[sizeof (rollup_magic)];
+    __uint32_t byteorder, ntiers, nseries;
+    __int64_t tier, sec, usec;
+    bool ok;
+
+    ri = rollup_index ();
+    FILE *f = fopen (path.c_str (), "r");
+    if (f == NULL)
+        return 0;
+
+    ok = rollup_get (f, magic) && memcmp (magic, rollup_magic, sizeof (magic)) == 0 &&
+         rollup_get (f, byteorder) && byteorder == rollup_byteorder &&
+         rollup_get (f, ntiers) && ntiers == ROLLUP_NTIERS;
+    for (unsigned t = 0; ok && t < ROLLUP_NTIERS; t++)
+        ok = rollup_get (f, tier) && tier == rollup_tiers[t];
+    if (ok && (ok = rollup_get (f, sec) && rollup_get (f, usec))) {
+        ri.label.tv_sec = sec;
+        ri.label.tv_usec = usec;
+    }
+    if (ok && (ok = rollup_get (f, sec) && rollup_get (f, usec))) {
+        ri.covered.tv_sec = sec;
+        ri.covered.tv_usec = usec;
+    }
+    ok = ok && rollup_get (f, nseries);
+
+    for (unsigned i = 0; ok && i < nseries; i++) {
+        rollup_series rs;
+        __uint32_t nnames;
+        __int32_t inst;
+
+        ok = rollup_get (f, rs.desc) && rollup_get (f, nnames) && nnames < MAXPATHLEN;
+        for (unsigned k = 0; ok && k < nnames; k++) {
+            string name;
+            if ((ok = rollup_get_string (f, name)))
+                rs.names.push_back (name);
+        }
+        ok = ok && rollup_get (f, inst) && rollup_get_string (f, rs.instname);
+        rs.inst = inst;
+        for (unsigned t = 0; ok && t < ROLLUP_NTIERS; t++)
+            ok = rollup_get (f, rs.first[t]) && rollup_get (f, rs.nbuckets[t]) &&
+                 rollup_get (f, rs.offset[t]);
+        if (ok) {
+            ri.series.push_back (rs);
+            rollup_index_series (ri, ri.series.size () - 1);
+        }
+    }
+    ri.data_base = ftell (f);
+
+    for (unsigned i = 0; ok && data_p && i < ri.series.size (); i++) {
+        rollup_series& rs = ri.series[i];
+        for (unsigned t = 0; ok && t < ROLLUP_NTIERS; t++) {
+            rs.data[t].resize (rs.nbuckets[t]);
+            ok = (rs.nbuckets[t] == 0 ||
+                  (fseek (f, ri.data_base + rs.offset[t], SEEK_SET) == 0 &&
+                   fread (&rs.data[t][0], sizeof (rollup_bucket), rs.nbuckets[t], f) == rs.nbuckets[t]));
+        }
+    }
+
+    if (! ok) {
+        fclose (f);
+        ri = rollup_index ();
+        return 0;
+    }
+    return f;
+}
+
+
+// Write out a complete rollup file, replacing any old one.
+static int
+rollup_save (const string& path, rollup_index& ri)
+{
+    string tmppath = path + ".tmp";
+    __uint32_t ntiers = ROLLUP_NTIERS, nseries = ri.series.size ();
+    __uint64_t offset = 0;
+    bool ok;
+
+    FILE *f = fopen (tmppath.c_str (), "w");
+    if (f == NULL)
+        return -oserror ();
+
+    for (unsigned i = 0; i < ri.series.size (); i++) {
+        rollup_series& rs = ri.series[i];
+        for (unsigned t = 0; t < ROLLUP_NTIERS; t++) {
+            rs.nbuckets[t] = rs.data[t].size ();
+            rs.offset[t] = offset;
+            offset += rs.nbuckets[t] * sizeof (rollup_bucket);
+        }
+    }
+
+    ok = rollup_put (f, rollup_magic) && rollup_put (f, rollup_byteorder) && rollup_put (f, ntiers);
+    for (unsigned t = 0; ok && t < ROLLUP_NTIERS; t++)
+        ok = rollup_put (f, (__int64_t) rollup_tiers[t]);
+    ok = ok && rollup_put (f, (__int64_t) ri.label.tv_sec) && rollup_put (f, (__int64_t) ri.label.tv_usec) &&
+         rollup_put (f, (__int64_t) ri.covered.tv_sec) && rollup_put (f, (__int64_t) ri.covered.tv_usec) &&
+         rollup_put (f, nseries);
+    for (unsigned i = 0; ok && i < ri.series.size (); i++) {
+        const rollup_series& rs = ri.series[i];
+        ok = rollup_put (f, rs.desc) && rollup_put (f, (__uint32_t) rs.names.size ());
+        for (unsigned k = 0; ok && k < rs.names.size (); k++)
+            ok = rollup_put_string (f, rs.names[k]);
+        ok = ok && rollup_put (f, (__int32_t) rs.inst) && rollup_put_string (f, rs.instname);
+        for (unsigned t = 0; ok && t < ROLLUP_NTIERS; t++)
+            ok = rollup_put (f, rs.first[t]) && rollup_put (f, rs.nbuckets[t]) && rollup_put (f, rs.offset[t]);
+    }
+    for (unsigned i = 0; ok && i < ri.series.size (); i++) {
+        const rollup_series& rs = ri.series[i];
+        for (unsigned t = 0; ok && t < ROLLUP_NTIERS; t++)
+            ok = (rs.nbuckets[t] == 0 ||
+                  fwrite (&rs.data[t][0], sizeof (rollup_bucket), rs.nbuckets[t], f) == rs.nbuckets[t]);
+    }
+
+    int sts = 0;
+    if (! ok || ferror (f))
+        sts = -oserror ();
+    if (fclose (f) != 0 && sts == 0)
+        sts = -oserror ();
+    if (sts == 0 && rename (tmppath.c_str (), path.c_str ()) < 0)
+        sts = -oserror ();
+    if (sts < 0)
+        unlink (tmppath.c_str ());
+    return sts;
+}
+
+
+static void
+rollup_add (rollup_series& rs, time_t t, double v)
+{
+    for (unsigned tier = 0; tier < ROLLUP_NTIERS; tier++) {
+        vector<rollup_bucket>& data = rs.data[tier];
+        __int64_t b = t / rollup_tiers[tier];
+
+        if (data.empty ())
+            rs.first[tier] = b;
+        else if (b < rs.first[tier])
+            continue; // archive records are in time order; should not happen
+        size_t i = b - rs.first[tier];
+        if (i >= data.size ()) {
+            rollup_bucket empty = { 0, 0, 0, 0 };
+            data.resize (i + 1, empty);
+        }
+
+        rollup_bucket& k = data[i];
+        if (k.count == 0) {
+            k.min = k.max = k.avg = v;
+        } else {
+            if (v < k.min)
+                k.min = v;
+            if (v > k.max)
+                k.max = v;
+            k.avg += (v - k.avg) / (k.count + 1);
+        }
+        k.count++;
+    }
+}
+
+
+// Read the archive records that the rollups do not yet include,
+// and add them in.
+static int
+rollup_extend (const string& filename, rollup_index& ri)
+{
+    // what we know about each pmid seen in the archive
+    struct rollup_metric {
+        int sts;
+        pmDesc desc;
+        vector<string> names;
+    };
+    map<pmID,rollup_metric> metrics;
+    map<pair<pmID,int>,unsigned> series; // (pmid,inst) -> ri.series[]
+    struct timeval origin;
+    pmResult *result;
+    int sts;
+
+    archivepool_entry *pmc = ap_checkout (filename, sts);
+    if (pmc == 0)
+        return sts;
+
+    if (ri.label.tv_sec != pmc->label.ll_start.tv_sec ||
+        ri.label.tv_usec != pmc->label.ll_start.tv_usec) {
+        // a new, or different, archive
+        ri = rollup_index ();
+        ri.label = pmc->label.ll_start;
+    }
+    for (unsigned i = 0; i < ri.series.size (); i++)
+        series[make_pair (ri.series[i].desc.pmid, ri.series[i].inst)] = i;
+
+    if (ri.covered.tv_sec == 0) {
+        origin = ri.label;
+    } else {
+        struct timeval usec = { 0, 1 };
+        origin = ri.covered;
+        pmtimevalInc (&origin, &usec);
+    }
+    sts = pmSetMode (PM_MODE_FORW, &origin, 0);
+
+    while (sts >= 0 && ! exit_p && (sts = pmFetchArchive (&result)) >= 0) {
+        for (int j = 0; j < result->numpmid; j++) {
+            pmValueSet *vsp = result->vset[j];
+            if (vsp->numval <= 0)
+                continue;
+
+            map<pmID,rollup_metric>::iterator m = metrics.find (vsp->pmid);
+            if (m == metrics.end ()) {
+                rollup_metric rm;
+                char **names;
+                rm.sts = pmLookupDesc (vsp->pmid, &rm.desc);
+                switch (rm.desc.type) {
+                case PM_TYPE_32:
+                case PM_TYPE_U32:
+                case PM_TYPE_64:
+                case PM_TYPE_U64:
+                case PM_TYPE_FLOAT:
+                case PM_TYPE_DOUBLE:
+                    break;
+                default:
+                    rm.sts = PM_ERR_TYPE;
+                }
+                if (rm.sts >= 0 && (rm.sts = pmNameAll (vsp->pmid, &names)) > 0) {
+                    for (int k = 0; k < rm.sts; k++)
+                        rm.names.push_back (names[k]);
+                    free (names);
+                }
+                m = metrics.insert (make_pair (vsp->pmid, rm)).first;
+            }
+            if (m->second.sts <= 0)
+                continue;
+            const rollup_metric& rm = m->second;
+
+            for (int k = 0; k < vsp->numval; k++) {
+                pmValue *vp = &vsp->vlist[k];
+                pair<pmID,int> key (vsp->pmid, vp->inst);
+                map<pair<pmID,int>,unsigned>::iterator s = series.find (key);
+                if (s == series.end ()) {
+                    rollup_series rs;
+                    rs.desc = rm.desc;
+                    rs.names = rm.names;
+                    rs.inst = vp->inst;
+                    if (rm.desc.indom != PM_INDOM_NULL) {
+                        char *instname;
+                        if (pmNameInDomArchive (rm.desc.indom, vp->inst, &instname) < 0)
+                            continue;
+                        rs.instname = instname;
+                        free (instname);
+                    }
+                    ri.series.push_back (rs);
+                    rollup_index_series (ri, ri.series.size () - 1);
+                    s = series.insert (make_pair (key, ri.series.size () - 1)).first;
+                }
+
+                pmAtomValue value;
+                if (pmExtractValue (vsp->valfmt, vp, rm.desc.type, &value, PM_TYPE_DOUBLE) == 0)
+                    rollup_add (ri.series[s->second], result->timestamp.tv_sec, value.d);
+            }
+        }
+        ri.covered = result->timestamp;
+        pmFreeResult (result);
+    }
+
+    ap_checkin (pmc);
+    return (sts == PM_ERR_EOL) ? 0 : sts;
+}
+
+
+// The first bucket of resolution res centred at or after time t.
+static inline __int64_t
+rollup_centred (time_t t, time_t res)
+{
+    return (t - res / 2 + res - 1) / res;
+}
+
+
+// Fill in whatever points of the job's outputs the rollups can, after
+// bringing them up to date with the archive if need be.  Returns the
+// first time point that still needs to come from the raw archive.
+static time_t
+rollup_fetch_series (fetch_series_jobspec *spec, stringstream& message)
+{
+    time_t t_start = spec->t_start;
+    time_t t_end = spec->t_end;
+    time_t t_step = spec->t_step;
+    char pmmsg[PM_MAXERRMSGLEN];
+    rollup_index ri;
+    time_t res;
+    int tier = -1;
+    int sts;
+
+    // the coarsest tier with at least two buckets per step
+    for (unsigned t = 0; t < ROLLUP_NTIERS; t++)
+        if (2 * rollup_tiers[t] <= t_step)
+            tier = t;
+    if (tier < 0)
+        return t_start;
+    res = rollup_tiers[tier];
+
+    string path = rollup_path (spec->filename);
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_lock (& rollup_lock);
+#endif
+    bool busy = ! rollup_busy.insert (path).second;
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_unlock (& rollup_lock);
+#endif
+    if (busy)
+        return t_start;
+
+    // Bring the rollups up to date, if the archive has grown by more
+    // than the finest resolution since they were built.
+    FILE *f = rollup_load (path, ri, false);
+    if (ri.covered.tv_sec + rollup_tiers[0] < spec->archive_end) {
+        if (f) {
+            fclose (f);
+            f = rollup_load (path, ri, true);
+        }
+        if (f) {
+            fclose (f);
+            f = 0;
+        }
+        sts = rollup_extend (spec->filename, ri);
+        if (sts < 0)
+            message << " cannot build rollups: " << pmErrStr_r (sts, pmmsg, sizeof (pmmsg));
+        else if ((sts = rollup_save (path, ri)) < 0)
+            message << " cannot save rollups " << path << ": "
+                    << pmErrStr_r (sts, pmmsg, sizeof (pmmsg));
+        if (sts < 0)
+            ri = rollup_index ();
+    }
+
+    // Points whose step ends after the last record rolled up need the raw data.
+    time_t raw_start = t_start;
+    while (raw_start <= t_end && raw_start + t_step <= ri.covered.tv_sec)
+        raw_start += t_step;
+
+    unsigned served = 0;
+    for (unsigned j = 0; j < spec->targets.size () && raw_start > t_start; j++) {
+        const vector<string>& target_tok = spec->targets[j].split ();
+        if (target_tok.size () < 2)
+            continue;
+
+        // same metric[.instance] resolution as pmgraphite_fetch_series
+        string metric_name = "";
+        for (unsigned i = 1; i < target_tok.size () - 1; i++) {
+            if (i > 1)
+                metric_name += '.';
+            metric_name += target_tok[i];
+        }
+        const string& last_component = target_tok[target_tok.size () - 1];
+        map<pair<string,string>,unsigned>::iterator it =
+            ri.by_name.find (make_pair (metric_name, pmgraphite_metric_decode (last_component)));
+        if (it == ri.by_name.end () || ri.series[it->second].desc.indom == PM_INDOM_NULL) {
+            if (metric_name != "")
+                metric_name += '.';
+            metric_name += last_component;
+            it = ri.by_name.find (make_pair (metric_name, string ()));
+            if (it == ri.by_name.end () || ri.series[it->second].desc.indom != PM_INDOM_NULL)
+                continue;
+        }
+        rollup_series& rs = ri.series[it->second];
+
+        // the buckets centred within, or around, the steps to be served
+        __int64_t lo = t_start / res;
+        __int64_t hi = raw_start / res + 2; // exclusive
+        lo = max (lo, rs.first[tier]);
+        hi = min (hi, rs.first[tier] + (__int64_t) rs.nbuckets[tier]);
+        if (lo >= hi)
+            continue;
+        vector<rollup_bucket> buckets (hi - lo);
+        if (rs.data[tier].size () > 0) {
+            copy (rs.data[tier].begin () + (lo - rs.first[tier]),
+                  rs.data[tier].begin () + (hi - rs.first[tier]), buckets.begin ());
+        } else if (f == 0 ||
+                   fseek (f, ri.data_base + rs.offset[tier] + (lo - rs.first[tier]) * sizeof (rollup_bucket),
+                          SEEK_SET) != 0 ||
+                   fread (&buckets[0], sizeof (rollup_bucket), buckets.size (), f) != buckets.size ()) {
+            message << " cannot read rollups " << path;
+            break;
+        }
+
+#ifdef HAVE_PTHREAD_H
+        pthread_mutex_lock (spec->output_locks[j]);
+#endif
+        *(spec->output_descs[j]) = rs.desc;
+        for (time_t t = t_start; t < raw_start; t += t_step) {
+            double sum = 0;
+            __uint64_t count = 0;
+            if (rs.desc.sem == PM_SEM_COUNTER) {
+                __int64_t b = t / res;
+                if (b >= lo && b + 1 < hi && buckets[b - lo].count && buckets[b + 1 - lo].count) {
+                    const rollup_bucket& k0 = buckets[b - lo];
+                    const rollup_bucket& k1 = buckets[b + 1 - lo];
+                    sum = k0.min + ((double) k1.min - k0.min) * (t - b * res) / res;
+                    count = 1;
+                }
+            } else {
+                for (__int64_t b = max (lo, rollup_centred (t, res));
+                     b < hi && b * res + res / 2 < t + t_step; b++) {
+                    const rollup_bucket& k = buckets[b - lo];
+                    sum += (double) k.avg * k.count;
+                    count += k.count;
+                }
+            }
+            if (count > 0) {
+                (*spec->outputs[j]).at(t) = sum / count;
+                served++;
+            }
+        }
+#ifdef HAVE_PTHREAD_H
+        pthread_mutex_unlock (spec->output_locks[j]);
+#endif
+    }
+
+    if (f)
+        fclose (f);
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_lock (& rollup_lock);
+#endif
+    rollup_busy.erase (path);
+#ifdef HAVE_PTHREAD_H
+    pthread_mutex_unlock (& rollup_lock);
+#endif
+
+    if (raw_start > t_start) {
+        spec->rollup_tier = res;
+        spec->rollup_values = served;
+    }
+    return raw_start;
+}
+
+
 // Heavy lifter.  Parse graphite "target" name into archive
 // file/directory, metric names, and (if appropriate) instances within
 // metric indom; fetch all the data values interpolated between given
@@ -1330,6 +2199,7 @@ void fetch_series_jobqueue<Spec>::run ()
 // an empty vector.  (As a matter of security, we prefer not to give too
 // much information to a remote web user about the exact error.)  Occasional
 // missing metric values are represented as floating-point NaN values.
+// Whatever the rollup store can supply is taken from there instead.
 void pmgraphite_fetch_series (fetch_series_jobspec *spec)
 {
     assert (spec != NULL);
@@ -1340,13 +2210,13 @@ void pmgraphite_fetch_series (fetch_series_jobspec *spec)
     time_t t_start = spec->t_start;
     time_t t_end = spec->t_end;
     time_t t_step = spec->t_step;
+    time_t raw_start;
     int sts;
     string last_component;
-    int pmc;
+    archivepool_entry *pmc;
     string archive;
     unsigned entries_good = 0, entries;
     stringstream message;
-    pmLogLabel archive_label;
     struct timeval archive_end;
     int pmSetMode_called_p = 0;
     vector<pmID> pmids;
@@ -1362,17 +2232,25 @@ void pmgraphite_fetch_series (fetch_series_jobspec *spec)
 
     // XXX: in future, parse graphite functions-of-metrics
     // http://graphite.readthedocs.org/en/latest/functions.html
-    //
-    // XXX: in future, cache the pmid/pmdesc/inst# -> pcp-context
-
-    // -------------------- PART 1 - per-archive processing
 
     archive = spec->filename;
 
-    // Open the bad boy.
-    pmc = pmNewContext (PM_CONTEXT_ARCHIVE, archive.c_str ());
-    if (pmc < 0) {
-        // error already noted XXX where?
+    // -------------------- PART 0 - pre-aggregated rollups
+
+    raw_start = t_start;
+    if (graphite_rollupdir != "")
+        raw_start = rollup_fetch_series (spec, message);
+    if (raw_start > t_end || raw_start > spec->archive_end)
+        goto out0; // nothing left for the raw archive data
+
+    // -------------------- PART 1 - per-archive processing
+
+    // Open the bad boy, or reuse it from the archive context pool,
+    // along with its archive label and resolved names.
+    pmc = ap_checkout (archive, sts);
+    if (pmc == 0) {
+        char pmmsg[PM_MAXERRMSGLEN];
+        message << "cannot open archive: " << pmErrStr_r (sts, pmmsg, sizeof (pmmsg));
         goto out0;
     }
 
@@ -1381,13 +2259,9 @@ void pmgraphite_fetch_series (fetch_series_jobspec *spec)
     // Fetch end of archive time boundaries, to avoid having libpcp
     // iterate across vast regions of void.  This would be especially
     // bad if libpcp worries the archive might have grown since last
-    // call, go and do an fstat(2)/lseek(2) every point.
-    sts = pmGetArchiveLabel (& archive_label);
-    if (sts < 0) {
-        message << "cannot find archive label";
-        goto out;
-    }
-
+    // call, go and do an fstat(2)/lseek(2) every point.  A live
+    // archive may have grown since the pooled context was opened,
+    // so this is done every time.
     sts = pmGetArchiveEnd (& archive_end);
     if (sts < 0) {
         message << "cannot find archive end";
@@ -1395,7 +2269,7 @@ void pmgraphite_fetch_series (fetch_series_jobspec *spec)
     }
 
     if (verbosity > 3) {
-        message << "[" << archive_label.ll_start.tv_sec
+        message << "[" << pmc->label.ll_start.tv_sec
                 << "-" << archive_end.tv_sec << "] ";
     }
     // XXX ^^^ redundant with archivecache
@@ -1438,15 +2312,13 @@ void pmgraphite_fetch_series (fetch_series_jobspec *spec)
         }
         last_component = target_tok[target_tok.size () - 1];
 
-        char *namelist[1];
         pmID pmidlist[1]; // fetch here instead of pmids[i], so an early error continue leaves latter zero
-        namelist[0] = (char *) metric_name.c_str ();
-        int sts = pmLookupName (1, namelist, & pmidlist[0]);
+        int desc_sts;
+        int sts = ap_lookup_metric (pmc, metric_name, pmidlist[0], pmdescs[j], desc_sts);
 
         if (sts == 1) {
             // found ... last name must be instance domain name
-            sts = pmLookupDesc (pmidlist[0], &pmdescs[j]);
-            if (sts != 0) {
+            if (desc_sts != 0) {
                 if (! graphite_hostcache) // this is normal in -J mode; mixing archives
                     message << " cannot find metric descriptor " << metric_name;
                 continue;
@@ -1460,8 +2332,7 @@ void pmgraphite_fetch_series (fetch_series_jobspec *spec)
             }
             // look up that instance name
             string instance_name = pmgraphite_metric_decode (last_component);
-            int inst = pmLookupInDomArchive (pmdescs[j].indom,
-                                             (char *) instance_name.c_str ());
+            int inst = ap_lookup_instance (pmc, pmdescs[j].indom, instance_name);
             if (inst < 0) {
                 if (! graphite_hostcache) // this is normal in -J mode; mixing archives
                     message << " metric " << metric_name << " lacks recognized indom "
@@ -1475,8 +2346,7 @@ void pmgraphite_fetch_series (fetch_series_jobspec *spec)
         } else {
             // not found ... ok, try again with that last component
             metric_name = metric_name + '.' + last_component;
-            namelist[0] = (char *) metric_name.c_str ();
-            int sts = pmLookupName (1, namelist, pmidlist);
+            int sts = ap_lookup_metric (pmc, metric_name, pmidlist[0], pmdescs[j], desc_sts);
             if (sts != 1) {
                 // still not found .. give up
                 if (! graphite_hostcache) // this is normal in -J mode; mixing archives
@@ -1484,8 +2354,7 @@ void pmgraphite_fetch_series (fetch_series_jobspec *spec)
                 continue;
             }
 
-            sts = pmLookupDesc (pmidlist[0], &pmdescs[j]);
-            if (sts != 0) {
+            if (desc_sts != 0) {
                 message << " cannot find metric descriptor " << metric_name;
                 continue;
             }
@@ -1534,14 +2403,14 @@ void pmgraphite_fetch_series (fetch_series_jobspec *spec)
     pmSetMode_called_p = 0;
 
     entries = 0; // index in (*outputs[i]) to fill - i.e., a scaled time coordinate
-    for (time_t iteration_time = t_start; iteration_time <= t_end; iteration_time += t_step, entries++) {
+    for (time_t iteration_time = raw_start; iteration_time <= t_end; iteration_time += t_step, entries++) {
         if (exit_p)
             break;
 
         pmResult *result;
 
         // We only want to pmFetch within known time boundaries of the archive.
-        if (iteration_time >= archive_label.ll_start.tv_sec &&
+        if (iteration_time >= pmc->label.ll_start.tv_sec &&
                 iteration_time <= archive_end.tv_sec) {
 
             if (! pmSetMode_called_p) {
@@ -1617,10 +2486,13 @@ void pmgraphite_fetch_series (fetch_series_jobspec *spec)
     }
 
  out:
-    pmDestroyContext (pmc);
+    ap_checkin (pmc);
  out0:
     // vector output already returned via jobspec pointer
 
+    if (verbosity > 2 && spec->rollup_tier)
+        message << " rollup tier " << spec->rollup_tier << "s, " << spec->rollup_values << " values";
+
     spec->message = message.str (); // pass back message
     // ... but prefix it with archive name
     if (spec->message.size() > 0 && // have -some- message
@@ -1706,6 +2578,9 @@ pmgraphite_fetch_all_series (struct MHD_Connection* connection,
                 js.t_end = t_end;
                 js.t_step = t_step;
                 js.filename = e->filename;
+                js.archive_end = e->archive_end.tv_sec;
+                js.rollup_tier = 0;
+                js.rollup_values = 0;
                 it2 = jobmap.insert(make_pair(e->filename,js)).first;
             }
 
@@ -1753,10 +2628,20 @@ pmgraphite_fetch_all_series (struct MHD_Connection* connection,
             timeseries_rateconvert(outputs[i]);
 
     if (verbosity > 1) {
+        // which rollup tiers served how many archives
+        map<time_t,unsigned> tiers;
+        for (unsigned i = 0; i < q.jobs.size (); i++)
+            if (q.jobs[i].rollup_tier)
+                tiers[q.jobs[i].rollup_tier]++;
+        stringstream rollups;
+        for (map<time_t,unsigned>::iterator it = tiers.begin (); it != tiers.end (); it++)
+            rollups << ", rollup tier " << it->first << "s for " << it->second << " archive(s)";
+
         connstamp (clog, connection) << "digested " << targets.size () << " metric(s)"
                                      << " over " << number_of_jobs << " archive(s)"
                                      << ", timespan [" << t_start << "-" << t_end
                                      << " by " << t_step << "]"
+                                     << rollups.str ()
                                      << ", in " << pmtimevalSub (&finish,&start)*1000 << "ms "
                                      << endl;
     }
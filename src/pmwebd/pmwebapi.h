@@ -71,6 +71,8 @@ extern unsigned maxtimeout;			/* set by -t option */
 extern unsigned multithread;			/* set by -M option */
 extern unsigned graphite_timestep;              /* set by -i option */
 extern unsigned graphite_hostcache;             /* set by -J option */
+extern unsigned graphite_contexts;              /* set by -F option */
+extern std::string graphite_rollupdir;		/* set by -r option */
 extern unsigned graphite_encode;                /* set by -X option */
 
 struct http_params: public std::multimap <std::string, std::string> {